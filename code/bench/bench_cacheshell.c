@@ -0,0 +1,785 @@
+/**
+ * -----------------------------------------------------------------------------
+ * Project: Fossil Logic
+ *
+ * This file is part of the Fossil Logic project, which aims to develop
+ * high-performance, cross-platform applications and libraries. The code
+ * contained herein is licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License. You may obtain
+ * a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ * Author: Michael Gene Brockus (Dreamer)
+ * Date: 04/05/2014
+ *
+ * Copyright (C) 2014-2025 Fossil Logic. All rights reserved.
+ * -----------------------------------------------------------------------------
+ */
+#if !defined(_WIN32) && !defined(_WIN64)
+#if !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L   // clock_gettime
+#endif
+#endif
+#include "fossil/crabdb/cacheshell.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#endif
+
+/**
+ * @brief CacheShell throughput benchmark and hit-ratio simulator.
+ *
+ * Throughput modes (get / set / mixed):
+ *   The keyspace is preloaded, then 1, 2, 4 .. --threads threads each run
+ *   --ops operations against it. Every operation is timed on its own and
+ *   dropped into a per-thread log-linear histogram (16 sub-buckets per
+ *   power of two, so percentiles are within ~6%). Each row reports the
+ *   aggregate ops/s and p50 / p99 / p999 latency in nanoseconds.
+ *
+ * Key distributions:
+ *   uniform  every key equally likely
+ *   zipf     YCSB-style Zipfian over the keyspace, skew --theta
+ *   scan     each thread walks the keyspace sequentially from a random start
+ *
+ * Replay mode:
+ *   Replays a trace (--trace FILE, one key per line; otherwise --ops
+ *   accesses drawn from --dist) against a cache of --capacity entries and
+ *   prints the hit ratio for LRU, FIFO and CLOCK eviction next to
+ *   CacheShell itself, which admits new keys only while below max_entries.
+ *   A miss is followed by an insert, as a read-through cache would do.
+ *
+ * Usage:
+ *   bench_cacheshell [--mode get|set|mixed|replay] [--threads N] [--ops N]
+ *                    [--keys N] [--value-size N] [--dist uniform|zipf|scan]
+ *                    [--theta F] [--read-ratio F] [--near]
+ *                    [--trace FILE] [--capacity N]
+ */
+
+// ===========================================================
+// Options
+// ===========================================================
+
+typedef enum { BENCH_GET, BENCH_SET, BENCH_MIXED, BENCH_REPLAY } bench_mode_t;
+typedef enum { BENCH_UNIFORM, BENCH_ZIPF, BENCH_SCAN } bench_dist_t;
+
+typedef struct {
+    bench_mode_t mode;
+    bench_dist_t dist;
+    size_t threads;
+    size_t ops;
+    size_t keys;
+    size_t value_size;
+    double theta;
+    double read_ratio;
+    bool near_cache;
+    const char *trace;
+    size_t capacity;
+} bench_options_t;
+
+static bool bench_parse_size(const char *s, size_t *out) {
+    char *end = NULL;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (!end || *end != '\0' || v == 0)
+        return false;
+    *out = (size_t)v;
+    return true;
+}
+
+static bool bench_parse_options(int argc, char **argv, bench_options_t *o) {
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+        bool ok = true;
+        if (strcmp(arg, "--near") == 0) {
+            o->near_cache = true;
+            continue;
+        }
+        if (!val) {
+            fprintf(stderr, "missing value for %s\n", arg);
+            return false;
+        }
+        ++i;
+        if (strcmp(arg, "--mode") == 0) {
+            if (strcmp(val, "get") == 0)         o->mode = BENCH_GET;
+            else if (strcmp(val, "set") == 0)    o->mode = BENCH_SET;
+            else if (strcmp(val, "mixed") == 0)  o->mode = BENCH_MIXED;
+            else if (strcmp(val, "replay") == 0) o->mode = BENCH_REPLAY;
+            else ok = false;
+        } else if (strcmp(arg, "--dist") == 0) {
+            if (strcmp(val, "uniform") == 0)     o->dist = BENCH_UNIFORM;
+            else if (strcmp(val, "zipf") == 0)   o->dist = BENCH_ZIPF;
+            else if (strcmp(val, "scan") == 0)   o->dist = BENCH_SCAN;
+            else ok = false;
+        } else if (strcmp(arg, "--threads") == 0) {
+            ok = bench_parse_size(val, &o->threads);
+        } else if (strcmp(arg, "--ops") == 0) {
+            ok = bench_parse_size(val, &o->ops);
+        } else if (strcmp(arg, "--keys") == 0) {
+            ok = bench_parse_size(val, &o->keys);
+        } else if (strcmp(arg, "--value-size") == 0) {
+            ok = bench_parse_size(val, &o->value_size);
+        } else if (strcmp(arg, "--capacity") == 0) {
+            ok = bench_parse_size(val, &o->capacity);
+        } else if (strcmp(arg, "--theta") == 0) {
+            o->theta = strtod(val, NULL);
+            ok = o->theta > 0.0 && o->theta < 1.0;
+        } else if (strcmp(arg, "--read-ratio") == 0) {
+            o->read_ratio = strtod(val, NULL);
+            ok = o->read_ratio >= 0.0 && o->read_ratio <= 1.0;
+        } else if (strcmp(arg, "--trace") == 0) {
+            o->trace = val;
+        } else {
+            fprintf(stderr, "unknown option %s\n", arg);
+            return false;
+        }
+        if (!ok) {
+            fprintf(stderr, "bad value for %s: %s\n", arg, val);
+            return false;
+        }
+    }
+    return true;
+}
+
+// ===========================================================
+// Clock / Threads / Random
+// ===========================================================
+
+#if defined(_WIN32) || defined(_WIN64)
+static uint64_t bench_now_ns(void) {
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER t;
+    if (!freq.QuadPart)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&t);
+    return (uint64_t)((double)t.QuadPart * 1e9 / (double)freq.QuadPart);
+}
+
+typedef HANDLE bench_thread_t;
+
+static DWORD WINAPI bench_thread_entry(LPVOID arg);
+
+static bool bench_thread_start(bench_thread_t *t, void *arg) {
+    *t = CreateThread(NULL, 0, bench_thread_entry, arg, 0, NULL);
+    return *t != NULL;
+}
+
+static void bench_thread_join(bench_thread_t t) {
+    WaitForSingleObject(t, INFINITE);
+    CloseHandle(t);
+}
+#else
+static uint64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+typedef pthread_t bench_thread_t;
+
+static void *bench_thread_entry(void *arg);
+
+static bool bench_thread_start(bench_thread_t *t, void *arg) {
+    return pthread_create(t, NULL, bench_thread_entry, arg) == 0;
+}
+
+static void bench_thread_join(bench_thread_t t) {
+    pthread_join(t, NULL);
+}
+#endif
+
+// splitmix64: small, fast and good enough for key selection
+static uint64_t bench_rand(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static double bench_rand_unit(uint64_t *state) {
+    return (double)(bench_rand(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// ===========================================================
+// Key Distributions
+// ===========================================================
+
+// Zipfian generator after Gray et al. ("Quickly generating billion-record
+// synthetic databases"), as used by YCSB. Rank 0 is the hottest key.
+typedef struct {
+    size_t n;
+    double theta;
+    double alpha;
+    double zetan;
+    double eta;
+} bench_zipf_t;
+
+static void bench_zipf_init(bench_zipf_t *z, size_t n, double theta) {
+    double zeta2 = 0.0;
+    z->n = n;
+    z->theta = theta;
+    z->zetan = 0.0;
+    for (size_t i = 1; i <= n; ++i) {
+        double term = 1.0 / pow((double)i, theta);
+        z->zetan += term;
+        if (i <= 2)
+            zeta2 += term;
+    }
+    z->alpha = 1.0 / (1.0 - theta);
+    z->eta = (1.0 - pow(2.0 / (double)n, 1.0 - theta)) / (1.0 - zeta2 / z->zetan);
+}
+
+static size_t bench_zipf_next(const bench_zipf_t *z, uint64_t *state) {
+    double u = bench_rand_unit(state);
+    double uz = u * z->zetan;
+    if (uz < 1.0)
+        return 0;
+    if (uz < 1.0 + pow(0.5, z->theta))
+        return z->n > 1 ? 1 : 0;
+    size_t r = (size_t)((double)z->n * pow(z->eta * u - z->eta + 1.0, z->alpha));
+    return r < z->n ? r : z->n - 1;
+}
+
+typedef struct {
+    bench_dist_t dist;
+    size_t keys;
+    const bench_zipf_t *zipf;
+    uint64_t rng;
+    size_t cursor; // scan position
+} bench_keygen_t;
+
+// Zipf ranks are scattered over the keyspace so hot keys do not share a
+// bucket neighbourhood or sort next to each other.
+static size_t bench_next_key(bench_keygen_t *g) {
+    switch (g->dist) {
+        case BENCH_UNIFORM:
+            return (size_t)(bench_rand(&g->rng) % g->keys);
+        case BENCH_ZIPF: {
+            uint64_t rank = bench_zipf_next(g->zipf, &g->rng);
+            return (size_t)((rank * 0x9e3779b97f4a7c15ull) % g->keys);
+        }
+        case BENCH_SCAN:
+        default: {
+            size_t k = g->cursor;
+            g->cursor = (g->cursor + 1) % g->keys;
+            return k;
+        }
+    }
+}
+
+#define BENCH_KEY_LEN 16
+
+// Fixed-width "key:" + 11 hex digits, so every key is BENCH_KEY_LEN - 1 bytes.
+static void bench_format_key(char *dst, size_t id) {
+    memcpy(dst, "key:", 4);
+    for (int i = BENCH_KEY_LEN - 2; i >= 4; --i) {
+        dst[i] = "0123456789abcdef"[id & 15];
+        id >>= 4;
+    }
+    dst[BENCH_KEY_LEN - 1] = '\0';
+}
+
+// ===========================================================
+// Latency Histogram
+// ===========================================================
+
+#define BENCH_HIST_SUB   16 // sub-buckets per power of two
+#define BENCH_HIST_SIZE  (64 * BENCH_HIST_SUB)
+
+typedef struct {
+    uint64_t counts[BENCH_HIST_SIZE];
+    uint64_t total;
+} bench_hist_t;
+
+static size_t bench_hist_index(uint64_t ns) {
+    if (ns < BENCH_HIST_SUB)
+        return (size_t)ns;
+    unsigned int msb = 63;
+    while (!(ns >> msb))
+        --msb;
+    unsigned int shift = msb - 4; // keep the top 5 bits: 1xxxx
+    return (size_t)(msb - 3) * BENCH_HIST_SUB + (size_t)((ns >> shift) & (BENCH_HIST_SUB - 1));
+}
+
+// Upper edge of a bucket, so reported percentiles never flatter.
+static uint64_t bench_hist_value(size_t index) {
+    if (index < BENCH_HIST_SUB)
+        return index;
+    unsigned int msb = (unsigned int)(index / BENCH_HIST_SUB) + 3;
+    uint64_t sub = index % BENCH_HIST_SUB;
+    unsigned int shift = msb - 4;
+    return ((BENCH_HIST_SUB + sub + 1) << shift) - 1;
+}
+
+static void bench_hist_record(bench_hist_t *h, uint64_t ns) {
+    h->counts[bench_hist_index(ns)]++;
+    h->total++;
+}
+
+static void bench_hist_merge(bench_hist_t *dst, const bench_hist_t *src) {
+    for (size_t i = 0; i < BENCH_HIST_SIZE; ++i)
+        dst->counts[i] += src->counts[i];
+    dst->total += src->total;
+}
+
+static uint64_t bench_hist_percentile(const bench_hist_t *h, double p) {
+    uint64_t rank = (uint64_t)ceil(p * (double)h->total);
+    uint64_t seen = 0;
+    if (rank == 0)
+        rank = 1;
+    for (size_t i = 0; i < BENCH_HIST_SIZE; ++i) {
+        seen += h->counts[i];
+        if (seen >= rank)
+            return bench_hist_value(i);
+    }
+    return 0;
+}
+
+// ===========================================================
+// Throughput Runs
+// ===========================================================
+
+typedef struct {
+    const bench_options_t *opt;
+    const bench_zipf_t *zipf;
+    const unsigned char *value;
+    uint64_t seed;
+    bench_hist_t hist;
+    size_t misses;
+} bench_worker_t;
+
+static void bench_worker_run(bench_worker_t *w) {
+    const bench_options_t *o = w->opt;
+    bench_keygen_t gen = { o->dist, o->keys, w->zipf, w->seed, 0 };
+    gen.cursor = (size_t)(bench_rand(&gen.rng) % o->keys);
+    unsigned char *buf = (unsigned char *)malloc(o->value_size);
+    char key[BENCH_KEY_LEN];
+    if (!buf)
+        return;
+
+    for (size_t i = 0; i < o->ops; ++i) {
+        bench_format_key(key, bench_next_key(&gen));
+        bool read = o->mode == BENCH_GET ||
+                    (o->mode == BENCH_MIXED && bench_rand_unit(&gen.rng) < o->read_ratio);
+        uint64_t t0 = bench_now_ns();
+        bool ok = read
+            ? fossil_bluecrab_cacheshell_get_binary_into_n(key, BENCH_KEY_LEN - 1, buf, o->value_size, NULL)
+            : fossil_bluecrab_cacheshell_set_binary_n(key, BENCH_KEY_LEN - 1, w->value, o->value_size);
+        bench_hist_record(&w->hist, bench_now_ns() - t0);
+        if (!ok)
+            w->misses++;
+    }
+    free(buf);
+}
+
+#if defined(_WIN32) || defined(_WIN64)
+static DWORD WINAPI bench_thread_entry(LPVOID arg) {
+    bench_worker_run((bench_worker_t *)arg);
+    return 0;
+}
+#else
+static void *bench_thread_entry(void *arg) {
+    bench_worker_run((bench_worker_t *)arg);
+    return NULL;
+}
+#endif
+
+static bool bench_run_threads(const bench_options_t *o, const bench_zipf_t *zipf,
+                              const unsigned char *value, size_t threads) {
+    bench_worker_t *workers = (bench_worker_t *)calloc(threads, sizeof(*workers));
+    bench_thread_t *handles = (bench_thread_t *)calloc(threads, sizeof(*handles));
+    if (!workers || !handles) {
+        free(workers);
+        free(handles);
+        return false;
+    }
+
+    size_t started = 0;
+    uint64_t t0 = bench_now_ns();
+    for (; started < threads; ++started) {
+        workers[started].opt = o;
+        workers[started].zipf = zipf;
+        workers[started].value = value;
+        workers[started].seed = 0x5eed0000ull + started;
+        if (!bench_thread_start(&handles[started], &workers[started]))
+            break;
+    }
+    for (size_t i = 0; i < started; ++i)
+        bench_thread_join(handles[i]);
+    double secs = (double)(bench_now_ns() - t0) / 1e9;
+
+    bench_hist_t *all = (bench_hist_t *)calloc(1, sizeof(*all));
+    size_t misses = 0;
+    if (all) {
+        for (size_t i = 0; i < started; ++i) {
+            bench_hist_merge(all, &workers[i].hist);
+            misses += workers[i].misses;
+        }
+        printf("%7zu %14.0f %10llu %10llu %10llu %10zu\n", started,
+               secs > 0.0 ? (double)all->total / secs : 0.0,
+               (unsigned long long)bench_hist_percentile(all, 0.50),
+               (unsigned long long)bench_hist_percentile(all, 0.99),
+               (unsigned long long)bench_hist_percentile(all, 0.999),
+               misses);
+    }
+    bool ok = all && started == threads;
+    free(all);
+    free(workers);
+    free(handles);
+    return ok;
+}
+
+static int bench_throughput(const bench_options_t *o) {
+    static const char *modes[] = { "get", "set", "mixed" };
+    static const char *dists[] = { "uniform", "zipf", "scan" };
+    bench_zipf_t zipf;
+    if (o->dist == BENCH_ZIPF)
+        bench_zipf_init(&zipf, o->keys, o->theta);
+
+    unsigned char *value = (unsigned char *)malloc(o->value_size);
+    if (!value || !fossil_bluecrab_cacheshell_init(0)) {
+        free(value);
+        fprintf(stderr, "init failed\n");
+        return 1;
+    }
+    for (size_t i = 0; i < o->value_size; ++i)
+        value[i] = (unsigned char)(i * 31u + 7u);
+
+    // Lock from the start so every row pays the same synchronisation cost
+    fossil_bluecrab_cacheshell_threadsafe(true);
+    fossil_bluecrab_cacheshell_near_cache(o->near_cache, 0);
+
+    char key[BENCH_KEY_LEN];
+    for (size_t i = 0; i < o->keys; ++i) {
+        bench_format_key(key, i);
+        if (!fossil_bluecrab_cacheshell_set_binary_n(key, BENCH_KEY_LEN - 1, value, o->value_size)) {
+            fprintf(stderr, "preload failed at key %zu\n", i);
+            fossil_bluecrab_cacheshell_shutdown();
+            free(value);
+            return 1;
+        }
+    }
+
+    printf("# mode=%s dist=%s keys=%zu ops/thread=%zu value=%zuB", modes[o->mode], dists[o->dist],
+           o->keys, o->ops, o->value_size);
+    if (o->mode == BENCH_MIXED)
+        printf(" reads=%.2f", o->read_ratio);
+    if (o->dist == BENCH_ZIPF)
+        printf(" theta=%.2f", o->theta);
+    printf(" near=%s\n", o->near_cache ? "on" : "off");
+    printf("%7s %14s %10s %10s %10s %10s\n", "threads", "ops/s", "p50(ns)", "p99(ns)", "p999(ns)", "failed");
+
+    bool ok = true;
+    for (size_t t = 1; ok && t <= o->threads; t *= 2) {
+        ok = bench_run_threads(o, o->dist == BENCH_ZIPF ? &zipf : NULL, value, t);
+        if (ok && t < o->threads && t * 2 > o->threads)
+            ok = bench_run_threads(o, o->dist == BENCH_ZIPF ? &zipf : NULL, value, o->threads);
+    }
+
+    fossil_bluecrab_cacheshell_shutdown();
+    free(value);
+    return ok ? 0 : 1;
+}
+
+// ===========================================================
+// Trace Replay / Policy Simulation
+// ===========================================================
+
+typedef struct {
+    size_t *ids;   // access sequence, dense ids 0..distinct-1
+    size_t length;
+    size_t distinct;
+} bench_trace_t;
+
+// String interning for trace files: open addressing over key copies.
+typedef struct {
+    char **keys;
+    size_t *ids;
+    size_t cap;
+    size_t used;
+} bench_intern_t;
+
+static uint64_t bench_hash_bytes(const char *s, size_t n) {
+    uint64_t h = 0xcbf29ce484222325ull; // FNV-1a
+    for (size_t i = 0; i < n; ++i)
+        h = (h ^ (unsigned char)s[i]) * 0x100000001b3ull;
+    return h;
+}
+
+static bool bench_intern_grow(bench_intern_t *t) {
+    size_t cap = t->cap ? t->cap * 2 : 1024;
+    char **keys = (char **)calloc(cap, sizeof(*keys));
+    size_t *ids = (size_t *)calloc(cap, sizeof(*ids));
+    if (!keys || !ids) {
+        free(keys);
+        free(ids);
+        return false;
+    }
+    for (size_t i = 0; i < t->cap; ++i) {
+        if (!t->keys[i])
+            continue;
+        size_t j = (size_t)bench_hash_bytes(t->keys[i], strlen(t->keys[i])) & (cap - 1);
+        while (keys[j])
+            j = (j + 1) & (cap - 1);
+        keys[j] = t->keys[i];
+        ids[j] = t->ids[i];
+    }
+    free(t->keys);
+    free(t->ids);
+    t->keys = keys;
+    t->ids = ids;
+    t->cap = cap;
+    return true;
+}
+
+static bool bench_intern(bench_intern_t *t, const char *key, size_t len, size_t *out_id) {
+    if ((t->used + 1) * 2 > t->cap && !bench_intern_grow(t))
+        return false;
+    size_t j = (size_t)bench_hash_bytes(key, len) & (t->cap - 1);
+    while (t->keys[j]) {
+        if (strncmp(t->keys[j], key, len) == 0 && t->keys[j][len] == '\0') {
+            *out_id = t->ids[j];
+            return true;
+        }
+        j = (j + 1) & (t->cap - 1);
+    }
+    char *copy = (char *)malloc(len + 1);
+    if (!copy)
+        return false;
+    memcpy(copy, key, len);
+    copy[len] = '\0';
+    t->keys[j] = copy;
+    t->ids[j] = t->used;
+    *out_id = t->used++;
+    return true;
+}
+
+static void bench_intern_free(bench_intern_t *t) {
+    for (size_t i = 0; i < t->cap; ++i)
+        free(t->keys[i]);
+    free(t->keys);
+    free(t->ids);
+}
+
+static bool bench_trace_push(bench_trace_t *tr, size_t *cap, size_t id) {
+    if (tr->length == *cap) {
+        size_t ncap = *cap ? *cap * 2 : 4096;
+        size_t *ids = (size_t *)realloc(tr->ids, ncap * sizeof(*ids));
+        if (!ids)
+            return false;
+        tr->ids = ids;
+        *cap = ncap;
+    }
+    tr->ids[tr->length++] = id;
+    return true;
+}
+
+static bool bench_trace_load(const char *path, bench_trace_t *tr) {
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return false;
+    bench_intern_t intern = { NULL, NULL, 0, 0 };
+    size_t cap = 0;
+    char line[1024];
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), file)) {
+        size_t len = strcspn(line, "\r\n");
+        size_t id;
+        if (len == 0)
+            continue;
+        ok = bench_intern(&intern, line, len, &id) && bench_trace_push(tr, &cap, id);
+    }
+    fclose(file);
+    tr->distinct = intern.used;
+    bench_intern_free(&intern);
+    return ok && tr->length > 0;
+}
+
+static bool bench_trace_generate(const bench_options_t *o, bench_trace_t *tr) {
+    bench_zipf_t zipf;
+    if (o->dist == BENCH_ZIPF)
+        bench_zipf_init(&zipf, o->keys, o->theta);
+    bench_keygen_t gen = { o->dist, o->keys, &zipf, 0x7ace, 0 };
+    size_t cap = 0;
+    for (size_t i = 0; i < o->ops; ++i) {
+        if (!bench_trace_push(tr, &cap, bench_next_key(&gen)))
+            return false;
+    }
+    tr->distinct = o->keys;
+    return true;
+}
+
+// Shared bookkeeping for the simulated policies: slot_of[id] is the
+// resident slot of a key or SIZE_MAX.
+typedef struct {
+    size_t capacity;
+    size_t *slot_of;
+    size_t *key_of;   // slot -> id
+    size_t *prev;     // LRU list over slots
+    size_t *next;
+    unsigned char *ref; // CLOCK reference bits
+    size_t head, tail, used, hand;
+} bench_policy_t;
+
+typedef enum { BENCH_LRU, BENCH_FIFO, BENCH_CLOCK } bench_policy_kind_t;
+
+static bool bench_policy_init(bench_policy_t *p, size_t capacity, size_t distinct) {
+    memset(p, 0, sizeof(*p));
+    p->capacity = capacity;
+    p->slot_of = (size_t *)malloc(distinct * sizeof(size_t));
+    p->key_of = (size_t *)calloc(capacity, sizeof(size_t));
+    p->prev = (size_t *)calloc(capacity, sizeof(size_t));
+    p->next = (size_t *)calloc(capacity, sizeof(size_t));
+    p->ref = (unsigned char *)calloc(capacity, 1);
+    if (!p->slot_of || !p->key_of || !p->prev || !p->next || !p->ref)
+        return false;
+    for (size_t i = 0; i < distinct; ++i)
+        p->slot_of[i] = SIZE_MAX;
+    p->head = p->tail = SIZE_MAX;
+    return true;
+}
+
+static void bench_policy_free(bench_policy_t *p) {
+    free(p->slot_of);
+    free(p->key_of);
+    free(p->prev);
+    free(p->next);
+    free(p->ref);
+}
+
+static void bench_lru_unlink(bench_policy_t *p, size_t s) {
+    if (p->prev[s] != SIZE_MAX) p->next[p->prev[s]] = p->next[s]; else p->head = p->next[s];
+    if (p->next[s] != SIZE_MAX) p->prev[p->next[s]] = p->prev[s]; else p->tail = p->prev[s];
+}
+
+static void bench_lru_push_front(bench_policy_t *p, size_t s) {
+    p->prev[s] = SIZE_MAX;
+    p->next[s] = p->head;
+    if (p->head != SIZE_MAX)
+        p->prev[p->head] = s;
+    p->head = s;
+    if (p->tail == SIZE_MAX)
+        p->tail = s;
+}
+
+// Returns true on a hit; a miss inserts the key, evicting if full.
+static bool bench_policy_access(bench_policy_t *p, bench_policy_kind_t kind, size_t id) {
+    size_t s = p->slot_of[id];
+    if (s != SIZE_MAX) {
+        if (kind == BENCH_LRU) {
+            bench_lru_unlink(p, s);
+            bench_lru_push_front(p, s);
+        } else if (kind == BENCH_CLOCK) {
+            p->ref[s] = 1;
+        }
+        return true;
+    }
+
+    if (p->used < p->capacity) {
+        s = p->used++;
+    } else if (kind == BENCH_LRU) {
+        s = p->tail;
+        bench_lru_unlink(p, s);
+        p->slot_of[p->key_of[s]] = SIZE_MAX;
+    } else {
+        // FIFO is CLOCK without second chances
+        while (kind == BENCH_CLOCK && p->ref[p->hand]) {
+            p->ref[p->hand] = 0;
+            p->hand = (p->hand + 1) % p->capacity;
+        }
+        s = p->hand;
+        p->hand = (p->hand + 1) % p->capacity;
+        p->slot_of[p->key_of[s]] = SIZE_MAX;
+    }
+    p->key_of[s] = id;
+    p->slot_of[id] = s;
+    p->ref[s] = 0;
+    if (kind == BENCH_LRU)
+        bench_lru_push_front(p, s);
+    return false;
+}
+
+// Replays the trace through the real cache, bounded by max_entries.
+static bool bench_replay_cacheshell(const bench_trace_t *tr, size_t capacity, size_t value_size,
+                                    size_t *out_hits) {
+    unsigned char *value = (unsigned char *)calloc(1, value_size);
+    if (!value || !fossil_bluecrab_cacheshell_init(capacity)) {
+        free(value);
+        return false;
+    }
+    char key[BENCH_KEY_LEN];
+    size_t hits = 0;
+    for (size_t i = 0; i < tr->length; ++i) {
+        bench_format_key(key, tr->ids[i]);
+        if (fossil_bluecrab_cacheshell_exists_n(key, BENCH_KEY_LEN - 1))
+            hits++;
+        else
+            fossil_bluecrab_cacheshell_set_binary_n(key, BENCH_KEY_LEN - 1, value, value_size);
+    }
+    fossil_bluecrab_cacheshell_shutdown();
+    free(value);
+    *out_hits = hits;
+    return true;
+}
+
+static int bench_replay(const bench_options_t *o) {
+    bench_trace_t tr = { NULL, 0, 0 };
+    bool ok = o->trace ? bench_trace_load(o->trace, &tr) : bench_trace_generate(o, &tr);
+    if (!ok) {
+        fprintf(stderr, "could not %s trace\n", o->trace ? "read" : "generate");
+        free(tr.ids);
+        return 1;
+    }
+    size_t capacity = o->capacity ? o->capacity : (tr.distinct / 10 ? tr.distinct / 10 : 1);
+
+    printf("# replay accesses=%zu distinct=%zu capacity=%zu\n", tr.length, tr.distinct, capacity);
+    printf("%-10s %12s %10s\n", "policy", "hits", "hit-ratio");
+
+    static const char *names[] = { "lru", "fifo", "clock" };
+    for (int kind = BENCH_LRU; ok && kind <= BENCH_CLOCK; ++kind) {
+        bench_policy_t p;
+        ok = bench_policy_init(&p, capacity, tr.distinct);
+        size_t hits = 0;
+        for (size_t i = 0; ok && i < tr.length; ++i)
+            hits += bench_policy_access(&p, (bench_policy_kind_t)kind, tr.ids[i]);
+        if (ok)
+            printf("%-10s %12zu %10.4f\n", names[kind], hits, (double)hits / (double)tr.length);
+        bench_policy_free(&p);
+    }
+
+    size_t hits = 0;
+    if (ok && (ok = bench_replay_cacheshell(&tr, capacity, o->value_size, &hits)))
+        printf("%-10s %12zu %10.4f\n", "cacheshell", hits, (double)hits / (double)tr.length);
+
+    free(tr.ids);
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+    bench_options_t o = {
+        BENCH_MIXED, BENCH_ZIPF,
+        4,        // threads
+        200000,   // ops per thread (replay: trace length)
+        100000,   // keys
+        64,       // value size
+        0.99,     // zipf theta
+        0.9,      // read ratio
+        false, NULL, 0
+    };
+    if (!bench_parse_options(argc, argv, &o))
+        return 2;
+    return o.mode == BENCH_REPLAY ? bench_replay(&o) : bench_throughput(&o);
+}
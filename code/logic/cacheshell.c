@@ -22,6 +22,17 @@
  * Copyright (C) 2014-2025 Fossil Logic. All rights reserved.
  * -----------------------------------------------------------------------------
  */
+#if !defined(_WIN32) && !defined(_WIN64)
+#if !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L   // shm_open, mmap, robust mutexes
+#endif
+#if !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE           // MAP_ANONYMOUS on glibc / musl
+#endif
+#if !defined(_DARWIN_C_SOURCE)
+#define _DARWIN_C_SOURCE          // MAP_ANON on macOS
+#endif
+#endif
 #include "fossil/crabdb/cacheshell.h"
 #include <stdlib.h>
 #include <string.h>
@@ -31,6 +42,13 @@
 typedef CRITICAL_SECTION pthread_mutex_t;
 #else
 #include <pthread.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
 #endif
 
 /**
@@ -43,11 +61,23 @@ typedef CRITICAL_SECTION pthread_mutex_t;
  *
  * Core Features:
  *   - String & binary storage (size tracked, not null-terminated required)
+ *   - Pinned zero-copy reads: a pinned value outlives overwrite / removal
+ *     of its key until the last unpin
  *   - Optional per-entry TTL (seconds) with lazy + bulk eviction
  *   - Optional thread safety (runtime toggle)
  *   - Basic stats (hits / misses), memory usage, count
  *   - Iteration callback over all entries
- *   - Simple persistence (key + size + raw bytes) — TTL NOT persisted
+ *   - Optional ordered key index (skip list) for prefix / range scans + deletes
+ *   - Optional per-thread L1 near-cache for small, hot values
+ *   - Optional shared-memory mode: one cache shared by several processes
+ *   - Native hash / list / set values with packed small encodings
+ *   - Optional transparent LZ compression of values above a size threshold
+ *   - Optional large-object store: oversized values in their own mappings,
+ *     with a separate byte budget and LRU eviction
+ *   - Optional hot-key (sampled Space-Saving) and big-key (largest values)
+ *     tracking, pollable without taking the cache lock
+ *   - Snapshot persistence (length-prefixed little-endian records, plain
+ *     values and collections) — TTL NOT persisted
  *
  * Data Structures:
  *   fossil_cache_entry_t:
@@ -70,9 +100,115 @@ typedef CRITICAL_SECTION pthread_mutex_t;
  *       |  key=A    |----->|  key=Q    |----->|  key=Z    |-> NULL
  *       +-----------+      +-----------+      +-----------+
  *
+ *   Ordered Index (opt-in, fossil_bluecrab_cacheshell_ordered_index(true)):
+ *
+ *       level 2: head ---------------------> [s:2:1] -----------------> NULL
+ *       level 1: head --------> [s:1:7] ---> [s:2:1] ---> [user:9] ---> NULL
+ *       level 0: head -> [a] -> [s:1:7] ---> [s:2:1] ---> [user:9] ---> NULL
+ *
+ *     A skip list of nodes pointing at hash table entries, sorted by key
+ *     bytes. It is maintained alongside the buckets on every insert and
+ *     removal, so scan_prefix / scan_range / delete_prefix / delete_range
+ *     cost O(log n + matches). When disabled no nodes exist and the range
+ *     APIs fall back to a filtered full-table walk (unordered).
+ *
+ *   Near Cache (opt-in, fossil_bluecrab_cacheshell_near_cache(true, lease_ms)):
+ *
+ *       thread T1: slots[64] --+
+ *       thread T2: slots[64] --+--> miss --> lock -> shared table -> fill slot
+ *                               |
+ *                               +--> hit: epoch & stripe version unchanged
+ *
+ *     Every thread owns 64 direct-mapped slots holding copies of small
+ *     entries (key < 48 bytes, value <= 128 bytes). A slot records the
+ *     global epoch and its key's version stripe at fill time; writers bump
+ *     the stripe under the lock and clear() bumps the epoch, so copy-out
+ *     readers (get, get_binary_into) can validate a slot with two atomic
+ *     loads instead of the lock. An optional lease caps how long a slot is
+ *     served before the next read goes back to the shared table.
+ *     get_binary() still returns a pointer into the table and never uses L1.
+ *
+ *   Shared-Memory Mode (fossil_bluecrab_cacheshell_init_shared(name, ...)):
+ *
+ *       +--------+----------------------+--------------------------------+
+ *       | header | buckets[] (offsets)  | arena: power-of-two blocks     |
+ *       +--------+----------------------+--------------------------------+
+ *         lock, counters, free_lists[class] -> block -> block -> 0
+ *
+ *     The same table lives in a shm_open/mmap segment. Entries are arena
+ *     blocks (header + key + value) linked by segment offsets rather than
+ *     pointers, so each process may map the segment anywhere. Freed blocks
+ *     go to a per-size-class free list; when the arena is exhausted expired
+ *     entries are swept once before an insert fails. All access takes a
+ *     process-shared robust mutex, recovered if a worker dies holding it;
+ *     if it cannot be recovered the call fails. get_binary returns NULL
+ *     here since the block may be reused once the lock is dropped. A
+ *     segment whose creator died mid-setup is taken over by the next
+ *     attacher after a timeout. No ordered index or near cache in this mode.
+ *
+ *   Hot / Big Keys (opt-in, fossil_bluecrab_cacheshell_key_tracking):
+ *
+ *       get/set --(1 in sample_rate)--> hot[128]: {key, count, error}
+ *       set (size > threshold) -------> big[32]:  {entry, key, size}
+ *       top_keys / largest_keys ------> copy under keys lock, sort
+ *
+ *     Hot keys use the Space-Saving algorithm: a new key evicts the
+ *     smallest counter and inherits its count as the error bound, so any
+ *     key with true frequency above N/128 is guaranteed to be listed.
+ *     The big list holds the 32 largest live values; writes smaller than
+ *     the current minimum skip it with one atomic load. Both arrays sit
+ *     behind their own small lock, so polling never blocks cache traffic.
+ *     In shared-memory mode hot keys are per process and big keys are not
+ *     tracked.
+ *
+ *   Collection Values (hset/hget/hdel, lpush/lrange, sadd/sismember):
+ *
+ *       small:  data -> [len|field][len|value][len|field][len|value]...
+ *       large:  data -> slots[2^n] -> node{hash, field, value}   (hash/set)
+ *                       ring[2^n]  -> node{value}, head index      (list)
+ *
+ *     One entry holds a whole object instead of one entry per field, so a
+ *     field costs a 4-byte length prefix rather than an entry struct, key
+ *     copy and chain node. Collections start packed and upgrade once they
+ *     exceed 64 items or any item exceeds 64 bytes; they never downgrade.
+ *     entry->size is the collection's footprint, so memory accounting and
+ *     big-key tracking see it. Raw getters, iterate, scans and save ignore
+ *     collections; an emptied collection removes its key.
+ *
+ *   Value Compression (opt-in, fossil_bluecrab_cacheshell_compression(min)):
+ *
+ *       set_binary(size >= min) --LZ--> [token|literals|offset|len]...
+ *                                       kept only if >= 1/8 smaller
+ *       get / get_binary_into --------> decode straight into caller buffer
+ *       get_binary / iterate / save --> decode into per-thread scratch
+ *
+ *     A built-in LZ77 codec (LZ4 block layout, 64 KiB window, no external
+ *     dependency) runs before the lock is taken. entry->size is the
+ *     compressed size and raw_size the logical one, so total_bytes and the
+ *     memory budget count what is really allocated. Readers always see the
+ *     original bytes; save writes them uncompressed.
+ *
+ *   Large-Object Store (opt-in, fossil_bluecrab_cacheshell_large_objects):
+ *
+ *       entry{key, data, size} --data--> region: [lob header | value bytes] ...
+ *                                                prev/next: LRU, newest first
+ *
+ *     Values whose stored size reaches the threshold bypass malloc and get
+ *     a page-aligned block carved from a pool of 64 MiB anonymous mappings
+ *     (free runs are coalesced; an oversized value gets a region of its
+ *     own), so the mapping count stays small. The table entry stays a
+ *     small header. Large objects have their own budget in block bytes: a
+ *     new one evicts the least recently read large objects, never small
+ *     entries, and a value bigger than the whole budget is rejected.
+ *     Removal returns the block's pages to the OS at once but keeps the
+ *     region mapped until shutdown, so a get_binary pointer that outlived
+ *     its value reads stale bytes instead of faulting.
+ *
  * Hash Function:
- *   FNV-1a (32 or 64-bit) plus extra avalanche mixing for better
- *   distribution. Final index = hash % bucket_count.
+ *   Word-at-a-time: 8 key bytes per step through a Murmur3-style multiply /
+ *   rotate mix, the tail packed into one last word, then the SplitMix64
+ *   finalizer. Native-endian loads, so hashes are never persisted.
+ *   Final index = hash % bucket_count.
  *
  * TTL / Expiration:
  *   - When fetched:
@@ -99,21 +235,36 @@ typedef CRITICAL_SECTION pthread_mutex_t;
  *   - POSIX: pthread_mutex_t
  *
  * Persistence Format (sequential stream):
- *   For each entry (non-expired at save time):
- *       key bytes including '\0'
- *       size (size_t)
- *       raw data bytes
+ *   8-byte magic "\0FCACHE4", then for each entry (non-expired at save time):
+ *       type (1 byte: raw, hash, list or set)
+ *       key_len (u32 LE) + key bytes (may contain '\0' / '\n')
+ *       size (u64 LE)
+ *       raw data bytes, or for a collection its items as [u32 LE len][bytes]
+ *       (hash: field, value, field, value...; list: front to back)
+ *   "\0FCACHE3" (same layout, native size_t lengths) and "\0FCACHE2" (no
+ *   type byte) files still load, and files without a magic are read as the
+ *   older newline-terminated format. Lengths longer than the rest of the
+ *   file are rejected before anything is allocated.
  *   NOT stored: expiry/TTL, stats, locking flag, bucket count.
  *   On load: table cleared, entries appended (TTL defaults to 0).
  *
  * Memory Usage Calculation:
- *   sum( sizeof(entry) + entry->size + strlen(key)+1 )
+ *   sum( sizeof(entry) + entry->size + key_len+1 )
+ *   (entry->size is the compressed size for compressed values)
  *
  * Limitations / Trade-offs:
  *   - No resizing: very large key counts per bucket degrade performance
  *   - No eviction policy (LRU/LFU); rely on max_entries or TTL + manual removal
  *   - Global singleton cache (g_cache) — not multi-instance
- *   - Persistence is endian/ABI dependent (size_t & layout)
+ *   - L1 hits do not refresh last_access; per-thread L1 counters are
+ *     flushed every 64 lookups, so layer stats may lag in other threads
+ *   - Snapshots are portable across hosts (fixed-width LE lengths), but
+ *     collection items over 4 GiB or keys over 4 GiB cannot be saved
+ *   - Shared segments are fixed-size and ABI dependent; all attached
+ *     processes must run the same build. POSIX only.
+ *   - get_binary on a compressed value returns per-thread scratch, valid
+ *     until that thread next decompresses; on Windows scratch buffers are
+ *     not freed at thread exit
  *
  * Example Usage:
  *
@@ -155,6 +306,8 @@ typedef CRITICAL_SECTION pthread_mutex_t;
  *   - set/get/remove: O(1) expected, O(n) worst (n = entries in a bucket)
  *   - evict_expired: O(total_entries)
  *   - iterate: O(total_entries)
+ *   - scan/delete prefix or range: O(log n + matches) with the ordered
+ *     index, O(total_entries) without it
  *
  * Safety Notes:
  *   - Caller must provide adequate buffer for fossil_bluecrab_cacheshell_get
@@ -165,16 +318,168 @@ typedef CRITICAL_SECTION pthread_mutex_t;
 // Internal Types
 // ===========================================================
 
+typedef enum {
+    FOSSIL_CACHE_TYPE_RAW = 0,  // plain bytes (set / set_binary)
+    FOSSIL_CACHE_TYPE_HASH,     // field -> value map
+    FOSSIL_CACHE_TYPE_LIST,     // ordered values
+    FOSSIL_CACHE_TYPE_SET       // unique members
+} fossil_cache_type_t;
+
+typedef enum {
+    FOSSIL_CACHE_ENC_PACKED = 0, // [u32 len][bytes] records in one buffer
+    FOSSIL_CACHE_ENC_TABLE,      // open-addressing node table (hash / set)
+    FOSSIL_CACHE_ENC_DEQUE       // ring buffer of nodes (list)
+} fossil_cache_encoding_t;
+
+#define FOSSIL_CACHE_PACKED_MAX_ITEMS  64   // upgrade past this many items
+#define FOSSIL_CACHE_PACKED_MAX_ITEM   64   // ... or any field/value longer than this
+
+// Heap node used once a collection outgrows the packed encoding: field
+// bytes (hash / set) followed by value bytes (hash / list).
+typedef struct {
+    size_t hash;
+    uint32_t field_len;
+    uint32_t value_len;
+    unsigned char bytes[];
+} fossil_cache_node_t;
+
+// Value of a hash / list / set entry (entry->data).
+typedef struct {
+    fossil_cache_encoding_t encoding;
+    size_t count;              // fields / elements / members
+    size_t node_bytes;         // heap bytes held by nodes
+    unsigned char *buf;        // packed records
+    size_t len;
+    size_t cap;
+    fossil_cache_node_t **slots; // table or deque, power-of-two sized
+    size_t slot_count;
+    size_t used;               // table: live + tombstone slots
+    size_t head;               // deque: slot of the first element
+} fossil_cache_coll_t;
+
 typedef struct fossil_cache_entry_t {
-    char *key;
-    void *data;
-    size_t size;
+    char *key;              // key_len bytes + '\0'; may hold embedded NULs
+    size_t key_len;
+    size_t hash;            // fossil_cache_hash(key, key_len)
+    void *data;             // bytes, or fossil_cache_coll_t * for collections
+    size_t size;            // stored bytes (collections: footprint)
+    size_t raw_size;        // logical bytes when FOSSIL_CACHE_ENTRY_LZ is set
+    fossil_cache_type_t type;
     time_t expiry;          // 0 if no TTL
     time_t created;         // creation timestamp
     time_t last_access;     // last access timestamp
+    unsigned int flags;     // FOSSIL_CACHE_ENTRY_* bits
+    fossil_bluecrab_cache_pin_t *pin; // readers holding the current value
     struct fossil_cache_entry_t *next;
 } fossil_cache_entry_t;
 
+// A pinned value. While entry is set the bytes belong to that entry and
+// every reader of it shares this pin; once the entry lets go (overwrite,
+// removal, clear) ownership moves here and the last unpin frees it.
+struct fossil_bluecrab_cache_pin {
+    const void *bytes;
+    size_t size;
+    size_t refs;
+    fossil_cache_entry_t *entry;   // NULL once detached, or for private copies
+    void *owned;                   // retired value block or decoded copy
+    unsigned int owned_flags;      // FOSSIL_CACHE_ENTRY_LOB when owned is a mapping
+    bool private_copy;             // single holder; released without the lock
+};
+
+#define FOSSIL_CACHE_ENTRY_BIG  0x01u  // listed in g_cache_keys.big
+#define FOSSIL_CACHE_ENTRY_LZ   0x02u  // data is LZ-compressed, see raw_size
+#define FOSSIL_CACHE_ENTRY_LOB  0x04u  // data lives in a large-object mapping
+#define FOSSIL_CACHE_ENTRY_STORAGE (FOSSIL_CACHE_ENTRY_LZ | FOSSIL_CACHE_ENTRY_LOB)
+
+#define FOSSIL_CACHE_LOB_HEADER 64    // keeps the value 64-byte aligned
+#define FOSSIL_CACHE_LOB_REGION ((size_t)64 * 1024 * 1024) // pooled mapping size
+
+// Free run of pages inside a large-object region.
+typedef struct {
+    size_t off;
+    size_t len;
+} fossil_cache_lob_extent_t;
+
+// One pooled mapping that large-object blocks are carved from.
+typedef struct fossil_cache_lob_region_t {
+    struct fossil_cache_lob_region_t *next;
+    uint8_t *base;
+    size_t len;                       // bytes mapped (page multiple)
+    size_t top;                       // bump offset; nothing handed out above it
+    size_t live;                      // blocks currently handed out
+    fossil_cache_lob_extent_t *free;  // freed runs below top, sorted by offset
+    size_t free_count;
+    size_t free_cap;
+} fossil_cache_lob_region_t;
+
+// Header at the start of each large-object block; the value follows.
+typedef struct fossil_cache_lob_t {
+    size_t block_len;                 // bytes held in the region (page multiple)
+    fossil_cache_lob_region_t *region;
+    struct fossil_cache_entry_t *entry;
+    struct fossil_cache_lob_t *prev;  // LRU list, most recent first
+    struct fossil_cache_lob_t *next;
+} fossil_cache_lob_t;
+
+// Regions are shared by every writer and by unpin, which run outside the
+// cache lock, so the pool has its own (leaf) lock.
+typedef struct {
+    pthread_mutex_t lock;             // set up once, on first use
+    fossil_cache_lob_region_t *regions;
+} fossil_cache_lob_pool_t;
+
+#define FOSSIL_CACHE_INDEX_MAX_LEVEL 24
+
+// Ordered index node (skip list). next[] holds `level` forward pointers.
+typedef struct fossil_cache_index_node_t {
+    fossil_cache_entry_t *entry;
+    int level;
+    struct fossil_cache_index_node_t *next[];
+} fossil_cache_index_node_t;
+
+#define FOSSIL_CACHE_SHM_MAGIC          0x4d534346u   // "FCSM"
+#define FOSSIL_CACHE_SHM_VERSION        3u
+#define FOSSIL_CACHE_SHM_MIN_BLOCK      64            // smallest size class
+#define FOSSIL_CACHE_SHM_CLASSES        40            // 64 B .. 32 TiB
+#define FOSSIL_CACHE_SHM_DEFAULT_ARENA  ((size_t)64 * 1024 * 1024)
+#define FOSSIL_CACHE_SHM_ATTACH_MS      2000          // wait before taking over a stalled init
+
+// Entry stored in a shared-memory arena block: header, key + '\0', then
+// the value at the next 8-byte boundary. Links are segment offsets.
+typedef struct {
+    uint64_t next;             // offset of the next entry in the chain, 0 = end
+    uint64_t hash;
+    int64_t expiry;            // 0 if no TTL
+    int64_t created;
+    int64_t last_access;
+    uint64_t size;             // value bytes
+    uint32_t key_len;          // excluding '\0'
+    uint32_t size_class;       // block is MIN_BLOCK << size_class bytes
+} fossil_cache_shm_entry_t;
+
+// Start of a shared segment: [header][buckets: uint64_t offsets][arena].
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t ready;            // set last by the formatting process
+    uint32_t init_pid;         // process formatting the segment, 0 = unclaimed
+    uint64_t segment_size;
+    uint64_t bucket_count;     // power of two
+    uint64_t buckets_offset;
+    uint64_t max_entries;
+    uint64_t entry_count;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t total_bytes;      // arena bytes held by live entries
+    uint64_t expired_evictions;
+    int64_t start_time;
+    uint64_t arena_offset;
+    uint64_t arena_top;        // bump pointer for never-used blocks
+    uint64_t arena_end;
+    uint64_t free_lists[FOSSIL_CACHE_SHM_CLASSES];
+    pthread_mutex_t lock;      // process-shared, robust
+} fossil_cache_shm_header_t;
+
 typedef struct {
     fossil_cache_entry_t **buckets;
     size_t bucket_count;
@@ -187,63 +492,184 @@ typedef struct {
     bool locking_enabled;
     pthread_mutex_t lock;
     time_t start_time;         // cache initialization time
+
+    // Ordered key index (NULL head => disabled)
+    fossil_cache_index_node_t *index_head;
+    int index_level;           // highest level currently in use
+    uint64_t index_rng;        // xorshift state for node levels
+
+    // Shared-memory mode (NULL => private heap table above)
+    fossil_cache_shm_header_t *shm;
+    size_t shm_size;
+
+    // Value compression (compress_min == 0 => disabled)
+    uint64_t compress_min;     // smallest value size worth compressing
+    size_t lz_entries;         // entries currently stored compressed
+    size_t lz_logical_bytes;   // their uncompressed size
+    size_t lz_stored_bytes;    // their compressed size
+
+    // Large-object store (lob_min == 0 => disabled)
+    uint64_t lob_min;          // stored size routed to a private mapping
+    uint64_t lob_budget;       // mapped-bytes cap, 0 => unlimited
+    size_t lob_count;
+    size_t lob_bytes;          // bytes currently mapped
+    size_t lob_evictions;      // large objects evicted to honour the budget
+    fossil_cache_lob_t *lob_head;
+    fossil_cache_lob_t *lob_tail;
 } fossil_cache_t;
 
+#define FOSSIL_CACHE_L1_SLOTS      64   // direct-mapped, power of two
+#define FOSSIL_CACHE_L1_MAX_KEY    48   // including '\0'
+#define FOSSIL_CACHE_L1_MAX_VALUE  128
+#define FOSSIL_CACHE_L1_STRIPES    256  // per-key version stripes, power of two
+#define FOSSIL_CACHE_L1_FLUSH      64   // per-thread counter flush interval
+
+// One near-cache slot: a private copy of a small entry plus the versions it
+// was read under. size == 0 marks an empty slot.
+typedef struct {
+    size_t hash;
+    uint64_t epoch;            // g_cache_l1.epoch at fill time
+    uint64_t version;          // g_cache_l1.versions[stripe] at fill time
+    uint64_t filled_ms;        // for the staleness lease
+    time_t expiry;
+    size_t size;
+    size_t key_len;
+    char key[FOSSIL_CACHE_L1_MAX_KEY];
+    unsigned char data[FOSSIL_CACHE_L1_MAX_VALUE];
+} fossil_cache_l1_slot_t;
+
+typedef struct {
+    fossil_cache_l1_slot_t slots[FOSSIL_CACHE_L1_SLOTS];
+    uint64_t stats_gen;        // drops pending counts across shutdown
+    uint64_t hits;             // not yet flushed to g_cache_l1
+    uint64_t misses;
+} fossil_cache_l1_t;
+
+// Shared near-cache state. Read without the cache lock, so every field is
+// accessed through the atomic helpers. Never reset by init, which keeps
+// epochs monotonic across shutdown/init cycles.
+typedef struct {
+    uint64_t enabled;
+    uint64_t lease_ms;         // 0 = slots live until invalidated
+    uint64_t epoch;            // bumped by clear / shutdown / toggling
+    uint64_t versions[FOSSIL_CACHE_L1_STRIPES];
+    uint64_t stats_gen;
+    uint64_t hits;
+    uint64_t misses;
+} fossil_cache_l1_shared_t;
+
+#define FOSSIL_CACHE_HOT_SLOTS  128  // Space-Saving counters
+#define FOSSIL_CACHE_BIG_SLOTS  32   // largest values tracked
+
+typedef struct {
+    size_t hash;
+    uint64_t count;            // estimated accesses (already scaled by rate)
+    uint64_t error;            // Space-Saving overestimation bound
+    char key[FOSSIL_BLUECRAB_CACHE_KEY_STAT_LEN];
+} fossil_cache_hot_slot_t;
+
+typedef struct {
+    fossil_cache_entry_t *entry;   // valid: dropped entries are unlisted first
+    size_t size;
+    char key[FOSSIL_BLUECRAB_CACHE_KEY_STAT_LEN];
+} fossil_cache_big_slot_t;
+
+// Hot/big key tracking. The arrays have their own lock so pollers never
+// take the cache lock; writers may take it while holding the cache lock,
+// never the other way round.
+typedef struct {
+    uint64_t sample_rate;      // atomic; 0 = tracking disabled
+    uint64_t big_threshold;    // atomic; smallest listed size once full
+    pthread_mutex_t lock;      // set up once, on first use
+    fossil_cache_hot_slot_t hot[FOSSIL_CACHE_HOT_SLOTS];
+    size_t hot_used;
+    fossil_cache_big_slot_t big[FOSSIL_CACHE_BIG_SLOTS];
+    size_t big_used;
+} fossil_cache_keys_t;
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define FOSSIL_CACHE_TLS __declspec(thread)
+#else
+#define FOSSIL_CACHE_TLS _Thread_local
+#endif
+
 // ===========================================================
 // Internal Globals
 // ===========================================================
 
 static fossil_cache_t g_cache;
+static fossil_cache_l1_shared_t g_cache_l1;
+static FOSSIL_CACHE_TLS fossil_cache_l1_t t_cache_l1;
+static fossil_cache_keys_t g_cache_keys;
+static fossil_cache_lob_pool_t g_cache_lob_pool;
+static FOSSIL_CACHE_TLS uint32_t t_cache_sample_skip;
+static FOSSIL_CACHE_TLS uint32_t t_cache_sample_rng;
+static FOSSIL_CACHE_TLS uint8_t *t_cache_scratch;   // decompressed value views
+static FOSSIL_CACHE_TLS size_t t_cache_scratch_cap;
 
 // ===========================================================
 // Internal Helpers
 // ===========================================================
 
 /**
- * Custom cacheshell_strdup implementation.
+ * Copies len bytes (which may include NULs) and appends a '\0'.
  */
-static char *cacheshell_strdup(const char *s) {
+static char *cacheshell_memdup(const char *s, size_t len) {
     if (!s) return NULL;
-    size_t len = strlen(s);
     char *copy = (char *)malloc(len + 1);
     if (copy) {
-        memcpy(copy, s, len + 1);
+        memcpy(copy, s, len);
+        copy[len] = '\0';
     }
     return copy;
 }
 
-// Enhanced hash: FNV-1a with architecture-aware final mixing (avalanche).
-// Keeps speed while improving distribution over classic djb2.
-static size_t fossil_cache_hash(const char *key) {
-#if SIZE_MAX > 0xFFFFFFFFu  // 64-bit size_t
-    uint64_t h = 1469598103934665603ull;          // FNV-1a 64-bit offset
-    while (*key) {
-        h ^= (uint8_t)*key++;
-        h *= 1099511628211ull;                   // FNV prime
+// Word-at-a-time key hash: folds 8 bytes per step with a multiply /
+// rotate mix (Murmur3 constants), packs the 0..7 byte tail into one last
+// word and finishes with the SplitMix64 avalanche. Loads are native
+// endian, so values differ between architectures (never persisted).
+static size_t fossil_cache_hash(const char *key, size_t len) {
+    const uint8_t *p = (const uint8_t *)key;
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ ((uint64_t)len * 0xc2b2ae3d27d4eb4full);
+
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t w;
+        memcpy(&w, p, sizeof(w));
+        h ^= w * 0x87c37b91114253d5ull;
+        h = ((h << 31) | (h >> 33)) * 0x4cf5ad432745937full;
     }
-    // Mix (inspired by SplitMix64 / Murmur finalizers)
-    h ^= h >> 32;
-    h *= 0x9e3779b97f4a7c15ull;
-    h ^= h >> 29;
+    uint64_t tail = 0;
+    for (size_t i = 0; i < len; ++i)
+        tail |= (uint64_t)p[i] << (8 * i);
+    h ^= tail * 0x87c37b91114253d5ull;
+
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 27;
     h *= 0x94d049bb133111ebull;
-    h ^= h >> 32;
-    return (size_t)h;
-#else // 32-bit size_t
-    uint32_t h = 2166136261u;                    // FNV-1a 32-bit offset
-    while (*key) {
-        h ^= (uint8_t)*key++;
-        h *= 16777619u;                          // FNV prime
-    }
-    // Final avalanche (MurMur / Jenkins style)
-    h ^= h >> 15;
-    h *= 0x85ebca6bu;
-    h ^= h >> 13;
-    h *= 0xc2b2ae35u;
-    h ^= h >> 16;
+    h ^= h >> 31;
+#if SIZE_MAX > 0xFFFFFFFFu
     return (size_t)h;
+#else
+    return (size_t)(h ^ (h >> 32));
 #endif
 }
 
+// True when the entry's key is exactly (key, len); hash and length are
+// checked before any bytes.
+static bool fossil_cache_key_eq(const fossil_cache_entry_t *entry, const char *key,
+                                size_t len, size_t hash) {
+    return entry->hash == hash && entry->key_len == len && memcmp(entry->key, key, len) == 0;
+}
+
+// Orders keys bytewise; a proper prefix sorts first.
+static int fossil_cache_key_cmp(const char *a, size_t a_len, const char *b, size_t b_len) {
+    int r = memcmp(a, b, a_len < b_len ? a_len : b_len);
+    if (r != 0)
+        return r;
+    return (a_len > b_len) - (a_len < b_len);
+}
+
 #if defined(_WIN32) || defined(_WIN64)
 static void fossil_cache_lock_init(void) {
     InitializeCriticalSection(&g_cache.lock);
@@ -262,6 +688,40 @@ static void fossil_cache_unlock(void) {
     if (g_cache.locking_enabled)
         LeaveCriticalSection(&g_cache.lock);
 }
+
+static INIT_ONCE g_cache_keys_once = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK fossil_cache_keys_lock_init(PINIT_ONCE once, PVOID param, PVOID *ctx) {
+    (void)once; (void)param; (void)ctx;
+    InitializeCriticalSection(&g_cache_keys.lock);
+    return TRUE;
+}
+
+static void fossil_cache_keys_lock(void) {
+    InitOnceExecuteOnce(&g_cache_keys_once, fossil_cache_keys_lock_init, NULL, NULL);
+    EnterCriticalSection(&g_cache_keys.lock);
+}
+
+static void fossil_cache_keys_unlock(void) {
+    LeaveCriticalSection(&g_cache_keys.lock);
+}
+
+static INIT_ONCE g_cache_lob_once = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK fossil_cache_lob_lock_init(PINIT_ONCE once, PVOID param, PVOID *ctx) {
+    (void)once; (void)param; (void)ctx;
+    InitializeCriticalSection(&g_cache_lob_pool.lock);
+    return TRUE;
+}
+
+static void fossil_cache_lob_lock(void) {
+    InitOnceExecuteOnce(&g_cache_lob_once, fossil_cache_lob_lock_init, NULL, NULL);
+    EnterCriticalSection(&g_cache_lob_pool.lock);
+}
+
+static void fossil_cache_lob_unlock(void) {
+    LeaveCriticalSection(&g_cache_lob_pool.lock);
+}
 #else
 static void fossil_cache_lock_init(void) {
     pthread_mutex_init(&g_cache.lock, NULL);
@@ -280,750 +740,3969 @@ static void fossil_cache_unlock(void) {
     if (g_cache.locking_enabled)
         pthread_mutex_unlock(&g_cache.lock);
 }
-#endif
 
-static void fossil_cache_free_entry(fossil_cache_entry_t *entry) {
-    if (!entry) return;
-    free(entry->key);
-    free(entry->data);
-    free(entry);
+static pthread_once_t g_cache_keys_once = PTHREAD_ONCE_INIT;
+
+static void fossil_cache_keys_lock_init(void) {
+    pthread_mutex_init(&g_cache_keys.lock, NULL);
 }
 
-static void fossil_cache_remove_internal(const char *key) {
-    if (!key || !g_cache.buckets)
-        return;
+static void fossil_cache_keys_lock(void) {
+    pthread_once(&g_cache_keys_once, fossil_cache_keys_lock_init);
+    pthread_mutex_lock(&g_cache_keys.lock);
+}
 
-    size_t index = fossil_cache_hash(key) % g_cache.bucket_count;
-    fossil_cache_entry_t *prev = NULL;
-    fossil_cache_entry_t *curr = g_cache.buckets[index];
+static void fossil_cache_keys_unlock(void) {
+    pthread_mutex_unlock(&g_cache_keys.lock);
+}
 
-    while (curr) {
-        if (strcmp(curr->key, key) == 0) {
-            if (prev)
-                prev->next = curr->next;
-            else
-                g_cache.buckets[index] = curr->next;
+static pthread_once_t g_cache_lob_once = PTHREAD_ONCE_INIT;
 
-            // Account for memory usage (best-effort).
-            size_t bytes = sizeof(*curr) + curr->size + strlen(curr->key) + 1;
-            if (g_cache.total_bytes >= bytes)
-                g_cache.total_bytes -= bytes;
-            else
-                g_cache.total_bytes = 0;
+static void fossil_cache_lob_lock_init(void) {
+    pthread_mutex_init(&g_cache_lob_pool.lock, NULL);
+}
 
-            fossil_cache_free_entry(curr);
-            if (g_cache.entry_count > 0)
-                g_cache.entry_count--;
-            return;
-        }
-        prev = curr;
-        curr = curr->next;
-    }
+static void fossil_cache_lob_lock(void) {
+    pthread_once(&g_cache_lob_once, fossil_cache_lob_lock_init);
+    pthread_mutex_lock(&g_cache_lob_pool.lock);
 }
 
-static fossil_cache_entry_t *fossil_cache_find(const char *key) {
-    if (!key || !g_cache.buckets)
-        return NULL;
+static void fossil_cache_lob_unlock(void) {
+    pthread_mutex_unlock(&g_cache_lob_pool.lock);
+}
+#endif
 
-    size_t index = fossil_cache_hash(key) % g_cache.bucket_count;
-    fossil_cache_entry_t *prev = NULL;
-    fossil_cache_entry_t *entry = g_cache.buckets[index];
-    time_t now = time(NULL);
+#if defined(_MSC_VER) && !defined(__clang__)
+static uint64_t fossil_cache_atomic_load(uint64_t *p) {
+    return (uint64_t)InterlockedCompareExchange64((volatile LONG64 *)p, 0, 0);
+}
 
-    while (entry) {
-        if (strcmp(entry->key, key) == 0) {
-            // Expired?
-            if (entry->expiry > 0 && entry->expiry <= now) {
-                fossil_cache_entry_t *expired = entry;
-                if (prev)
-                    prev->next = entry->next;
-                else
-                    g_cache.buckets[index] = entry->next;
-                entry = entry->next;
-                fossil_cache_free_entry(expired);
-                g_cache.entry_count--;
-                g_cache.misses++;
-                g_cache.expired_evictions++;
-                return NULL;
-            }
-            if (entry->created == 0)
-                entry->created = now;
-            entry->last_access = now;
-            g_cache.hits++;
-            return entry;
-        }
-        prev = entry;
-        entry = entry->next;
-    }
+static void fossil_cache_atomic_store(uint64_t *p, uint64_t v) {
+    InterlockedExchange64((volatile LONG64 *)p, (LONG64)v);
+}
 
-    g_cache.misses++;
-    return NULL;
+static void fossil_cache_atomic_add(uint64_t *p, uint64_t v) {
+    InterlockedExchangeAdd64((volatile LONG64 *)p, (LONG64)v);
+}
+#else
+static uint64_t fossil_cache_atomic_load(uint64_t *p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static void fossil_cache_atomic_store(uint64_t *p, uint64_t v) {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+static void fossil_cache_atomic_add(uint64_t *p, uint64_t v) {
+    __atomic_add_fetch(p, v, __ATOMIC_ACQ_REL);
 }
+#endif
 
 // ===========================================================
-// Initialization / Lifecycle
+// Collection Values (hash / list / set)
 // ===========================================================
 
-bool fossil_bluecrab_cacheshell_init(size_t max_entries) {
-    if (g_cache.buckets) // already initialized
-        return true;
-
-    memset(&g_cache, 0, sizeof(g_cache));
-    g_cache.bucket_count = 1024;          // fixed bucket count for now
-    g_cache.max_entries  = max_entries;
-    g_cache.start_time   = time(NULL);
-    g_cache.locking_enabled = false;      // opt-in
+#define FOSSIL_CACHE_NODE_TOMBSTONE ((fossil_cache_node_t *)(uintptr_t)1)
 
-    g_cache.buckets = (fossil_cache_entry_t **)calloc(
-        g_cache.bucket_count, sizeof(fossil_cache_entry_t *));
-    if (!g_cache.buckets)
-        return false;
+static size_t fossil_cache_coll_bytes(const fossil_cache_coll_t *c) {
+    return sizeof(*c) + c->cap + c->slot_count * sizeof(c->slots[0]) + c->node_bytes;
+}
 
-    fossil_cache_lock_init();
-    return true;
+static bool fossil_cache_node_live(const fossil_cache_node_t *n) {
+    return n && n != FOSSIL_CACHE_NODE_TOMBSTONE;
 }
 
-void fossil_bluecrab_cacheshell_shutdown(void) {
-    if (!g_cache.buckets)
+static void fossil_cache_coll_free(fossil_cache_coll_t *c) {
+    if (!c)
         return;
+    for (size_t i = 0; i < c->slot_count; ++i) {
+        if (fossil_cache_node_live(c->slots[i]))
+            free(c->slots[i]);
+    }
+    free(c->slots);
+    free(c->buf);
+    free(c);
+}
 
-    fossil_cache_lock();
-    for (size_t i = 0; i < g_cache.bucket_count; ++i) {
-        fossil_cache_entry_t *entry = g_cache.buckets[i];
-        while (entry) {
-            fossil_cache_entry_t *next = entry->next;
-            fossil_cache_free_entry(entry);
-            entry = next;
-        }
-        g_cache.buckets[i] = NULL;
+static fossil_cache_node_t *fossil_cache_node_new(size_t hash, const void *field, size_t field_len,
+                                                  const void *value, size_t value_len) {
+    fossil_cache_node_t *n = (fossil_cache_node_t *)malloc(sizeof(*n) + field_len + value_len);
+    if (!n)
+        return NULL;
+    n->hash = hash;
+    n->field_len = (uint32_t)field_len;
+    n->value_len = (uint32_t)value_len;
+    if (field_len)
+        memcpy(n->bytes, field, field_len);
+    if (value_len)
+        memcpy(n->bytes + field_len, value, value_len);
+    return n;
+}
+
+static size_t fossil_cache_node_size(const fossil_cache_node_t *n) {
+    return sizeof(*n) + n->field_len + n->value_len;
+}
+
+static size_t fossil_cache_field_hash(const void *field, size_t len) {
+    // FNV-1a over explicit length (fields are not stored NUL-terminated)
+    const unsigned char *p = (const unsigned char *)field;
+    uint64_t h = 1469598103934665603ull;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= p[i];
+        h *= 1099511628211ull;
     }
-    free(g_cache.buckets);
-    g_cache.buckets = NULL;
-    g_cache.entry_count = 0;
-    g_cache.hits = 0;
-    g_cache.misses = 0;
-    g_cache.total_bytes = 0;
-    g_cache.expired_evictions = 0;
-    g_cache.start_time = 0;
-    fossil_cache_unlock();
+    h ^= h >> 32;
+    return (size_t)h;
+}
 
-    fossil_cache_lock_destroy();
-    g_cache.locking_enabled = false;
+// --- packed encoding: [u32 len][bytes] records in one buffer ------------
+
+static uint32_t fossil_cache_packed_len(const fossil_cache_coll_t *c, size_t off) {
+    uint32_t n;
+    memcpy(&n, c->buf + off, sizeof(n));
+    return n;
 }
 
-// ===========================================================
-// Basic Key/Value Operations
-// ===========================================================
+static size_t fossil_cache_packed_next(const fossil_cache_coll_t *c, size_t off) {
+    return off + sizeof(uint32_t) + fossil_cache_packed_len(c, off);
+}
 
-bool fossil_bluecrab_cacheshell_set(const char *key, const char *value) {
-    if (!key || !value)
+static bool fossil_cache_packed_reserve(fossil_cache_coll_t *c, size_t extra) {
+    if (c->len + extra <= c->cap)
+        return true;
+    size_t cap = c->cap ? c->cap : 64;
+    while (cap < c->len + extra)
+        cap *= 2;
+    unsigned char *buf = (unsigned char *)realloc(c->buf, cap);
+    if (!buf)
         return false;
-    return fossil_bluecrab_cacheshell_set_binary(key, value, strlen(value) + 1);
+    c->buf = buf;
+    c->cap = cap;
+    return true;
 }
 
-char *fossil_bluecrab_cacheshell_get(const char *key, size_t buffer_size) {
-    if (!key || buffer_size == 0)
-        return NULL;
+// Inserts a record at `off`; space must already be reserved.
+static void fossil_cache_packed_insert(fossil_cache_coll_t *c, size_t off, const void *data, size_t len) {
+    uint32_t n = (uint32_t)len;
+    memmove(c->buf + off + sizeof(n) + len, c->buf + off, c->len - off);
+    memcpy(c->buf + off, &n, sizeof(n));
+    if (len)
+        memcpy(c->buf + off + sizeof(n), data, len);
+    c->len += sizeof(n) + len;
+}
 
-    fossil_cache_lock();
-    fossil_cache_entry_t *entry = fossil_cache_find(key);
-    if (!entry) {
-        fossil_cache_unlock();
-        return NULL;
-    }
+static void fossil_cache_packed_erase(fossil_cache_coll_t *c, size_t off) {
+    size_t rec = sizeof(uint32_t) + fossil_cache_packed_len(c, off);
+    memmove(c->buf + off, c->buf + off + rec, c->len - off - rec);
+    c->len -= rec;
+}
 
-    size_t data_size = entry->size; // may include '\0' (string path) or be binary
-    if (data_size == 0) {
-        fossil_cache_unlock();
-        return NULL;
+// Offset of the record equal to `field`, stepping over values when the
+// collection stores field/value pairs. Returns SIZE_MAX if absent.
+static size_t fossil_cache_packed_find(const fossil_cache_coll_t *c, const void *field,
+                                       size_t field_len, bool pairs) {
+    size_t off = 0;
+    while (off < c->len) {
+        if (fossil_cache_packed_len(c, off) == field_len &&
+            memcmp(c->buf + off + sizeof(uint32_t), field, field_len) == 0)
+            return off;
+        off = fossil_cache_packed_next(c, off);
+        if (pairs)
+            off = fossil_cache_packed_next(c, off);
     }
+    return SIZE_MAX;
+}
 
-    /* We always reserve one byte for a terminating '\0' to return a C-string.
-       Allocate at most buffer_size bytes, but ensure space for terminator. */
-    size_t alloc_size = data_size + 1;
-    if (alloc_size > buffer_size)
-        alloc_size = buffer_size;
-    if (alloc_size == 0) { // defensive (should not happen since buffer_size>0)
-        fossil_cache_unlock();
-        return NULL;
+// --- table encoding: open addressing over node pointers (hash / set) ----
+
+static fossil_cache_node_t **fossil_cache_table_find(fossil_cache_coll_t *c, const void *field,
+                                                     size_t field_len, size_t hash, bool for_insert) {
+    size_t mask = c->slot_count - 1;
+    fossil_cache_node_t **tomb = NULL;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        fossil_cache_node_t **slot = &c->slots[i];
+        if (!*slot)
+            return (for_insert && tomb) ? tomb : (for_insert ? slot : NULL);
+        if (*slot == FOSSIL_CACHE_NODE_TOMBSTONE) {
+            if (!tomb)
+                tomb = slot;
+        } else if ((*slot)->hash == hash && (*slot)->field_len == field_len &&
+                   memcmp((*slot)->bytes, field, field_len) == 0) {
+            return slot;
+        }
     }
+}
 
-    char *out = (char *)malloc(alloc_size);
-    if (!out) {
-        fossil_cache_unlock();
-        return NULL;
+static bool fossil_cache_table_resize(fossil_cache_coll_t *c, size_t slot_count) {
+    fossil_cache_node_t **slots = (fossil_cache_node_t **)calloc(slot_count, sizeof(*slots));
+    if (!slots)
+        return false;
+    for (size_t i = 0; i < c->slot_count; ++i) {
+        fossil_cache_node_t *n = c->slots[i];
+        if (!fossil_cache_node_live(n))
+            continue;
+        size_t j = n->hash & (slot_count - 1);
+        while (slots[j])
+            j = (j + 1) & (slot_count - 1);
+        slots[j] = n;
     }
+    free(c->slots);
+    c->slots = slots;
+    c->slot_count = slot_count;
+    c->used = c->count;
+    return true;
+}
 
-    size_t copy_len = data_size;
-    if (copy_len > alloc_size - 1)
-        copy_len = alloc_size - 1;
-
-    if (copy_len > 0)
-        memcpy(out, entry->data, copy_len);
-    out[copy_len] = '\0';
-
-    fossil_cache_unlock();
-    return out;
+// Keeps live + tombstone slots at or below 3/4 so probes always end.
+static bool fossil_cache_table_reserve(fossil_cache_coll_t *c) {
+    if ((c->used + 1) * 4 <= c->slot_count * 3)
+        return true;
+    size_t want = 16;
+    while (want * 3 < (c->count + 1) * 4 * 2)
+        want <<= 1;
+    return fossil_cache_table_resize(c, want);
 }
 
-bool fossil_bluecrab_cacheshell_remove(const char *key) {
-    if (!key)
+// Moves a packed hash/set into the table encoding.
+static bool fossil_cache_coll_to_table(fossil_cache_coll_t *c, bool pairs) {
+    fossil_cache_coll_t t;
+    memset(&t, 0, sizeof(t));
+    t.encoding = FOSSIL_CACHE_ENC_TABLE;
+    if (!fossil_cache_table_resize(&t, 16))
         return false;
-    fossil_cache_lock();
-    size_t before = g_cache.entry_count;
-    fossil_cache_remove_internal(key);
-    fossil_cache_unlock();
-    return (before != g_cache.entry_count);
+
+    for (size_t off = 0; off < c->len;) {
+        size_t field_len = fossil_cache_packed_len(c, off);
+        const unsigned char *field = c->buf + off + sizeof(uint32_t);
+        off = fossil_cache_packed_next(c, off);
+        size_t value_len = 0;
+        const unsigned char *value = NULL;
+        if (pairs) {
+            value_len = fossil_cache_packed_len(c, off);
+            value = c->buf + off + sizeof(uint32_t);
+            off = fossil_cache_packed_next(c, off);
+        }
+        size_t hash = fossil_cache_field_hash(field, field_len);
+        fossil_cache_node_t *n = fossil_cache_table_reserve(&t)
+            ? fossil_cache_node_new(hash, field, field_len, value, value_len) : NULL;
+        if (!n) {
+            for (size_t i = 0; i < t.slot_count; ++i) {
+                if (fossil_cache_node_live(t.slots[i]))
+                    free(t.slots[i]);
+            }
+            free(t.slots);
+            return false;
+        }
+        *fossil_cache_table_find(&t, field, field_len, hash, true) = n;
+        t.count++;
+        t.used++;
+        t.node_bytes += fossil_cache_node_size(n);
+    }
+
+    free(c->buf);
+    *c = t;
+    return true;
 }
 
-bool fossil_bluecrab_cacheshell_exists(const char *key) {
-    if (!key) return false;
+// --- deque encoding: ring buffer of node pointers (list) ----------------
 
-    fossil_cache_lock();
+static fossil_cache_node_t *fossil_cache_deque_at(const fossil_cache_coll_t *c, size_t i) {
+    return c->slots[(c->head + i) & (c->slot_count - 1)];
+}
 
-    if (!g_cache.buckets) {
-        fossil_cache_unlock();
+static bool fossil_cache_deque_grow(fossil_cache_coll_t *c) {
+    size_t slot_count = c->slot_count ? c->slot_count * 2 : 16;
+    fossil_cache_node_t **slots = (fossil_cache_node_t **)calloc(slot_count, sizeof(*slots));
+    if (!slots)
         return false;
-    }
+    for (size_t i = 0; i < c->count; ++i)
+        slots[i] = fossil_cache_deque_at(c, i);
+    free(c->slots);
+    c->slots = slots;
+    c->slot_count = slot_count;
+    c->head = 0;
+    return true;
+}
 
-    size_t index = fossil_cache_hash(key) % g_cache.bucket_count;
+// Moves a packed list into the deque encoding, preserving order.
+static bool fossil_cache_coll_to_deque(fossil_cache_coll_t *c) {
+    fossil_cache_coll_t d;
+    memset(&d, 0, sizeof(d));
+    d.encoding = FOSSIL_CACHE_ENC_DEQUE;
+    while (d.slot_count < c->count + 1) {
+        if (!fossil_cache_deque_grow(&d)) {
+            free(d.slots);
+            return false;
+        }
+    }
+    for (size_t off = 0; off < c->len; off = fossil_cache_packed_next(c, off)) {
+        fossil_cache_node_t *n = fossil_cache_node_new(0, NULL, 0, c->buf + off + sizeof(uint32_t),
+                                                       fossil_cache_packed_len(c, off));
+        if (!n) {
+            for (size_t i = 0; i < d.count; ++i)
+                free(d.slots[i]);
+            free(d.slots);
+            return false;
+        }
+        d.slots[d.count++] = n;
+        d.node_bytes += fossil_cache_node_size(n);
+    }
+
+    free(c->buf);
+    *c = d;
+    return true;
+}
+
+// --- operations ----------------------------------------------------------
+
+static bool fossil_cache_packed_fits(const fossil_cache_coll_t *c, size_t field_len, size_t value_len) {
+    return c->encoding == FOSSIL_CACHE_ENC_PACKED &&
+           c->count < FOSSIL_CACHE_PACKED_MAX_ITEMS &&
+           field_len <= FOSSIL_CACHE_PACKED_MAX_ITEM &&
+           value_len <= FOSSIL_CACHE_PACKED_MAX_ITEM;
+}
+
+// Inserts or replaces field (with value for hashes; value NULL for sets).
+static bool fossil_cache_coll_put(fossil_cache_coll_t *c, bool pairs, const char *field,
+                                  size_t field_len, const void *value, size_t value_len) {
+    if (field_len > UINT32_MAX || value_len > UINT32_MAX)
+        return false;
+
+    if (c->encoding == FOSSIL_CACHE_ENC_PACKED) {
+        size_t off = fossil_cache_packed_find(c, field, field_len, pairs);
+        if (off != SIZE_MAX && field_len <= FOSSIL_CACHE_PACKED_MAX_ITEM &&
+            value_len <= FOSSIL_CACHE_PACKED_MAX_ITEM) {
+            if (!pairs)
+                return true; // set member already present
+            if (!fossil_cache_packed_reserve(c, sizeof(uint32_t) + value_len))
+                return false;
+            size_t voff = fossil_cache_packed_next(c, off);
+            fossil_cache_packed_erase(c, voff);
+            fossil_cache_packed_insert(c, voff, value, value_len);
+            return true;
+        }
+        if (off == SIZE_MAX && fossil_cache_packed_fits(c, field_len, value_len)) {
+            size_t need = sizeof(uint32_t) + field_len + (pairs ? sizeof(uint32_t) + value_len : 0);
+            if (!fossil_cache_packed_reserve(c, need))
+                return false;
+            fossil_cache_packed_insert(c, c->len, field, field_len);
+            if (pairs)
+                fossil_cache_packed_insert(c, c->len, value, value_len);
+            c->count++;
+            return true;
+        }
+        if (!fossil_cache_coll_to_table(c, pairs))
+            return false;
+    }
+
+    size_t hash = fossil_cache_field_hash(field, field_len);
+    if (!fossil_cache_table_reserve(c))
+        return false;
+    fossil_cache_node_t **slot = fossil_cache_table_find(c, field, field_len, hash, true);
+    if (fossil_cache_node_live(*slot) && !pairs)
+        return true;
+
+    fossil_cache_node_t *n = fossil_cache_node_new(hash, field, field_len, value, pairs ? value_len : 0);
+    if (!n)
+        return false;
+    if (fossil_cache_node_live(*slot)) {
+        c->node_bytes -= fossil_cache_node_size(*slot);
+        free(*slot);
+    } else {
+        if (!*slot)
+            c->used++;
+        c->count++;
+    }
+    *slot = n;
+    c->node_bytes += fossil_cache_node_size(n);
+    return true;
+}
+
+// Finds field; for hashes *value/*value_len receive the stored value.
+static bool fossil_cache_coll_get(fossil_cache_coll_t *c, bool pairs, const char *field,
+                                  size_t field_len, const void **value, size_t *value_len) {
+    if (c->encoding == FOSSIL_CACHE_ENC_PACKED) {
+        size_t off = fossil_cache_packed_find(c, field, field_len, pairs);
+        if (off == SIZE_MAX)
+            return false;
+        if (pairs) {
+            size_t voff = fossil_cache_packed_next(c, off);
+            *value = c->buf + voff + sizeof(uint32_t);
+            *value_len = fossil_cache_packed_len(c, voff);
+        }
+        return true;
+    }
+
+    fossil_cache_node_t **slot = fossil_cache_table_find(
+        c, field, field_len, fossil_cache_field_hash(field, field_len), false);
+    if (!slot)
+        return false;
+    if (pairs) {
+        *value = (*slot)->bytes + (*slot)->field_len;
+        *value_len = (*slot)->value_len;
+    }
+    return true;
+}
+
+static bool fossil_cache_coll_del(fossil_cache_coll_t *c, bool pairs, const char *field,
+                                  size_t field_len) {
+    if (c->encoding == FOSSIL_CACHE_ENC_PACKED) {
+        size_t off = fossil_cache_packed_find(c, field, field_len, pairs);
+        if (off == SIZE_MAX)
+            return false;
+        if (pairs)
+            fossil_cache_packed_erase(c, fossil_cache_packed_next(c, off));
+        fossil_cache_packed_erase(c, off);
+        c->count--;
+        return true;
+    }
+
+    fossil_cache_node_t **slot = fossil_cache_table_find(
+        c, field, field_len, fossil_cache_field_hash(field, field_len), false);
+    if (!slot)
+        return false;
+    c->node_bytes -= fossil_cache_node_size(*slot);
+    free(*slot);
+    *slot = FOSSIL_CACHE_NODE_TOMBSTONE;
+    c->count--;
+    return true;
+}
+
+static bool fossil_cache_coll_push_front(fossil_cache_coll_t *c, const void *value, size_t value_len) {
+    if (value_len > UINT32_MAX)
+        return false;
+    if (fossil_cache_packed_fits(c, 0, value_len)) {
+        if (!fossil_cache_packed_reserve(c, sizeof(uint32_t) + value_len))
+            return false;
+        fossil_cache_packed_insert(c, 0, value, value_len);
+        c->count++;
+        return true;
+    }
+    if (c->encoding == FOSSIL_CACHE_ENC_PACKED && !fossil_cache_coll_to_deque(c))
+        return false;
+
+    if (c->count == c->slot_count && !fossil_cache_deque_grow(c))
+        return false;
+    fossil_cache_node_t *n = fossil_cache_node_new(0, NULL, 0, value, value_len);
+    if (!n)
+        return false;
+    c->head = (c->head + c->slot_count - 1) & (c->slot_count - 1);
+    c->slots[c->head] = n;
+    c->count++;
+    c->node_bytes += fossil_cache_node_size(n);
+    return true;
+}
+
+// Visits list elements start..stop (inclusive, negative = from the end).
+static size_t fossil_cache_coll_range(fossil_cache_coll_t *c, long start, long stop,
+                                      fossil_bluecrab_cache_value_cb cb, void *user_data) {
+    long count = (long)c->count;
+    if (start < 0)
+        start += count;
+    if (stop < 0)
+        stop += count;
+    if (start < 0)
+        start = 0;
+    if (stop >= count)
+        stop = count - 1;
+    if (start > stop)
+        return 0;
+
+    if (c->encoding == FOSSIL_CACHE_ENC_DEQUE) {
+        for (long i = start; i <= stop; ++i) {
+            const fossil_cache_node_t *n = fossil_cache_deque_at(c, (size_t)i);
+            cb(n->bytes, n->value_len, user_data);
+        }
+    } else {
+        size_t off = 0;
+        for (long i = 0; i <= stop; ++i, off = fossil_cache_packed_next(c, off)) {
+            if (i >= start)
+                cb(c->buf + off + sizeof(uint32_t), fossil_cache_packed_len(c, off), user_data);
+        }
+    }
+    return (size_t)(stop - start + 1);
+}
+
+// ===========================================================
+// Large-Object Store
+// ===========================================================
+//
+// Values at or above lob_min get page-aligned blocks carved from a few
+// pooled anonymous mappings (FOSSIL_CACHE_LOB_REGION each, or one sized to
+// the value if it is larger) instead of heap blocks, so multi-megabyte
+// values neither fragment the malloc heap nor linger in it after removal,
+// and the process keeps a handful of mappings however many values it
+// holds. Freeing a block hands its pages straight back to the OS but
+// leaves the region mapped, so a stale get_binary pointer reads zeros or a
+// newer value rather than faulting; regions are unmapped at shutdown once
+// empty. Blocks sit on their own LRU list and are evicted oldest first to
+// stay within lob_budget.
+
+static size_t fossil_cache_page_size(void) {
+#if defined(_WIN32) || defined(_WIN64)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (size_t)info.dwPageSize;
+#else
+    long page = sysconf(_SC_PAGESIZE);
+    return page > 0 ? (size_t)page : 4096;
+#endif
+}
+
+// Bytes of region held for a value of the given size.
+static size_t fossil_cache_lob_block_len(size_t size) {
+    size_t page = fossil_cache_page_size();
+    size_t need = FOSSIL_CACHE_LOB_HEADER + size;
+    if (need < size || need > SIZE_MAX - page)
+        return 0; // overflow
+    return (need + page - 1) / page * page;
+}
+
+#if defined(_WIN32) || defined(_WIN64)
+// Regions are reserved whole and committed block by block.
+static uint8_t *fossil_cache_lob_map_region(size_t len) {
+    return (uint8_t *)VirtualAlloc(NULL, len, MEM_RESERVE, PAGE_NOACCESS);
+}
+
+static void fossil_cache_lob_unmap_region(uint8_t *base, size_t len) {
+    (void)len;
+    VirtualFree(base, 0, MEM_RELEASE);
+}
+
+static bool fossil_cache_lob_commit(uint8_t *block, size_t len) {
+    return VirtualAlloc(block, len, MEM_COMMIT, PAGE_READWRITE) != NULL;
+}
+
+static void fossil_cache_lob_discard(uint8_t *block, size_t len) {
+    VirtualAlloc(block, len, MEM_RESET, PAGE_READWRITE); // stays readable
+}
+#else
+static uint8_t *fossil_cache_lob_map_region(size_t len) {
+    void *base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return base == MAP_FAILED ? NULL : (uint8_t *)base;
+}
+
+static void fossil_cache_lob_unmap_region(uint8_t *base, size_t len) {
+    munmap(base, len);
+}
+
+static bool fossil_cache_lob_commit(uint8_t *block, size_t len) {
+    (void)block; (void)len;
+    return true; // anonymous pages are committed on first touch
+}
+
+static void fossil_cache_lob_discard(uint8_t *block, size_t len) {
+#if defined(MADV_DONTNEED)
+    madvise(block, len, MADV_DONTNEED); // pages read back as zeros
+#else
+    (void)block; (void)len;
+#endif
+}
+#endif
+
+// Takes len bytes from a free run or above top; NULL if the region is
+// too full. Caller holds the pool lock.
+static uint8_t *fossil_cache_lob_region_take(fossil_cache_lob_region_t *r, size_t len) {
+    for (size_t i = 0; i < r->free_count; ++i) {
+        fossil_cache_lob_extent_t *x = &r->free[i];
+        if (x->len < len)
+            continue;
+        uint8_t *block = r->base + x->off;
+        x->off += len;
+        x->len -= len;
+        if (x->len == 0) {
+            memmove(x, x + 1, (r->free_count - i - 1) * sizeof(*x));
+            r->free_count--;
+        }
+        return block;
+    }
+    if (r->len - r->top < len)
+        return NULL;
+    uint8_t *block = r->base + r->top;
+    r->top += len;
+    return block;
+}
+
+// Returns a run to its region, merging it with free neighbours. Caller
+// holds the pool lock.
+static void fossil_cache_lob_region_give(fossil_cache_lob_region_t *r, size_t off, size_t len) {
+    if (--r->live == 0) { // empty: start over from the bottom
+        r->top = 0;
+        r->free_count = 0;
+        return;
+    }
+    if (off + len == r->top) {
+        r->top = off;
+        if (r->free_count && r->free[r->free_count - 1].off + r->free[r->free_count - 1].len == r->top)
+            r->top = r->free[--r->free_count].off;
+        return;
+    }
+
+    size_t i = 0;
+    while (i < r->free_count && r->free[i].off < off)
+        ++i;
+    bool join_prev = i > 0 && r->free[i - 1].off + r->free[i - 1].len == off;
+    bool join_next = i < r->free_count && off + len == r->free[i].off;
+    if (join_prev && join_next) {
+        r->free[i - 1].len += len + r->free[i].len;
+        memmove(&r->free[i], &r->free[i + 1], (r->free_count - i - 1) * sizeof(r->free[0]));
+        r->free_count--;
+    } else if (join_prev) {
+        r->free[i - 1].len += len;
+    } else if (join_next) {
+        r->free[i].off = off;
+        r->free[i].len += len;
+    } else {
+        if (r->free_count == r->free_cap) {
+            size_t cap = r->free_cap ? r->free_cap * 2 : 16;
+            fossil_cache_lob_extent_t *grown = (fossil_cache_lob_extent_t *)realloc(
+                r->free, cap * sizeof(*grown));
+            if (!grown)
+                return; // run stays unusable until the region empties
+            r->free = grown;
+            r->free_cap = cap;
+        }
+        memmove(&r->free[i + 1], &r->free[i], (r->free_count - i) * sizeof(r->free[0]));
+        r->free[i].off = off;
+        r->free[i].len = len;
+        r->free_count++;
+    }
+}
+
+// Carves room for size value bytes from the pool, mapping a new region
+// only when none has space, and returns the value pointer.
+static void *fossil_cache_lob_alloc(size_t size) {
+    size_t len = fossil_cache_lob_block_len(size);
+    if (len == 0)
+        return NULL;
+
+    fossil_cache_lob_lock();
+    fossil_cache_lob_region_t *r;
+    uint8_t *block = NULL;
+    for (r = g_cache_lob_pool.regions; r; r = r->next) {
+        if ((block = fossil_cache_lob_region_take(r, len)) != NULL)
+            break;
+    }
+    if (!block) {
+        size_t region_len = len > FOSSIL_CACHE_LOB_REGION ? len : FOSSIL_CACHE_LOB_REGION;
+        r = (fossil_cache_lob_region_t *)calloc(1, sizeof(*r));
+        if (r && (r->base = fossil_cache_lob_map_region(region_len)) != NULL) {
+            r->len = region_len;
+            r->next = g_cache_lob_pool.regions;
+            g_cache_lob_pool.regions = r;
+            block = fossil_cache_lob_region_take(r, len);
+        } else {
+            free(r);
+        }
+    }
+    if (block) {
+        r->live++;
+        if (!fossil_cache_lob_commit(block, len)) {
+            fossil_cache_lob_region_give(r, (size_t)(block - r->base), len);
+            block = NULL;
+        }
+    }
+    fossil_cache_lob_unlock();
+    if (!block)
+        return NULL;
+
+    fossil_cache_lob_t *lob = (fossil_cache_lob_t *)block;
+    memset(lob, 0, sizeof(*lob));
+    lob->block_len = len;
+    lob->region = r;
+    return block + FOSSIL_CACHE_LOB_HEADER;
+}
+
+static fossil_cache_lob_t *fossil_cache_lob_of(const fossil_cache_entry_t *entry) {
+    return (fossil_cache_lob_t *)((uint8_t *)entry->data - FOSSIL_CACHE_LOB_HEADER);
+}
+
+// Returns a block's pages to the OS and its run to the region.
+static void fossil_cache_lob_free(void *data) {
+    fossil_cache_lob_t *lob = (fossil_cache_lob_t *)((uint8_t *)data - FOSSIL_CACHE_LOB_HEADER);
+    fossil_cache_lob_region_t *r = lob->region;
+    size_t off = (size_t)((uint8_t *)lob - r->base);
+    size_t len = lob->block_len;
+    fossil_cache_lob_discard((uint8_t *)lob, len);
+    fossil_cache_lob_lock();
+    fossil_cache_lob_region_give(r, off, len);
+    fossil_cache_lob_unlock();
+}
+
+// Unmaps regions with no live blocks (pins may still hold some).
+static void fossil_cache_lob_trim(void) {
+    fossil_cache_lob_lock();
+    fossil_cache_lob_region_t **link = &g_cache_lob_pool.regions;
+    while (*link) {
+        fossil_cache_lob_region_t *r = *link;
+        if (r->live) {
+            link = &r->next;
+            continue;
+        }
+        *link = r->next;
+        fossil_cache_lob_unmap_region(r->base, r->len);
+        free(r->free);
+        free(r);
+    }
+    fossil_cache_lob_unlock();
+}
+
+// Releases a block returned by fossil_cache_value_encode.
+static void fossil_cache_value_release(void *data, unsigned int flags) {
+    if (flags & FOSSIL_CACHE_ENTRY_LOB)
+        fossil_cache_lob_free(data);
+    else
+        free(data);
+}
+
+static void fossil_cache_lob_unlink(fossil_cache_lob_t *lob) {
+    if (lob->prev)
+        lob->prev->next = lob->next;
+    else
+        g_cache.lob_head = lob->next;
+    if (lob->next)
+        lob->next->prev = lob->prev;
+    else
+        g_cache.lob_tail = lob->prev;
+    lob->prev = lob->next = NULL;
+}
+
+static void fossil_cache_lob_push_front(fossil_cache_lob_t *lob) {
+    lob->prev = NULL;
+    lob->next = g_cache.lob_head;
+    if (g_cache.lob_head)
+        g_cache.lob_head->prev = lob;
+    else
+        g_cache.lob_tail = lob;
+    g_cache.lob_head = lob;
+}
+
+// Marks a large object as most recently used.
+static void fossil_cache_lob_touch(const fossil_cache_entry_t *entry) {
+    fossil_cache_lob_t *lob = fossil_cache_lob_of(entry);
+    if (g_cache.lob_head != lob) {
+        fossil_cache_lob_unlink(lob);
+        fossil_cache_lob_push_front(lob);
+    }
+}
+
+// False when a freshly mapped value alone exceeds the budget.
+static bool fossil_cache_lob_fits(void *data, unsigned int storage) {
+    if (!(storage & FOSSIL_CACHE_ENTRY_LOB) || g_cache.lob_budget == 0)
+        return true;
+    const fossil_cache_lob_t *lob = (const fossil_cache_lob_t *)((uint8_t *)data - FOSSIL_CACHE_LOB_HEADER);
+    return lob->block_len <= g_cache.lob_budget;
+}
+
+// Takes a large object off the LRU list and the budget before it is freed.
+static void fossil_cache_lob_forget(fossil_cache_entry_t *entry) {
+    if (!(entry->flags & FOSSIL_CACHE_ENTRY_LOB))
+        return;
+    fossil_cache_lob_t *lob = fossil_cache_lob_of(entry);
+    fossil_cache_lob_unlink(lob);
+    g_cache.lob_bytes -= lob->block_len;
+    g_cache.lob_count--;
+}
+
+// Hands a pinned entry's value over to its pin before the entry frees or
+// replaces it.
+static void fossil_cache_pin_detach(fossil_cache_entry_t *entry) {
+    fossil_bluecrab_cache_pin_t *pin = entry->pin;
+    if (!pin->owned) { // zero-copy pin: it takes the block itself
+        pin->owned = entry->data;
+        pin->owned_flags = entry->flags & FOSSIL_CACHE_ENTRY_LOB;
+        entry->data = NULL;
+    }
+    pin->entry = NULL;
+    entry->pin = NULL;
+}
+
+static void fossil_cache_free_value(fossil_cache_entry_t *entry) {
+    if (entry->pin)
+        fossil_cache_pin_detach(entry);
+    if (!entry->data)
+        return;
+    if (entry->type == FOSSIL_CACHE_TYPE_RAW)
+        fossil_cache_value_release(entry->data, entry->flags);
+    else
+        fossil_cache_coll_free((fossil_cache_coll_t *)entry->data);
+    entry->data = NULL;
+}
+
+static void fossil_cache_free_entry(fossil_cache_entry_t *entry) {
+    if (!entry) return;
+    free(entry->key);
+    fossil_cache_free_value(entry);
+    free(entry);
+}
+
+// Bytes charged to total_bytes for one entry.
+static size_t fossil_cache_entry_bytes(const fossil_cache_entry_t *entry) {
+    return sizeof(*entry) + entry->size + entry->key_len + 1;
+}
+
+// ===========================================================
+// Value Compression (LZ)
+// ===========================================================
+//
+// Byte-oriented LZ77 in the LZ4 block layout: each sequence is a token
+// (literal length << 4 | match length - 4), extra length bytes when a
+// nibble saturates at 15, the literals, then a 2-byte little-endian match
+// offset. The last sequence carries literals only.
+
+#define FOSSIL_CACHE_LZ_HASH_BITS  12
+#define FOSSIL_CACHE_LZ_MIN_MATCH  4
+#define FOSSIL_CACHE_LZ_MAX_OFFSET 65535u
+#define FOSSIL_CACHE_LZ_TAIL       12   // trailing bytes never searched for matches
+#define FOSSIL_CACHE_LZ_BAD        ((size_t)-1)
+
+static uint8_t *fossil_cache_lz_put_len(uint8_t *op, const uint8_t *oend, size_t len) {
+    for (; len >= 255; len -= 255) {
+        if (op >= oend)
+            return NULL;
+        *op++ = 255;
+    }
+    if (op >= oend)
+        return NULL;
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+// Emits literals [lit, lit + lit_len) followed by a match unless
+// match_len == 0. NULL when the output would pass oend.
+static uint8_t *fossil_cache_lz_emit(uint8_t *op, const uint8_t *oend, const uint8_t *lit,
+                                     size_t lit_len, size_t offset, size_t match_len) {
+    if (op >= oend)
+        return NULL;
+    uint8_t *token = op++;
+    size_t ml = match_len ? match_len - FOSSIL_CACHE_LZ_MIN_MATCH : 0;
+    *token = (uint8_t)(((lit_len < 15 ? lit_len : 15) << 4) | (ml < 15 ? ml : 15));
+    if (lit_len >= 15 && !(op = fossil_cache_lz_put_len(op, oend, lit_len - 15)))
+        return NULL;
+    if ((size_t)(oend - op) < lit_len)
+        return NULL;
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+    if (match_len == 0)
+        return op;
+    if (oend - op < 2)
+        return NULL;
+    *op++ = (uint8_t)(offset & 0xff);
+    *op++ = (uint8_t)(offset >> 8);
+    if (ml >= 15 && !(op = fossil_cache_lz_put_len(op, oend, ml - 15)))
+        return NULL;
+    return op;
+}
+
+// Compresses src into dst. Returns the compressed size, or 0 if it would
+// not fit in cap bytes (the caller then stores the value as-is).
+static size_t fossil_cache_lz_encode(const uint8_t *src, size_t n, uint8_t *dst, size_t cap) {
+    uint32_t table[1u << FOSSIL_CACHE_LZ_HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    const uint8_t *ip = src;
+    const uint8_t *anchor = src;
+    const uint8_t *end = src + n;
+    const uint8_t *limit = n > FOSSIL_CACHE_LZ_TAIL ? end - FOSSIL_CACHE_LZ_TAIL : src;
+    uint8_t *op = dst;
+    const uint8_t *oend = dst + cap;
+
+    while (ip < limit) {
+        uint32_t seq, ref_seq;
+        memcpy(&seq, ip, sizeof(seq));
+        uint32_t h = (seq * 2654435761u) >> (32 - FOSSIL_CACHE_LZ_HASH_BITS);
+        const uint8_t *ref = src + table[h];
+        table[h] = (uint32_t)(ip - src);
+        memcpy(&ref_seq, ref, sizeof(ref_seq));
+
+        if (ref >= ip || (size_t)(ip - ref) > FOSSIL_CACHE_LZ_MAX_OFFSET || ref_seq != seq) {
+            // Skip faster through data that keeps missing, never past limit
+            size_t step = 1 + ((size_t)(ip - anchor) >> 6);
+            ip = step < (size_t)(limit - ip) ? ip + step : limit;
+            continue;
+        }
+
+        size_t len = FOSSIL_CACHE_LZ_MIN_MATCH;
+        while (ip + len < end && ip[len] == ref[len])
+            len++;
+        op = fossil_cache_lz_emit(op, oend, anchor, (size_t)(ip - anchor), (size_t)(ip - ref), len);
+        if (!op)
+            return 0;
+        ip += len;
+        anchor = ip;
+    }
+
+    op = fossil_cache_lz_emit(op, oend, anchor, (size_t)(end - anchor), 0, 0);
+    return op ? (size_t)(op - dst) : 0;
+}
+
+static bool fossil_cache_lz_get_len(const uint8_t **ip, const uint8_t *iend, size_t *len) {
+    uint8_t b;
+    do {
+        if (*ip >= iend)
+            return false;
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return true;
+}
+
+// Decompresses src into dst, stopping once cap bytes are written, so a
+// short buffer receives a prefix of the value. Returns bytes written or
+// FOSSIL_CACHE_LZ_BAD for malformed input.
+static size_t fossil_cache_lz_decode(const uint8_t *src, size_t n, uint8_t *dst, size_t cap) {
+    const uint8_t *ip = src;
+    const uint8_t *iend = src + n;
+    uint8_t *op = dst;
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+        size_t len = token >> 4;
+        if (len == 15 && !fossil_cache_lz_get_len(&ip, iend, &len))
+            return FOSSIL_CACHE_LZ_BAD;
+        if ((size_t)(iend - ip) < len)
+            return FOSSIL_CACHE_LZ_BAD;
+        size_t room = cap - (size_t)(op - dst);
+        if (len >= room) {
+            memcpy(op, ip, room);
+            return cap;
+        }
+        memcpy(op, ip, len);
+        op += len;
+        ip += len;
+        if (ip == iend)
+            break;
+
+        if (iend - ip < 2)
+            return FOSSIL_CACHE_LZ_BAD;
+        size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - dst))
+            return FOSSIL_CACHE_LZ_BAD;
+        len = token & 15;
+        if (len == 15 && !fossil_cache_lz_get_len(&ip, iend, &len))
+            return FOSSIL_CACHE_LZ_BAD;
+        len += FOSSIL_CACHE_LZ_MIN_MATCH;
+
+        room = cap - (size_t)(op - dst);
+        if (len > room)
+            len = room;
+        const uint8_t *ref = op - offset;
+        if (offset >= len) {
+            memcpy(op, ref, len);
+        } else {
+            for (size_t i = 0; i < len; ++i) // overlapping run
+                op[i] = ref[i];
+        }
+        op += len;
+        if ((size_t)(op - dst) == cap)
+            return cap;
+    }
+    return (size_t)(op - dst);
+}
+
+// Bytes a reader sees for a raw entry.
+static size_t fossil_cache_value_size(const fossil_cache_entry_t *entry) {
+    return (entry->flags & FOSSIL_CACHE_ENTRY_LZ) ? entry->raw_size : entry->size;
+}
+
+// Copies up to cap leading bytes of a raw entry's value into dst.
+static size_t fossil_cache_value_copy(const fossil_cache_entry_t *entry, void *dst, size_t cap) {
+    if (!(entry->flags & FOSSIL_CACHE_ENTRY_LZ)) {
+        size_t n = entry->size < cap ? entry->size : cap;
+        memcpy(dst, entry->data, n);
+        return n;
+    }
+    if (cap > entry->raw_size)
+        cap = entry->raw_size;
+    size_t n = fossil_cache_lz_decode((const uint8_t *)entry->data, entry->size, (uint8_t *)dst, cap);
+    return n == FOSSIL_CACHE_LZ_BAD ? 0 : n;
+}
+
+#if defined(_WIN32) || defined(_WIN64)
+static void fossil_cache_scratch_track(void *buf) { (void)buf; }
+#else
+// Frees each thread's scratch buffer when the thread exits.
+static pthread_once_t g_cache_scratch_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_cache_scratch_key;
+
+static void fossil_cache_scratch_key_init(void) {
+    pthread_key_create(&g_cache_scratch_key, free);
+}
+
+static void fossil_cache_scratch_track(void *buf) {
+    pthread_once(&g_cache_scratch_once, fossil_cache_scratch_key_init);
+    pthread_setspecific(g_cache_scratch_key, buf);
+}
+#endif
+
+// Readable bytes of a raw entry: the stored buffer, or the value
+// decompressed into this thread's scratch buffer, which stays valid until
+// the thread decompresses another value. NULL if the scratch cannot grow.
+static const void *fossil_cache_value_view(const fossil_cache_entry_t *entry) {
+    if (!(entry->flags & FOSSIL_CACHE_ENTRY_LZ))
+        return entry->data;
+    if (t_cache_scratch_cap < entry->raw_size) {
+        uint8_t *grown = (uint8_t *)realloc(t_cache_scratch, entry->raw_size);
+        if (!grown)
+            return NULL;
+        t_cache_scratch = grown;
+        t_cache_scratch_cap = entry->raw_size;
+        fossil_cache_scratch_track(grown);
+    }
+    fossil_cache_value_copy(entry, t_cache_scratch, entry->raw_size);
+    return t_cache_scratch;
+}
+
+// Builds the stored form of a value before the lock is taken. It is
+// compressed when compression is enabled, the value is at least
+// compress_min bytes and the result saves at least an eighth, then placed
+// in a large-object mapping if it is still at least lob_min bytes (heap
+// otherwise). With terminate the stored value is data plus a '\0', added
+// while copying. out_flags receives the FOSSIL_CACHE_ENTRY_LZ / _LOB bits.
+static void *fossil_cache_value_encode(const void *data, size_t size, bool terminate,
+                                       size_t *out_stored, unsigned int *out_flags) {
+    uint64_t min_size = fossil_cache_atomic_load(&g_cache.compress_min);
+    uint64_t lob_min = fossil_cache_atomic_load(&g_cache.lob_min);
+    uint8_t *packed = NULL;
+    if (terminate && size == SIZE_MAX)
+        return NULL;
+    size_t total = size + (terminate ? 1 : 0);
+    *out_stored = total;
+    *out_flags = 0;
+
+    if (min_size > 0 && total >= min_size && (uint64_t)total <= UINT32_MAX) {
+        // The encoder needs the whole value in one buffer
+        uint8_t *joined = terminate ? (uint8_t *)malloc(total) : NULL;
+        if (joined) {
+            memcpy(joined, data, size);
+            joined[size] = '\0';
+        }
+        const uint8_t *in = terminate ? joined : (const uint8_t *)data;
+        size_t cap = total - total / 8;
+        packed = in ? (uint8_t *)malloc(cap) : NULL;
+        size_t n = packed ? fossil_cache_lz_encode(in, total, packed, cap) : 0;
+        free(joined);
+        if (n > 0) {
+            *out_stored = n;
+            *out_flags = FOSSIL_CACHE_ENTRY_LZ;
+        } else {
+            free(packed);
+            packed = NULL;
+        }
+    }
+
+    if (lob_min > 0 && *out_stored >= lob_min) {
+        void *mapped = fossil_cache_lob_alloc(*out_stored);
+        if (mapped) { // otherwise fall back to the heap
+            if (packed) {
+                memcpy(mapped, packed, *out_stored);
+            } else {
+                memcpy(mapped, data, size);
+                if (terminate)
+                    ((uint8_t *)mapped)[size] = '\0';
+            }
+            free(packed);
+            *out_flags |= FOSSIL_CACHE_ENTRY_LOB;
+            return mapped;
+        }
+    }
+
+    if (packed) {
+        void *fit = realloc(packed, *out_stored);
+        return fit ? fit : packed;
+    }
+    uint8_t *blk = (uint8_t *)malloc(total);
+    if (blk) {
+        memcpy(blk, data, size);
+        if (terminate)
+            blk[size] = '\0';
+    }
+    return blk;
+}
+
+// Adds or removes a compressed entry's share of the compression counters.
+static void fossil_cache_lz_account(const fossil_cache_entry_t *entry, bool add) {
+    if (!(entry->flags & FOSSIL_CACHE_ENTRY_LZ))
+        return;
+    if (add) {
+        g_cache.lz_entries++;
+        g_cache.lz_logical_bytes += entry->raw_size;
+        g_cache.lz_stored_bytes += entry->size;
+    } else {
+        g_cache.lz_entries--;
+        g_cache.lz_logical_bytes -= entry->raw_size;
+        g_cache.lz_stored_bytes -= entry->size;
+    }
+}
+
+// ===========================================================
+// Ordered Key Index (skip list)
+// ===========================================================
+
+static int fossil_cache_index_random_level(void) {
+    // xorshift64; two bits per level gives p = 1/4
+    uint64_t x = g_cache.index_rng;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    g_cache.index_rng = x;
+
+    int level = 1;
+    while (level < FOSSIL_CACHE_INDEX_MAX_LEVEL && (x & 3) == 0) {
+        level++;
+        x >>= 2;
+    }
+    return level;
+}
+
+static fossil_cache_index_node_t *fossil_cache_index_node_new(fossil_cache_entry_t *entry, int level) {
+    fossil_cache_index_node_t *node = (fossil_cache_index_node_t *)calloc(
+        1, sizeof(*node) + (size_t)level * sizeof(node->next[0]));
+    if (!node)
+        return NULL;
+    node->entry = entry;
+    node->level = level;
+    return node;
+}
+
+// Fills update[] with the rightmost node before `key` on every level and
+// returns the first node whose key is >= `key` (or NULL).
+static fossil_cache_index_node_t *fossil_cache_index_seek(
+        const char *key, size_t key_len, fossil_cache_index_node_t **update) {
+    fossil_cache_index_node_t *x = g_cache.index_head;
+    for (int i = g_cache.index_level - 1; i >= 0; --i) {
+        while (x->next[i] && fossil_cache_key_cmp(x->next[i]->entry->key, x->next[i]->entry->key_len,
+                                                  key, key_len) < 0)
+            x = x->next[i];
+        if (update)
+            update[i] = x;
+    }
+    return x->next[0];
+}
+
+static bool fossil_cache_index_insert(fossil_cache_entry_t *entry) {
+    if (!g_cache.index_head)
+        return true;
+
+    fossil_cache_index_node_t *update[FOSSIL_CACHE_INDEX_MAX_LEVEL];
+    fossil_cache_index_seek(entry->key, entry->key_len, update);
+
+    int level = fossil_cache_index_random_level();
+    fossil_cache_index_node_t *node = fossil_cache_index_node_new(entry, level);
+    if (!node)
+        return false;
+
+    if (level > g_cache.index_level) {
+        for (int i = g_cache.index_level; i < level; ++i)
+            update[i] = g_cache.index_head;
+        g_cache.index_level = level;
+    }
+    for (int i = 0; i < level; ++i) {
+        node->next[i] = update[i]->next[i];
+        update[i]->next[i] = node;
+    }
+    return true;
+}
+
+static void fossil_cache_index_remove(const fossil_cache_entry_t *entry) {
+    if (!g_cache.index_head)
+        return;
+
+    fossil_cache_index_node_t *update[FOSSIL_CACHE_INDEX_MAX_LEVEL];
+    fossil_cache_index_node_t *node = fossil_cache_index_seek(entry->key, entry->key_len, update);
+    if (!node || node->entry != entry)
+        return;
+
+    for (int i = 0; i < node->level; ++i) {
+        if (update[i]->next[i] == node)
+            update[i]->next[i] = node->next[i];
+    }
+    while (g_cache.index_level > 1 && !g_cache.index_head->next[g_cache.index_level - 1])
+        g_cache.index_level--;
+    free(node);
+}
+
+// Frees every index node; the head sentinel is kept when keep_head is set.
+static void fossil_cache_index_destroy_nodes(bool keep_head) {
+    fossil_cache_index_node_t *head = g_cache.index_head;
+    if (!head)
+        return;
+
+    fossil_cache_index_node_t *node = head->next[0];
+    while (node) {
+        fossil_cache_index_node_t *next = node->next[0];
+        free(node);
+        node = next;
+    }
+
+    if (keep_head) {
+        memset(head->next, 0, (size_t)FOSSIL_CACHE_INDEX_MAX_LEVEL * sizeof(head->next[0]));
+        g_cache.index_level = 1;
+    } else {
+        free(head);
+        g_cache.index_head = NULL;
+        g_cache.index_level = 0;
+    }
+}
+
+// ===========================================================
+// Near Cache (per-thread L1)
+// ===========================================================
+
+static uint64_t fossil_cache_l1_now_ms(void) {
+    struct timespec ts;
+    if (timespec_get(&ts, TIME_UTC) != TIME_UTC)
+        return 0;
+    return (uint64_t)ts.tv_sec * 1000u + (uint64_t)(ts.tv_nsec / 1000000);
+}
+
+static uint64_t *fossil_cache_l1_version(size_t hash) {
+    return &g_cache_l1.versions[hash & (FOSSIL_CACHE_L1_STRIPES - 1)];
+}
+
+static fossil_cache_l1_slot_t *fossil_cache_l1_slot(size_t hash) {
+    return &t_cache_l1.slots[(hash >> 10) & (FOSSIL_CACHE_L1_SLOTS - 1)];
+}
+
+// Invalidates every thread's copy of the entry. Called under the cache
+// lock by every path that changes an entry's data or expiry.
+static void fossil_cache_l1_invalidate(const fossil_cache_entry_t *entry) {
+    if (!fossil_cache_atomic_load(&g_cache_l1.enabled))
+        return;
+    fossil_cache_atomic_add(fossil_cache_l1_version(entry->hash), 1);
+}
+
+static void fossil_cache_l1_invalidate_all(void) {
+    fossil_cache_atomic_add(&g_cache_l1.epoch, 1);
+}
+
+static void fossil_cache_l1_count(bool hit) {
+    fossil_cache_l1_t *l1 = &t_cache_l1;
+    uint64_t gen = fossil_cache_atomic_load(&g_cache_l1.stats_gen);
+    if (l1->stats_gen != gen) {
+        l1->stats_gen = gen;
+        l1->hits = 0;
+        l1->misses = 0;
+    }
+    if (hit)
+        l1->hits++;
+    else
+        l1->misses++;
+    if (l1->hits + l1->misses >= FOSSIL_CACHE_L1_FLUSH) {
+        fossil_cache_atomic_add(&g_cache_l1.hits, l1->hits);
+        fossil_cache_atomic_add(&g_cache_l1.misses, l1->misses);
+        l1->hits = 0;
+        l1->misses = 0;
+    }
+}
+
+// Flushed counters plus whatever the calling thread has not flushed yet.
+static void fossil_cache_l1_totals(uint64_t *hits, uint64_t *misses) {
+    uint64_t gen = fossil_cache_atomic_load(&g_cache_l1.stats_gen);
+    *hits = fossil_cache_atomic_load(&g_cache_l1.hits);
+    *misses = fossil_cache_atomic_load(&g_cache_l1.misses);
+    if (t_cache_l1.stats_gen == gen) {
+        *hits += t_cache_l1.hits;
+        *misses += t_cache_l1.misses;
+    }
+}
+
+// Returns this thread's slot for `key` if it is still current, without
+// touching the cache lock. A slot is current when neither the global
+// epoch nor the key's version stripe moved since it was filled, the
+// entry has not expired and the staleness lease has not run out.
+static const fossil_cache_l1_slot_t *fossil_cache_l1_lookup(const char *key, size_t key_len, size_t hash) {
+    const fossil_cache_l1_slot_t *slot = fossil_cache_l1_slot(hash);
+    if (slot->size == 0 || slot->hash != hash)
+        return NULL;
+    if (slot->epoch != fossil_cache_atomic_load(&g_cache_l1.epoch))
+        return NULL;
+    if (slot->version != fossil_cache_atomic_load(fossil_cache_l1_version(hash)))
+        return NULL;
+    if (slot->key_len != key_len || memcmp(slot->key, key, key_len) != 0)
+        return NULL;
+    if (slot->expiry > 0 && slot->expiry <= time(NULL))
+        return NULL;
+
+    uint64_t lease = fossil_cache_atomic_load(&g_cache_l1.lease_ms);
+    if (lease > 0 && fossil_cache_l1_now_ms() - slot->filled_ms > lease)
+        return NULL;
+    return slot;
+}
+
+// Copies a small entry into this thread's slot. Must run under the cache
+// lock so the recorded versions match the data copied.
+static void fossil_cache_l1_fill(const fossil_cache_entry_t *entry, size_t hash) {
+    size_t key_len = entry->key_len;
+    size_t size = fossil_cache_value_size(entry);
+    if (key_len >= FOSSIL_CACHE_L1_MAX_KEY || size > FOSSIL_CACHE_L1_MAX_VALUE)
+        return;
+
+    fossil_cache_l1_slot_t *slot = fossil_cache_l1_slot(hash);
+    slot->hash = hash;
+    slot->epoch = fossil_cache_atomic_load(&g_cache_l1.epoch);
+    slot->version = fossil_cache_atomic_load(fossil_cache_l1_version(hash));
+    slot->filled_ms = fossil_cache_atomic_load(&g_cache_l1.lease_ms) ? fossil_cache_l1_now_ms() : 0;
+    slot->expiry = entry->expiry;
+    slot->size = size;
+    slot->key_len = key_len;
+    memcpy(slot->key, entry->key, key_len + 1);
+    fossil_cache_value_copy(entry, slot->data, size);
+}
+
+// ===========================================================
+// Hot / Big Key Tracking
+// ===========================================================
+
+// Report form of a key: at most 63 bytes, NUL-terminated.
+static size_t fossil_cache_stat_key(char *dst, const char *key, size_t len) {
+    if (len > FOSSIL_BLUECRAB_CACHE_KEY_STAT_LEN - 1)
+        len = FOSSIL_BLUECRAB_CACHE_KEY_STAT_LEN - 1;
+    memcpy(dst, key, len);
+    dst[len] = '\0';
+    return len;
+}
+
+// Space-Saving update: bump the key's counter, or take over the smallest
+// one and inherit its count as the error bound.
+static void fossil_cache_hot_record(const char *key, size_t key_len, uint64_t weight) {
+    size_t hash = fossil_cache_hash(key, key_len);
+    size_t cmp_len = key_len < FOSSIL_BLUECRAB_CACHE_KEY_STAT_LEN - 1
+                   ? key_len : FOSSIL_BLUECRAB_CACHE_KEY_STAT_LEN - 1;
+    fossil_cache_keys_lock();
+    fossil_cache_hot_slot_t *min = NULL;
+    for (size_t i = 0; i < g_cache_keys.hot_used; ++i) {
+        fossil_cache_hot_slot_t *slot = &g_cache_keys.hot[i];
+        if (slot->hash == hash && memcmp(slot->key, key, cmp_len) == 0 && slot->key[cmp_len] == '\0') {
+            slot->count += weight;
+            fossil_cache_keys_unlock();
+            return;
+        }
+        if (!min || slot->count < min->count)
+            min = slot;
+    }
+
+    fossil_cache_hot_slot_t *slot;
+    if (g_cache_keys.hot_used < FOSSIL_CACHE_HOT_SLOTS) {
+        slot = &g_cache_keys.hot[g_cache_keys.hot_used++];
+        slot->count = weight;
+        slot->error = 0;
+    } else {
+        slot = min;
+        slot->error = slot->count;
+        slot->count += weight;
+    }
+    slot->hash = hash;
+    fossil_cache_stat_key(slot->key, key, key_len);
+    fossil_cache_keys_unlock();
+}
+
+// Called on every read/write entry point; records roughly one access in
+// sample_rate, chosen at random so periodic access patterns do not alias.
+static void fossil_cache_hot_sample(const char *key, size_t key_len) {
+    uint64_t rate = fossil_cache_atomic_load(&g_cache_keys.sample_rate);
+    if (!rate)
+        return;
+    if (t_cache_sample_skip) {
+        t_cache_sample_skip--;
+        return;
+    }
+    if (rate > 1) {
+        uint32_t x = t_cache_sample_rng ? t_cache_sample_rng
+                                        : (uint32_t)(uintptr_t)&t_cache_sample_rng | 1u;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        t_cache_sample_rng = x;
+        t_cache_sample_skip = (uint32_t)(x % (2 * rate - 1)); // mean rate - 1
+    }
+    fossil_cache_hot_record(key, key_len, rate);
+}
+
+static void fossil_cache_big_update_threshold(void) {
+    size_t threshold = 0;
+    if (g_cache_keys.big_used == FOSSIL_CACHE_BIG_SLOTS) {
+        threshold = g_cache_keys.big[0].size;
+        for (size_t i = 1; i < g_cache_keys.big_used; ++i) {
+            if (g_cache_keys.big[i].size < threshold)
+                threshold = g_cache_keys.big[i].size;
+        }
+    }
+    fossil_cache_atomic_store(&g_cache_keys.big_threshold, (uint64_t)threshold);
+}
+
+// Unlists an entry that is about to be freed. Caller holds the cache lock.
+static void fossil_cache_big_forget(fossil_cache_entry_t *entry) {
+    if (!(entry->flags & FOSSIL_CACHE_ENTRY_BIG))
+        return;
+    entry->flags &= ~FOSSIL_CACHE_ENTRY_BIG;
+    fossil_cache_keys_lock();
+    for (size_t i = 0; i < g_cache_keys.big_used; ++i) {
+        if (g_cache_keys.big[i].entry == entry) {
+            g_cache_keys.big[i] = g_cache_keys.big[--g_cache_keys.big_used];
+            break;
+        }
+    }
+    fossil_cache_big_update_threshold();
+    fossil_cache_keys_unlock();
+}
+
+// Re-ranks an entry after its value size changed. Caller holds the cache
+// lock. Values below the current threshold skip the keys lock entirely.
+static void fossil_cache_big_note(fossil_cache_entry_t *entry) {
+    if (!fossil_cache_atomic_load(&g_cache_keys.sample_rate))
+        return;
+    uint64_t threshold = fossil_cache_atomic_load(&g_cache_keys.big_threshold);
+    if (!(entry->flags & FOSSIL_CACHE_ENTRY_BIG) && threshold > 0 && entry->size <= threshold)
+        return;
+
+    fossil_cache_keys_lock();
+    fossil_cache_big_slot_t *slot = NULL;
+    if (entry->flags & FOSSIL_CACHE_ENTRY_BIG) {
+        for (size_t i = 0; i < g_cache_keys.big_used && !slot; ++i) {
+            if (g_cache_keys.big[i].entry == entry)
+                slot = &g_cache_keys.big[i];
+        }
+    } else if (g_cache_keys.big_used < FOSSIL_CACHE_BIG_SLOTS) {
+        slot = &g_cache_keys.big[g_cache_keys.big_used++];
+    } else {
+        fossil_cache_big_slot_t *min = &g_cache_keys.big[0];
+        for (size_t i = 1; i < g_cache_keys.big_used; ++i) {
+            if (g_cache_keys.big[i].size < min->size)
+                min = &g_cache_keys.big[i];
+        }
+        if (entry->size > min->size) {
+            min->entry->flags &= ~FOSSIL_CACHE_ENTRY_BIG;
+            slot = min;
+        }
+    }
+
+    if (slot) {
+        slot->entry = entry;
+        slot->size = entry->size;
+        fossil_cache_stat_key(slot->key, entry->key, entry->key_len);
+        entry->flags |= FOSSIL_CACHE_ENTRY_BIG;
+        fossil_cache_big_update_threshold();
+    }
+    fossil_cache_keys_unlock();
+}
+
+// Empties the big-key list; entries are about to be freed wholesale.
+static void fossil_cache_big_reset(void) {
+    fossil_cache_keys_lock();
+    g_cache_keys.big_used = 0;
+    fossil_cache_big_update_threshold();
+    fossil_cache_keys_unlock();
+}
+
+// Releases an entry already unlinked from its bucket chain: memory
+// accounting, ordered index and the allocation itself.
+static void fossil_cache_drop_entry(fossil_cache_entry_t *entry) {
+    size_t bytes = fossil_cache_entry_bytes(entry);
+    if (g_cache.total_bytes >= bytes)
+        g_cache.total_bytes -= bytes;
+    else
+        g_cache.total_bytes = 0;
+
+    fossil_cache_lz_account(entry, false);
+    fossil_cache_lob_forget(entry);
+    fossil_cache_l1_invalidate(entry);
+    fossil_cache_big_forget(entry);
+    fossil_cache_index_remove(entry);
+    fossil_cache_free_entry(entry);
+    if (g_cache.entry_count > 0)
+        g_cache.entry_count--;
+}
+
+// Unlinks a known entry from its bucket chain and drops it.
+static void fossil_cache_unlink_entry(fossil_cache_entry_t *entry) {
+    size_t index = entry->hash % g_cache.bucket_count;
+    fossil_cache_entry_t **link = &g_cache.buckets[index];
+    while (*link && *link != entry)
+        link = &(*link)->next;
+    if (*link)
+        *link = entry->next;
+    fossil_cache_drop_entry(entry);
+}
+
+// Puts a freshly stored large object at the front of its LRU list, then
+// evicts the least recently used others until the budget holds again.
+static void fossil_cache_lob_admit(fossil_cache_entry_t *entry) {
+    if (!(entry->flags & FOSSIL_CACHE_ENTRY_LOB))
+        return;
+    fossil_cache_lob_t *lob = fossil_cache_lob_of(entry);
+    lob->entry = entry;
+    fossil_cache_lob_push_front(lob);
+    g_cache.lob_bytes += lob->block_len;
+    g_cache.lob_count++;
+
+    size_t budget = (size_t)g_cache.lob_budget;
+    while (budget && g_cache.lob_bytes > budget && g_cache.lob_tail != lob) {
+        fossil_cache_unlink_entry(g_cache.lob_tail->entry);
+        g_cache.lob_evictions++;
+    }
+}
+
+// Drops the entry for a key, if any; returns whether one was removed.
+static bool fossil_cache_remove_internal(const char *key, size_t key_len, size_t hash) {
+    if (!key || !g_cache.buckets)
+        return false;
+
+    size_t index = hash % g_cache.bucket_count;
+    fossil_cache_entry_t *prev = NULL;
+    fossil_cache_entry_t *curr = g_cache.buckets[index];
+
+    while (curr) {
+        if (fossil_cache_key_eq(curr, key, key_len, hash)) {
+            if (prev)
+                prev->next = curr->next;
+            else
+                g_cache.buckets[index] = curr->next;
+
+            fossil_cache_drop_entry(curr);
+            return true;
+        }
+        prev = curr;
+        curr = curr->next;
+    }
+    return false;
+}
+
+// Looks up a live entry, evicting it if expired. Reads pass count_stats to
+// record a hit/miss and refresh last_access; writers do not.
+static fossil_cache_entry_t *fossil_cache_find_hashed(const char *key, size_t key_len, size_t hash,
+                                                      bool count_stats) {
+    if (!key || !g_cache.buckets)
+        return NULL;
+
+    size_t index = hash % g_cache.bucket_count;
+    fossil_cache_entry_t *prev = NULL;
+    fossil_cache_entry_t *entry = g_cache.buckets[index];
+    time_t now = time(NULL);
+
+    while (entry) {
+        if (fossil_cache_key_eq(entry, key, key_len, hash)) {
+            // Expired?
+            if (entry->expiry > 0 && entry->expiry <= now) {
+                fossil_cache_entry_t *expired = entry;
+                if (prev)
+                    prev->next = entry->next;
+                else
+                    g_cache.buckets[index] = entry->next;
+                fossil_cache_drop_entry(expired);
+                if (count_stats)
+                    g_cache.misses++;
+                g_cache.expired_evictions++;
+                return NULL;
+            }
+            if (entry->created == 0)
+                entry->created = now;
+            if (count_stats) {
+                entry->last_access = now;
+                g_cache.hits++;
+            }
+            return entry;
+        }
+        prev = entry;
+        entry = entry->next;
+    }
+
+    if (count_stats)
+        g_cache.misses++;
+    return NULL;
+}
+
+// Read lookup for the raw-value getters; collections read as missing.
+static fossil_cache_entry_t *fossil_cache_find_raw(const char *key, size_t key_len, size_t hash) {
+    fossil_cache_entry_t *entry = fossil_cache_find_hashed(key, key_len, hash, true);
+    if (!entry || entry->type != FOSSIL_CACHE_TYPE_RAW)
+        return NULL;
+    if (entry->flags & FOSSIL_CACHE_ENTRY_LOB)
+        fossil_cache_lob_touch(entry);
+    return entry;
+}
+
+// Links a fully built entry into the index, its bucket and the accounting.
+// Caller holds the lock and has checked max_entries.
+static bool fossil_cache_insert_entry(fossil_cache_entry_t *entry, size_t hash) {
+    if (!fossil_cache_index_insert(entry))
+        return false;
+
+    size_t index = hash % g_cache.bucket_count;
+    entry->next = g_cache.buckets[index];
+    g_cache.buckets[index] = entry;
+    g_cache.entry_count++;
+    g_cache.total_bytes += fossil_cache_entry_bytes(entry);
+    fossil_cache_lz_account(entry, true);
+    fossil_cache_big_note(entry);
+    fossil_cache_lob_admit(entry);
+    return true;
+}
+
+// Builds the NUL-terminated copy returned by fossil_bluecrab_cacheshell_get,
+// truncated to buffer_size - 1 bytes.
+static char *fossil_cache_copy_string(const void *data, size_t data_size, size_t buffer_size) {
+    if (data_size == 0)
+        return NULL;
+
+    /* We always reserve one byte for a terminating '\0' to return a C-string.
+       Allocate at most buffer_size bytes, but ensure space for terminator. */
+    size_t alloc_size = data_size + 1;
+    if (alloc_size > buffer_size)
+        alloc_size = buffer_size;
+    if (alloc_size == 0) // defensive (should not happen since buffer_size>0)
+        return NULL;
+
+    char *out = (char *)malloc(alloc_size);
+    if (!out)
+        return NULL;
+
+    size_t copy_len = data_size;
+    if (copy_len > alloc_size - 1)
+        copy_len = alloc_size - 1;
+
+    if (copy_len > 0)
+        memcpy(out, data, copy_len);
+    out[copy_len] = '\0';
+    return out;
+}
+
+// Hands a raw entry's uncompressed bytes to an iteration callback.
+static void fossil_cache_visit_entry(fossil_bluecrab_cache_iter_n_cb cb, const fossil_cache_entry_t *entry,
+                                     void *user_data) {
+    const void *value = fossil_cache_value_view(entry);
+    if (value)
+        cb(entry->key, entry->key_len, value, fossil_cache_value_size(entry), user_data);
+}
+
+// Lets the plain iterate / scan_* callbacks, which get no key length, run
+// on the length-aware walkers.
+typedef struct {
+    fossil_bluecrab_cache_iter_cb cb;
+    void *user_data;
+} fossil_cache_iter_adapter_t;
+
+static void fossil_cache_iter_adapt(const char *key, size_t key_len, const void *value, size_t value_size,
+                                    void *user_data) {
+    const fossil_cache_iter_adapter_t *a = (const fossil_cache_iter_adapter_t *)user_data;
+    (void)key_len;
+    a->cb(key, value, value_size, a->user_data);
+}
+
+// Key filter of a range walk: [start, end) with NULL bounds open, or a
+// prefix instead. Bounds are byte strings of the given lengths.
+typedef struct {
+    const char *start;
+    size_t start_len;
+    const char *end;
+    size_t end_len;
+    const char *prefix;
+    size_t prefix_len;
+} fossil_cache_key_range_t;
+
+static fossil_cache_key_range_t fossil_cache_key_range(const char *start, size_t start_len, const char *end,
+                                                       size_t end_len, const char *prefix, size_t prefix_len) {
+    fossil_cache_key_range_t r;
+    r.start = start;
+    r.start_len = start ? start_len : 0;
+    r.end = end;
+    r.end_len = end ? end_len : 0;
+    r.prefix = prefix;
+    r.prefix_len = prefix ? prefix_len : 0;
+    return r;
+}
+
+// Range of the NUL-terminated bounds of the plain scan_* / delete_* calls.
+static fossil_cache_key_range_t fossil_cache_key_range_str(const char *start, const char *end, const char *prefix) {
+    return fossil_cache_key_range(start, start ? strlen(start) : 0, end, end ? strlen(end) : 0,
+                                  prefix, prefix ? strlen(prefix) : 0);
+}
+
+// True when key lies in the range.
+static bool fossil_cache_key_matches(const char *key, size_t key_len, const fossil_cache_key_range_t *r) {
+    if (r->prefix)
+        return key_len >= r->prefix_len && memcmp(key, r->prefix, r->prefix_len) == 0;
+    if (r->start && fossil_cache_key_cmp(key, key_len, r->start, r->start_len) < 0)
+        return false;
+    if (r->end && fossil_cache_key_cmp(key, key_len, r->end, r->end_len) >= 0)
+        return false;
+    return true;
+}
+
+// ===========================================================
+// Shared-Memory Backend
+// ===========================================================
+
+// All offsets below are relative to the segment base; 0 means "none".
+
+static void *fossil_cache_shm_ptr(uint64_t off) {
+    return off ? (void *)((unsigned char *)g_cache.shm + off) : NULL;
+}
+
+static uint64_t *fossil_cache_shm_buckets(void) {
+    return (uint64_t *)fossil_cache_shm_ptr(g_cache.shm->buckets_offset);
+}
+
+static fossil_cache_shm_entry_t *fossil_cache_shm_entry(uint64_t off) {
+    return (fossil_cache_shm_entry_t *)fossil_cache_shm_ptr(off);
+}
+
+static char *fossil_cache_shm_key(fossil_cache_shm_entry_t *e) {
+    return (char *)(e + 1);
+}
+
+static size_t fossil_cache_shm_data_offset(size_t key_len) {
+    return (sizeof(fossil_cache_shm_entry_t) + key_len + 1 + 7) & ~(size_t)7;
+}
+
+static void *fossil_cache_shm_data(fossil_cache_shm_entry_t *e) {
+    return (unsigned char *)e + fossil_cache_shm_data_offset(e->key_len);
+}
+
+static bool fossil_cache_shm_expired(const fossil_cache_shm_entry_t *e, time_t now) {
+    return e->expiry > 0 && e->expiry <= (int64_t)now;
+}
+
+#if defined(_WIN32) || defined(_WIN64)
+static bool fossil_cache_shm_lock(void) { return true; }
+static void fossil_cache_shm_unlock(void) {}
+#else
+// Robust mutex: if a worker died holding it, take over and carry on. Chain
+// links are only ever updated with a single store, so the table stays
+// walkable; at worst the dead writer's block is leaked. Returns false
+// (lock not held) on any other error, including ENOTRECOVERABLE, and the
+// caller fails the operation.
+static bool fossil_cache_shm_lock(void) {
+    int rc = pthread_mutex_lock(&g_cache.shm->lock);
+    if (rc == EOWNERDEAD) {
+        if (pthread_mutex_consistent(&g_cache.shm->lock) == 0)
+            return true;
+        pthread_mutex_unlock(&g_cache.shm->lock); // leaves it ENOTRECOVERABLE
+        return false;
+    }
+    return rc == 0;
+}
+
+static void fossil_cache_shm_unlock(void) {
+    pthread_mutex_unlock(&g_cache.shm->lock);
+}
+#endif
+
+// Pops a block from the matching size-class free list, or carves a new
+// one from the arena. Returns 0 when the arena is exhausted.
+static uint64_t fossil_cache_shm_alloc(size_t bytes, uint32_t *out_class) {
+    fossil_cache_shm_header_t *h = g_cache.shm;
+    uint32_t cls = 0;
+    while (cls < FOSSIL_CACHE_SHM_CLASSES &&
+           ((uint64_t)FOSSIL_CACHE_SHM_MIN_BLOCK << cls) < bytes)
+        cls++;
+    if (cls == FOSSIL_CACHE_SHM_CLASSES)
+        return 0;
+    *out_class = cls;
+
+    uint64_t off = h->free_lists[cls];
+    if (off) {
+        h->free_lists[cls] = *(uint64_t *)fossil_cache_shm_ptr(off);
+        return off;
+    }
+
+    uint64_t block = (uint64_t)FOSSIL_CACHE_SHM_MIN_BLOCK << cls;
+    if (h->arena_end - h->arena_top < block)
+        return 0;
+    off = h->arena_top;
+    h->arena_top += block;
+    return off;
+}
+
+static void fossil_cache_shm_free(uint64_t off) {
+    fossil_cache_shm_entry_t *e = fossil_cache_shm_entry(off);
+    uint32_t cls = e->size_class;
+    *(uint64_t *)e = g_cache.shm->free_lists[cls];
+    g_cache.shm->free_lists[cls] = off;
+}
+
+static uint64_t fossil_cache_shm_block_bytes(const fossil_cache_shm_entry_t *e) {
+    return (uint64_t)FOSSIL_CACHE_SHM_MIN_BLOCK << e->size_class;
+}
+
+// Returns the link (bucket slot or ->next field) that points at `key`.
+static uint64_t *fossil_cache_shm_find_link(const char *key, size_t key_len, uint64_t hash) {
+    fossil_cache_shm_header_t *h = g_cache.shm;
+    uint64_t *link = &fossil_cache_shm_buckets()[hash & (h->bucket_count - 1)];
+    while (*link) {
+        fossil_cache_shm_entry_t *e = fossil_cache_shm_entry(*link);
+        if (e->hash == hash && e->key_len == key_len &&
+            memcmp(fossil_cache_shm_key(e), key, key_len) == 0)
+            return link;
+        link = &e->next;
+    }
+    return NULL;
+}
+
+static void fossil_cache_shm_drop(uint64_t *link) {
+    fossil_cache_shm_header_t *h = g_cache.shm;
+    uint64_t off = *link;
+    fossil_cache_shm_entry_t *e = fossil_cache_shm_entry(off);
+    *link = e->next;
+    h->total_bytes -= fossil_cache_shm_block_bytes(e);
+    h->entry_count--;
+    fossil_cache_shm_free(off);
+}
+
+// Looks up a live entry, evicting it if expired. Hit/miss counters are
+// only updated for reads (count_stats).
+static fossil_cache_shm_entry_t *fossil_cache_shm_lookup(const char *key, size_t key_len, bool count_stats) {
+    fossil_cache_shm_header_t *h = g_cache.shm;
+    uint64_t *link = fossil_cache_shm_find_link(key, key_len, (uint64_t)fossil_cache_hash(key, key_len));
+    time_t now = time(NULL);
+    if (link && fossil_cache_shm_expired(fossil_cache_shm_entry(*link), now)) {
+        fossil_cache_shm_drop(link);
+        h->expired_evictions++;
+        link = NULL;
+    }
+    if (!link) {
+        if (count_stats)
+            h->misses++;
+        return NULL;
+    }
+    fossil_cache_shm_entry_t *e = fossil_cache_shm_entry(*link);
+    if (count_stats) {
+        h->hits++;
+        e->last_access = (int64_t)now;
+    }
+    return e;
+}
+
+static size_t fossil_cache_shm_evict_expired_locked(void) {
+    fossil_cache_shm_header_t *h = g_cache.shm;
+    uint64_t *buckets = fossil_cache_shm_buckets();
+    time_t now = time(NULL);
+    size_t evicted = 0;
+    for (uint64_t i = 0; i < h->bucket_count; ++i) {
+        uint64_t *link = &buckets[i];
+        while (*link) {
+            if (fossil_cache_shm_expired(fossil_cache_shm_entry(*link), now)) {
+                fossil_cache_shm_drop(link);
+                h->expired_evictions++;
+                evicted++;
+            } else {
+                link = &fossil_cache_shm_entry(*link)->next;
+            }
+        }
+    }
+    return evicted;
+}
+
+// Inserts or replaces a value. ttl_sec == 0 leaves the entry non-expiring.
+// Stores data (plus a '\0' with terminate) under key; see value_encode.
+static bool fossil_cache_shm_set(const char *key, size_t key_len, const void *data, size_t size,
+                                 bool terminate, unsigned int ttl_sec) {
+    if (key_len > UINT32_MAX || (terminate && size == SIZE_MAX))
+        return false;
+    size_t total = size + (terminate ? 1 : 0);
+    size_t need = fossil_cache_shm_data_offset(key_len) + total;
+    uint64_t hash = (uint64_t)fossil_cache_hash(key, key_len);
+    time_t now = time(NULL);
+
+    if (!fossil_cache_shm_lock())
+        return false;
+    fossil_cache_shm_header_t *h = g_cache.shm;
+    uint64_t *link = fossil_cache_shm_find_link(key, key_len, hash);
+    fossil_cache_shm_entry_t *old = link ? fossil_cache_shm_entry(*link) : NULL;
+
+    // Update in place when the value still fits the existing block
+    if (old && need <= fossil_cache_shm_block_bytes(old)) {
+        memcpy(fossil_cache_shm_data(old), data, size);
+        if (terminate)
+            ((unsigned char *)fossil_cache_shm_data(old))[size] = '\0';
+        old->size = total;
+        old->expiry = ttl_sec ? (int64_t)now + ttl_sec : 0;
+        old->created = (int64_t)now;
+        old->last_access = (int64_t)now;
+        fossil_cache_shm_unlock();
+        return true;
+    }
+
+    if (!old && h->max_entries && h->entry_count >= h->max_entries) {
+        fossil_cache_shm_unlock();
+        return false;
+    }
+
+    uint32_t cls = 0;
+    uint64_t off = fossil_cache_shm_alloc(need, &cls);
+    if (!off && fossil_cache_shm_evict_expired_locked() > 0) {
+        link = fossil_cache_shm_find_link(key, key_len, hash); // eviction may relink
+        old = link ? fossil_cache_shm_entry(*link) : NULL;
+        off = fossil_cache_shm_alloc(need, &cls);
+    }
+    if (!off) {
+        fossil_cache_shm_unlock();
+        return false;
+    }
+
+    fossil_cache_shm_entry_t *e = fossil_cache_shm_entry(off);
+    memset(e, 0, sizeof(*e));
+    e->hash = hash;
+    e->key_len = (uint32_t)key_len;
+    e->size_class = cls;
+    e->size = total;
+    e->expiry = ttl_sec ? (int64_t)now + ttl_sec : 0;
+    e->created = (int64_t)now;
+    e->last_access = (int64_t)now;
+    memcpy(fossil_cache_shm_key(e), key, key_len); // key need not be NUL-terminated
+    fossil_cache_shm_key(e)[key_len] = '\0';
+    memcpy(fossil_cache_shm_data(e), data, size);
+    if (terminate)
+        ((unsigned char *)fossil_cache_shm_data(e))[size] = '\0';
+
+    if (old) {
+        e->next = old->next;
+        *link = off;
+        h->total_bytes -= fossil_cache_shm_block_bytes(old);
+        fossil_cache_shm_free((uint64_t)((unsigned char *)old - (unsigned char *)h));
+    } else {
+        uint64_t *bucket = &fossil_cache_shm_buckets()[hash & (h->bucket_count - 1)];
+        e->next = *bucket;
+        *bucket = off;
+        h->entry_count++;
+    }
+    h->total_bytes += fossil_cache_shm_block_bytes(e);
+    fossil_cache_shm_unlock();
+    return true;
+}
+
+static char *fossil_cache_shm_get(const char *key, size_t key_len, size_t buffer_size) {
+    if (!fossil_cache_shm_lock())
+        return NULL;
+    fossil_cache_shm_entry_t *e = fossil_cache_shm_lookup(key, key_len, true);
+    char *out = e ? fossil_cache_copy_string(fossil_cache_shm_data(e), (size_t)e->size, buffer_size) : NULL;
+    fossil_cache_shm_unlock();
+    return out;
+}
+
+static bool fossil_cache_shm_get_into(const char *key, size_t key_len, void *out_buf, size_t buf_size,
+                                      size_t *out_size) {
+    if (!fossil_cache_shm_lock())
+        return false;
+    fossil_cache_shm_entry_t *e = fossil_cache_shm_lookup(key, key_len, true);
+    if (e) {
+        size_t size = (size_t)e->size;
+        if (out_size)
+            *out_size = size;
+        if (out_buf && buf_size)
+            memcpy(out_buf, fossil_cache_shm_data(e), size < buf_size ? size : buf_size);
+    }
+    fossil_cache_shm_unlock();
+    return e != NULL;
+}
+
+static bool fossil_cache_shm_remove(const char *key, size_t key_len) {
+    if (!fossil_cache_shm_lock())
+        return false;
+    uint64_t *link = fossil_cache_shm_find_link(key, key_len, (uint64_t)fossil_cache_hash(key, key_len));
+    if (link)
+        fossil_cache_shm_drop(link);
+    fossil_cache_shm_unlock();
+    return link != NULL;
+}
+
+static bool fossil_cache_shm_exists(const char *key, size_t key_len) {
+    if (!fossil_cache_shm_lock())
+        return false;
+    bool found = fossil_cache_shm_lookup(key, key_len, false) != NULL;
+    fossil_cache_shm_unlock();
+    return found;
+}
+
+static bool fossil_cache_shm_expire(const char *key, size_t key_len, unsigned int ttl_sec) {
+    if (!fossil_cache_shm_lock())
+        return false;
+    fossil_cache_shm_entry_t *e = fossil_cache_shm_lookup(key, key_len, false);
+    if (e) {
+        time_t now = time(NULL);
+        e->expiry = ttl_sec ? (int64_t)now + ttl_sec : 0;
+        if (ttl_sec)
+            e->created = (int64_t)now;
+        e->last_access = (int64_t)now;
+    }
+    fossil_cache_shm_unlock();
+    return e != NULL;
+}
+
+static int fossil_cache_shm_ttl(const char *key, size_t key_len) {
+    if (!fossil_cache_shm_lock())
+        return -1;
+    fossil_cache_shm_entry_t *e = fossil_cache_shm_lookup(key, key_len, false);
+    int ttl = -1;
+    if (e && e->expiry > 0) {
+        int64_t left = e->expiry - (int64_t)time(NULL);
+        ttl = left > 0 ? (int)left : -1;
+    }
+    fossil_cache_shm_unlock();
+    return ttl;
+}
+
+static bool fossil_cache_shm_touch(const char *key, size_t key_len) {
+    if (!fossil_cache_shm_lock())
+        return false;
+    fossil_cache_shm_entry_t *e = fossil_cache_shm_lookup(key, key_len, false);
+    if (e) {
+        int64_t now = (int64_t)time(NULL);
+        // Extend by the original TTL, as the private table does
+        if (e->expiry > 0 && e->expiry > e->created) {
+            e->expiry = now + (e->expiry - e->created);
+            e->created = now;
+        }
+        e->last_access = now;
+    }
+    fossil_cache_shm_unlock();
+    return e != NULL;
+}
+
+static size_t fossil_cache_shm_evict_expired(void) {
+    if (!fossil_cache_shm_lock())
+        return 0;
+    size_t evicted = fossil_cache_shm_evict_expired_locked();
+    fossil_cache_shm_unlock();
+    return evicted;
+}
+
+// Drops every entry at once by resetting the arena; counters survive.
+static void fossil_cache_shm_clear(void) {
+    if (!fossil_cache_shm_lock())
+        return;
+    fossil_cache_shm_header_t *h = g_cache.shm;
+    memset(fossil_cache_shm_buckets(), 0, (size_t)h->bucket_count * sizeof(uint64_t));
+    memset(h->free_lists, 0, sizeof(h->free_lists));
+    h->arena_top = h->arena_offset;
+    h->entry_count = 0;
+    h->total_bytes = 0;
+    fossil_cache_shm_unlock();
+}
+
+// Table walk shared by iterate / scan_* / delete_*, same contract as the
+// private fossil_cache_range_visit but always unordered. Caller holds the
+// shm lock.
+static size_t fossil_cache_shm_visit(const fossil_cache_key_range_t *range, bool remove,
+                                     fossil_bluecrab_cache_iter_n_cb cb, void *user_data) {
+    fossil_cache_shm_header_t *h = g_cache.shm;
+    uint64_t *buckets = fossil_cache_shm_buckets();
+    time_t now = time(NULL);
+    size_t visited = 0;
+
+    for (uint64_t i = 0; i < h->bucket_count; ++i) {
+        uint64_t *link = &buckets[i];
+        while (*link) {
+            fossil_cache_shm_entry_t *e = fossil_cache_shm_entry(*link);
+            bool expired = fossil_cache_shm_expired(e, now);
+            bool match = !expired && fossil_cache_key_matches(fossil_cache_shm_key(e), e->key_len, range);
+
+            if (match) {
+                if (cb)
+                    cb(fossil_cache_shm_key(e), (size_t)e->key_len, fossil_cache_shm_data(e), (size_t)e->size,
+                       user_data);
+                visited++;
+            }
+            if (expired || (match && remove)) {
+                fossil_cache_shm_drop(link);
+                if (expired)
+                    h->expired_evictions++;
+            } else {
+                link = &e->next;
+            }
+        }
+    }
+    return visited;
+}
+
+// ===========================================================
+// Initialization / Lifecycle
+// ===========================================================
+
+bool fossil_bluecrab_cacheshell_init(size_t max_entries) {
+    if (g_cache.buckets || g_cache.shm) // already initialized
+        return true;
+
+    memset(&g_cache, 0, sizeof(g_cache));
+    g_cache.bucket_count = 1024;          // fixed bucket count for now
+    g_cache.max_entries  = max_entries;
+    g_cache.start_time   = time(NULL);
+    g_cache.locking_enabled = false;      // opt-in
+
+    g_cache.buckets = (fossil_cache_entry_t **)calloc(
+        g_cache.bucket_count, sizeof(fossil_cache_entry_t *));
+    if (!g_cache.buckets)
+        return false;
+
+    fossil_cache_lock_init();
+    return true;
+}
+
+#if defined(_WIN32) || defined(_WIN64)
+bool fossil_bluecrab_cacheshell_init_shared(const char *name, size_t max_entries, size_t arena_bytes) {
+    (void)name; (void)max_entries; (void)arena_bytes;
+    return false; // POSIX shared memory only
+}
+
+bool fossil_bluecrab_cacheshell_unlink_shared(const char *name) {
+    (void)name;
+    return false;
+}
+
+static void fossil_cache_shm_detach(void) {}
+#else
+static void fossil_cache_shm_sleep_ms(long ms) {
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+static size_t fossil_cache_shm_header_bytes(void) {
+    return (sizeof(fossil_cache_shm_header_t) + 63) & ~(size_t)63;
+}
+
+// Largest power-of-two bucket count wanted for max_entries that still
+// leaves room for an arena in a segment of segment_size bytes.
+static size_t fossil_cache_shm_fit_buckets(size_t max_entries, size_t segment_size) {
+    size_t bucket_count = 1024;
+    while (bucket_count < max_entries && bucket_count < ((size_t)1 << 24))
+        bucket_count <<= 1;
+    while (bucket_count > 1 && fossil_cache_shm_header_bytes() + bucket_count * sizeof(uint64_t) + 64 +
+                               FOSSIL_CACHE_SHM_MIN_BLOCK > segment_size)
+        bucket_count >>= 1;
+    return bucket_count;
+}
+
+// Claims the right to format a segment that is not ready yet: either
+// nobody has claimed it, or the claimant died before finishing.
+static bool fossil_cache_shm_claim(fossil_cache_shm_header_t *h) {
+    uint32_t owner = __atomic_load_n(&h->init_pid, __ATOMIC_ACQUIRE);
+    if (owner && (kill((pid_t)owner, 0) == 0 || errno != ESRCH))
+        return false; // a live process is formatting it
+    return __atomic_compare_exchange_n(&h->init_pid, &owner, (uint32_t)getpid(), false,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+// Lays out a claimed segment. Everything but the claim is reset, so a
+// segment half-written by a dead process is formatted from scratch.
+static bool fossil_cache_shm_format(fossil_cache_shm_header_t *h, size_t segment_size,
+                                    size_t bucket_count, size_t max_entries) {
+    size_t header = fossil_cache_shm_header_bytes();
+    if (header + bucket_count * sizeof(uint64_t) + 64 > segment_size)
+        return false;
+    memset(&h->segment_size, 0, sizeof(*h) - offsetof(fossil_cache_shm_header_t, segment_size));
+    memset((unsigned char *)h + header, 0, bucket_count * sizeof(uint64_t));
+
+    pthread_mutexattr_t attr;
+    if (pthread_mutexattr_init(&attr) != 0)
+        return false;
+    bool ok = pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED) == 0 &&
+              pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST) == 0 &&
+              pthread_mutex_init(&h->lock, &attr) == 0;
+    pthread_mutexattr_destroy(&attr);
+    if (!ok)
+        return false;
+
+    h->magic = FOSSIL_CACHE_SHM_MAGIC;
+    h->version = FOSSIL_CACHE_SHM_VERSION;
+    h->segment_size = segment_size;
+    h->bucket_count = bucket_count;
+    h->buckets_offset = header;
+    h->max_entries = max_entries;
+    h->start_time = (int64_t)time(NULL);
+    h->arena_offset = (header + bucket_count * sizeof(uint64_t) + 63) & ~(uint64_t)63;
+    h->arena_top = h->arena_offset;
+    h->arena_end = segment_size;
+    __atomic_store_n(&h->ready, 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+// Waits for another process to finish formatting. If nothing happens
+// within FOSSIL_CACHE_SHM_ATTACH_MS and the formatter is gone, formats the
+// segment here instead; gives up if a live formatter stalls for longer.
+static bool fossil_cache_shm_wait_ready(fossil_cache_shm_header_t *h, size_t segment_size,
+                                        size_t max_entries) {
+    for (int waited = 1; !__atomic_load_n(&h->ready, __ATOMIC_ACQUIRE); ++waited) {
+        if (waited % FOSSIL_CACHE_SHM_ATTACH_MS == 0) {
+            if (fossil_cache_shm_claim(h))
+                return fossil_cache_shm_format(h, segment_size,
+                                               fossil_cache_shm_fit_buckets(max_entries, segment_size),
+                                               max_entries);
+            if (waited >= 4 * FOSSIL_CACHE_SHM_ATTACH_MS)
+                return false;
+        }
+        fossil_cache_shm_sleep_ms(1);
+    }
+    return true;
+}
+
+// Unlinks `name` if it still refers to the segment described by `st`,
+// i.e. one a creator left unsized when it died.
+static bool fossil_cache_shm_unlink_stale(const char *name, const struct stat *st) {
+    int fd = shm_open(name, O_RDWR, 0600);
+    if (fd < 0)
+        return errno == ENOENT; // already gone
+    struct stat cur;
+    bool stale = fstat(fd, &cur) == 0 && cur.st_dev == st->st_dev && cur.st_ino == st->st_ino &&
+                 (size_t)cur.st_size < sizeof(fossil_cache_shm_header_t);
+    close(fd);
+    return stale && shm_unlink(name) == 0;
+}
+
+static bool fossil_cache_shm_attach(const char *name, size_t max_entries, size_t arena_bytes,
+                                    bool retry) {
+    if (arena_bytes == 0)
+        arena_bytes = FOSSIL_CACHE_SHM_DEFAULT_ARENA;
+
+    bool creator = true;
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        if (errno != EEXIST)
+            return false;
+        creator = false;
+        fd = shm_open(name, O_RDWR, 0600);
+        if (fd < 0)
+            return false;
+    }
+
+    size_t segment_size;
+    if (creator) {
+        size_t bucket_count = fossil_cache_shm_fit_buckets(max_entries, SIZE_MAX);
+        segment_size = fossil_cache_shm_header_bytes() + bucket_count * sizeof(uint64_t) + 64 + arena_bytes;
+        if (ftruncate(fd, (off_t)segment_size) != 0) {
+            close(fd);
+            shm_unlink(name);
+            return false;
+        }
+    } else {
+        // Wait (briefly) for the creator to size the segment
+        struct stat st;
+        memset(&st, 0, sizeof(st));
+        int tries = 0;
+        while (fstat(fd, &st) == 0 && (size_t)st.st_size < sizeof(fossil_cache_shm_header_t) &&
+               tries++ < FOSSIL_CACHE_SHM_ATTACH_MS)
+            fossil_cache_shm_sleep_ms(1);
+        if ((size_t)st.st_size < sizeof(fossil_cache_shm_header_t)) {
+            close(fd);
+            // The creator died before sizing it: drop the name and start over once
+            return retry && fossil_cache_shm_unlink_stale(name, &st) &&
+                   fossil_cache_shm_attach(name, max_entries, arena_bytes, false);
+        }
+        segment_size = (size_t)st.st_size;
+    }
+
+    void *base = mmap(NULL, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        if (creator)
+            shm_unlink(name);
+        return false;
+    }
+    fossil_cache_shm_header_t *h = (fossil_cache_shm_header_t *)base;
+
+    // The creator formats unless an attacher already took the segment over
+    // because the creator looked dead or stalled; then it waits like one.
+    bool ok = creator && fossil_cache_shm_claim(h)
+        ? fossil_cache_shm_format(h, segment_size, fossil_cache_shm_fit_buckets(max_entries, segment_size),
+                                  max_entries)
+        : fossil_cache_shm_wait_ready(h, segment_size, max_entries);
+    if (!ok || h->magic != FOSSIL_CACHE_SHM_MAGIC || h->version != FOSSIL_CACHE_SHM_VERSION ||
+        h->segment_size != segment_size) {
+        munmap(base, segment_size);
+        return false;
+    }
+
+    memset(&g_cache, 0, sizeof(g_cache));
+    g_cache.shm = h;
+    g_cache.shm_size = segment_size;
+    g_cache.start_time = (time_t)h->start_time;
+    return true;
+}
+
+bool fossil_bluecrab_cacheshell_init_shared(const char *name, size_t max_entries, size_t arena_bytes) {
+    if (!name || !*name)
+        return false;
+    if (g_cache.shm)
+        return true;
+    if (g_cache.buckets) // private table already in use
+        return false;
+    return fossil_cache_shm_attach(name, max_entries, arena_bytes, true);
+}
+
+bool fossil_bluecrab_cacheshell_unlink_shared(const char *name) {
+    if (!name || !*name)
+        return false;
+    return shm_unlink(name) == 0;
+}
+
+static void fossil_cache_shm_detach(void) {
+    munmap(g_cache.shm, g_cache.shm_size);
+    g_cache.shm = NULL;
+    g_cache.shm_size = 0;
+    g_cache.start_time = 0;
+    g_cache.locking_enabled = false;
+}
+#endif
+
+void fossil_bluecrab_cacheshell_shutdown(void) {
+    if (g_cache.shm) {
+        fossil_cache_shm_detach();
+        return;
+    }
+    if (!g_cache.buckets)
+        return;
+
+    fossil_cache_lock();
+    for (size_t i = 0; i < g_cache.bucket_count; ++i) {
+        fossil_cache_entry_t *entry = g_cache.buckets[i];
+        while (entry) {
+            fossil_cache_entry_t *next = entry->next;
+            fossil_cache_free_entry(entry);
+            entry = next;
+        }
+        g_cache.buckets[i] = NULL;
+    }
+    free(g_cache.buckets);
+    g_cache.buckets = NULL;
+    fossil_cache_index_destroy_nodes(false);
+    fossil_cache_l1_invalidate_all();
+    fossil_cache_atomic_store(&g_cache_keys.sample_rate, 0);
+    fossil_cache_big_reset();
+    fossil_cache_atomic_store(&g_cache_l1.enabled, 0);
+    fossil_cache_atomic_store(&g_cache_l1.hits, 0);
+    fossil_cache_atomic_store(&g_cache_l1.misses, 0);
+    fossil_cache_atomic_add(&g_cache_l1.stats_gen, 1);
+    g_cache.entry_count = 0;
+    g_cache.hits = 0;
+    g_cache.misses = 0;
+    g_cache.total_bytes = 0;
+    g_cache.expired_evictions = 0;
+    g_cache.start_time = 0;
+    g_cache.compress_min = 0;
+    g_cache.lz_entries = 0;
+    g_cache.lz_logical_bytes = 0;
+    g_cache.lz_stored_bytes = 0;
+    g_cache.lob_min = 0;
+    g_cache.lob_budget = 0;
+    g_cache.lob_count = 0;
+    g_cache.lob_bytes = 0;
+    g_cache.lob_evictions = 0;
+    g_cache.lob_head = g_cache.lob_tail = NULL;
+    fossil_cache_unlock();
+    fossil_cache_lob_trim();
+
+    if (t_cache_scratch) { // other threads free theirs on exit
+        free(t_cache_scratch);
+        fossil_cache_scratch_track(NULL);
+        t_cache_scratch = NULL;
+        t_cache_scratch_cap = 0;
+    }
+
+    fossil_cache_lock_destroy();
+    g_cache.locking_enabled = false;
+}
+
+// ===========================================================
+// Basic Key/Value Operations
+// ===========================================================
+
+bool fossil_bluecrab_cacheshell_set(const char *key, const char *value) {
+    if (!key || !value)
+        return false;
+    return fossil_bluecrab_cacheshell_set_binary(key, value, strlen(value) + 1);
+}
+
+char *fossil_bluecrab_cacheshell_get(const char *key, size_t buffer_size) {
+    if (!key || buffer_size == 0)
+        return NULL;
+    size_t key_len = strlen(key);
+    fossil_cache_hot_sample(key, key_len);
+    if (g_cache.shm)
+        return fossil_cache_shm_get(key, key_len, buffer_size);
+
+    size_t hash = fossil_cache_hash(key, key_len);
+    bool near = fossil_cache_atomic_load(&g_cache_l1.enabled) != 0;
+    if (near) {
+        const fossil_cache_l1_slot_t *slot = fossil_cache_l1_lookup(key, key_len, hash);
+        fossil_cache_l1_count(slot != NULL);
+        if (slot)
+            return fossil_cache_copy_string(slot->data, slot->size, buffer_size);
+    }
+
+    fossil_cache_lock();
+    fossil_cache_entry_t *entry = fossil_cache_find_raw(key, key_len, hash);
+    if (!entry) {
+        fossil_cache_unlock();
+        return NULL;
+    }
+    if (near)
+        fossil_cache_l1_fill(entry, hash);
+
+    // may include '\0' (string path) or be binary
+    const void *value = fossil_cache_value_view(entry);
+    char *out = value ? fossil_cache_copy_string(value, fossil_cache_value_size(entry), buffer_size) : NULL;
+    fossil_cache_unlock();
+    return out;
+}
+
+bool fossil_bluecrab_cacheshell_remove(const char *key) {
+    return key && fossil_bluecrab_cacheshell_remove_n(key, strlen(key));
+}
+
+bool fossil_bluecrab_cacheshell_remove_n(const char *key, size_t key_len) {
+    if (!key)
+        return false;
+    if (g_cache.shm)
+        return fossil_cache_shm_remove(key, key_len);
+    fossil_cache_lock();
+    bool removed = fossil_cache_remove_internal(key, key_len, fossil_cache_hash(key, key_len));
+    fossil_cache_unlock();
+    return removed;
+}
+
+bool fossil_bluecrab_cacheshell_exists(const char *key) {
+    return key && fossil_bluecrab_cacheshell_exists_n(key, strlen(key));
+}
+
+bool fossil_bluecrab_cacheshell_exists_n(const char *key, size_t key_len) {
+    if (!key) return false;
+    if (g_cache.shm)
+        return fossil_cache_shm_exists(key, key_len);
+
+    fossil_cache_lock();
+
+    if (!g_cache.buckets) {
+        fossil_cache_unlock();
+        return false;
+    }
+
+    size_t hash = fossil_cache_hash(key, key_len);
+    size_t index = hash % g_cache.bucket_count;
     fossil_cache_entry_t *prev = NULL;
     fossil_cache_entry_t *curr = g_cache.buckets[index];
     time_t now = time(NULL);
 
     while (curr) {
-        if (strcmp(curr->key, key) == 0) {
+        if (fossil_cache_key_eq(curr, key, key_len, hash)) {
             // If expired, remove it (do NOT count as miss/hit)
             if (curr->expiry > 0 && curr->expiry <= now) {
                 fossil_cache_entry_t *dead = curr;
                 if (prev)
                     prev->next = curr->next;
                 else
-                    g_cache.buckets[index] = curr->next;
+                    g_cache.buckets[index] = curr->next;
+                fossil_cache_drop_entry(dead);
+                g_cache.expired_evictions++;
+                fossil_cache_unlock();
+                return false;
+            }
+            // Found and valid; do NOT update hits/last_access for exists()
+            fossil_cache_unlock();
+            return true;
+        }
+        prev = curr;
+        curr = curr->next;
+    }
+
+    fossil_cache_unlock();
+    return false;
+}
+
+// ===========================================================
+// Expiration / TTL
+// ===========================================================
+
+// Avoids double-locking by calling the existing setter first (it handles locking)
+// then setting TTL under a separate lock. Also initializes created/last_access.
+bool fossil_bluecrab_cacheshell_set_with_ttl(const char *key, const char *value, unsigned int ttl_sec) {
+    if (!key || !value) return false;
+    return fossil_bluecrab_cacheshell_set_binary_with_ttl_n(key, strlen(key), value, strlen(value) + 1, ttl_sec);
+}
+
+// Binary variant for completeness.
+bool fossil_bluecrab_cacheshell_set_binary_with_ttl(const char *key, const void *data, size_t size, unsigned int ttl_sec) {
+    if (!key) return false;
+    return fossil_bluecrab_cacheshell_set_binary_with_ttl_n(key, strlen(key), data, size, ttl_sec);
+}
+
+// Shared by set_with_ttl_n (terminate: a '\0' is stored after the text)
+// and set_binary_with_ttl_n.
+static bool fossil_cache_set_value_ttl(const char *key, size_t key_len, const void *data, size_t size,
+                                       bool terminate, unsigned int ttl_sec) {
+    if (!key || !data) return false;
+    if (g_cache.shm) {
+        fossil_cache_hot_sample(key, key_len);
+        return (size > 0 || terminate) && fossil_cache_shm_set(key, key_len, data, size, terminate, ttl_sec);
+    }
+    bool stored = terminate ? fossil_bluecrab_cacheshell_set_n(key, key_len, (const char *)data, size)
+                            : fossil_bluecrab_cacheshell_set_binary_n(key, key_len, data, size);
+    if (!stored)
+        return false;
+    if (ttl_sec == 0) return true;
+
+    fossil_cache_lock();
+    if (g_cache.buckets) {
+        size_t hash = fossil_cache_hash(key, key_len);
+        fossil_cache_entry_t *e = g_cache.buckets[hash % g_cache.bucket_count];
+        while (e) {
+            if (fossil_cache_key_eq(e, key, key_len, hash)) {
+                time_t now = time(NULL);
+                e->expiry = now + ttl_sec;
+                fossil_cache_l1_invalidate(e);
+                if (e->created == 0) e->created = now;
+                e->last_access = e->created;
+                break;
+            }
+            e = e->next;
+        }
+    }
+    fossil_cache_unlock();
+    return true;
+}
+
+bool fossil_bluecrab_cacheshell_set_binary_with_ttl_n(const char *key, size_t key_len, const void *data,
+                                                      size_t size, unsigned int ttl_sec) {
+    return fossil_cache_set_value_ttl(key, key_len, data, size, false, ttl_sec);
+}
+
+bool fossil_bluecrab_cacheshell_set_with_ttl_n(const char *key, size_t key_len, const char *value,
+                                               size_t value_len, unsigned int ttl_sec) {
+    return fossil_cache_set_value_ttl(key, key_len, value, value_len, true, ttl_sec);
+}
+
+bool fossil_bluecrab_cacheshell_expire(const char *key, unsigned int ttl_sec) {
+    return key && fossil_bluecrab_cacheshell_expire_n(key, strlen(key), ttl_sec);
+}
+
+bool fossil_bluecrab_cacheshell_expire_n(const char *key, size_t key_len, unsigned int ttl_sec) {
+    if (!key) return false;
+    if (g_cache.shm)
+        return fossil_cache_shm_expire(key, key_len, ttl_sec);
+
+    fossil_cache_lock();
+    if (!g_cache.buckets) {
+        fossil_cache_unlock();
+        return false;
+    }
+
+    size_t hash = fossil_cache_hash(key, key_len);
+    size_t index = hash % g_cache.bucket_count;
+    fossil_cache_entry_t *prev = NULL;
+    fossil_cache_entry_t *entry = g_cache.buckets[index];
+    time_t now = time(NULL);
+
+    while (entry) {
+        if (fossil_cache_key_eq(entry, key, key_len, hash)) {
+            // If currently expired, unlink and treat as not found (cannot extend)
+            if (entry->expiry > 0 && entry->expiry <= now) {
+                if (prev)
+                    prev->next = entry->next;
+                else
+                    g_cache.buckets[index] = entry->next;
+                fossil_cache_drop_entry(entry);
+                g_cache.expired_evictions++;
+                fossil_cache_unlock();
+                return false;
+            }
+            fossil_cache_l1_invalidate(entry);
+            if (ttl_sec > 0) {
+                entry->expiry = now + ttl_sec;
+                if (entry->created == 0) entry->created = now;
+            } else {
+                entry->expiry = 0; // make non-expiring
+            }
+            entry->last_access = now; // treat as a maintenance touch
+            fossil_cache_unlock();
+            return true;
+        }
+        prev = entry;
+        entry = entry->next;
+    }
+
+    fossil_cache_unlock();
+    return false;
+}
+
+int fossil_bluecrab_cacheshell_ttl(const char *key) {
+    return key ? fossil_bluecrab_cacheshell_ttl_n(key, strlen(key)) : -1;
+}
+
+int fossil_bluecrab_cacheshell_ttl_n(const char *key, size_t key_len) {
+    if (!key) return -1;
+    if (g_cache.shm)
+        return fossil_cache_shm_ttl(key, key_len);
+
+    fossil_cache_lock();
+    if (!g_cache.buckets) {
+        fossil_cache_unlock();
+        return -1;
+    }
+
+    size_t hash = fossil_cache_hash(key, key_len);
+    size_t index = hash % g_cache.bucket_count;
+    fossil_cache_entry_t *prev = NULL;
+    fossil_cache_entry_t *curr = g_cache.buckets[index];
+    time_t now = time(NULL);
+
+    while (curr) {
+        if (fossil_cache_key_eq(curr, key, key_len, hash)) {
+            // If expired, unlink and report -1 (also count eviction, but no hit/miss)
+            if (curr->expiry > 0 && curr->expiry <= now) {
+                if (prev)
+                    prev->next = curr->next;
+                else
+                    g_cache.buckets[index] = curr->next;
+                fossil_cache_drop_entry(curr);
+                g_cache.expired_evictions++;
+                fossil_cache_unlock();
+                return -1;
+            }
+            // No TTL set
+            if (curr->expiry == 0) {
+                fossil_cache_unlock();
+                return -1;
+            }
+            int ttl = (int)difftime(curr->expiry, now);
+            fossil_cache_unlock();
+            return ttl > 0 ? ttl : -1;
+        }
+        prev = curr;
+        curr = curr->next;
+    }
+
+    fossil_cache_unlock();
+    return -1;
+}
+
+bool fossil_bluecrab_cacheshell_touch(const char *key) {
+    return key && fossil_bluecrab_cacheshell_touch_n(key, strlen(key));
+}
+
+bool fossil_bluecrab_cacheshell_touch_n(const char *key, size_t key_len) {
+    if (!key) return false;
+    if (g_cache.shm)
+        return fossil_cache_shm_touch(key, key_len);
+
+    fossil_cache_lock();
+
+    if (!g_cache.buckets) {
+        fossil_cache_unlock();
+        return false;
+    }
+
+    size_t hash = fossil_cache_hash(key, key_len);
+    size_t index = hash % g_cache.bucket_count;
+    fossil_cache_entry_t *prev = NULL;
+    fossil_cache_entry_t *entry = g_cache.buckets[index];
+    time_t now = time(NULL);
+
+    while (entry) {
+        if (fossil_cache_key_eq(entry, key, key_len, hash)) {
+            // If expired, remove and report false (do not count as miss/hit)
+            if (entry->expiry > 0 && entry->expiry <= now) {
+                if (prev)
+                    prev->next = entry->next;
+                else
+                    g_cache.buckets[index] = entry->next;
+                fossil_cache_drop_entry(entry);
+                g_cache.expired_evictions++;
+                fossil_cache_unlock();
+                return false;
+            }
+
+            // Update last access timestamp
+            entry->last_access = now;
+            if (entry->created == 0)
+                entry->created = now;
+
+            // For expiring entries, extend by the original TTL (expiry - created)
+            if (entry->expiry > 0) {
+                fossil_cache_l1_invalidate(entry);
+                time_t original_ttl = 0;
+                if (entry->created > 0 && entry->expiry > entry->created)
+                    original_ttl = entry->expiry - entry->created;
+
+                if (original_ttl > 0) {
+                    entry->expiry = now + original_ttl;
+                } else {
+                    // Fallback: preserve remaining time (rare path if created not set)
+                    time_t remaining = entry->expiry - now;
+                    if (remaining > 0)
+                        entry->expiry = now + remaining;
+                }
+            }
+
+            fossil_cache_unlock();
+            return true;
+        }
+        prev = entry;
+        entry = entry->next;
+    }
+
+    fossil_cache_unlock();
+    return false;
+}
+
+size_t fossil_bluecrab_cacheshell_evict_expired(void) {
+    if (g_cache.shm)
+        return fossil_cache_shm_evict_expired();
+
+    fossil_cache_lock();
+    if (!g_cache.buckets) {
+        fossil_cache_unlock();
+        return 0;
+    }
+
+    size_t evicted = 0;
+    time_t now = time(NULL);
+
+    for (size_t i = 0; i < g_cache.bucket_count; ++i) {
+        fossil_cache_entry_t *prev = NULL;
+        fossil_cache_entry_t *curr = g_cache.buckets[i];
+
+        while (curr) {
+            if (curr->expiry > 0 && curr->expiry <= now) {
+                fossil_cache_entry_t *dead = curr;
+
+                if (prev)
+                    prev->next = curr->next;
+                else
+                    g_cache.buckets[i] = curr->next;
+
                 curr = curr->next;
-                fossil_cache_free_entry(dead);
-                if (g_cache.entry_count > 0)
-                    g_cache.entry_count--;
+
+                fossil_cache_drop_entry(dead);
                 g_cache.expired_evictions++;
-                fossil_cache_unlock();
-                return false;
+                evicted++;
+                continue;
             }
-            // Found and valid; do NOT update hits/last_access for exists()
-            fossil_cache_unlock();
-            return true;
+            prev = curr;
+            curr = curr->next;
         }
-        prev = curr;
-        curr = curr->next;
     }
 
     fossil_cache_unlock();
-    return false;
+    return evicted;
 }
 
 // ===========================================================
-// Expiration / TTL
+// Binary-Safe Operations
 // ===========================================================
 
-// Avoids double-locking by calling the existing setter first (it handles locking)
-// then setting TTL under a separate lock. Also initializes created/last_access.
-bool fossil_bluecrab_cacheshell_set_with_ttl(const char *key, const char *value, unsigned int ttl_sec) {
-    if (!key || !value) return false;
-    size_t len = strlen(value) + 1;
-    if (!fossil_bluecrab_cacheshell_set_binary(key, value, len))
+bool fossil_bluecrab_cacheshell_set_binary(const char *key, const void *data, size_t size) {
+    return key && fossil_bluecrab_cacheshell_set_binary_n(key, strlen(key), data, size);
+}
+
+// Shared by set_n (terminate: a '\0' is stored after the text, added
+// while copying) and set_binary_n.
+static bool fossil_cache_set_value(const char *key, size_t key_len, const void *data, size_t size,
+                                   bool terminate) {
+    if (!key || !data || (size == 0 && !terminate))
+        return false;
+    fossil_cache_hot_sample(key, key_len);
+    if (g_cache.shm)
+        return fossil_cache_shm_set(key, key_len, data, size, terminate, 0);
+
+    // Compress / map (or copy) outside the lock
+    size_t stored;
+    unsigned int storage;
+    void *newblk = fossil_cache_value_encode(data, size, terminate, &stored, &storage);
+    if (terminate)
+        size++; // logical size includes the '\0'
+    if (!newblk)
         return false;
-    if (ttl_sec == 0) return true;
 
     fossil_cache_lock();
-    if (g_cache.buckets) {
-        size_t index = fossil_cache_hash(key) % g_cache.bucket_count;
-        fossil_cache_entry_t *e = g_cache.buckets[index];
-        while (e) {
-            if (strcmp(e->key, key) == 0) {
-                time_t now = time(NULL);
-                e->expiry = now + ttl_sec;
-                if (e->created == 0) e->created = now;
-                e->last_access = e->created;
-                break;
-            }
-            e = e->next;
+
+    if (!g_cache.buckets || !fossil_cache_lob_fits(newblk, storage)) {
+        fossil_cache_unlock();
+        fossil_cache_value_release(newblk, storage);
+        return false;
+    }
+
+    size_t hash = fossil_cache_hash(key, key_len);
+    fossil_cache_entry_t *entry = g_cache.buckets[hash % g_cache.bucket_count];
+
+    // Update existing entry (allowed even if at max capacity)
+    while (entry) {
+        if (fossil_cache_key_eq(entry, key, key_len, hash)) {
+            // Adjust memory usage accounting
+            size_t old_bytes = fossil_cache_entry_bytes(entry);
+            size_t new_bytes = old_bytes - entry->size + stored;
+            if (new_bytes >= old_bytes)
+                g_cache.total_bytes += (new_bytes - old_bytes);
+            else
+                g_cache.total_bytes -= (old_bytes - new_bytes);
+
+            fossil_cache_l1_invalidate(entry);
+            fossil_cache_lz_account(entry, false);
+            fossil_cache_lob_forget(entry);
+            fossil_cache_free_value(entry); // a collection becomes raw again
+            entry->type = FOSSIL_CACHE_TYPE_RAW;
+            entry->data = newblk;
+            entry->size = stored;
+            entry->raw_size = size;
+            entry->flags = (entry->flags & ~FOSSIL_CACHE_ENTRY_STORAGE) | storage;
+            fossil_cache_lz_account(entry, true);
+            fossil_cache_big_note(entry);
+            fossil_cache_lob_admit(entry);
+            entry->expiry = 0; // reset TTL on overwrite (intentional)
+            time_t now = time(NULL);
+            if (entry->created == 0) entry->created = now;
+            entry->last_access = now;
+            fossil_cache_unlock();
+            return true;
         }
+        entry = entry->next;
+    }
+
+    // Insertion path
+    if (g_cache.max_entries && g_cache.entry_count >= g_cache.max_entries) {
+        fossil_cache_unlock();
+        fossil_cache_value_release(newblk, storage);
+        return false;
+    }
+
+    fossil_cache_entry_t *new_entry = (fossil_cache_entry_t *)calloc(1, sizeof(fossil_cache_entry_t));
+    if (!new_entry) {
+        fossil_cache_unlock();
+        fossil_cache_value_release(newblk, storage);
+        return false;
+    }
+
+    new_entry->key = cacheshell_memdup(key, key_len);
+    new_entry->key_len = key_len;
+    new_entry->hash = hash;
+    new_entry->data = newblk;
+    new_entry->flags = storage;
+    if (!new_entry->key) {
+        fossil_cache_free_entry(new_entry);
+        fossil_cache_unlock();
+        return false;
+    }
+
+    new_entry->size = stored;
+    new_entry->raw_size = size;
+    new_entry->expiry = 0;
+    time_t now = time(NULL);
+    new_entry->created = now;
+    new_entry->last_access = now;
+
+    if (!fossil_cache_insert_entry(new_entry, hash)) {
+        fossil_cache_free_entry(new_entry);
+        fossil_cache_unlock();
+        return false;
     }
+
     fossil_cache_unlock();
     return true;
 }
 
-// Binary variant for completeness.
-bool fossil_bluecrab_cacheshell_set_binary_with_ttl(const char *key, const void *data, size_t size, unsigned int ttl_sec) {
-    if (!key || !data) return false;
-    if (!fossil_bluecrab_cacheshell_set_binary(key, data, size))
-        return false;
-    if (ttl_sec == 0) return true;
+bool fossil_bluecrab_cacheshell_set_binary_n(const char *key, size_t key_len, const void *data, size_t size) {
+    return fossil_cache_set_value(key, key_len, data, size, false);
+}
+
+bool fossil_bluecrab_cacheshell_set_n(const char *key, size_t key_len, const char *value, size_t value_len) {
+    return fossil_cache_set_value(key, key_len, value, value_len, true);
+}
+
+// Binary fetch (returns internal pointer, do NOT modify or free).
+// Thread-safe lookup; pointer becomes invalid if the entry is later removed or updated.
+const void *fossil_bluecrab_cacheshell_get_binary(const char *key, size_t *out_size) {
+    return key ? fossil_bluecrab_cacheshell_get_binary_n(key, strlen(key), out_size) : NULL;
+}
+
+const void *fossil_bluecrab_cacheshell_get_binary_n(const char *key, size_t key_len, size_t *out_size) {
+    if (!key)
+        return NULL;
+    // Another process may free or reuse the block as soon as the shm lock
+    // is dropped, so no pointer into the segment is handed out; callers use
+    // get_binary_into or pin, which copy under the lock.
+    if (g_cache.shm)
+        return NULL;
+    fossil_cache_hot_sample(key, key_len);
 
     fossil_cache_lock();
-    if (g_cache.buckets) {
-        size_t index = fossil_cache_hash(key) % g_cache.bucket_count;
-        fossil_cache_entry_t *e = g_cache.buckets[index];
-        while (e) {
-            if (strcmp(e->key, key) == 0) {
-                time_t now = time(NULL);
-                e->expiry = now + ttl_sec;
-                if (e->created == 0) e->created = now;
-                e->last_access = e->created;
-                break;
-            }
-            e = e->next;
-        }
+    fossil_cache_entry_t *entry = fossil_cache_find_raw(key, key_len, fossil_cache_hash(key, key_len));
+    if (!entry) {
+        fossil_cache_unlock();
+        return NULL;
     }
+
+    if (out_size)
+        *out_size = fossil_cache_value_size(entry);
+
+    const void *ptr = fossil_cache_value_view(entry); // internal or scratch buffer
     fossil_cache_unlock();
-    return true;
+    return ptr;
 }
 
-bool fossil_bluecrab_cacheshell_expire(const char *key, unsigned int ttl_sec) {
-    if (!key) return false;
+bool fossil_bluecrab_cacheshell_get_binary_into(const char *key, void *out_buf, size_t buf_size, size_t *out_size) {
+    if (out_size)
+        *out_size = 0;
+    return key && fossil_bluecrab_cacheshell_get_binary_into_n(key, strlen(key), out_buf, buf_size, out_size);
+}
+
+bool fossil_bluecrab_cacheshell_get_binary_into_n(const char *key, size_t key_len, void *out_buf,
+                                                  size_t buf_size, size_t *out_size) {
+    if (out_size)
+        *out_size = 0;
+    if (!key)
+        return false;
+    fossil_cache_hot_sample(key, key_len);
+    if (g_cache.shm)
+        return fossil_cache_shm_get_into(key, key_len, out_buf, buf_size, out_size);
+
+    size_t hash = fossil_cache_hash(key, key_len);
+    bool near = fossil_cache_atomic_load(&g_cache_l1.enabled) != 0;
+    if (near) {
+        const fossil_cache_l1_slot_t *slot = fossil_cache_l1_lookup(key, key_len, hash);
+        fossil_cache_l1_count(slot != NULL);
+        if (slot) {
+            if (out_size)
+                *out_size = slot->size;
+            if (out_buf && buf_size)
+                memcpy(out_buf, slot->data, slot->size < buf_size ? slot->size : buf_size);
+            return true;
+        }
+    }
 
     fossil_cache_lock();
-    if (!g_cache.buckets) {
+    fossil_cache_entry_t *entry = fossil_cache_find_raw(key, key_len, hash);
+    if (!entry) {
         fossil_cache_unlock();
         return false;
     }
+    if (near)
+        fossil_cache_l1_fill(entry, hash);
 
-    size_t index = fossil_cache_hash(key) % g_cache.bucket_count;
-    fossil_cache_entry_t *prev = NULL;
-    fossil_cache_entry_t *entry = g_cache.buckets[index];
-    time_t now = time(NULL);
+    if (out_size)
+        *out_size = fossil_cache_value_size(entry);
+    if (out_buf && buf_size)
+        fossil_cache_value_copy(entry, out_buf, buf_size);
+    fossil_cache_unlock();
+    return true;
+}
 
-    while (entry) {
-        if (strcmp(entry->key, key) == 0) {
-            // If currently expired, unlink and treat as not found (cannot extend)
-            if (entry->expiry > 0 && entry->expiry <= now) {
-                if (prev)
-                    prev->next = entry->next;
-                else
-                    g_cache.buckets[index] = entry->next;
-                fossil_cache_free_entry(entry);
-                if (g_cache.entry_count > 0) g_cache.entry_count--;
-                g_cache.expired_evictions++;
-                fossil_cache_unlock();
-                return false;
-            }
-            if (ttl_sec > 0) {
-                entry->expiry = now + ttl_sec;
-                if (entry->created == 0) entry->created = now;
-            } else {
-                entry->expiry = 0; // make non-expiring
-            }
-            entry->last_access = now; // treat as a maintenance touch
-            fossil_cache_unlock();
-            return true;
+// Pin of a value the caller gets to itself (shared-memory entries).
+static fossil_bluecrab_cache_pin_t *fossil_cache_pin_copy(const void *data, size_t size) {
+    fossil_bluecrab_cache_pin_t *pin = (fossil_bluecrab_cache_pin_t *)calloc(1, sizeof(*pin));
+    void *copy = malloc(size ? size : 1);
+    if (!pin || !copy) {
+        free(pin);
+        free(copy);
+        return NULL;
+    }
+    memcpy(copy, data, size);
+    pin->bytes = copy;
+    pin->size = size;
+    pin->refs = 1;
+    pin->owned = copy;
+    pin->private_copy = true;
+    return pin;
+}
+
+// Creates the shared pin of an entry's current value. Caller holds the lock.
+static fossil_bluecrab_cache_pin_t *fossil_cache_pin_attach(fossil_cache_entry_t *entry) {
+    fossil_bluecrab_cache_pin_t *pin = (fossil_bluecrab_cache_pin_t *)calloc(1, sizeof(*pin));
+    if (!pin)
+        return NULL;
+    pin->size = fossil_cache_value_size(entry);
+    if (entry->flags & FOSSIL_CACHE_ENTRY_LZ) { // readers need the decoded bytes
+        void *decoded = malloc(pin->size);
+        if (!decoded) {
+            free(pin);
+            return NULL;
         }
-        prev = entry;
-        entry = entry->next;
+        fossil_cache_value_copy(entry, decoded, pin->size);
+        pin->owned = decoded;
+        pin->bytes = decoded;
+    } else {
+        pin->bytes = entry->data;
+    }
+    pin->refs = 1;
+    pin->entry = entry;
+    entry->pin = pin;
+    return pin;
+}
+
+const void *fossil_bluecrab_cacheshell_pin(const char *key, size_t *out_size,
+                                           fossil_bluecrab_cache_pin_t **out_pin) {
+    return fossil_bluecrab_cacheshell_pin_n(key, key ? strlen(key) : 0, out_size, out_pin);
+}
+
+const void *fossil_bluecrab_cacheshell_pin_n(const char *key, size_t key_len, size_t *out_size,
+                                             fossil_bluecrab_cache_pin_t **out_pin) {
+    if (out_size)
+        *out_size = 0;
+    if (!out_pin)
+        return NULL;
+    *out_pin = NULL;
+    if (!key)
+        return NULL;
+    fossil_cache_hot_sample(key, key_len);
+
+    fossil_bluecrab_cache_pin_t *pin = NULL;
+    if (g_cache.shm) {
+        if (!fossil_cache_shm_lock())
+            return NULL;
+        fossil_cache_shm_entry_t *e = fossil_cache_shm_lookup(key, key_len, true);
+        if (e)
+            pin = fossil_cache_pin_copy(fossil_cache_shm_data(e), (size_t)e->size);
+        fossil_cache_shm_unlock();
+    } else {
+        fossil_cache_lock();
+        fossil_cache_entry_t *entry = fossil_cache_find_raw(key, key_len, fossil_cache_hash(key, key_len));
+        if (entry && entry->pin) {
+            pin = entry->pin;
+            pin->refs++;
+        } else if (entry) {
+            pin = fossil_cache_pin_attach(entry);
+        }
+        fossil_cache_unlock();
+    }
+
+    if (!pin)
+        return NULL;
+    if (out_size)
+        *out_size = pin->size;
+    *out_pin = pin;
+    return pin->bytes;
+}
+
+void fossil_bluecrab_cacheshell_unpin(fossil_bluecrab_cache_pin_t *pin) {
+    if (!pin)
+        return;
+    bool shared = !pin->private_copy;
+    if (shared)
+        fossil_cache_lock();
+    bool last = --pin->refs == 0;
+    if (last && pin->entry)
+        pin->entry->pin = NULL;
+    if (shared)
+        fossil_cache_unlock();
+
+    if (last) {
+        if (pin->owned)
+            fossil_cache_value_release(pin->owned, pin->owned_flags);
+        free(pin);
+    }
+}
+
+// ===========================================================
+// Collection Values (hash / list / set)
+// ===========================================================
+
+// Finds the collection stored at key, creating an empty one if asked.
+// Caller holds the lock. NULL on a type mismatch, a missing key without
+// create, the entry limit or allocation failure.
+static fossil_cache_entry_t *fossil_cache_coll_entry(const char *key, size_t key_len,
+                                                     fossil_cache_type_t type,
+                                                     bool create, bool count_stats) {
+    if (!g_cache.buckets)
+        return NULL;
+    size_t hash = fossil_cache_hash(key, key_len);
+    fossil_cache_entry_t *entry = fossil_cache_find_hashed(key, key_len, hash, count_stats);
+    if (entry)
+        return entry->type == type ? entry : NULL;
+    if (!create || (g_cache.max_entries && g_cache.entry_count >= g_cache.max_entries))
+        return NULL;
+
+    entry = (fossil_cache_entry_t *)calloc(1, sizeof(*entry));
+    if (!entry)
+        return NULL;
+    entry->key = cacheshell_memdup(key, key_len);
+    entry->key_len = key_len;
+    entry->hash = hash;
+    entry->data = calloc(1, sizeof(fossil_cache_coll_t));
+    entry->type = type;
+    if (!entry->key || !entry->data) {
+        fossil_cache_free_entry(entry);
+        return NULL;
+    }
+    entry->size = fossil_cache_coll_bytes((fossil_cache_coll_t *)entry->data);
+    entry->created = time(NULL);
+    entry->last_access = entry->created;
+    if (!fossil_cache_insert_entry(entry, hash)) {
+        fossil_cache_free_entry(entry);
+        return NULL;
+    }
+    return entry;
+}
+
+// Re-accounts a collection after a mutation; empty ones are removed.
+static void fossil_cache_coll_commit(fossil_cache_entry_t *entry) {
+    fossil_cache_coll_t *c = (fossil_cache_coll_t *)entry->data;
+    if (c->count == 0) {
+        fossil_cache_unlink_entry(entry);
+        return;
+    }
+    size_t old_bytes = fossil_cache_entry_bytes(entry);
+    entry->size = fossil_cache_coll_bytes(c);
+    g_cache.total_bytes = g_cache.total_bytes - old_bytes + fossil_cache_entry_bytes(entry);
+    entry->last_access = time(NULL);
+    fossil_cache_big_note(entry);
+}
+
+bool fossil_bluecrab_cacheshell_hset(const char *key, const char *field, const void *value, size_t size) {
+    return key && field &&
+           fossil_bluecrab_cacheshell_hset_n(key, strlen(key), field, strlen(field), value, size);
+}
+
+bool fossil_bluecrab_cacheshell_hset_n(const char *key, size_t key_len, const char *field, size_t field_len,
+                                       const void *value, size_t size) {
+    if (!key || !field || (!value && size) || g_cache.shm)
+        return false;
+    fossil_cache_hot_sample(key, key_len);
+
+    fossil_cache_lock();
+    fossil_cache_entry_t *entry = fossil_cache_coll_entry(key, key_len, FOSSIL_CACHE_TYPE_HASH, true, false);
+    bool ok = entry && fossil_cache_coll_put((fossil_cache_coll_t *)entry->data, true, field, field_len, value, size);
+    if (entry)
+        fossil_cache_coll_commit(entry);
+    fossil_cache_unlock();
+    return ok;
+}
+
+bool fossil_bluecrab_cacheshell_hget(const char *key, const char *field,
+                                     void *out_buf, size_t buf_size, size_t *out_size) {
+    if (!key || !field) {
+        if (out_size)
+            *out_size = 0;
+        return false;
+    }
+    return fossil_bluecrab_cacheshell_hget_n(key, strlen(key), field, strlen(field), out_buf, buf_size, out_size);
+}
+
+bool fossil_bluecrab_cacheshell_hget_n(const char *key, size_t key_len, const char *field, size_t field_len,
+                                       void *out_buf, size_t buf_size, size_t *out_size) {
+    if (out_size)
+        *out_size = 0;
+    if (!key || !field || g_cache.shm)
+        return false;
+    fossil_cache_hot_sample(key, key_len);
+
+    fossil_cache_lock();
+    fossil_cache_entry_t *entry = fossil_cache_coll_entry(key, key_len, FOSSIL_CACHE_TYPE_HASH, false, true);
+    const void *value = NULL;
+    size_t value_len = 0;
+    bool found = entry && fossil_cache_coll_get((fossil_cache_coll_t *)entry->data, true,
+                                                field, field_len, &value, &value_len);
+    if (found) {
+        if (out_size)
+            *out_size = value_len;
+        if (out_buf && buf_size && value_len)
+            memcpy(out_buf, value, value_len < buf_size ? value_len : buf_size);
     }
+    fossil_cache_unlock();
+    return found;
+}
+
+bool fossil_bluecrab_cacheshell_hdel(const char *key, const char *field) {
+    return key && field && fossil_bluecrab_cacheshell_hdel_n(key, strlen(key), field, strlen(field));
+}
+
+bool fossil_bluecrab_cacheshell_hdel_n(const char *key, size_t key_len, const char *field, size_t field_len) {
+    if (!key || !field || g_cache.shm)
+        return false;
+
+    fossil_cache_lock();
+    fossil_cache_entry_t *entry = fossil_cache_coll_entry(key, key_len, FOSSIL_CACHE_TYPE_HASH, false, false);
+    bool removed = entry && fossil_cache_coll_del((fossil_cache_coll_t *)entry->data, true, field, field_len);
+    if (removed)
+        fossil_cache_coll_commit(entry);
+    fossil_cache_unlock();
+    return removed;
+}
+
+bool fossil_bluecrab_cacheshell_lpush(const char *key, const void *value, size_t size) {
+    return key && fossil_bluecrab_cacheshell_lpush_n(key, strlen(key), value, size);
+}
+
+bool fossil_bluecrab_cacheshell_lpush_n(const char *key, size_t key_len, const void *value, size_t size) {
+    if (!key || (!value && size) || g_cache.shm)
+        return false;
+    fossil_cache_hot_sample(key, key_len);
+
+    fossil_cache_lock();
+    fossil_cache_entry_t *entry = fossil_cache_coll_entry(key, key_len, FOSSIL_CACHE_TYPE_LIST, true, false);
+    bool ok = entry && fossil_cache_coll_push_front((fossil_cache_coll_t *)entry->data, value, size);
+    if (entry)
+        fossil_cache_coll_commit(entry);
+    fossil_cache_unlock();
+    return ok;
+}
+
+size_t fossil_bluecrab_cacheshell_lrange(const char *key, long start, long stop,
+                                         fossil_bluecrab_cache_value_cb cb, void *user_data) {
+    return key ? fossil_bluecrab_cacheshell_lrange_n(key, strlen(key), start, stop, cb, user_data) : 0;
+}
+
+size_t fossil_bluecrab_cacheshell_lrange_n(const char *key, size_t key_len, long start, long stop,
+                                           fossil_bluecrab_cache_value_cb cb, void *user_data) {
+    if (!key || !cb || g_cache.shm)
+        return 0;
+    fossil_cache_hot_sample(key, key_len);
+
+    fossil_cache_lock();
+    fossil_cache_entry_t *entry = fossil_cache_coll_entry(key, key_len, FOSSIL_CACHE_TYPE_LIST, false, true);
+    size_t n = entry ? fossil_cache_coll_range((fossil_cache_coll_t *)entry->data,
+                                               start, stop, cb, user_data) : 0;
+    fossil_cache_unlock();
+    return n;
+}
+
+bool fossil_bluecrab_cacheshell_sadd(const char *key, const char *member) {
+    return key && member && fossil_bluecrab_cacheshell_sadd_n(key, strlen(key), member, strlen(member));
+}
 
+bool fossil_bluecrab_cacheshell_sadd_n(const char *key, size_t key_len, const char *member, size_t member_len) {
+    if (!key || !member || g_cache.shm)
+        return false;
+    fossil_cache_hot_sample(key, key_len);
+
+    fossil_cache_lock();
+    fossil_cache_entry_t *entry = fossil_cache_coll_entry(key, key_len, FOSSIL_CACHE_TYPE_SET, true, false);
+    bool ok = entry && fossil_cache_coll_put((fossil_cache_coll_t *)entry->data, false, member, member_len, NULL, 0);
+    if (entry)
+        fossil_cache_coll_commit(entry);
     fossil_cache_unlock();
-    return false;
+    return ok;
 }
 
-int fossil_bluecrab_cacheshell_ttl(const char *key) {
-    if (!key) return -1;
+bool fossil_bluecrab_cacheshell_sismember(const char *key, const char *member) {
+    return key && member && fossil_bluecrab_cacheshell_sismember_n(key, strlen(key), member, strlen(member));
+}
+
+bool fossil_bluecrab_cacheshell_sismember_n(const char *key, size_t key_len, const char *member,
+                                            size_t member_len) {
+    if (!key || !member || g_cache.shm)
+        return false;
+    fossil_cache_hot_sample(key, key_len);
+
+    fossil_cache_lock();
+    fossil_cache_entry_t *entry = fossil_cache_coll_entry(key, key_len, FOSSIL_CACHE_TYPE_SET, false, true);
+    bool found = entry && fossil_cache_coll_get((fossil_cache_coll_t *)entry->data, false,
+                                                member, member_len, NULL, NULL);
+    fossil_cache_unlock();
+    return found;
+}
+
+// ===========================================================
+// Cache Management
+// ===========================================================
+
+void fossil_bluecrab_cacheshell_clear(void) {
+    if (g_cache.shm) {
+        fossil_cache_shm_clear();
+        return;
+    }
 
     fossil_cache_lock();
+
     if (!g_cache.buckets) {
         fossil_cache_unlock();
-        return -1;
+        return;
     }
 
-    size_t index = fossil_cache_hash(key) % g_cache.bucket_count;
-    fossil_cache_entry_t *prev = NULL;
-    fossil_cache_entry_t *curr = g_cache.buckets[index];
-    time_t now = time(NULL);
-
-    while (curr) {
-        if (strcmp(curr->key, key) == 0) {
-            // If expired, unlink and report -1 (also count eviction, but no hit/miss)
-            if (curr->expiry > 0 && curr->expiry <= now) {
-                if (prev)
-                    prev->next = curr->next;
-                else
-                    g_cache.buckets[index] = curr->next;
-                fossil_cache_free_entry(curr);
-                if (g_cache.entry_count > 0)
-                    g_cache.entry_count--;
-                g_cache.expired_evictions++;
-                fossil_cache_unlock();
-                return -1;
-            }
-            // No TTL set
-            if (curr->expiry == 0) {
-                fossil_cache_unlock();
-                return -1;
-            }
-            int ttl = (int)difftime(curr->expiry, now);
-            fossil_cache_unlock();
-            return ttl > 0 ? ttl : -1;
+    for (size_t i = 0; i < g_cache.bucket_count; ++i) {
+        fossil_cache_entry_t *entry = g_cache.buckets[i];
+        while (entry) {
+            fossil_cache_entry_t *next = entry->next;
+            fossil_cache_free_entry(entry);
+            entry = next;
         }
-        prev = curr;
-        curr = curr->next;
+        g_cache.buckets[i] = NULL;
     }
+    fossil_cache_index_destroy_nodes(true);
+    fossil_cache_l1_invalidate_all();
+    fossil_cache_big_reset();
+
+    g_cache.entry_count = 0;
+    g_cache.total_bytes = 0;          // reset accounted bytes
+    g_cache.lz_entries = 0;
+    g_cache.lz_logical_bytes = 0;
+    g_cache.lz_stored_bytes = 0;
+    g_cache.lob_count = 0;
+    g_cache.lob_bytes = 0;
+    g_cache.lob_head = g_cache.lob_tail = NULL;
+    // Do NOT reset hits/misses or expired_evictions to preserve lifetime stats.
 
     fossil_cache_unlock();
-    return -1;
 }
 
-bool fossil_bluecrab_cacheshell_touch(const char *key) {
-    if (!key) return false;
+size_t fossil_bluecrab_cacheshell_count(void) {
+    if (g_cache.shm)
+        return (size_t)__atomic_load_n(&g_cache.shm->entry_count, __ATOMIC_RELAXED);
+    return g_cache.entry_count;
+}
+
+size_t fossil_bluecrab_cacheshell_memory_usage(void) {
+    if (g_cache.shm) {
+        if (!fossil_cache_shm_lock())
+            return 0;
+        size_t bytes = (size_t)g_cache.shm->total_bytes;
+        fossil_cache_shm_unlock();
+        return bytes;
+    }
 
     fossil_cache_lock();
+    size_t bytes = g_cache.total_bytes; // O(1) tracked value
+    fossil_cache_unlock();
+    return bytes;
+}
 
-    if (!g_cache.buckets) {
-        fossil_cache_unlock();
-        return false;
+// ===========================================================
+// Statistics / Thread Safety
+// ===========================================================
+
+void fossil_bluecrab_cacheshell_stats(size_t *out_hits, size_t *out_misses) {
+    if (g_cache.shm) {
+        bool locked = fossil_cache_shm_lock();
+        if (out_hits)   *out_hits   = locked ? (size_t)g_cache.shm->hits : 0;
+        if (out_misses) *out_misses = locked ? (size_t)g_cache.shm->misses : 0;
+        if (locked)
+            fossil_cache_shm_unlock();
+        return;
     }
 
-    size_t index = fossil_cache_hash(key) % g_cache.bucket_count;
-    fossil_cache_entry_t *prev = NULL;
-    fossil_cache_entry_t *entry = g_cache.buckets[index];
-    time_t now = time(NULL);
+    uint64_t l1_hits, l1_misses;
+    fossil_cache_l1_totals(&l1_hits, &l1_misses);
 
-    while (entry) {
-        if (strcmp(entry->key, key) == 0) {
-            // If expired, remove and report false (do not count as miss/hit)
-            if (entry->expiry > 0 && entry->expiry <= now) {
-                if (prev)
-                    prev->next = entry->next;
-                else
-                    g_cache.buckets[index] = entry->next;
-                fossil_cache_free_entry(entry);
-                if (g_cache.entry_count > 0) g_cache.entry_count--;
-                g_cache.expired_evictions++;
-                fossil_cache_unlock();
-                return false;
-            }
+    fossil_cache_lock();
+    if (out_hits)   *out_hits   = g_cache.hits + (size_t)l1_hits;
+    if (out_misses) *out_misses = g_cache.misses;
+    fossil_cache_unlock();
+}
 
-            // Update last access timestamp
-            entry->last_access = now;
-            if (entry->created == 0)
-                entry->created = now;
+void fossil_bluecrab_cacheshell_stats_extended(
+        size_t *out_hits,
+        size_t *out_misses,
+        size_t *out_entries,
+        size_t *out_expired_evictions,
+        size_t *out_memory_bytes,
+        time_t *out_uptime_seconds) {
 
-            // For expiring entries, extend by the original TTL (expiry - created)
-            if (entry->expiry > 0) {
-                time_t original_ttl = 0;
-                if (entry->created > 0 && entry->expiry > entry->created)
-                    original_ttl = entry->expiry - entry->created;
+    if (g_cache.shm) {
+        if (!fossil_cache_shm_lock()) {
+            if (out_hits)             *out_hits = 0;
+            if (out_misses)           *out_misses = 0;
+            if (out_entries)          *out_entries = 0;
+            if (out_expired_evictions)*out_expired_evictions = 0;
+            if (out_memory_bytes)     *out_memory_bytes = 0;
+            if (out_uptime_seconds)   *out_uptime_seconds = 0;
+            return;
+        }
+        fossil_cache_shm_header_t *h = g_cache.shm;
+        if (out_hits)             *out_hits = (size_t)h->hits;
+        if (out_misses)           *out_misses = (size_t)h->misses;
+        if (out_entries)          *out_entries = (size_t)h->entry_count;
+        if (out_expired_evictions)*out_expired_evictions = (size_t)h->expired_evictions;
+        if (out_memory_bytes)     *out_memory_bytes = (size_t)h->total_bytes;
+        if (out_uptime_seconds) {
+            int64_t now = (int64_t)time(NULL);
+            *out_uptime_seconds = now >= h->start_time ? (time_t)(now - h->start_time) : 0;
+        }
+        fossil_cache_shm_unlock();
+        return;
+    }
 
-                if (original_ttl > 0) {
-                    entry->expiry = now + original_ttl;
-                } else {
-                    // Fallback: preserve remaining time (rare path if created not set)
-                    time_t remaining = entry->expiry - now;
-                    if (remaining > 0)
-                        entry->expiry = now + remaining;
-                }
-            }
+    uint64_t l1_hits, l1_misses;
+    fossil_cache_l1_totals(&l1_hits, &l1_misses);
 
-            fossil_cache_unlock();
-            return true;
-        }
-        prev = entry;
-        entry = entry->next;
+    fossil_cache_lock();
+    if (out_hits)             *out_hits = g_cache.hits + (size_t)l1_hits;
+    if (out_misses)           *out_misses = g_cache.misses;
+    if (out_entries)          *out_entries = g_cache.entry_count;
+    if (out_expired_evictions)*out_expired_evictions = g_cache.expired_evictions;
+    if (out_memory_bytes)     *out_memory_bytes = g_cache.total_bytes;
+    if (out_uptime_seconds) {
+        time_t now = time(NULL);
+        *out_uptime_seconds = (g_cache.start_time > 0 && now >= g_cache.start_time)
+                              ? (now - g_cache.start_time)
+                              : 0;
+    }
+    fossil_cache_unlock();
+}
+
+void fossil_bluecrab_cacheshell_layer_stats(
+        size_t *out_l1_hits,
+        size_t *out_l1_misses,
+        size_t *out_shared_hits,
+        size_t *out_shared_misses) {
+
+    if (g_cache.shm) { // no near cache in shared mode
+        if (out_l1_hits)   *out_l1_hits = 0;
+        if (out_l1_misses) *out_l1_misses = 0;
+        fossil_bluecrab_cacheshell_stats_extended(out_shared_hits, out_shared_misses,
+                                                  NULL, NULL, NULL, NULL);
+        return;
     }
 
+    uint64_t l1_hits, l1_misses;
+    fossil_cache_l1_totals(&l1_hits, &l1_misses);
+
+    fossil_cache_lock();
+    if (out_l1_hits)       *out_l1_hits = (size_t)l1_hits;
+    if (out_l1_misses)     *out_l1_misses = (size_t)l1_misses;
+    if (out_shared_hits)   *out_shared_hits = g_cache.hits;
+    if (out_shared_misses) *out_shared_misses = g_cache.misses;
     fossil_cache_unlock();
-    return false;
 }
 
-size_t fossil_bluecrab_cacheshell_evict_expired(void) {
+void fossil_bluecrab_cacheshell_threadsafe(bool enabled) {
+    g_cache.locking_enabled = enabled;
+}
+
+// ===========================================================
+// Iteration
+// ===========================================================
+
+void fossil_bluecrab_cacheshell_iterate(fossil_bluecrab_cache_iter_cb cb, void *user_data) {
+    if (!cb) return;
+    fossil_cache_iter_adapter_t adapter = { cb, user_data };
+    fossil_bluecrab_cacheshell_iterate_n(fossil_cache_iter_adapt, &adapter);
+}
+
+void fossil_bluecrab_cacheshell_iterate_n(fossil_bluecrab_cache_iter_n_cb cb, void *user_data) {
+    if (!cb) return;
+    if (g_cache.shm) {
+        if (!fossil_cache_shm_lock())
+            return;
+        fossil_cache_key_range_t all = fossil_cache_key_range(NULL, 0, NULL, 0, NULL, 0);
+        fossil_cache_shm_visit(&all, false, cb, user_data);
+        fossil_cache_shm_unlock();
+        return;
+    }
+
     fossil_cache_lock();
     if (!g_cache.buckets) {
         fossil_cache_unlock();
-        return 0;
+        return;
     }
 
-    size_t evicted = 0;
     time_t now = time(NULL);
 
     for (size_t i = 0; i < g_cache.bucket_count; ++i) {
         fossil_cache_entry_t *prev = NULL;
-        fossil_cache_entry_t *curr = g_cache.buckets[i];
-
-        while (curr) {
-            if (curr->expiry > 0 && curr->expiry <= now) {
-                fossil_cache_entry_t *dead = curr;
+        fossil_cache_entry_t *entry = g_cache.buckets[i];
 
+        while (entry) {
+            // Remove expired inline (lazy eviction)
+            if (entry->expiry > 0 && entry->expiry <= now) {
+                fossil_cache_entry_t *dead = entry;
                 if (prev)
-                    prev->next = curr->next;
+                    prev->next = entry->next;
                 else
-                    g_cache.buckets[i] = curr->next;
-
-                curr = curr->next;
+                    g_cache.buckets[i] = entry->next;
 
-                size_t bytes = sizeof(*dead) + dead->size + strlen(dead->key) + 1;
-                if (g_cache.total_bytes >= bytes)
-                    g_cache.total_bytes -= bytes;
-                else
-                    g_cache.total_bytes = 0;
+                entry = entry->next;
 
-                fossil_cache_free_entry(dead);
-                if (g_cache.entry_count > 0)
-                    g_cache.entry_count--;
+                fossil_cache_drop_entry(dead);
                 g_cache.expired_evictions++;
-                evicted++;
                 continue;
             }
-            prev = curr;
-            curr = curr->next;
+
+            // Invoke callback (note: lock is held; callback must not call cache APIs that lock)
+            if (entry->type == FOSSIL_CACHE_TYPE_RAW)
+                fossil_cache_visit_entry(cb, entry, user_data);
+
+            prev = entry;
+            entry = entry->next;
         }
     }
 
     fossil_cache_unlock();
-    return evicted;
 }
 
 // ===========================================================
-// Binary-Safe Operations
+// Ordered Index / Range Queries
 // ===========================================================
 
-bool fossil_bluecrab_cacheshell_set_binary(const char *key, const void *data, size_t size) {
-    if (!key || !data || size == 0)
-        return false;
+bool fossil_bluecrab_cacheshell_ordered_index(bool enabled) {
+    if (g_cache.shm) // pointers cannot live in the shared segment
+        return !enabled;
 
     fossil_cache_lock();
-
     if (!g_cache.buckets) {
         fossil_cache_unlock();
         return false;
     }
 
-    size_t index = fossil_cache_hash(key) % g_cache.bucket_count;
-    fossil_cache_entry_t *entry = g_cache.buckets[index];
+    if (!enabled) {
+        fossil_cache_index_destroy_nodes(false);
+        fossil_cache_unlock();
+        return true;
+    }
+    if (g_cache.index_head) {
+        fossil_cache_unlock();
+        return true;
+    }
 
-    // Update existing entry (allowed even if at max capacity)
-    while (entry) {
-        if (strcmp(entry->key, key) == 0) {
-            void *newblk = malloc(size);
-            if (!newblk) {
+    g_cache.index_head = fossil_cache_index_node_new(NULL, FOSSIL_CACHE_INDEX_MAX_LEVEL);
+    if (!g_cache.index_head) {
+        fossil_cache_unlock();
+        return false;
+    }
+    g_cache.index_level = 1;
+    if (g_cache.index_rng == 0)
+        g_cache.index_rng = 0x9e3779b97f4a7c15ull ^ (uint64_t)time(NULL);
+
+    // Build from the existing table
+    for (size_t i = 0; i < g_cache.bucket_count; ++i) {
+        for (fossil_cache_entry_t *e = g_cache.buckets[i]; e; e = e->next) {
+            if (!fossil_cache_index_insert(e)) {
+                fossil_cache_index_destroy_nodes(false);
                 fossil_cache_unlock();
                 return false;
             }
-            memcpy(newblk, data, size);
+        }
+    }
 
-            // Adjust memory usage accounting
-            size_t old_bytes = sizeof(*entry) + entry->size + strlen(entry->key) + 1;
-            size_t new_bytes = sizeof(*entry) + size + strlen(entry->key) + 1;
-            if (new_bytes >= old_bytes)
-                g_cache.total_bytes += (new_bytes - old_bytes);
-            else
-                g_cache.total_bytes -= (old_bytes - new_bytes);
+    fossil_cache_unlock();
+    return true;
+}
 
-            free(entry->data);
-            entry->data = newblk;
-            entry->size = size;
-            entry->expiry = 0; // reset TTL on overwrite (intentional)
-            time_t now = time(NULL);
-            if (entry->created == 0) entry->created = now;
-            entry->last_access = now;
-            fossil_cache_unlock();
-            return true;
+// Shared walker for scan_* / delete_*. Visits matching, non-expired entries
+// in key order when the index is enabled (filtered table walk otherwise),
+// invoking cb and/or removing them. Expired entries met on the way are
+// evicted. Returns the number of entries visited or removed.
+static size_t fossil_cache_range_visit(const fossil_cache_key_range_t *bounds, bool remove,
+                                       fossil_bluecrab_cache_iter_n_cb cb, void *user_data) {
+    fossil_cache_key_range_t range = *bounds;
+    time_t now = time(NULL);
+    size_t visited = 0;
+
+    if (g_cache.index_head) {
+        fossil_cache_index_node_t *node = range.prefix ? fossil_cache_index_seek(range.prefix, range.prefix_len, NULL)
+                                        : range.start  ? fossil_cache_index_seek(range.start, range.start_len, NULL)
+                                                       : g_cache.index_head->next[0];
+        range.start = NULL; // the seek already skipped everything below start
+        while (node) {
+            fossil_cache_index_node_t *next = node->next[0];
+            fossil_cache_entry_t *entry = node->entry;
+            if (!fossil_cache_key_matches(entry->key, entry->key_len, &range))
+                break; // sorted: nothing further can match
+
+            if (entry->expiry > 0 && entry->expiry <= now) {
+                fossil_cache_unlink_entry(entry);
+                g_cache.expired_evictions++;
+            } else if (remove) {
+                fossil_cache_unlink_entry(entry);
+                visited++;
+            } else if (entry->type == FOSSIL_CACHE_TYPE_RAW) {
+                if (cb)
+                    fossil_cache_visit_entry(cb, entry, user_data);
+                visited++;
+            }
+            node = next;
+        }
+        return visited;
+    }
+
+    for (size_t i = 0; i < g_cache.bucket_count; ++i) {
+        fossil_cache_entry_t *prev = NULL;
+        fossil_cache_entry_t *entry = g_cache.buckets[i];
+        while (entry) {
+            fossil_cache_entry_t *next = entry->next;
+            bool expired = entry->expiry > 0 && entry->expiry <= now;
+            bool match = !expired &&
+                fossil_cache_key_matches(entry->key, entry->key_len, &range) &&
+                (remove || entry->type == FOSSIL_CACHE_TYPE_RAW); // scans skip collections
+
+            if (match) {
+                if (cb)
+                    fossil_cache_visit_entry(cb, entry, user_data);
+                visited++;
+            }
+            if (expired || (match && remove)) {
+                if (prev)
+                    prev->next = next;
+                else
+                    g_cache.buckets[i] = next;
+                fossil_cache_drop_entry(entry);
+                if (expired)
+                    g_cache.expired_evictions++;
+            } else {
+                prev = entry;
+            }
+            entry = next;
         }
-        entry = entry->next;
-    }
-
-    // Insertion path
-    if (g_cache.max_entries && g_cache.entry_count >= g_cache.max_entries) {
-        fossil_cache_unlock();
-        return false;
     }
+    return visited;
+}
 
-    fossil_cache_entry_t *new_entry = (fossil_cache_entry_t *)calloc(1, sizeof(fossil_cache_entry_t));
-    if (!new_entry) {
-        fossil_cache_unlock();
-        return false;
+// Locks the active backend and runs the matching walker.
+static size_t fossil_cache_range_run(const fossil_cache_key_range_t *range, bool remove,
+                                     fossil_bluecrab_cache_iter_n_cb cb, void *user_data) {
+    if (g_cache.shm) {
+        if (!fossil_cache_shm_lock())
+            return 0;
+        size_t n = fossil_cache_shm_visit(range, remove, cb, user_data);
+        fossil_cache_shm_unlock();
+        return n;
     }
 
-    new_entry->key = cacheshell_strdup(key);
-    new_entry->data = malloc(size);
-    if (!new_entry->key || !new_entry->data) {
-        fossil_cache_free_entry(new_entry);
+    fossil_cache_lock();
+    if (!g_cache.buckets) {
         fossil_cache_unlock();
-        return false;
+        return 0;
     }
+    size_t n = fossil_cache_range_visit(range, remove, cb, user_data);
+    fossil_cache_unlock();
+    return n;
+}
 
-    memcpy(new_entry->data, data, size);
-    new_entry->size = size;
-    new_entry->expiry = 0;
-    time_t now = time(NULL);
-    new_entry->created = now;
-    new_entry->last_access = now;
+size_t fossil_bluecrab_cacheshell_scan_prefix(const char *prefix, fossil_bluecrab_cache_iter_cb cb, void *user_data) {
+    if (!prefix || !cb) return 0;
+    fossil_cache_key_range_t range = fossil_cache_key_range_str(NULL, NULL, prefix);
+    fossil_cache_iter_adapter_t adapter = { cb, user_data };
+    return fossil_cache_range_run(&range, false, fossil_cache_iter_adapt, &adapter);
+}
 
-    new_entry->next = g_cache.buckets[index];
-    g_cache.buckets[index] = new_entry;
-    g_cache.entry_count++;
+size_t fossil_bluecrab_cacheshell_scan_prefix_n(const char *prefix, size_t prefix_len,
+                                                fossil_bluecrab_cache_iter_n_cb cb, void *user_data) {
+    if (!prefix || !cb) return 0;
+    fossil_cache_key_range_t range = fossil_cache_key_range(NULL, 0, NULL, 0, prefix, prefix_len);
+    return fossil_cache_range_run(&range, false, cb, user_data);
+}
 
-    // Memory accounting
-    g_cache.total_bytes += sizeof(*new_entry) + size + strlen(new_entry->key) + 1;
+size_t fossil_bluecrab_cacheshell_scan_range(const char *start, const char *end,
+                                             fossil_bluecrab_cache_iter_cb cb, void *user_data) {
+    if (!cb) return 0;
+    fossil_cache_key_range_t range = fossil_cache_key_range_str(start, end, NULL);
+    fossil_cache_iter_adapter_t adapter = { cb, user_data };
+    return fossil_cache_range_run(&range, false, fossil_cache_iter_adapt, &adapter);
+}
 
-    fossil_cache_unlock();
-    return true;
+size_t fossil_bluecrab_cacheshell_scan_range_n(const char *start, size_t start_len, const char *end, size_t end_len,
+                                               fossil_bluecrab_cache_iter_n_cb cb, void *user_data) {
+    if (!cb) return 0;
+    fossil_cache_key_range_t range = fossil_cache_key_range(start, start_len, end, end_len, NULL, 0);
+    return fossil_cache_range_run(&range, false, cb, user_data);
 }
 
-// Binary fetch (returns internal pointer, do NOT modify or free).
-// Thread-safe lookup; pointer becomes invalid if the entry is later removed or updated.
-const void *fossil_bluecrab_cacheshell_get_binary(const char *key, size_t *out_size) {
-    if (!key)
-        return NULL;
+size_t fossil_bluecrab_cacheshell_delete_prefix(const char *prefix) {
+    return prefix ? fossil_bluecrab_cacheshell_delete_prefix_n(prefix, strlen(prefix)) : 0;
+}
 
-    fossil_cache_lock();
-    fossil_cache_entry_t *entry = fossil_cache_find(key);
-    if (!entry) {
-        fossil_cache_unlock();
-        return NULL;
-    }
+size_t fossil_bluecrab_cacheshell_delete_prefix_n(const char *prefix, size_t prefix_len) {
+    if (!prefix) return 0;
+    fossil_cache_key_range_t range = fossil_cache_key_range(NULL, 0, NULL, 0, prefix, prefix_len);
+    return fossil_cache_range_run(&range, true, NULL, NULL);
+}
 
-    if (out_size)
-        *out_size = entry->size;
+size_t fossil_bluecrab_cacheshell_delete_range(const char *start, const char *end) {
+    fossil_cache_key_range_t range = fossil_cache_key_range_str(start, end, NULL);
+    return fossil_cache_range_run(&range, true, NULL, NULL);
+}
 
-    const void *ptr = entry->data; // internal buffer
-    fossil_cache_unlock();
-    return ptr;
+size_t fossil_bluecrab_cacheshell_delete_range_n(const char *start, size_t start_len, const char *end, size_t end_len) {
+    fossil_cache_key_range_t range = fossil_cache_key_range(start, start_len, end, end_len, NULL, 0);
+    return fossil_cache_range_run(&range, true, NULL, NULL);
 }
 
 // ===========================================================
-// Cache Management
+// Near Cache (per-thread L1)
 // ===========================================================
 
-void fossil_bluecrab_cacheshell_clear(void) {
-    fossil_cache_lock();
+bool fossil_bluecrab_cacheshell_near_cache(bool enabled, unsigned int max_staleness_ms) {
+    if (g_cache.shm) // other processes' writes cannot bump our versions
+        return !enabled;
 
+    fossil_cache_lock();
     if (!g_cache.buckets) {
         fossil_cache_unlock();
-        return;
+        return false;
     }
+    // Slots filled before a disable/enable cycle missed the per-key
+    // invalidations in between, so any toggle retires all of them.
+    fossil_cache_l1_invalidate_all();
+    fossil_cache_atomic_store(&g_cache_l1.lease_ms, enabled ? max_staleness_ms : 0);
+    fossil_cache_atomic_store(&g_cache_l1.enabled, enabled ? 1 : 0);
+    fossil_cache_unlock();
+    return true;
+}
 
-    for (size_t i = 0; i < g_cache.bucket_count; ++i) {
-        fossil_cache_entry_t *entry = g_cache.buckets[i];
-        while (entry) {
-            fossil_cache_entry_t *next = entry->next;
-            fossil_cache_free_entry(entry);
-            entry = next;
-        }
-        g_cache.buckets[i] = NULL;
-    }
+// ===========================================================
+// Hot / Big Key Tracking
+// ===========================================================
 
-    g_cache.entry_count = 0;
-    g_cache.total_bytes = 0;          // reset accounted bytes
-    // Do NOT reset hits/misses or expired_evictions to preserve lifetime stats.
+bool fossil_bluecrab_cacheshell_key_tracking(bool enabled, unsigned int sample_rate) {
+    if (!g_cache.buckets && !g_cache.shm)
+        return false;
+    if (sample_rate == 0)
+        sample_rate = 1;
 
+    // Cache lock first (entry flags), then the keys lock: same order as writers.
+    fossil_cache_lock();
+    fossil_cache_keys_lock();
+    fossil_cache_atomic_store(&g_cache_keys.sample_rate, 0);
+    g_cache_keys.hot_used = 0;
+    for (size_t i = 0; i < g_cache_keys.big_used; ++i)
+        g_cache_keys.big[i].entry->flags &= ~FOSSIL_CACHE_ENTRY_BIG;
+    g_cache_keys.big_used = 0;
+    fossil_cache_big_update_threshold();
+    fossil_cache_keys_unlock();
+
+    if (enabled) {
+        fossil_cache_atomic_store(&g_cache_keys.sample_rate, sample_rate);
+        // Seed the big-key list from what is already stored
+        for (size_t i = 0; g_cache.buckets && i < g_cache.bucket_count; ++i) {
+            for (fossil_cache_entry_t *e = g_cache.buckets[i]; e; e = e->next)
+                fossil_cache_big_note(e);
+        }
+    }
     fossil_cache_unlock();
+    return true;
 }
 
-size_t fossil_bluecrab_cacheshell_count(void) {
-    return g_cache.entry_count;
+static int fossil_cache_key_stat_cmp(const void *a, const void *b) {
+    size_t va = ((const fossil_bluecrab_cache_key_stat_t *)a)->value;
+    size_t vb = ((const fossil_bluecrab_cache_key_stat_t *)b)->value;
+    return (va < vb) - (va > vb); // descending
 }
 
-size_t fossil_bluecrab_cacheshell_memory_usage(void) {
-    fossil_cache_lock();
-    size_t bytes = g_cache.total_bytes; // O(1) tracked value
-    fossil_cache_unlock();
-    return bytes;
+size_t fossil_bluecrab_cacheshell_top_keys(fossil_bluecrab_cache_key_stat_t *out, size_t k) {
+    if (!out || k == 0)
+        return 0;
+
+    fossil_bluecrab_cache_key_stat_t snap[FOSSIL_CACHE_HOT_SLOTS];
+    fossil_cache_keys_lock();
+    size_t n = g_cache_keys.hot_used;
+    for (size_t i = 0; i < n; ++i) {
+        memcpy(snap[i].key, g_cache_keys.hot[i].key, sizeof(snap[i].key));
+        snap[i].value = (size_t)g_cache_keys.hot[i].count;
+        snap[i].error = (size_t)g_cache_keys.hot[i].error;
+    }
+    fossil_cache_keys_unlock();
+
+    qsort(snap, n, sizeof(snap[0]), fossil_cache_key_stat_cmp);
+    if (n > k)
+        n = k;
+    memcpy(out, snap, n * sizeof(snap[0]));
+    return n;
+}
+
+size_t fossil_bluecrab_cacheshell_largest_keys(fossil_bluecrab_cache_key_stat_t *out, size_t k) {
+    if (!out || k == 0)
+        return 0;
+
+    fossil_bluecrab_cache_key_stat_t snap[FOSSIL_CACHE_BIG_SLOTS];
+    fossil_cache_keys_lock();
+    size_t n = g_cache_keys.big_used;
+    for (size_t i = 0; i < n; ++i) {
+        memcpy(snap[i].key, g_cache_keys.big[i].key, sizeof(snap[i].key));
+        snap[i].value = g_cache_keys.big[i].size;
+        snap[i].error = 0;
+    }
+    fossil_cache_keys_unlock();
+
+    qsort(snap, n, sizeof(snap[0]), fossil_cache_key_stat_cmp);
+    if (n > k)
+        n = k;
+    memcpy(out, snap, n * sizeof(snap[0]));
+    return n;
 }
 
 // ===========================================================
-// Statistics / Thread Safety
+// Value Compression
 // ===========================================================
 
-void fossil_bluecrab_cacheshell_stats(size_t *out_hits, size_t *out_misses) {
-    fossil_cache_lock();
-    if (out_hits)   *out_hits   = g_cache.hits;
-    if (out_misses) *out_misses = g_cache.misses;
-    fossil_cache_unlock();
+bool fossil_bluecrab_cacheshell_compression(size_t min_size) {
+    if (!g_cache.buckets) // uninitialized or shared-memory mode
+        return false;
+    fossil_cache_atomic_store(&g_cache.compress_min, (uint64_t)min_size);
+    return true;
 }
 
-void fossil_bluecrab_cacheshell_stats_extended(
-        size_t *out_hits,
-        size_t *out_misses,
-        size_t *out_entries,
-        size_t *out_expired_evictions,
-        size_t *out_memory_bytes,
-        time_t *out_uptime_seconds) {
+void fossil_bluecrab_cacheshell_compression_stats(size_t *out_entries,
+                                                  size_t *out_logical_bytes,
+                                                  size_t *out_stored_bytes) {
+    if (g_cache.shm) { // shared segments store values as-is
+        if (out_entries)       *out_entries = 0;
+        if (out_logical_bytes) *out_logical_bytes = 0;
+        if (out_stored_bytes)  *out_stored_bytes = 0;
+        return;
+    }
 
     fossil_cache_lock();
-    if (out_hits)             *out_hits = g_cache.hits;
-    if (out_misses)           *out_misses = g_cache.misses;
-    if (out_entries)          *out_entries = g_cache.entry_count;
-    if (out_expired_evictions)*out_expired_evictions = g_cache.expired_evictions;
-    if (out_memory_bytes)     *out_memory_bytes = g_cache.total_bytes;
-    if (out_uptime_seconds) {
-        time_t now = time(NULL);
-        *out_uptime_seconds = (g_cache.start_time > 0 && now >= g_cache.start_time)
-                              ? (now - g_cache.start_time)
-                              : 0;
-    }
+    if (out_entries)       *out_entries = g_cache.lz_entries;
+    if (out_logical_bytes) *out_logical_bytes = g_cache.lz_logical_bytes;
+    if (out_stored_bytes)  *out_stored_bytes = g_cache.lz_stored_bytes;
     fossil_cache_unlock();
 }
 
-void fossil_bluecrab_cacheshell_threadsafe(bool enabled) {
-    g_cache.locking_enabled = enabled;
-}
-
 // ===========================================================
-// Iteration
+// Large-Object Store
 // ===========================================================
 
-void fossil_bluecrab_cacheshell_iterate(fossil_bluecrab_cache_iter_cb cb, void *user_data) {
-    if (!cb) return;
+bool fossil_bluecrab_cacheshell_large_objects(size_t min_size, size_t budget_bytes) {
+    if (!g_cache.buckets) // uninitialized or shared-memory mode
+        return false;
 
     fossil_cache_lock();
-    if (!g_cache.buckets) {
-        fossil_cache_unlock();
+    fossil_cache_atomic_store(&g_cache.lob_min, (uint64_t)min_size);
+    g_cache.lob_budget = (uint64_t)budget_bytes;
+    while (budget_bytes && g_cache.lob_bytes > budget_bytes) {
+        fossil_cache_unlink_entry(g_cache.lob_tail->entry);
+        g_cache.lob_evictions++;
+    }
+    fossil_cache_unlock();
+    return true;
+}
+
+void fossil_bluecrab_cacheshell_large_object_stats(size_t *out_count,
+                                                   size_t *out_mapped_bytes,
+                                                   size_t *out_evictions) {
+    if (g_cache.shm) { // shared segments keep every value in the arena
+        if (out_count)        *out_count = 0;
+        if (out_mapped_bytes) *out_mapped_bytes = 0;
+        if (out_evictions)    *out_evictions = 0;
         return;
     }
 
-    time_t now = time(NULL);
+    fossil_cache_lock();
+    if (out_count)        *out_count = g_cache.lob_count;
+    if (out_mapped_bytes) *out_mapped_bytes = g_cache.lob_bytes;
+    if (out_evictions)    *out_evictions = g_cache.lob_evictions;
+    fossil_cache_unlock();
+}
 
-    for (size_t i = 0; i < g_cache.bucket_count; ++i) {
-        fossil_cache_entry_t *prev = NULL;
-        fossil_cache_entry_t *entry = g_cache.buckets[i];
+// ===========================================================
+// Persistence (Optional)
+// ===========================================================
 
-        while (entry) {
-            // Remove expired inline (lazy eviction)
-            if (entry->expiry > 0 && entry->expiry <= now) {
-                fossil_cache_entry_t *dead = entry;
-                if (prev)
-                    prev->next = entry->next;
-                else
-                    g_cache.buckets[i] = entry->next;
+// Leading NUL keeps the header from parsing as a legacy key line. Version
+// 2 files hold raw values only; version 3 records start with a type tag.
+// Both wrote lengths as native size_t; version 4 fixes every length to
+// little-endian u32 (key, collection item) or u64 (value size).
+static const char fossil_cache_save_magic[8] = { '\0', 'F', 'C', 'A', 'C', 'H', 'E', '4' };
+static const char fossil_cache_save_magic_v3[8] = { '\0', 'F', 'C', 'A', 'C', 'H', 'E', '3' };
+static const char fossil_cache_save_magic_v2[8] = { '\0', 'F', 'C', 'A', 'C', 'H', 'E', '2' };
+
+static void fossil_cache_put_le(unsigned char *p, uint64_t v, size_t width) {
+    for (size_t i = 0; i < width; ++i)
+        p[i] = (unsigned char)(v >> (8 * i));
+}
 
-                entry = entry->next;
+static uint64_t fossil_cache_get_le(const unsigned char *p, size_t width) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < width; ++i)
+        v |= (uint64_t)p[i] << (8 * i);
+    return v;
+}
 
-                size_t bytes = sizeof(*dead) + dead->size + strlen(dead->key) + 1;
-                if (g_cache.total_bytes >= bytes)
-                    g_cache.total_bytes -= bytes;
-                else
-                    g_cache.total_bytes = 0;
+// Writes the head of one record: type, key_len, key bytes, size. The
+// caller writes the size value bytes that follow.
+static bool fossil_cache_save_head(FILE *file, fossil_cache_type_t type, const char *key,
+                                   size_t key_len, size_t size) {
+    if ((uint64_t)key_len > UINT32_MAX)
+        return false;
+    unsigned char head[1 + 4];
+    head[0] = (unsigned char)type;
+    fossil_cache_put_le(head + 1, key_len, 4);
+    if (fwrite(head, sizeof(head), 1, file) != 1)
+        return false;
+    if (key_len > 0 && fwrite(key, 1, key_len, file) != key_len)
+        return false;
+    unsigned char len[8];
+    fossil_cache_put_le(len, size, sizeof(len));
+    return fwrite(len, sizeof(len), 1, file) == 1;
+}
 
-                fossil_cache_free_entry(dead);
-                if (g_cache.entry_count > 0)
-                    g_cache.entry_count--;
-                g_cache.expired_evictions++;
-                continue;
-            }
+// Writes one raw record: head, then the value bytes.
+static bool fossil_cache_save_record(FILE *file, const char *key, size_t key_len,
+                                     const void *data, size_t size) {
+    if (!fossil_cache_save_head(file, FOSSIL_CACHE_TYPE_RAW, key, key_len, size))
+        return false;
+    if (size > 0 && fwrite(data, 1, size, file) != size)
+        return false;
+    return true;
+}
 
-            // Invoke callback (note: lock is held; callback must not call cache APIs that lock)
-            cb(entry->key, entry->data, entry->size, user_data);
+static bool fossil_cache_save_item(FILE *file, const void *data, size_t len) {
+    if ((uint64_t)len > UINT32_MAX)
+        return false;
+    unsigned char n[4];
+    fossil_cache_put_le(n, len, sizeof(n));
+    return fwrite(n, sizeof(n), 1, file) == 1 && (len == 0 || fwrite(data, 1, len, file) == len);
+}
 
-            prev = entry;
-            entry = entry->next;
+// Writes a hash / list / set as one record whose value is the packed
+// encoding ([u32 len][bytes] items; hashes alternate field and value,
+// lists run front to back), whatever encoding it currently uses.
+static bool fossil_cache_save_coll(FILE *file, const fossil_cache_entry_t *entry) {
+    const fossil_cache_coll_t *c = (const fossil_cache_coll_t *)entry->data;
+    if (c->encoding == FOSSIL_CACHE_ENC_PACKED) {
+        if (!fossil_cache_save_head(file, entry->type, entry->key, entry->key_len, c->len))
+            return false;
+        // The buffer holds native-order lengths; rewrite each item
+        for (size_t off = 0; off < c->len; off = fossil_cache_packed_next(c, off)) {
+            if (!fossil_cache_save_item(file, c->buf + off + sizeof(uint32_t), fossil_cache_packed_len(c, off)))
+                return false;
         }
+        return true;
     }
 
-    fossil_cache_unlock();
+    bool pairs = entry->type == FOSSIL_CACHE_TYPE_HASH;
+    size_t size = 0;
+    for (size_t i = 0; i < c->slot_count; ++i) {
+        const fossil_cache_node_t *n = c->slots[i];
+        if (fossil_cache_node_live(n))
+            size += sizeof(uint32_t) + n->field_len + n->value_len + (pairs ? sizeof(uint32_t) : 0);
+    }
+    if (!fossil_cache_save_head(file, entry->type, entry->key, entry->key_len, size))
+        return false;
+
+    for (size_t i = 0; i < c->count && c->encoding == FOSSIL_CACHE_ENC_DEQUE; ++i) {
+        const fossil_cache_node_t *n = fossil_cache_deque_at(c, i);
+        if (!fossil_cache_save_item(file, n->bytes, n->value_len))
+            return false;
+    }
+    for (size_t i = 0; i < c->slot_count && c->encoding == FOSSIL_CACHE_ENC_TABLE; ++i) {
+        const fossil_cache_node_t *n = c->slots[i];
+        if (!fossil_cache_node_live(n))
+            continue;
+        if (!fossil_cache_save_item(file, n->bytes, n->field_len) ||
+            (pairs && !fossil_cache_save_item(file, n->bytes + n->field_len, n->value_len)))
+            return false;
+    }
+    return true;
 }
 
-// ===========================================================
-// Persistence (Optional)
-// ===========================================================
+static bool fossil_cache_shm_save(FILE *file) {
+    if (!fossil_cache_shm_lock())
+        return false;
+    fossil_cache_shm_header_t *h = g_cache.shm;
+    uint64_t *buckets = fossil_cache_shm_buckets();
+    time_t now = time(NULL);
+    bool ok = true;
+    for (uint64_t i = 0; ok && i < h->bucket_count; ++i) {
+        for (uint64_t off = buckets[i]; ok && off; off = fossil_cache_shm_entry(off)->next) {
+            fossil_cache_shm_entry_t *e = fossil_cache_shm_entry(off);
+            if (fossil_cache_shm_expired(e, now))
+                continue;
+            ok = fossil_cache_save_record(file, fossil_cache_shm_key(e), e->key_len,
+                                          fossil_cache_shm_data(e), (size_t)e->size);
+        }
+    }
+    fossil_cache_shm_unlock();
+    return ok;
+}
 
 bool fossil_bluecrab_cacheshell_save(const char *path) {
+    if (g_cache.shm) {
+        FILE *file = fopen(path, "wb");
+        if (!file)
+            return false;
+        bool ok = fwrite(fossil_cache_save_magic, sizeof(fossil_cache_save_magic), 1, file) == 1 &&
+                  fossil_cache_shm_save(file);
+        if (fclose(file) != 0)
+            ok = false;
+        return ok;
+    }
+
     fossil_cache_lock();
 
     if (!g_cache.buckets) {
@@ -1037,51 +4716,190 @@ bool fossil_bluecrab_cacheshell_save(const char *path) {
         return false;
     }
 
-    bool ok = true;
+    bool ok = fwrite(fossil_cache_save_magic, sizeof(fossil_cache_save_magic), 1, file) == 1;
     time_t now = time(NULL);
 
     for (size_t i = 0; ok && i < g_cache.bucket_count; ++i) {
-        fossil_cache_entry_t *entry = g_cache.buckets[i];
-        while (ok && entry) {
-            // Skip expired entries (do not persist)
-            if (entry->expiry > 0 && entry->expiry <= now) {
-                entry = entry->next;
+        for (fossil_cache_entry_t *entry = g_cache.buckets[i]; ok && entry; entry = entry->next) {
+            if (entry->expiry > 0 && entry->expiry <= now)
+                continue; // expired: do not persist
+            if (entry->type != FOSSIL_CACHE_TYPE_RAW) {
+                ok = fossil_cache_save_coll(file, entry);
                 continue;
             }
+            const void *value = fossil_cache_value_view(entry);
+            ok = value && fossil_cache_save_record(file, entry->key, entry->key_len,
+                                                   value, fossil_cache_value_size(entry));
+        }
+    }
 
-            // Reject keys with embedded newlines (would corrupt format)
-            if (strchr(entry->key, '\n')) {
-                entry = entry->next;
-                continue;
-            }
+    if (fclose(file) != 0)
+        ok = false;
 
-            if (fputs(entry->key, file) == EOF || fputc('\n', file) == EOF) {
-                ok = false;
-                break;
-            }
+    fossil_cache_unlock();
+    return ok;
+}
 
-            if (fwrite(&entry->size, sizeof(entry->size), 1, file) != 1) {
-                ok = false;
-                break;
-            }
+// Bytes from the current position to the end of the file, so record
+// lengths can be checked against what the file still holds before any
+// allocation. Uses 64-bit offsets so files past 2 GiB measure correctly.
+static bool fossil_cache_file_left(FILE *file, uint64_t *out_left) {
+#if defined(_WIN32) || defined(_WIN64)
+    __int64 pos = _ftelli64(file);
+    if (pos < 0 || _fseeki64(file, 0, SEEK_END) != 0)
+        return false;
+    __int64 end = _ftelli64(file);
+    if (end < pos || _fseeki64(file, pos, SEEK_SET) != 0)
+        return false;
+#else
+    off_t pos = ftello(file);
+    if (pos < 0 || fseeko(file, 0, SEEK_END) != 0)
+        return false;
+    off_t end = ftello(file);
+    if (end < pos || fseeko(file, pos, SEEK_SET) != 0)
+        return false;
+#endif
+    *out_left = (uint64_t)(end - pos);
+    return true;
+}
 
-            if (entry->size > 0 &&
-                fwrite(entry->data, 1, entry->size, file) != entry->size) {
-                ok = false;
-                break;
-            }
+// Reads a record length: little-endian of `width` bytes, or a native
+// size_t for pre-version-4 files. Fails if fewer bytes remain.
+static bool fossil_cache_load_len(FILE *file, size_t width, bool native, uint64_t *left, uint64_t *out) {
+    unsigned char buf[8];
+    if (native)
+        width = sizeof(size_t);
+    if (*left < width || fread(buf, 1, width, file) != width)
+        return false;
+    *left -= width;
+    if (native) {
+        size_t v;
+        memcpy(&v, buf, sizeof(v));
+        *out = v;
+    } else {
+        *out = fossil_cache_get_le(buf, width);
+    }
+    return true;
+}
 
-            entry = entry->next;
-        }
+// Reads `size` bytes into a fresh buffer with a trailing NUL; NULL if the
+// file holds fewer than `size` more bytes, on a short read or allocation
+// failure.
+static char *fossil_cache_load_bytes(FILE *file, uint64_t size, uint64_t *left) {
+    if (size > *left || size >= SIZE_MAX)
+        return NULL;
+    char *buf = (char *)malloc((size_t)size + 1);
+    if (!buf)
+        return NULL;
+    if (size > 0 && fread(buf, 1, (size_t)size, file) != size) {
+        free(buf);
+        return NULL;
     }
+    *left -= size;
+    buf[size] = '\0';
+    return buf;
+}
 
-    if (fclose(file) != 0)
-        ok = false;
+// Item length inside a collection value: little-endian since version 4,
+// native before.
+static uint32_t fossil_cache_load_item_len(const unsigned char *p, bool native) {
+    uint32_t n;
+    if (native)
+        memcpy(&n, p, sizeof(n));
+    else
+        n = (uint32_t)fossil_cache_get_le(p, sizeof(n));
+    return n;
+}
+
+// Rebuilds a collection from its packed record value (see
+// fossil_cache_save_coll). Fails on a malformed value or if the key is
+// already taken by another type.
+static bool fossil_cache_load_coll(const char *key, size_t key_len, fossil_cache_type_t type,
+                                   const unsigned char *data, size_t size, bool native) {
+    // Validate and index the items first; lists are rebuilt back to front
+    size_t count = 0;
+    for (size_t off = 0; off < size; ++count) {
+        if (size - off < sizeof(uint32_t))
+            return false;
+        uint32_t n = fossil_cache_load_item_len(data + off, native);
+        if (size - off - sizeof(n) < n)
+            return false;
+        off += sizeof(n) + n;
+    }
+    bool pairs = type == FOSSIL_CACHE_TYPE_HASH;
+    if (count == 0 || (pairs && count % 2 != 0))
+        return false;
+    size_t *items = (size_t *)malloc(count * sizeof(*items));
+    if (!items)
+        return false;
+    for (size_t i = 0, off = 0; i < count; ++i) {
+        items[i] = off;
+        off += sizeof(uint32_t) + fossil_cache_load_item_len(data + off, native);
+    }
 
+    fossil_cache_lock();
+    fossil_cache_entry_t *entry = fossil_cache_coll_entry(key, key_len, type, true, false);
+    bool ok = entry != NULL;
+    for (size_t i = 0; ok && i < count; i += pairs ? 2 : 1) {
+        size_t at = type == FOSSIL_CACHE_TYPE_LIST ? items[count - 1 - i] : items[i];
+        uint32_t n = fossil_cache_load_item_len(data + at, native);
+        const char *item = (const char *)data + at + sizeof(n);
+        fossil_cache_coll_t *c = (fossil_cache_coll_t *)entry->data;
+        if (type == FOSSIL_CACHE_TYPE_LIST) {
+            ok = fossil_cache_coll_push_front(c, item, n);
+        } else if (pairs) {
+            uint32_t vn = fossil_cache_load_item_len(data + items[i + 1], native);
+            ok = fossil_cache_coll_put(c, true, item, n, data + items[i + 1] + sizeof(vn), vn);
+        } else {
+            ok = fossil_cache_coll_put(c, false, item, n, NULL, 0);
+        }
+    }
+    if (entry)
+        fossil_cache_coll_commit(entry);
     fossil_cache_unlock();
+    free(items);
     return ok;
 }
 
+// Current format: magic, then length-prefixed records until EOF. Version 3
+// and later records carry a leading type tag; version 4 lengths are
+// little-endian u32 key / u64 size instead of native size_t.
+static bool fossil_cache_load_records(FILE *file, int version) {
+    uint64_t left;
+    if (!fossil_cache_file_left(file, &left))
+        return false;
+    bool native = version < 4;
+    while (left > 0) {
+        unsigned char tag = FOSSIL_CACHE_TYPE_RAW;
+        if (version >= 3) {
+            if (fread(&tag, 1, 1, file) != 1)
+                return false;
+            left--;
+        }
+        if (tag > FOSSIL_CACHE_TYPE_SET)
+            return false;
+        uint64_t key_len = 0;
+        uint64_t size = 0;
+        if (!fossil_cache_load_len(file, 4, native, &left, &key_len))
+            return false;
+        char *key = fossil_cache_load_bytes(file, key_len, &left);
+        if (!key || !fossil_cache_load_len(file, 8, native, &left, &size)) {
+            free(key);
+            return false;
+        }
+        char *data = fossil_cache_load_bytes(file, size, &left);
+        bool ok = data && (tag == FOSSIL_CACHE_TYPE_RAW
+            ? fossil_bluecrab_cacheshell_set_binary_n(key, (size_t)key_len, data, (size_t)size)
+            : fossil_cache_load_coll(key, (size_t)key_len, (fossil_cache_type_t)tag,
+                                     (const unsigned char *)data, (size_t)size, native));
+        free(key);
+        free(data);
+        if (!ok)
+            return false;
+    }
+    return true;
+}
+
 bool fossil_bluecrab_cacheshell_load(const char *path) {
     FILE *file = fopen(path, "rb");
     if (!file)
@@ -1090,6 +4908,17 @@ bool fossil_bluecrab_cacheshell_load(const char *path) {
     // Use public clear (it manages its own locking)
     fossil_bluecrab_cacheshell_clear();
 
+    char magic[sizeof(fossil_cache_save_magic)];
+    if (fread(magic, sizeof(magic), 1, file) == 1 &&
+        (memcmp(magic, fossil_cache_save_magic, sizeof(magic)) == 0 ||
+         memcmp(magic, fossil_cache_save_magic_v3, sizeof(magic)) == 0 ||
+         memcmp(magic, fossil_cache_save_magic_v2, sizeof(magic)) == 0)) {
+        bool ok = fossil_cache_load_records(file, magic[7] - '0');
+        fclose(file);
+        return ok;
+    }
+    rewind(file); // legacy files: newline-terminated key lines
+
     bool ok = true;
 
     while (ok) {
@@ -1106,7 +4935,9 @@ bool fossil_bluecrab_cacheshell_load(const char *path) {
 
         // Read size
         size_t size = 0;
-        if (fread(&size, sizeof(size), 1, file) != 1) {
+        uint64_t left = 0;
+        if (fread(&size, sizeof(size), 1, file) != 1 ||
+            !fossil_cache_file_left(file, &left) || size > left) {
             ok = false;
             break;
         }
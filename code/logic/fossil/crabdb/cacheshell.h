@@ -56,6 +56,39 @@ bool fossil_bluecrab_cacheshell_init(size_t max_entries);
  */
 void fossil_bluecrab_cacheshell_shutdown(void);
 
+/**
+ * @brief Initializes the cache inside a named shared-memory segment.
+ *
+ * The table, entries and lock live in a POSIX shm_open/mmap segment so
+ * several processes on one host (e.g. pre-forked workers) share a single
+ * cache. The first caller creates and formats the segment; later callers
+ * attach to it and ignore max_entries/arena_bytes. Every public cache
+ * call then operates on the shared segment, always under a process-shared
+ * robust mutex. The ordered index and near cache are unavailable in this
+ * mode. shutdown() detaches; the segment persists until unlinked.
+ * An attacher waits about two seconds for the creator to finish; if the
+ * creator died first, the attacher formats (or recreates) the segment.
+ * A call fails, rather than proceeding unlocked, if the shared mutex is
+ * left unrecoverable.
+ *
+ * @param name         Segment name, e.g. "/crabdb-cache".
+ * @param max_entries  Optional maximum number of entries (0 = unlimited).
+ * @param arena_bytes  Bytes reserved for entries (0 = 64 MiB).
+ * @return             true on success, false on failure, if a private
+ *                     cache is already initialized, or on Windows.
+ */
+bool fossil_bluecrab_cacheshell_init_shared(const char *name, size_t max_entries, size_t arena_bytes);
+
+/**
+ * @brief Removes a shared-memory segment name.
+ *
+ * Processes still attached keep their mapping until they shut down.
+ *
+ * @param name  Segment name passed to fossil_bluecrab_cacheshell_init_shared.
+ * @return      true if the name was removed.
+ */
+bool fossil_bluecrab_cacheshell_unlink_shared(const char *name);
+
 // ===========================================================
 // Basic Key/Value Operations
 // ===========================================================
@@ -161,13 +194,344 @@ bool fossil_bluecrab_cacheshell_set_binary(const char *key, const void *data, si
  * Returns a pointer to the internal stored binary data for the given key, or NULL
  * if the key does not exist. The lifetime of the returned pointer is managed by
  * the cache; copy it if you need to retain it. Do not modify the pointed data.
+ * For a compressed value the pointer refers to a per-thread scratch buffer,
+ * valid until the same thread reads another compressed value. In
+ * shared-memory mode another process could free the block at any time, so
+ * this always returns NULL; use get_binary_into or pin there.
  *
  * @param key       Key string.
  * @param out_size  (Optional) Receives size of the binary value in bytes.
- * @return          Pointer to binary data, or NULL if not found.
+ * @return          Pointer to binary data, or NULL if not found (or shared).
  */
 const void *fossil_bluecrab_cacheshell_get_binary(const char *key, size_t *out_size);
 
+/**
+ * @brief Copies a binary value into a caller-provided buffer.
+ *
+ * Unlike fossil_bluecrab_cacheshell_get_binary, no pointer into the cache
+ * escapes, so this path can be served by the per-thread near cache.
+ *
+ * @param key       Key string.
+ * @param out_buf   Destination buffer (nullable to query the size only).
+ * @param buf_size  Capacity of out_buf; longer values are truncated.
+ * @param out_size  (Optional) Receives the full stored size in bytes.
+ * @return          true if the key exists, false otherwise.
+ */
+bool fossil_bluecrab_cacheshell_get_binary_into(const char *key, void *out_buf, size_t buf_size, size_t *out_size);
+
+/**
+ * @brief Handle keeping a pinned value readable.
+ */
+typedef struct fossil_bluecrab_cache_pin fossil_bluecrab_cache_pin_t;
+
+/**
+ * @brief Pins a value for zero-copy reading.
+ *
+ * The returned bytes stay valid and unchanged until the handle is passed
+ * to fossil_bluecrab_cacheshell_unpin, even if the key is overwritten,
+ * removed or evicted meanwhile; a replaced value is freed on its last
+ * unpin. Readers pinning the same value share it. Compressed values and
+ * shared-memory entries are pinned as a copy.
+ *
+ * @param key       Key string.
+ * @param out_size  (Optional) Receives the value size in bytes.
+ * @param out_pin   Receives the handle to release (NULL if not found).
+ * @return          Pointer to the value, or NULL if the key does not exist.
+ */
+const void *fossil_bluecrab_cacheshell_pin(const char *key, size_t *out_size,
+                                           fossil_bluecrab_cache_pin_t **out_pin);
+
+/**
+ * @brief Releases a pin obtained from fossil_bluecrab_cacheshell_pin.
+ *
+ * @param pin  Handle to release (NULL is ignored).
+ */
+void fossil_bluecrab_cacheshell_unpin(fossil_bluecrab_cache_pin_t *pin);
+
+// ===========================================================
+// Length-Delimited Keys
+// ===========================================================
+
+/**
+ * @brief Stores a string value under a key given by length.
+ *
+ * Keys passed by length may hold any bytes, including '\0' and '\n', so
+ * "a\0b" and "a" are distinct keys. value_len bytes are stored followed
+ * by a '\0', as fossil_bluecrab_cacheshell_set stores a C string, without
+ * copying the value first.
+ *
+ * @param key        Key bytes.
+ * @param key_len    Key length in bytes.
+ * @param value      Value bytes (need not be NUL-terminated).
+ * @param value_len  Value length in bytes, excluding the terminator.
+ * @return           true on success, false on failure.
+ */
+bool fossil_bluecrab_cacheshell_set_n(const char *key, size_t key_len, const char *value, size_t value_len);
+
+/**
+ * @brief Stores a string value with a TTL under a key given by length.
+ *
+ * @param key        Key bytes.
+ * @param key_len    Key length in bytes.
+ * @param value      Value bytes (need not be NUL-terminated).
+ * @param value_len  Value length in bytes, excluding the terminator.
+ * @param ttl_sec    Time-to-live in seconds.
+ * @return           true on success, false on failure.
+ */
+bool fossil_bluecrab_cacheshell_set_with_ttl_n(const char *key, size_t key_len, const char *value,
+                                               size_t value_len, unsigned int ttl_sec);
+
+/**
+ * @brief Stores a binary value under a key given by length.
+ *
+ * @param key      Key bytes.
+ * @param key_len  Key length in bytes.
+ * @param data     Value bytes.
+ * @param size     Value size in bytes.
+ * @return         true on success, false on failure.
+ */
+bool fossil_bluecrab_cacheshell_set_binary_n(const char *key, size_t key_len, const void *data, size_t size);
+
+/**
+ * @brief Stores a binary value with a TTL under a key given by length.
+ *
+ * @param key      Key bytes.
+ * @param key_len  Key length in bytes.
+ * @param data     Value bytes.
+ * @param size     Value size in bytes.
+ * @param ttl_sec  Time-to-live in seconds.
+ * @return         true on success, false on failure.
+ */
+bool fossil_bluecrab_cacheshell_set_binary_with_ttl_n(const char *key, size_t key_len, const void *data,
+                                                      size_t size, unsigned int ttl_sec);
+
+/**
+ * @brief Returns a pointer to the value of a key given by length.
+ *
+ * Same lifetime rules as fossil_bluecrab_cacheshell_get_binary.
+ *
+ * @param key       Key bytes.
+ * @param key_len   Key length in bytes.
+ * @param out_size  (Optional) Receives the value size in bytes.
+ * @return          Pointer to the value, or NULL if not found.
+ */
+const void *fossil_bluecrab_cacheshell_get_binary_n(const char *key, size_t key_len, size_t *out_size);
+
+/**
+ * @brief Copies the value of a key given by length into a caller buffer.
+ *
+ * @param key       Key bytes.
+ * @param key_len   Key length in bytes.
+ * @param out_buf   Destination buffer (nullable to query the size only).
+ * @param buf_size  Capacity of out_buf; longer values are truncated.
+ * @param out_size  (Optional) Receives the full value size in bytes.
+ * @return          true if the key exists.
+ */
+bool fossil_bluecrab_cacheshell_get_binary_into_n(const char *key, size_t key_len, void *out_buf,
+                                                  size_t buf_size, size_t *out_size);
+
+/**
+ * @brief Pins the value of a key given by length for zero-copy reading.
+ *
+ * @param key       Key bytes.
+ * @param key_len   Key length in bytes.
+ * @param out_size  (Optional) Receives the value size in bytes.
+ * @param out_pin   Receives the handle to release with unpin.
+ * @return          Pointer to the value, or NULL if not found.
+ */
+const void *fossil_bluecrab_cacheshell_pin_n(const char *key, size_t key_len, size_t *out_size,
+                                             fossil_bluecrab_cache_pin_t **out_pin);
+
+/**
+ * @brief Removes a key given by length.
+ *
+ * @return  true if removed, false if the key was not found.
+ */
+bool fossil_bluecrab_cacheshell_remove_n(const char *key, size_t key_len);
+
+/**
+ * @brief Tests whether a key given by length exists and is not expired.
+ */
+bool fossil_bluecrab_cacheshell_exists_n(const char *key, size_t key_len);
+
+/**
+ * @brief Sets the TTL of an existing key given by length.
+ *
+ * @return  true if the key exists.
+ */
+bool fossil_bluecrab_cacheshell_expire_n(const char *key, size_t key_len, unsigned int ttl_sec);
+
+/**
+ * @brief Returns the remaining TTL of a key given by length.
+ *
+ * @return  Remaining TTL in seconds, or -1 if not found or no TTL set.
+ */
+int fossil_bluecrab_cacheshell_ttl_n(const char *key, size_t key_len);
+
+/**
+ * @brief Refreshes the access time of a key given by length.
+ *
+ * @return  true if the key exists.
+ */
+bool fossil_bluecrab_cacheshell_touch_n(const char *key, size_t key_len);
+
+// ===========================================================
+// Collection Values (hash / list / set)
+// ===========================================================
+
+/*
+ * A key may hold a field map (hash), a list or a set instead of a plain
+ * value. Small collections are stored packed in one buffer and upgrade to
+ * a hash table (hash / set) or ring buffer (list) when they grow past 64
+ * items or hold an item longer than 64 bytes. Collections are invisible to
+ * get / get_binary / iterate / scan_* but are persisted by save; set()
+ * on a collection key replaces it with a plain value. Writing a field of
+ * the wrong collection type fails. Not available in shared-memory mode.
+ */
+
+/**
+ * @brief Callback type for list element visits.
+ */
+typedef void (*fossil_bluecrab_cache_value_cb)(
+    const void *value,
+    size_t value_size,
+    void *user_data
+);
+
+/**
+ * @brief Sets a field of the hash stored at key, creating it if needed.
+ *
+ * @param key    Key string.
+ * @param field  Null-terminated field name.
+ * @param value  Value bytes (nullable when size is 0).
+ * @param size   Value size in bytes.
+ * @return       true on success, false on type mismatch or failure.
+ */
+bool fossil_bluecrab_cacheshell_hset(const char *key, const char *field, const void *value, size_t size);
+
+/**
+ * @brief Sets a hash field, with key and field given by length.
+ *
+ * Key and field may hold any bytes, including '\0'.
+ *
+ * @param key        Key bytes.
+ * @param key_len    Key length in bytes.
+ * @param field      Field bytes.
+ * @param field_len  Field length in bytes.
+ * @param value      Value bytes (nullable when size is 0).
+ * @param size       Value size in bytes.
+ * @return           true on success, false on type mismatch or failure.
+ */
+bool fossil_bluecrab_cacheshell_hset_n(const char *key, size_t key_len, const char *field, size_t field_len,
+                                       const void *value, size_t size);
+
+/**
+ * @brief Copies a hash field into a caller-provided buffer.
+ *
+ * @param key       Key string.
+ * @param field     Field name.
+ * @param out_buf   Destination buffer (nullable to query the size only).
+ * @param buf_size  Capacity of out_buf; longer values are truncated.
+ * @param out_size  (Optional) Receives the full value size in bytes.
+ * @return          true if the field exists.
+ */
+bool fossil_bluecrab_cacheshell_hget(const char *key, const char *field,
+                                     void *out_buf, size_t buf_size, size_t *out_size);
+
+/**
+ * @brief Copies a hash field, with key and field given by length.
+ *
+ * @param key        Key bytes.
+ * @param key_len    Key length in bytes.
+ * @param field      Field bytes.
+ * @param field_len  Field length in bytes.
+ * @param out_buf    Destination buffer (nullable to query the size only).
+ * @param buf_size   Capacity of out_buf; longer values are truncated.
+ * @param out_size   (Optional) Receives the full value size in bytes.
+ * @return           true if the field exists.
+ */
+bool fossil_bluecrab_cacheshell_hget_n(const char *key, size_t key_len, const char *field, size_t field_len,
+                                       void *out_buf, size_t buf_size, size_t *out_size);
+
+/**
+ * @brief Removes a hash field; the key is removed with its last field.
+ *
+ * @return  true if the field existed.
+ */
+bool fossil_bluecrab_cacheshell_hdel(const char *key, const char *field);
+
+/**
+ * @brief Removes a hash field, with key and field given by length.
+ *
+ * @return  true if the field existed.
+ */
+bool fossil_bluecrab_cacheshell_hdel_n(const char *key, size_t key_len, const char *field, size_t field_len);
+
+/**
+ * @brief Prepends a value to the list stored at key, creating it if needed.
+ *
+ * @return  true on success, false on type mismatch or failure.
+ */
+bool fossil_bluecrab_cacheshell_lpush(const char *key, const void *value, size_t size);
+
+/**
+ * @brief Prepends a value to the list stored at a key given by length.
+ *
+ * @return  true on success, false on type mismatch or failure.
+ */
+bool fossil_bluecrab_cacheshell_lpush_n(const char *key, size_t key_len, const void *value, size_t size);
+
+/**
+ * @brief Visits list elements start..stop (inclusive).
+ *
+ * Negative indexes count from the end (-1 is the last element). The
+ * callback runs with the cache lock held and must not call back into
+ * the cache.
+ *
+ * @return  Number of elements visited.
+ */
+size_t fossil_bluecrab_cacheshell_lrange(const char *key, long start, long stop,
+                                         fossil_bluecrab_cache_value_cb cb, void *user_data);
+
+/**
+ * @brief Visits list elements start..stop of a key given by length.
+ *
+ * Same index and callback rules as fossil_bluecrab_cacheshell_lrange.
+ *
+ * @return  Number of elements visited.
+ */
+size_t fossil_bluecrab_cacheshell_lrange_n(const char *key, size_t key_len, long start, long stop,
+                                           fossil_bluecrab_cache_value_cb cb, void *user_data);
+
+/**
+ * @brief Adds a member to the set stored at key, creating it if needed.
+ *
+ * @return  true if the member is in the set afterwards.
+ */
+bool fossil_bluecrab_cacheshell_sadd(const char *key, const char *member);
+
+/**
+ * @brief Adds a member given by length to the set at a key given by length.
+ *
+ * @return  true if the member is in the set afterwards.
+ */
+bool fossil_bluecrab_cacheshell_sadd_n(const char *key, size_t key_len, const char *member, size_t member_len);
+
+/**
+ * @brief Tests set membership.
+ *
+ * @return  true if key holds a set containing member.
+ */
+bool fossil_bluecrab_cacheshell_sismember(const char *key, const char *member);
+
+/**
+ * @brief Tests set membership, with key and member given by length.
+ *
+ * @return  true if key holds a set containing member.
+ */
+bool fossil_bluecrab_cacheshell_sismember_n(const char *key, size_t key_len, const char *member,
+                                            size_t member_len);
+
 // ===========================================================
 // Cache Management
 // ===========================================================
@@ -203,12 +567,31 @@ size_t fossil_bluecrab_cacheshell_memory_usage(void);
  */
 void fossil_bluecrab_cacheshell_stats(size_t *out_hits, size_t *out_misses);
 
+/**
+ * @brief Retrieves hit/miss counters per cache layer.
+ *
+ * An L1 miss falls through to the shared table, which then records its own
+ * hit or miss. fossil_bluecrab_cacheshell_stats reports L1 hits plus shared
+ * hits. Other threads flush their L1 counters periodically, so their most
+ * recent lookups may not be visible yet.
+ *
+ * @param out_l1_hits        Lookups served by the near cache (nullable).
+ * @param out_l1_misses      Near-cache lookups that fell through (nullable).
+ * @param out_shared_hits    Hits in the shared table (nullable).
+ * @param out_shared_misses  Misses in the shared table (nullable).
+ */
+void fossil_bluecrab_cacheshell_layer_stats(size_t *out_l1_hits, size_t *out_l1_misses,
+                                            size_t *out_shared_hits, size_t *out_shared_misses);
+
 // ===========================================================
 // Iteration
 // ===========================================================
 
 /**
  * @brief Callback type for cache iteration.
+ *
+ * The key is NUL-terminated, so a key holding an embedded '\0' appears cut
+ * at its first NUL; use fossil_bluecrab_cache_iter_n_cb for such keys.
  */
 typedef void (*fossil_bluecrab_cache_iter_cb)(
     const char *key,
@@ -217,14 +600,284 @@ typedef void (*fossil_bluecrab_cache_iter_cb)(
     void *user_data
 );
 
+/**
+ * @brief Callback type for length-aware iteration (the _n walkers).
+ *
+ * key points at key_len bytes followed by a '\0'.
+ */
+typedef void (*fossil_bluecrab_cache_iter_n_cb)(
+    const char *key,
+    size_t key_len,
+    const void *value,
+    size_t value_size,
+    void *user_data
+);
+
 /**
  * @brief Iterates over all cache entries.
  *
+ * Keys reach the callback cut at their first embedded NUL, if any.
+ *
  * @param cb         Callback invoked per entry.
  * @param user_data  Optional pointer passed to callback.
  */
 void fossil_bluecrab_cacheshell_iterate(fossil_bluecrab_cache_iter_cb cb, void *user_data);
 
+/**
+ * @brief Iterates over all cache entries, passing each key's length.
+ *
+ * @param cb         Callback invoked per entry.
+ * @param user_data  Optional pointer passed to callback.
+ */
+void fossil_bluecrab_cacheshell_iterate_n(fossil_bluecrab_cache_iter_n_cb cb, void *user_data);
+
+// ===========================================================
+// Ordered Index / Range Queries
+// ===========================================================
+
+/**
+ * @brief Enables or disables the ordered secondary key index.
+ *
+ * When enabled, a sorted index is kept alongside the hash table so prefix
+ * and range operations run in O(log n + matches) and visit keys in byte
+ * order. Enabling builds the index from the current contents; disabling
+ * frees it. Disabled by default, so caches that do not need it pay nothing.
+ *
+ * @param enabled  true to build/maintain the index, false to drop it.
+ * @return         true on success, false if uninitialized or out of memory.
+ */
+bool fossil_bluecrab_cacheshell_ordered_index(bool enabled);
+
+/**
+ * @brief Visits every live entry whose key starts with a prefix.
+ *
+ * Keys are visited in ascending byte order when the ordered index is
+ * enabled; otherwise this falls back to an unordered full-table walk.
+ * The callback runs with the cache lock held and must not call back into
+ * the cache. Keys reach it cut at their first embedded NUL; use
+ * fossil_bluecrab_cacheshell_scan_prefix_n for keys that hold one.
+ *
+ * @param prefix     Key prefix ("" matches every key).
+ * @param cb         Callback invoked per matching entry.
+ * @param user_data  Optional pointer passed to callback.
+ * @return           Number of entries visited.
+ */
+size_t fossil_bluecrab_cacheshell_scan_prefix(const char *prefix, fossil_bluecrab_cache_iter_cb cb, void *user_data);
+
+/**
+ * @brief Visits every live entry whose key starts with a prefix given by length.
+ *
+ * Unlike fossil_bluecrab_cacheshell_scan_prefix, the prefix and the keys
+ * handed to the callback may hold embedded NULs.
+ *
+ * @param prefix      Prefix bytes.
+ * @param prefix_len  Prefix length in bytes (0 matches every key).
+ * @param cb          Callback invoked per matching entry.
+ * @param user_data   Optional pointer passed to callback.
+ * @return            Number of entries visited.
+ */
+size_t fossil_bluecrab_cacheshell_scan_prefix_n(const char *prefix, size_t prefix_len,
+                                                fossil_bluecrab_cache_iter_n_cb cb, void *user_data);
+
+/**
+ * @brief Visits every live entry with start <= key < end.
+ *
+ * Same ordering, locking and key rules as fossil_bluecrab_cacheshell_scan_prefix.
+ *
+ * @param start      Inclusive lower bound (NULL = unbounded).
+ * @param end        Exclusive upper bound (NULL = unbounded).
+ * @param cb         Callback invoked per matching entry.
+ * @param user_data  Optional pointer passed to callback.
+ * @return           Number of entries visited.
+ */
+size_t fossil_bluecrab_cacheshell_scan_range(const char *start, const char *end,
+                                             fossil_bluecrab_cache_iter_cb cb, void *user_data);
+
+/**
+ * @brief Visits every live entry with start <= key < end, bounds given by length.
+ *
+ * @param start      Inclusive lower bound (NULL = unbounded).
+ * @param start_len  Length of start in bytes.
+ * @param end        Exclusive upper bound (NULL = unbounded).
+ * @param end_len    Length of end in bytes.
+ * @param cb         Callback invoked per matching entry.
+ * @param user_data  Optional pointer passed to callback.
+ * @return           Number of entries visited.
+ */
+size_t fossil_bluecrab_cacheshell_scan_range_n(const char *start, size_t start_len, const char *end, size_t end_len,
+                                               fossil_bluecrab_cache_iter_n_cb cb, void *user_data);
+
+/**
+ * @brief Removes every entry whose key starts with a prefix.
+ *
+ * @param prefix  Key prefix ("" removes every key).
+ * @return        Number of entries removed.
+ */
+size_t fossil_bluecrab_cacheshell_delete_prefix(const char *prefix);
+
+/**
+ * @brief Removes every entry whose key starts with a prefix given by length.
+ *
+ * @param prefix      Prefix bytes.
+ * @param prefix_len  Prefix length in bytes (0 removes every key).
+ * @return            Number of entries removed.
+ */
+size_t fossil_bluecrab_cacheshell_delete_prefix_n(const char *prefix, size_t prefix_len);
+
+/**
+ * @brief Removes every entry with start <= key < end.
+ *
+ * @param start  Inclusive lower bound (NULL = unbounded).
+ * @param end    Exclusive upper bound (NULL = unbounded).
+ * @return       Number of entries removed.
+ */
+size_t fossil_bluecrab_cacheshell_delete_range(const char *start, const char *end);
+
+/**
+ * @brief Removes every entry with start <= key < end, bounds given by length.
+ *
+ * @param start      Inclusive lower bound (NULL = unbounded).
+ * @param start_len  Length of start in bytes.
+ * @param end        Exclusive upper bound (NULL = unbounded).
+ * @param end_len    Length of end in bytes.
+ * @return           Number of entries removed.
+ */
+size_t fossil_bluecrab_cacheshell_delete_range_n(const char *start, size_t start_len, const char *end, size_t end_len);
+
+// ===========================================================
+// Hot / Big Key Tracking
+// ===========================================================
+
+#define FOSSIL_BLUECRAB_CACHE_KEY_STAT_LEN 64
+
+/**
+ * @brief One row of a hot-key or big-key report.
+ */
+typedef struct {
+    char key[FOSSIL_BLUECRAB_CACHE_KEY_STAT_LEN]; ///< Key (truncated to 63 chars).
+    size_t value;   ///< Estimated accesses (top_keys) or value bytes (largest_keys).
+    size_t error;   ///< Max overestimate of value for top_keys; 0 for largest_keys.
+} fossil_bluecrab_cache_key_stat_t;
+
+/**
+ * @brief Enables or disables hot-key and big-key tracking.
+ *
+ * Reads and writes are sampled (about one in sample_rate) into a
+ * heavy-hitters sketch of 128 counters, and the 32 largest live values
+ * are tracked on every write. Enabling resets both reports.
+ *
+ * @param enabled      true to start tracking, false to stop.
+ * @param sample_rate  Average accesses per sample (0 or 1 = every access).
+ * @return             true on success, false if uninitialized.
+ */
+bool fossil_bluecrab_cacheshell_key_tracking(bool enabled, unsigned int sample_rate);
+
+/**
+ * @brief Reports the most frequently accessed keys.
+ *
+ * Safe to poll at any time; does not take the cache lock.
+ *
+ * @param out  Array receiving up to k rows, most accessed first.
+ * @param k    Capacity of out.
+ * @return     Number of rows written.
+ */
+size_t fossil_bluecrab_cacheshell_top_keys(fossil_bluecrab_cache_key_stat_t *out, size_t k);
+
+/**
+ * @brief Reports the keys holding the largest values.
+ *
+ * Safe to poll at any time; does not take the cache lock.
+ *
+ * @param out  Array receiving up to k rows, largest first.
+ * @param k    Capacity of out.
+ * @return     Number of rows written.
+ */
+size_t fossil_bluecrab_cacheshell_largest_keys(fossil_bluecrab_cache_key_stat_t *out, size_t k);
+
+// ===========================================================
+// Near Cache (per-thread L1)
+// ===========================================================
+
+/**
+ * @brief Enables or disables the per-thread L1 near cache.
+ *
+ * Each thread keeps a small direct-mapped set of copies of recently read
+ * small values. get and get_binary_into check it before taking the cache
+ * lock; a copy is dropped as soon as its key (or the whole cache) is
+ * written. Toggling discards every thread's copies.
+ *
+ * @param enabled           true to enable, false to disable.
+ * @param max_staleness_ms  Lease after which a copy is re-read from the
+ *                          shared table even if unchanged (0 = no lease).
+ * @return                  true on success, false if uninitialized.
+ */
+bool fossil_bluecrab_cacheshell_near_cache(bool enabled, unsigned int max_staleness_ms);
+
+// ===========================================================
+// Value Compression
+// ===========================================================
+
+/**
+ * @brief Sets the size at which values are stored compressed.
+ *
+ * Values of at least min_size bytes written afterwards are compressed with
+ * a built-in LZ codec when that saves at least an eighth of their size.
+ * Reads are unaffected: every getter returns the original bytes. Memory
+ * usage counts the compressed size. Existing entries are left as they are.
+ *
+ * @param min_size  Threshold in bytes (0 = disable compression).
+ * @return          true on success, false if uninitialized or in
+ *                  shared-memory mode.
+ */
+bool fossil_bluecrab_cacheshell_compression(size_t min_size);
+
+/**
+ * @brief Retrieves compression counters for the live entries.
+ *
+ * @param out_entries        Entries stored compressed (nullable).
+ * @param out_logical_bytes  Their uncompressed size in bytes (nullable).
+ * @param out_stored_bytes   Their compressed size in bytes (nullable).
+ */
+void fossil_bluecrab_cacheshell_compression_stats(size_t *out_entries,
+                                                  size_t *out_logical_bytes,
+                                                  size_t *out_stored_bytes);
+
+// ===========================================================
+// Large-Object Store
+// ===========================================================
+
+/**
+ * @brief Routes oversized values into a dedicated large-object store.
+ *
+ * Values written afterwards whose stored size (after any compression) is
+ * at least min_size get a page-aligned block from a small pool of
+ * anonymous mappings instead of a heap block. The store has its own
+ * budget: admitting a value evicts the least recently read large objects
+ * until the block total fits, leaving small entries alone. A single value
+ * larger than the budget is rejected. Lowering the budget evicts
+ * immediately. A get_binary pointer to a large object is valid until the
+ * key is written, removed or evicted, as for any value; the pool stays
+ * mapped, so a stale pointer reads wrong bytes rather than faulting. Use
+ * pin to keep a value readable past that.
+ *
+ * @param min_size      Threshold in bytes (0 = store everything on the heap).
+ * @param budget_bytes  Cap on mapped bytes (0 = unlimited).
+ * @return              true on success, false if uninitialized or in
+ *                      shared-memory mode.
+ */
+bool fossil_bluecrab_cacheshell_large_objects(size_t min_size, size_t budget_bytes);
+
+/**
+ * @brief Retrieves large-object store counters.
+ *
+ * @param out_count         Live large objects (nullable).
+ * @param out_mapped_bytes  Pool bytes currently held by them (nullable).
+ * @param out_evictions     Large objects evicted for the budget (nullable).
+ */
+void fossil_bluecrab_cacheshell_large_object_stats(size_t *out_count,
+                                                   size_t *out_mapped_bytes,
+                                                   size_t *out_evictions);
+
 // ===========================================================
 // Thread Safety
 // ===========================================================
@@ -259,7 +912,15 @@ bool fossil_bluecrab_cacheshell_load(const char *path);
 #ifdef __cplusplus
 }
 #include <string>
+#include <string_view>
+#include <span>
+#include <array>
+#include <bit>
 #include <vector>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <cstddef>
 #include <filesystem>
 #include <functional>
 #include <cstring>
@@ -297,6 +958,25 @@ namespace fossil {
                 return fossil_bluecrab_cacheshell_init(max_entries);
             }
 
+            /**
+             * @brief Initialize the cache in a named shared-memory segment.
+             *
+             * @param name        Segment name, e.g. "/crabdb-cache".
+             * @param max_entries Optional entry limit (0 = unlimited).
+             * @param arena_bytes Bytes reserved for entries (0 = default).
+             * @return true on success, false otherwise.
+             */
+            static bool init_shared(const std::string& name, size_t max_entries = 0, size_t arena_bytes = 0) {
+                return fossil_bluecrab_cacheshell_init_shared(name.c_str(), max_entries, arena_bytes);
+            }
+
+            /**
+             * @brief Remove a shared-memory segment name.
+             */
+            static bool unlink_shared(const std::string& name) {
+                return fossil_bluecrab_cacheshell_unlink_shared(name.c_str());
+            }
+
             /**
              * @brief Shutdown the cache subsystem. All entries are released.
              *
@@ -313,47 +993,107 @@ namespace fossil {
             /**
              * @brief Insert or update a UTF-8 string value.
              *
+             * Stored with a terminating '\0' exactly like the C set(), using the
+             * view's length rather than strlen.
+             *
              * @param key   Cache key.
              * @param value Value to store.
              * @return true on success, false on failure.
              */
-            static bool set(const std::string& key, const std::string& value) {
-                return fossil_bluecrab_cacheshell_set(key.c_str(), value.c_str());
+            static bool set(std::string_view key, std::string_view value) {
+                return fossil_bluecrab_cacheshell_set_n(key_ptr(key), key.size(), key_ptr(value), value.size());
             }
 
             /**
              * @brief Retrieve a string value.
              *
+             * Small values are copied through a stack buffer (so the near cache
+             * can serve them); larger ones are pinned and copied once into
+             * out_value. Either way the text ends at the first '\0'.
+             *
              * @param key       Cache key.
              * @param out_value On success, replaced with the stored value.
-             * @param max_len   Upper bound hint passed to C API (may truncate longer data).
+             * @param max_len   Optional cap, as a buffer size: at most max_len - 1
+             *                  characters are kept (npos = no cap).
              * @return true if key found, false otherwise.
+             */
+            static bool get(std::string_view key, std::string& out_value,
+                            size_t max_len = std::string::npos) {
+                char small[256];
+                size_t size = 0;
+                if (!fossil_bluecrab_cacheshell_get_binary_into_n(key_ptr(key), key.size(), small, sizeof(small), &size))
+                    return false;
+                PinnedView view;
+                std::string_view s(small, size < sizeof(small) ? size : sizeof(small));
+                if (size > sizeof(small)) {
+                    view = pin(key);
+                    if (!view)
+                        return false; // removed in between
+                    s = std::string_view(static_cast<const char*>(view.data()), view.size());
+                }
+                s = s.substr(0, s.find('\0'));
+                if (max_len != std::string::npos)
+                    s = s.substr(0, max_len ? max_len - 1 : 0);
+                out_value.assign(s);
+                return true;
+            }
+
+            /**
+             * @brief Store a trivially copyable object as its raw bytes.
              *
-             * NOTE: The C API returns a pointer to an internal (or transient) buffer.
-             *       We copy it immediately into out_value to ensure safety.
+             * No intermediate allocation; the cache copies sizeof(T) bytes.
              */
-            static bool get(const std::string& key, std::string& out_value, size_t max_len = 4096) {
-                char *val = fossil_bluecrab_cacheshell_get(key.c_str(), max_len);
-                if (!val)
+            template <typename T>
+                requires (std::is_trivially_copyable_v<T> && !std::is_array_v<T> &&
+                          !std::is_pointer_v<T>)
+            static bool set(std::string_view key, const T& value) {
+                return fossil_bluecrab_cacheshell_set_binary_n(key_ptr(key), key.size(), &value, sizeof(T));
+            }
+
+            /**
+             * @brief Read an object stored with set<T>, straight into out.
+             *
+             * @return true if the key exists and holds exactly sizeof(T) bytes.
+             */
+            template <typename T>
+                requires (std::is_trivially_copyable_v<T> && !std::is_array_v<T> &&
+                          !std::is_pointer_v<T>)
+            static bool get(std::string_view key, T& out) {
+                std::array<std::byte, sizeof(T)> raw;
+                if (!read_exact(key, raw.data(), raw.size()))
                     return false;
-                out_value.assign(val);
+                std::memcpy(&out, raw.data(), sizeof(T));
                 return true;
             }
 
+            /**
+             * @brief Read an object stored with set<T>.
+             * @return The value, or std::nullopt if missing or of another size.
+             */
+            template <typename T>
+                requires (std::is_trivially_copyable_v<T> && !std::is_array_v<T> &&
+                          !std::is_pointer_v<T>)
+            static std::optional<T> get(std::string_view key) {
+                std::array<std::byte, sizeof(T)> raw;
+                if (!read_exact(key, raw.data(), raw.size()))
+                    return std::nullopt;
+                return std::bit_cast<T>(raw);
+            }
+
             /**
              * @brief Remove a key/value pair.
              * @return true if removed, false if not present.
              */
-            static bool remove(const std::string& key) {
-                return fossil_bluecrab_cacheshell_remove(key.c_str());
+            static bool remove(std::string_view key) {
+                return fossil_bluecrab_cacheshell_remove_n(key_ptr(key), key.size());
             }
 
             /**
              * @brief Check if a key exists.
              * @return true if exists, false otherwise.
              */
-            static bool exists(const std::string& key) {
-                return fossil_bluecrab_cacheshell_exists(key.c_str());
+            static bool exists(std::string_view key) {
+                return fossil_bluecrab_cacheshell_exists_n(key_ptr(key), key.size());
             }
 
             // -----------------------------------------------------------------
@@ -368,8 +1108,9 @@ namespace fossil {
              * @param ttl_sec  Lifetime in seconds (0 may mean no TTL, depending on C layer).
              * @return true on success, false on failure.
              */
-            static bool set_with_ttl(const std::string& key, const std::string& value, unsigned int ttl_sec) {
-                return fossil_bluecrab_cacheshell_set_with_ttl(key.c_str(), value.c_str(), ttl_sec);
+            static bool set_with_ttl(std::string_view key, std::string_view value, unsigned int ttl_sec) {
+                return fossil_bluecrab_cacheshell_set_with_ttl_n(key_ptr(key), key.size(), key_ptr(value),
+                                                                value.size(), ttl_sec);
             }
 
             /**
@@ -379,8 +1120,8 @@ namespace fossil {
              * @param ttl_sec  New TTL in seconds.
              * @return true if updated, false if key not found.
              */
-            static bool expire(const std::string& key, unsigned int ttl_sec) {
-                return fossil_bluecrab_cacheshell_expire(key.c_str(), ttl_sec);
+            static bool expire(std::string_view key, unsigned int ttl_sec) {
+                return fossil_bluecrab_cacheshell_expire_n(key_ptr(key), key.size(), ttl_sec);
             }
 
             /**
@@ -389,16 +1130,16 @@ namespace fossil {
              * @param key Key to query.
              * @return Remaining seconds, or -1 if not found or no TTL set.
              */
-            static int ttl(const std::string& key) {
-                return fossil_bluecrab_cacheshell_ttl(key.c_str());
+            static int ttl(std::string_view key) {
+                return fossil_bluecrab_cacheshell_ttl_n(key_ptr(key), key.size());
             }
 
             /**
              * @brief Refresh TTL without altering value (similar to touch in Unix).
              * @return true if refreshed, false otherwise.
              */
-            static bool touch(const std::string& key) {
-                return fossil_bluecrab_cacheshell_touch(key.c_str());
+            static bool touch(std::string_view key) {
+                return fossil_bluecrab_cacheshell_touch_n(key_ptr(key), key.size());
             }
 
             /**
@@ -421,8 +1162,15 @@ namespace fossil {
              * @param size  Length in bytes.
              * @return true on success, false on failure.
              */
-            static bool set_binary(const std::string& key, const void* data, size_t size) {
-                return fossil_bluecrab_cacheshell_set_binary(key.c_str(), data, size);
+            static bool set_binary(std::string_view key, const void* data, size_t size) {
+                return fossil_bluecrab_cacheshell_set_binary_n(key_ptr(key), key.size(), data, size);
+            }
+
+            /**
+             * @brief Store a byte span.
+             */
+            static bool set_binary(std::string_view key, std::span<const std::byte> bytes) {
+                return fossil_bluecrab_cacheshell_set_binary_n(key_ptr(key), key.size(), bytes.data(), bytes.size());
             }
 
             /**
@@ -438,45 +1186,100 @@ namespace fossil {
              * @param out_size  (Optional) receives full stored size in bytes.
              * @return true if key exists, false otherwise.
              */
-            static bool get_binary(const std::string& key, void* out_buf, size_t buf_size, size_t* out_size) {
-                return fossil_bluecrab_cacheshell_get_binary(key.c_str(), out_buf, buf_size, out_size);
+            static bool get_binary(std::string_view key, void* out_buf, size_t buf_size, size_t* out_size) {
+                return fossil_bluecrab_cacheshell_get_binary_into_n(key_ptr(key), key.size(), out_buf, buf_size, out_size);
+            }
+
+            /**
+             * @brief Retrieve binary data into a byte span (truncating like above).
+             */
+            static bool get_binary(std::string_view key, std::span<std::byte> out, size_t* out_size = nullptr) {
+                return fossil_bluecrab_cacheshell_get_binary_into_n(key_ptr(key), key.size(), out.data(), out.size(),
+                                                                    out_size);
             }
 
             /**
              * @brief Obtain a direct (read-only) pointer to stored binary data.
              *
              * Lifetime is managed by the cache; copy if you need to retain.
+             * Always nullptr in shared-memory mode (use get_binary or pin).
              *
              * @param key       Key.
              * @param out_size  (Optional) receives size of data.
              * @return pointer to data or nullptr if not found.
              */
-            static const void* get_binary_ptr(const std::string& key, size_t* out_size = nullptr) {
-                return ::fossil_bluecrab_cacheshell_get_binary(key.c_str(), out_size);
+            static const void* get_binary_ptr(std::string_view key, size_t* out_size = nullptr) {
+                return ::fossil_bluecrab_cacheshell_get_binary_n(key_ptr(key), key.size(), out_size);
             }
 
-        private:
-            // Internal shim to emulate an extended fetch API used by get_binary_vector().
-            // This creates a unified interface (key, buffer, capacity, out_size) on top
-            // of the simpler C function that only returns a pointer + size.
-            static bool fossil_bluecrab_cacheshell_get_binary(const char* key,
-                                                              void* out_buf,
-                                                              size_t buf_size,
-                                                              size_t* out_size) {
-                size_t stored_sz = 0;
-                const void* data = ::fossil_bluecrab_cacheshell_get_binary(key, &stored_sz);
-                if (!data) {
-                    if (out_size) *out_size = 0;
-                    return false;
+            /**
+             * @brief Read-only view of a pinned value, released on destruction.
+             *
+             * The bytes stay valid for the view's lifetime even if the key is
+             * overwritten or removed meanwhile. Move-only.
+             */
+            class PinnedView {
+            public:
+                PinnedView() = default;
+                PinnedView(PinnedView&& other) noexcept
+                    : pin_(std::exchange(other.pin_, nullptr)),
+                      data_(std::exchange(other.data_, nullptr)),
+                      size_(std::exchange(other.size_, 0)) {}
+                PinnedView& operator=(PinnedView&& other) noexcept {
+                    if (this != &other) {
+                        reset();
+                        pin_ = std::exchange(other.pin_, nullptr);
+                        data_ = std::exchange(other.data_, nullptr);
+                        size_ = std::exchange(other.size_, 0);
+                    }
+                    return *this;
                 }
-                if (out_size) *out_size = stored_sz;
-                if (out_buf && buf_size) {
-                    size_t to_copy = stored_sz < buf_size ? stored_sz : buf_size;
-                    std::memcpy(out_buf, data, to_copy);
+                PinnedView(const PinnedView&) = delete;
+                PinnedView& operator=(const PinnedView&) = delete;
+                ~PinnedView() { reset(); }
+
+                explicit operator bool() const { return pin_ != nullptr; }
+                const void* data() const { return data_; }
+                size_t size() const { return size_; }
+
+                /** @brief The value as bytes. */
+                std::span<const std::byte> bytes() const {
+                    return {static_cast<const std::byte*>(data_), size_};
                 }
-                return true;
+
+                /** @brief The value as text, up to the first '\0'. */
+                std::string_view str() const {
+                    const char* p = static_cast<const char*>(data_);
+                    const void* nul = p ? std::memchr(p, '\0', size_) : nullptr;
+                    return {p, nul ? static_cast<size_t>(static_cast<const char*>(nul) - p) : size_};
+                }
+
+                /** @brief Release the pin early. */
+                void reset() {
+                    if (pin_)
+                        fossil_bluecrab_cacheshell_unpin(pin_);
+                    pin_ = nullptr;
+                    data_ = nullptr;
+                    size_ = 0;
+                }
+
+            private:
+                friend class CacheShell;
+                fossil_bluecrab_cache_pin_t* pin_ = nullptr;
+                const void* data_ = nullptr;
+                size_t size_ = 0;
+            };
+
+            /**
+             * @brief Pin a value for zero-copy reading.
+             * @return A view that is empty (false) if the key does not exist.
+             */
+            static PinnedView pin(std::string_view key) {
+                PinnedView view;
+                view.data_ = fossil_bluecrab_cacheshell_pin_n(key_ptr(key), key.size(), &view.size_, &view.pin_);
+                return view;
             }
-        public:
+
 
             /**
              * @brief Convenience helper returning binary data in a std::vector<uint8_t>.
@@ -489,18 +1292,86 @@ namespace fossil {
              * @param out Vector filled with data (cleared/reallocated as needed).
              * @return true on success, false if key not found.
              */
-            static bool get_binary_vector(const std::string& key, std::vector<uint8_t>& out) {
+            static bool get_binary_vector(std::string_view key, std::vector<uint8_t>& out) {
                 size_t sz = 0;
-                if (!fossil_bluecrab_cacheshell_get_binary(key.c_str(), nullptr, 0, &sz))
+                if (!fossil_bluecrab_cacheshell_get_binary_into_n(key_ptr(key), key.size(), nullptr, 0, &sz))
                     return false;
                 out.resize(sz);
                 size_t got = 0;
-                if (!fossil_bluecrab_cacheshell_get_binary(key.c_str(), out.data(), sz, &got))
+                if (!fossil_bluecrab_cacheshell_get_binary_into_n(key_ptr(key), key.size(), out.data(), sz, &got))
                     return false;
                 out.resize(got);
                 return true;
             }
 
+            // -----------------------------------------------------------------
+            // Collection Values (hash / list / set)
+            // -----------------------------------------------------------------
+
+            /**
+             * @brief Set a field of the hash stored at key.
+             */
+            static bool hset(std::string_view key, std::string_view field, std::string_view value) {
+                return fossil_bluecrab_cacheshell_hset_n(key_ptr(key), key.size(), key_ptr(field), field.size(),
+                                                         value.data(), value.size());
+            }
+
+            /**
+             * @brief Read a hash field.
+             * @return true if the field exists.
+             */
+            static bool hget(std::string_view key, std::string_view field, std::string& out_value) {
+                size_t sz = 0;
+                if (!fossil_bluecrab_cacheshell_hget_n(key_ptr(key), key.size(), key_ptr(field), field.size(),
+                                                       nullptr, 0, &sz))
+                    return false;
+                std::string tmp(sz, '\0');
+                if (!fossil_bluecrab_cacheshell_hget_n(key_ptr(key), key.size(), key_ptr(field), field.size(),
+                                                       tmp.data(), sz, &sz))
+                    return false;
+                tmp.resize(sz < tmp.size() ? sz : tmp.size());
+                out_value.swap(tmp);
+                return true;
+            }
+
+            /**
+             * @brief Remove a hash field.
+             */
+            static bool hdel(std::string_view key, std::string_view field) {
+                return fossil_bluecrab_cacheshell_hdel_n(key_ptr(key), key.size(), key_ptr(field), field.size());
+            }
+
+            /**
+             * @brief Prepend a value to the list stored at key.
+             */
+            static bool lpush(std::string_view key, std::string_view value) {
+                return fossil_bluecrab_cacheshell_lpush_n(key_ptr(key), key.size(), value.data(), value.size());
+            }
+
+            /**
+             * @brief Copy list elements start..stop (inclusive, negative from the end).
+             */
+            static std::vector<std::string> lrange(std::string_view key, long start, long stop) {
+                std::vector<std::string> out;
+                fossil_bluecrab_cacheshell_lrange_n(key_ptr(key), key.size(), start, stop, &lrange_collect, &out);
+                return out;
+            }
+
+            /**
+             * @brief Add a member to the set stored at key.
+             */
+            static bool sadd(std::string_view key, std::string_view member) {
+                return fossil_bluecrab_cacheshell_sadd_n(key_ptr(key), key.size(), key_ptr(member), member.size());
+            }
+
+            /**
+             * @brief Test set membership.
+             */
+            static bool sismember(std::string_view key, std::string_view member) {
+                return fossil_bluecrab_cacheshell_sismember_n(key_ptr(key), key.size(), key_ptr(member),
+                                                              member.size());
+            }
+
             // -----------------------------------------------------------------
             // Cache Management
             // -----------------------------------------------------------------
@@ -549,6 +1420,26 @@ namespace fossil {
                 return s;
             }
 
+            /**
+             * @brief Hit/miss counters split by layer (near cache vs shared table).
+             */
+            struct LayerStats {
+            size_t l1_hits = 0;       ///< Lookups served by the near cache.
+            size_t l1_misses = 0;     ///< Near-cache lookups that fell through.
+            size_t shared_hits = 0;   ///< Hits in the shared table.
+            size_t shared_misses = 0; ///< Misses in the shared table.
+            };
+
+            /**
+             * @brief Retrieve snapshot of per-layer counters.
+             */
+            static LayerStats layer_stats() {
+                LayerStats s;
+                fossil_bluecrab_cacheshell_layer_stats(&s.l1_hits, &s.l1_misses,
+                                                       &s.shared_hits, &s.shared_misses);
+                return s;
+            }
+
             // -----------------------------------------------------------------
             // Iteration
             // -----------------------------------------------------------------
@@ -562,16 +1453,178 @@ namespace fossil {
              * @param cb Callback invoked once per entry: (key, value_ptr, value_size).
              */
             static void iterate(const std::function<void(const std::string&, const void*, size_t)>& cb) {
-                struct Trampoline {
-                    static void call(const char* k, const void* v, size_t vsz, void* ud) {
-                    auto* fn = static_cast<const std::function<void(const std::string&, const void*, size_t)>*>(ud);
-                    (*fn)(k, v, vsz);
-                    }
-                };
-                fossil_bluecrab_cacheshell_iterate(&Trampoline::call,
+                fossil_bluecrab_cacheshell_iterate_n(&scan_trampoline,
                                 const_cast<void*>(reinterpret_cast<const void*>(&cb)));
             }
 
+            // -----------------------------------------------------------------
+            // Ordered Index / Range Queries
+            // -----------------------------------------------------------------
+
+            /**
+             * @brief Callback signature shared by the scan helpers.
+             */
+            using ScanFn = std::function<void(const std::string&, const void*, size_t)>;
+
+            /**
+             * @brief Enable or disable the ordered key index (opt-in).
+             * @return true on success, false on failure.
+             */
+            static bool ordered_index(bool enabled) {
+                return fossil_bluecrab_cacheshell_ordered_index(enabled);
+            }
+
+            /**
+             * @brief Visit entries whose key starts with prefix (sorted when indexed).
+             * @return Number of entries visited.
+             */
+            static size_t scan_prefix(std::string_view prefix, const ScanFn& cb) {
+                return fossil_bluecrab_cacheshell_scan_prefix_n(key_ptr(prefix), prefix.size(), &scan_trampoline,
+                                const_cast<void*>(reinterpret_cast<const void*>(&cb)));
+            }
+
+            /**
+             * @brief Visit entries with start <= key < end (sorted when indexed).
+             * @return Number of entries visited.
+             */
+            static size_t scan_range(std::string_view start, std::string_view end, const ScanFn& cb) {
+                return fossil_bluecrab_cacheshell_scan_range_n(key_ptr(start), start.size(), key_ptr(end), end.size(),
+                                &scan_trampoline,
+                                const_cast<void*>(reinterpret_cast<const void*>(&cb)));
+            }
+
+            /**
+             * @brief Remove entries whose key starts with prefix.
+             * @return Number of entries removed.
+             */
+            static size_t delete_prefix(std::string_view prefix) {
+                return fossil_bluecrab_cacheshell_delete_prefix_n(key_ptr(prefix), prefix.size());
+            }
+
+            /**
+             * @brief Remove entries with start <= key < end.
+             * @return Number of entries removed.
+             */
+            static size_t delete_range(std::string_view start, std::string_view end) {
+                return fossil_bluecrab_cacheshell_delete_range_n(key_ptr(start), start.size(), key_ptr(end),
+                                end.size());
+            }
+
+            // -----------------------------------------------------------------
+            // Hot / Big Key Tracking
+            // -----------------------------------------------------------------
+
+            /**
+             * @brief One row of a hot-key or big-key report.
+             */
+            struct KeyStat {
+            std::string key;   ///< Key (truncated to 63 chars).
+            size_t value = 0;  ///< Estimated accesses or value bytes.
+            size_t error = 0;  ///< Max overestimate (hot keys only).
+            };
+
+            /**
+             * @brief Enable or disable hot/big key tracking.
+             * @param sample_rate Average accesses per sample (0/1 = all).
+             */
+            static bool key_tracking(bool enabled, unsigned int sample_rate = 1) {
+                return fossil_bluecrab_cacheshell_key_tracking(enabled, sample_rate);
+            }
+
+            /**
+             * @brief Up to k most accessed keys, most accessed first.
+             */
+            static std::vector<KeyStat> top_keys(size_t k) {
+                return key_report(k, &fossil_bluecrab_cacheshell_top_keys);
+            }
+
+            /**
+             * @brief Up to k keys with the largest values, largest first.
+             */
+            static std::vector<KeyStat> largest_keys(size_t k) {
+                return key_report(k, &fossil_bluecrab_cacheshell_largest_keys);
+            }
+
+            // -----------------------------------------------------------------
+            // Near Cache (per-thread L1)
+            // -----------------------------------------------------------------
+
+            /**
+             * @brief Enable or disable the per-thread near cache.
+             *
+             * @param enabled           true to enable, false to disable.
+             * @param max_staleness_ms  Lease for cached copies (0 = none).
+             * @return true on success, false if the cache is not initialized.
+             */
+            static bool near_cache(bool enabled, unsigned int max_staleness_ms = 0) {
+                return fossil_bluecrab_cacheshell_near_cache(enabled, max_staleness_ms);
+            }
+
+            // -----------------------------------------------------------------
+            // Value Compression
+            // -----------------------------------------------------------------
+
+            /**
+             * @brief Compress values of at least min_size bytes (0 = off).
+             * @return true on success, false if uninitialized or shared.
+             */
+            static bool compression(size_t min_size) {
+                return fossil_bluecrab_cacheshell_compression(min_size);
+            }
+
+            /**
+             * @brief Counters for values currently stored compressed.
+             */
+            struct CompressionStats {
+            size_t entries = 0;        ///< Entries stored compressed.
+            size_t logical_bytes = 0;  ///< Their uncompressed size.
+            size_t stored_bytes = 0;   ///< Their compressed size.
+            };
+
+            /**
+             * @brief Retrieve snapshot of compression counters.
+             */
+            static CompressionStats compression_stats() {
+                CompressionStats s;
+                fossil_bluecrab_cacheshell_compression_stats(&s.entries, &s.logical_bytes,
+                                                             &s.stored_bytes);
+                return s;
+            }
+
+            // -----------------------------------------------------------------
+            // Large-Object Store
+            // -----------------------------------------------------------------
+
+            /**
+             * @brief Map values of at least min_size bytes separately.
+             *
+             * @param min_size      Threshold in bytes (0 = off).
+             * @param budget_bytes  Mapped-bytes cap (0 = unlimited).
+             * @return true on success, false if uninitialized or shared.
+             */
+            static bool large_objects(size_t min_size, size_t budget_bytes = 0) {
+                return fossil_bluecrab_cacheshell_large_objects(min_size, budget_bytes);
+            }
+
+            /**
+             * @brief Counters for the large-object store.
+             */
+            struct LargeObjectStats {
+            size_t count = 0;         ///< Live large objects.
+            size_t mapped_bytes = 0;  ///< Bytes mapped for them.
+            size_t evictions = 0;     ///< Evicted to honour the budget.
+            };
+
+            /**
+             * @brief Retrieve snapshot of large-object counters.
+             */
+            static LargeObjectStats large_object_stats() {
+                LargeObjectStats s;
+                fossil_bluecrab_cacheshell_large_object_stats(&s.count, &s.mapped_bytes,
+                                                              &s.evictions);
+                return s;
+            }
+
             // -----------------------------------------------------------------
             // Thread Safety Control
             // -----------------------------------------------------------------
@@ -612,6 +1665,38 @@ namespace fossil {
                 return fossil_bluecrab_cacheshell_load(path.c_str());
             }
 
+        private:
+            // Keys (and string values) go to the C layer by length, so they may
+            // hold '\0'; an empty view may have a null data pointer.
+            static const char* key_ptr(std::string_view key) {
+                return key.data() ? key.data() : "";
+            }
+
+            // Copies a value that must be exactly size bytes long.
+            static bool read_exact(std::string_view key, void* dst, size_t size) {
+                size_t stored = 0;
+                return fossil_bluecrab_cacheshell_get_binary_into_n(key_ptr(key), key.size(), dst, size, &stored) &&
+                       stored == size;
+            }
+
+            static void scan_trampoline(const char* k, size_t ksz, const void* v, size_t vsz, void* ud) {
+                (*static_cast<const ScanFn*>(ud))(std::string(k, ksz), v, vsz);
+            }
+
+            static void lrange_collect(const void* v, size_t vsz, void* ud) {
+                static_cast<std::vector<std::string>*>(ud)->emplace_back(static_cast<const char*>(v), vsz);
+            }
+
+            static std::vector<KeyStat> key_report(
+                    size_t k, size_t (*fn)(fossil_bluecrab_cache_key_stat_t*, size_t)) {
+                std::vector<fossil_bluecrab_cache_key_stat_t> raw(k);
+                size_t n = k ? fn(raw.data(), k) : 0;
+                std::vector<KeyStat> out;
+                out.reserve(n);
+                for (size_t i = 0; i < n; ++i)
+                    out.push_back(KeyStat{raw[i].key, raw[i].value, raw[i].error});
+                return out;
+            }
         };
 
     } // namespace bluecrab
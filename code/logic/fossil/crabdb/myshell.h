@@ -86,6 +86,20 @@ typedef enum {
     FOSSIL_MYSHELL_ERROR_UNKNOWN               /**< Unknown or unspecified error occurred. */
 } fossil_bluecrab_myshell_error_t;
 
+/**
+ * ===========================================================
+ * MyShell Durability Modes
+ * ===========================================================
+ * Decides when appended records are forced to stable storage. Records are
+ * grouped in memory and written to the file in one write at each commit (or
+ * when the group buffer fills); the mode adds an fdatasync on top.
+ */
+typedef enum {
+    FOSSIL_MYSHELL_DURABILITY_NONE = 0,        /**< Never sync; the OS writes back when it likes (default). */
+    FOSSIL_MYSHELL_DURABILITY_INTERVAL,        /**< Sync on the first write or commit once the interval has passed. */
+    FOSSIL_MYSHELL_DURABILITY_COMMIT           /**< Sync every commit and merge, one sync for the whole group. */
+} fossil_bluecrab_myshell_durability_t;
+
 // ============================================================================
 // FSON v2 compatible value representation (local to MyShell)
 // ============================================================================
@@ -169,7 +183,7 @@ typedef struct fossil_bluecrab_myshell_t {
     char    *branch;              /**< Current branch name. */
     uint64_t commit_head;         /**< Current commit head hash. */
     bool     is_open;             /**< Indicates if the DB is currently open. */
-    void    *cache;               /**< Pointer to cache structure (if any). */
+    void    *cache;               /**< Key index (key -> record offset/length), built at open. */
     void    *lock;                /**< Pointer to lock/mutex (if any). */
     int      error_code;          /**< Last error code encountered. */
 
@@ -183,9 +197,30 @@ typedef struct fossil_bluecrab_myshell_t {
     uint64_t merge_commit_hash;   /**< Merge commit hash (if merge). */
 } fossil_bluecrab_myshell_t;
 
+/**
+ * A read-only view of a stored value inside the database's file mapping.
+ * The bytes are not NUL-terminated and stay valid while the handle's map
+ * epoch (see fossil_myshell_map_epoch) still equals `epoch`; a remap after
+ * the file grows, a compaction or closing the handle ends them.
+ */
+typedef struct {
+    const char *data;             /**< First byte of the value. */
+    size_t      length;           /**< Value length in bytes. */
+    uint64_t    epoch;            /**< Map epoch the view belongs to. */
+} fossil_bluecrab_myshell_view_t;
+
+/**
+ * An ordered set of puts and deletes, encoded up front and applied to a
+ * database all at once (see fossil_myshell_batch_apply). Opaque; a batch is
+ * not tied to a handle and can be applied to several.
+ */
+typedef struct fossil_bluecrab_myshell_batch fossil_bluecrab_myshell_batch_t;
+
 /**
  * o-Open/create/close
  * Opens an existing database file, creates a new database file, or closes a database handle.
+ * Opening scans the file once to validate FSON types and build the in-memory key index.
+ * A last record cut short by a crash (or failing its checksum) is dropped from the file.
  * Time Complexity: O(1) for handle allocation, O(n) for file scan (n = file size).
  * @param path Path to the database file.
  * @param err Output parameter for error code.
@@ -214,7 +249,9 @@ void fossil_myshell_close(fossil_bluecrab_myshell_t *db);
 /**
  * o-Record CRUD (key/value, git-like chain)
  * Inserts or updates a key/value record in the database.
- * Time Complexity: O(1) for append, O(n) for update (n = number of records).
+ * The new version is appended to the file; the previous one is left behind as garbage.
+ * Keys and values are stored length-prefixed and may contain any characters.
+ * Time Complexity: O(1) append.
  * @param db Database handle.
  * @param key Key string.
  * @param type Type string (FSON type).
@@ -226,7 +263,9 @@ fossil_bluecrab_myshell_error_t fossil_myshell_put(fossil_bluecrab_myshell_t *db
 /**
  * o-Record CRUD (key/value, git-like chain)
  * Retrieves the value for a given key from the database.
- * Time Complexity: O(n) (n = number of records).
+ * The current branch's own writes are looked up first, then its snapshot tree; either gives
+ * the record's location, and the value is read with one positioned read.
+ * Time Complexity: O(1) average for keys written since the last commit, O(log n) otherwise.
  * @param db Database handle.
  * @param key Key string.
  * @param out_value Output buffer for value.
@@ -237,8 +276,30 @@ fossil_bluecrab_myshell_error_t fossil_myshell_get(fossil_bluecrab_myshell_t *db
 
 /**
  * o-Record CRUD (key/value, git-like chain)
- * Deletes a key/value record from the database.
- * Time Complexity: O(n) (n = number of records).
+ * Retrieves the value for a given key as a view into the read-only file mapping, without copying it.
+ * A value still waiting in the group buffer is written out first so the view can point into the file.
+ * Time Complexity: as fossil_myshell_get, plus a remap when the file has grown past the current mapping.
+ * @param db Database handle.
+ * @param key Key string.
+ * @param out_view Receives the value's bytes, length and map epoch.
+ * @return Error code (UNSUPPORTED when the file cannot be mapped or the value is an open transaction's write).
+ */
+fossil_bluecrab_myshell_error_t fossil_myshell_get_view(fossil_bluecrab_myshell_t *db, const char *key, fossil_bluecrab_myshell_view_t *out_view);
+
+/**
+ * o-Record CRUD (key/value, git-like chain)
+ * Returns the handle's current map epoch. It changes whenever the file mapping is replaced or dropped,
+ * which invalidates every view taken in an earlier epoch.
+ * Time Complexity: O(1).
+ * @param db Database handle.
+ * @return Current map epoch (0 for a NULL or closed handle).
+ */
+uint64_t fossil_myshell_map_epoch(const fossil_bluecrab_myshell_t *db);
+
+/**
+ * o-Record CRUD (key/value, git-like chain)
+ * Deletes a key/value record from the database by appending a `#del` tombstone.
+ * Time Complexity: O(1) append.
  * @param db Database handle.
  * @param key Key string.
  * @return Error code.
@@ -248,7 +309,11 @@ fossil_bluecrab_myshell_error_t fossil_myshell_del(fossil_bluecrab_myshell_t *db
 /**
  * o-Commit/branch
  * Commits the current changes to the database with a message.
- * Time Complexity: O(1) for metadata update.
+ * Staged changes, then an open transaction's writes, are applied with the commit record in one
+ * batch; the staging area is emptied and the transaction ends.
+ * The commit records a snapshot tree of every key; only the paths to keys changed since the
+ * last snapshot are written, the rest is shared with the parent commit.
+ * Time Complexity: O(d log n) (d = keys changed since the last commit), plus O(s + b) for the staged changes and an open transaction's batch.
  * @param db Database handle.
  * @param message Commit message.
  * @return Error code.
@@ -258,6 +323,8 @@ fossil_bluecrab_myshell_error_t fossil_myshell_commit(fossil_bluecrab_myshell_t
 /**
  * o-Commit/branch
  * Creates a new branch in the database.
+ * The branch starts at the head commit and the handle switches to it, taking the uncommitted
+ * writes along: it only names the current view, so nothing is copied.
  * Time Complexity: O(1).
  * @param db Database handle.
  * @param branch_name Name of the new branch.
@@ -268,17 +335,55 @@ fossil_bluecrab_myshell_error_t fossil_myshell_branch(fossil_bluecrab_myshell_t
 /**
  * o-Commit/branch
  * Checks out a branch or commit in the database.
- * Time Complexity: O(1) for branch, O(n) for commit scan (n = number of commits).
+ * Names resolve through the in-memory commit graph and ref tables: a branch, a tag, or a commit hash.
+ * Snapshot commits switch to that commit's view of the keys. Each branch keeps its own
+ * uncommitted writes over its snapshot: they are set aside while another branch is checked
+ * out and come back with it, also after a reopen. With an open transaction, or with writes
+ * on a detached head (create a branch there to keep them), it returns CONCURRENCY.
+ * Time Complexity: O(1), independent of the number of keys.
  * @param db Database handle.
  * @param branch_or_commit Branch name or commit hash.
  * @return Error code.
  */
 fossil_bluecrab_myshell_error_t fossil_myshell_checkout(fossil_bluecrab_myshell_t *db, const char *branch_or_commit);
 
+/**
+ * o-Commit/branch
+ * How a merge settles a key both sides changed differently.
+ */
+typedef enum {
+    FOSSIL_MYSHELL_MERGE_OURS,   /**< Keep the current branch's version. */
+    FOSSIL_MYSHELL_MERGE_THEIRS, /**< Take the merged branch's version. */
+    FOSSIL_MYSHELL_MERGE_ABORT   /**< Give up the merge; nothing is written. */
+} fossil_bluecrab_myshell_merge_choice_t;
+
+/**
+ * o-Commit/branch
+ * Callback type for merge conflicts. Called before anything is written, once per
+ * conflicting key. A value is NULL when the key does not exist on that side.
+ * Time Complexity: O(1) per callback.
+ * @param key The conflicting key.
+ * @param base The key's value at the merge base.
+ * @param ours The key's value on the current branch.
+ * @param theirs The key's value on the merged branch.
+ * @param user User data pointer.
+ * @return Which version to keep, or ABORT.
+ */
+typedef fossil_bluecrab_myshell_merge_choice_t (*fossil_myshell_conflict_cb)(const char *key, const char *base,
+                                                                            const char *ours, const char *theirs,
+                                                                            void *user);
+
 /**
  * o-Commit/branch
  * Merges a source branch into the current branch with a commit message.
- * Time Complexity: O(n) (n = number of commits in source branch).
+ * When both are snapshot commits this is a three-way merge: keys the source changed
+ * since the merge base and the current branch did not are taken over, and the merge
+ * commit's tree holds the result. Any conflict fails the merge with CONCURRENCY
+ * before anything is written; fossil_myshell_merge_with can settle them instead.
+ * Needs a clean working state: no uncommitted writes on the current branch and no open
+ * transaction, else it returns CONCURRENCY. Merging a branch the current one
+ * already contains does nothing.
+ * Time Complexity: O(k log k + d log n) (k = commits back to the merge base, d = keys the source changed).
  * @param db Database handle.
  * @param source_branch Name of the source branch to merge.
  * @param message Merge commit message.
@@ -286,20 +391,52 @@ fossil_bluecrab_myshell_error_t fossil_myshell_checkout(fossil_bluecrab_myshell_
  */
 fossil_bluecrab_myshell_error_t fossil_myshell_merge(fossil_bluecrab_myshell_t *db, const char *source_branch, const char *message);
 
+/**
+ * o-Commit/branch
+ * Merges like fossil_myshell_merge, asking @p cb how to settle each conflicting key.
+ * The changes and the merge commit are written as one batch.
+ * Time Complexity: O(k log k + d log n) (k = commits back to the merge base, d = keys the source changed).
+ * @param db Database handle.
+ * @param source_branch Name of the source branch to merge.
+ * @param message Merge commit message.
+ * @param cb Conflict callback; NULL makes any conflict fail with CONCURRENCY.
+ * @param user User data pointer for @p cb.
+ * @return Error code; TRANSACTION_FAILED if @p cb aborted the merge.
+ */
+fossil_bluecrab_myshell_error_t fossil_myshell_merge_with(fossil_bluecrab_myshell_t *db, const char *source_branch,
+                                                          const char *message, fossil_myshell_conflict_cb cb,
+                                                          void *user);
+
 /**
  * o-Commit/branch
  * Reverts to a specific commit in the current branch.
- * Time Complexity: O(n) (n = number of commits).
+ * Time Complexity: O(1) commit graph lookup.
  * @param db Database handle.
  * @param commit_hash Commit hash to revert to.
  * @return Error code.
  */
 fossil_bluecrab_myshell_error_t fossil_myshell_revert(fossil_bluecrab_myshell_t *db, const char *commit_hash);
 
+/**
+ * o-Commit/branch
+ * Finds the nearest common ancestor of two branches, tags or commits in the commit graph.
+ * The walk goes down both histories in generation order and stops at the first shared commit.
+ * Time Complexity: O(k log k) (k = commits between the two and their merge base).
+ * @param db Database handle.
+ * @param a First branch, tag or commit hash.
+ * @param b Second branch, tag or commit hash.
+ * @param out_hash Buffer receiving the merge base's commit hash (17 bytes with the terminator).
+ * @param out_size Size of @p out_hash.
+ * @return Error code; NOT_FOUND if the two share no commit.
+ */
+fossil_bluecrab_myshell_error_t fossil_myshell_merge_base(fossil_bluecrab_myshell_t *db, const char *a, const char *b,
+                                                          char *out_hash, size_t out_size);
+
 /**
  * o-Staging area
- * Stages a key/value pair for the next commit.
- * Time Complexity: O(1) for append, O(n) for update (n = number of staged records).
+ * Stages a key/value pair for the next commit, which puts it. The staging area is held in
+ * memory and written only by the commit, unless it is journaled (see fossil_myshell_set_stage_journal).
+ * Time Complexity: O(1) amortized, in memory; plus an append when journaled.
  * @param db Database handle.
  * @param key Key string.
  * @param type Type string (FSON type).
@@ -309,19 +446,32 @@ fossil_bluecrab_myshell_error_t fossil_myshell_revert(fossil_bluecrab_myshell_t
 fossil_bluecrab_myshell_error_t fossil_myshell_stage(fossil_bluecrab_myshell_t *db, const char *key, const char *type, const char *value);
 
 /**
- * o-Staging area 
+ * o-Staging area
  * Unstages a key/value pair from the staging area.
- * Time Complexity: O(n) (n = number of staged records).
+ * Time Complexity: O(1), in memory; plus an append of an `#unstage` tombstone when journaled.
  * @param db Database handle.
  * @param key Key string.
  * @return Error code.
  */
 fossil_bluecrab_myshell_error_t fossil_myshell_unstage(fossil_bluecrab_myshell_t *db, const char *key);
 
+/**
+ * o-Staging area
+ * Turns journaling of the staging area on or off (off by default). A journaled staging area
+ * appends `#stage` and `#unstage` records as it changes, so it survives closing the handle or
+ * a crash; otherwise what is staged but not committed is lost on close. Turning it on
+ * journals what is already staged.
+ * Time Complexity: O(1), or O(s) to turn it on (s = staged keys).
+ * @param db Database handle.
+ * @param enabled Whether to journal.
+ * @return Error code.
+ */
+fossil_bluecrab_myshell_error_t fossil_myshell_set_stage_journal(fossil_bluecrab_myshell_t *db, bool enabled);
+
 /**
  * o-Tagging
  * Tags a specific commit with a name.
- * Time Complexity: O(n) (n = number of commits).
+ * Time Complexity: O(1) commit graph lookup and append.
  * @param db Database handle.
  * @param commit_hash Commit hash to tag.
  * @param tag_name Name of the tag.
@@ -343,7 +493,9 @@ typedef bool (*fossil_myshell_commit_cb)(const char *commit_hash, const char *me
 /**
  * o-History iteration
  * Iterates over the commit log, invoking the callback for each commit.
- * Time Complexity: O(n) (n = number of commits).
+ * Only commit records are read, located through the commit graph, and commit hashes are
+ * re-derived only for commits past the last integrity checkpoint or earlier log walk.
+ * Time Complexity: O(c log c) (c = number of commits), independent of the number of key records.
  * @param db Database handle.
  * @param cb Callback function.
  * @param user User data pointer.
@@ -373,13 +525,49 @@ fossil_bluecrab_myshell_error_t fossil_myshell_restore(const char *backup_path,
 
 /**
  * o-Utility
- * Computes the difference between two database files and outputs the result.
- * Time Complexity: O(n) (n = number of records/commits).
+ * Callback type for streaming diffs.
+ * Time Complexity: O(1) per callback.
+ * @param change '-' for an entry only in the first database, '+' for one only in the
+ *               second, '~' for one in both that differs.
+ * @param before The entry's v1-style text line in the first database, or NULL for '+'.
+ * @param after The entry's v1-style text line in the second database, or NULL for '-'.
+ * @param user User data pointer.
+ * @return True to continue the diff, false to stop.
+ */
+typedef bool (*fossil_myshell_diff_cb)(char change, const char *before, const char *after, void *user);
+
+/**
+ * o-Utility
+ * Computes the difference between two databases' commits and staged entries, passing
+ * each change to the callback: first commits removed or changed, then commits added,
+ * then the same for staged entries. Each side's commit graph and staged index is probed
+ * with the other's entries, so there is no limit on how many entries are compared and
+ * memory use does not grow with them.
+ * Time Complexity: O(c + s) (c = commits, s = staged entries, in both databases).
+ * @param db1 First database handle.
+ * @param db2 Second database handle.
+ * @param cb Callback function.
+ * @param user User data pointer.
+ * @return Error code.
+ */
+fossil_bluecrab_myshell_error_t fossil_myshell_diff_stream(
+    const fossil_bluecrab_myshell_t *db1,
+    const fossil_bluecrab_myshell_t *db2,
+    fossil_myshell_diff_cb cb,
+    void *user
+);
+
+/**
+ * o-Utility
+ * Computes the difference between two database files and outputs the result, one
+ * line per change as produced by fossil_myshell_diff_stream, prefixed by "- ", "+ "
+ * or "~ " (a change gives its old and new line).
+ * Time Complexity: O(c + s) (c = commits, s = staged entries, in both databases).
  * @param db1 First database handle.
  * @param db2 Second database handle.
  * @param out_diff Output buffer for diff result.
  * @param out_size Size of output buffer.
- * @return Error code.
+ * @return Error code (CAPACITY_EXCEEDED if the diff does not fit).
  */
 fossil_bluecrab_myshell_error_t fossil_myshell_diff(
     const fossil_bluecrab_myshell_t *db1,
@@ -399,17 +587,227 @@ const char *fossil_myshell_errstr(fossil_bluecrab_myshell_error_t err);
 
 /**
  * Validates database integrity (hash chain, file size, corruption).
- * Time Complexity: O(n) (n = number of records/commits).
+ * Only records appended since the last successful check are validated; each success
+ * appends a checkpoint recording how far the file is verified.
+ * Time Complexity: O(k) (k = records appended since the last checkpoint).
  * @param db Database handle.
  * @return Error code.
  */
 fossil_bluecrab_myshell_error_t fossil_myshell_check_integrity(fossil_bluecrab_myshell_t *db);
 
+/**
+ * Validates database integrity like fossil_myshell_check_integrity, but from the start
+ * of the file regardless of checkpoints, to catch damage to data verified before.
+ * Time Complexity: O(n) (n = number of records).
+ * @param db Database handle.
+ * @return Error code.
+ */
+fossil_bluecrab_myshell_error_t fossil_myshell_check_integrity_full(fossil_bluecrab_myshell_t *db);
+
+/**
+ * One failure found by fossil_myshell_check_integrity_parallel.
+ */
+typedef struct {
+    uint64_t offset;                        /**< File offset of the failing record. */
+    fossil_bluecrab_myshell_error_t error;  /**< What is wrong with it. */
+} fossil_bluecrab_myshell_check_failure_t;
+
+/**
+ * Progress of a parallel integrity check, reported once per finished chunk.
+ */
+typedef struct {
+    size_t   chunk;                         /**< Index of the chunk, in file order. */
+    size_t   chunks;                        /**< Number of chunks the file was split into. */
+    uint64_t start;                         /**< First byte of the chunk. */
+    uint64_t end;                           /**< One past the last byte of the chunk. */
+    uint64_t records;                       /**< Records checked in the chunk. */
+    size_t   failures;                      /**< Failures found in the chunk. */
+} fossil_bluecrab_myshell_check_progress_t;
+
+/**
+ * Callback type for parallel integrity check progress. Called from the checking
+ * threads, one call at a time, as chunks finish (not necessarily in file order).
+ * @param progress The chunk that finished.
+ * @param user User data pointer.
+ */
+typedef void (*fossil_myshell_check_progress_cb)(const fossil_bluecrab_myshell_check_progress_t *progress,
+                                                 void *user);
+
+/**
+ * Validates the whole file like fossil_myshell_check_integrity_full, on several threads.
+ * The file is split into chunks at record boundaries, which a pool of threads checks;
+ * a final pass then checks the commit chain across chunks. Instead of stopping at the
+ * first damaged record the check carries on and collects failures in file order.
+ * Success appends a checkpoint as the other checks do.
+ * Time Complexity: O(n / t + c) (n = file size, t = threads, c = number of commits).
+ * @param db Database handle.
+ * @param threads Number of threads, the calling one included; 0 for one per CPU.
+ * @param failures Receives the first failures in file order (may be NULL if max_failures is 0).
+ * @param max_failures Capacity of @p failures.
+ * @param failure_count Receives the number of failures found, which may exceed max_failures (may be NULL).
+ * @param progress Optional per-chunk progress callback.
+ * @param user User data pointer for @p progress.
+ * @return SUCCESS, or the error of the first failure in the file.
+ */
+fossil_bluecrab_myshell_error_t fossil_myshell_check_integrity_parallel(
+    fossil_bluecrab_myshell_t *db, size_t threads, fossil_bluecrab_myshell_check_failure_t *failures,
+    size_t max_failures, size_t *failure_count, fossil_myshell_check_progress_cb progress, void *user);
+
+/**
+ * o-Compaction
+ * Starts rewriting the log on a background thread, keeping only the latest
+ * version of each live or staged key plus all history. Reads and writes keep
+ * using the current file meanwhile; writes made during the copy are carried
+ * over when the compacted file is swapped in by an atomic rename. The swap
+ * happens on the next write after the copy finishes, or in compact_wait.
+ * Does nothing if a compaction is already running.
+ * History is never reclaimed: every blob that any tree of any past commit
+ * refers to is kept, so only superseded uncommitted versions, tombstones and
+ * journal records shrink the file.
+ * Time Complexity: O(k log k) to start (k = live keys), O(n) in the
+ * background (n = file size).
+ * @param db Database handle.
+ * @return Error code.
+ */
+fossil_bluecrab_myshell_error_t fossil_myshell_compact(fossil_bluecrab_myshell_t *db);
+
+/**
+ * o-Compaction
+ * Waits for a running compaction and swaps the compacted file in.
+ * Time Complexity: O(n) worst case (remaining copy plus writes made meanwhile).
+ * @param db Database handle.
+ * @return Error code of the compaction; SUCCESS if none was running.
+ */
+fossil_bluecrab_myshell_error_t fossil_myshell_compact_wait(fossil_bluecrab_myshell_t *db);
+
+/**
+ * o-Compaction
+ * Configures automatic compaction: once superseded versions and tombstones make
+ * up at least @p garbage_ratio of the file, the next write starts a background
+ * compaction. The copy reads at most @p max_bytes_per_sec bytes per second.
+ * Time Complexity: O(1).
+ * @param db Database handle.
+ * @param garbage_ratio Threshold in [0, 1]; 0 disables automatic compaction (default).
+ * @param max_bytes_per_sec Copy rate limit; 0 means unlimited (default).
+ * @return Error code.
+ */
+fossil_bluecrab_myshell_error_t fossil_myshell_set_compaction(fossil_bluecrab_myshell_t *db, double garbage_ratio, uint64_t max_bytes_per_sec);
+
+/**
+ * o-Durability
+ * Selects when appended records are fdatasync'ed (see fossil_bluecrab_myshell_durability_t).
+ * Closing the handle syncs once more unless the mode is NONE.
+ * Time Complexity: O(1).
+ * @param db Database handle.
+ * @param mode Durability mode.
+ * @param interval_ms Maximum time between syncs for INTERVAL; ignored otherwise.
+ * @return Error code.
+ */
+fossil_bluecrab_myshell_error_t fossil_myshell_set_durability(fossil_bluecrab_myshell_t *db, fossil_bluecrab_myshell_durability_t mode, uint64_t interval_ms);
+
+/**
+ * o-Durability
+ * Writes out any grouped records and fdatasyncs the file now, whatever the mode.
+ * Time Complexity: O(k) (k = bytes not yet written).
+ * @param db Database handle.
+ * @return Error code.
+ */
+fossil_bluecrab_myshell_error_t fossil_myshell_sync(fossil_bluecrab_myshell_t *db);
+
+/**
+ * o-Format conversion
+ * Rewrites a v1 (text) .myshell file as a new v2 (binary) file, which can then be opened.
+ * Records whose #hash= stamp does not match their key are dropped, as the v1 reader did.
+ * Time Complexity: O(n) (n = file size).
+ * @param text_path Path to the v1 text file.
+ * @param binary_path Path of the v2 file to create; must not exist yet.
+ * @return Error code (ALREADY_EXISTS if binary_path exists, INVALID_FILE if text_path is already v2).
+ */
+fossil_bluecrab_myshell_error_t fossil_myshell_convert(const char *text_path, const char *binary_path);
+
+/**
+ * o-Write batches
+ * Creates an empty batch, frees one, or empties one for reuse.
+ * Time Complexity: O(1).
+ * @param batch Batch handle (free and clear accept NULL).
+ * @return The new batch, or NULL on allocation failure.
+ */
+fossil_bluecrab_myshell_batch_t *fossil_myshell_batch_new(void);
+void fossil_myshell_batch_free(fossil_bluecrab_myshell_batch_t *batch);
+void fossil_myshell_batch_clear(fossil_bluecrab_myshell_batch_t *batch);
+
+/**
+ * o-Write batches
+ * Returns the number of puts and deletes in a batch.
+ * Time Complexity: O(1).
+ * @param batch Batch handle.
+ * @return Operation count (0 for NULL).
+ */
+size_t fossil_myshell_batch_count(const fossil_bluecrab_myshell_batch_t *batch);
+
+/**
+ * o-Write batches
+ * Adds a put to a batch. The FSON type is checked now; nothing touches a database until the batch is applied.
+ * Time Complexity: O(1) amortized.
+ * @param batch Batch handle.
+ * @param key Key string.
+ * @param type Type string (FSON type).
+ * @param value Value string.
+ * @return Error code.
+ */
+fossil_bluecrab_myshell_error_t fossil_myshell_batch_put(fossil_bluecrab_myshell_batch_t *batch, const char *key, const char *type, const char *value);
+
+/**
+ * o-Write batches
+ * Adds a delete to a batch. Deleting a key that does not exist when the batch is applied does nothing.
+ * Time Complexity: O(1) amortized.
+ * @param batch Batch handle.
+ * @param key Key string.
+ * @return Error code.
+ */
+fossil_bluecrab_myshell_error_t fossil_myshell_batch_del(fossil_bluecrab_myshell_batch_t *batch, const char *key);
+
+/**
+ * o-Write batches
+ * Applies every operation of a batch, in order, with one write to the file. The records are
+ * framed so that after a crash either all of them or none are found on the next open.
+ * The batch is left unchanged and may be applied again.
+ * Time Complexity: O(b) (b = batch size in bytes), plus a sync in COMMIT durability mode.
+ * @param db Database handle.
+ * @param batch Batch handle.
+ * @return Error code.
+ */
+fossil_bluecrab_myshell_error_t fossil_myshell_batch_apply(fossil_bluecrab_myshell_t *db, const fossil_bluecrab_myshell_batch_t *batch);
+
+/**
+ * o-Transactions
+ * Opens a transaction on the handle. Until fossil_myshell_commit or fossil_myshell_rollback, puts
+ * and deletes are collected instead of written, and gets see them. The commit then writes them
+ * together with its commit record as one batch, so the history shows a single commit.
+ * Other operations (stage, branch, merge, ...) are not part of the transaction.
+ * Closing the handle with a transaction open rolls it back.
+ * Time Complexity: O(1).
+ * @param db Database handle.
+ * @return Error code (TRANSACTION_FAILED if one is already open).
+ */
+fossil_bluecrab_myshell_error_t fossil_myshell_begin(fossil_bluecrab_myshell_t *db);
+
+/**
+ * o-Transactions
+ * Discards the open transaction's writes.
+ * Time Complexity: O(n) (n = writes in the transaction).
+ * @param db Database handle.
+ * @return Error code (TRANSACTION_FAILED if none is open).
+ */
+fossil_bluecrab_myshell_error_t fossil_myshell_rollback(fossil_bluecrab_myshell_t *db);
+
 #ifdef __cplusplus
 }
 #include <utility>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <vector>
 
 namespace fossil {
 
@@ -491,7 +889,7 @@ namespace fossil {
             /**
              * o-Record CRUD (put)
              * Inserts or updates a key/value record in the database.
-             * Time Complexity: O(1) for append, O(n) for update.
+             * Time Complexity: O(1) append.
              */
             fossil_bluecrab_myshell_error_t put(const std::string& key, const std::string& type, const std::string& value) {
                 return fossil_myshell_put(db_, key.c_str(), type.c_str(), value.c_str());
@@ -499,22 +897,158 @@ namespace fossil {
 
             /**
              * o-Record CRUD (get)
-             * Retrieves the value for a given key from the database.
-             * Time Complexity: O(n)
+             * Retrieves the value for a given key from the database, whatever its size:
+             * the buffer starts at 4 KiB and doubles until the value fits.
+             * Time Complexity: O(1) average
              */
             fossil_bluecrab_myshell_error_t get(const std::string& key, std::string& out_value) {
-                char buffer[4096] = {0};
-                fossil_bluecrab_myshell_error_t err = fossil_myshell_get(db_, key.c_str(), buffer, sizeof(buffer));
+                std::string buffer(4096, '\0');
+                fossil_bluecrab_myshell_error_t err;
+                while ((err = fossil_myshell_get(db_, key.c_str(), buffer.data(), buffer.size())) ==
+                       FOSSIL_MYSHELL_ERROR_BUFFER_TOO_SMALL) {
+                    buffer.resize(buffer.size() * 2);
+                }
+                if (err == FOSSIL_MYSHELL_ERROR_SUCCESS) {
+                    buffer.resize(strlen(buffer.c_str()));
+                    out_value = std::move(buffer);
+                }
+                return err;
+            }
+
+            /**
+             * o-Record CRUD (get_view)
+             * Retrieves the value for a given key as a view into the file mapping, without copying.
+             * The view is valid while map_epoch() is unchanged.
+             * Time Complexity: O(1) average
+             */
+            fossil_bluecrab_myshell_error_t get_view(const std::string& key, std::string_view& out_value) {
+                fossil_bluecrab_myshell_view_t view;
+                fossil_bluecrab_myshell_error_t err = fossil_myshell_get_view(db_, key.c_str(), &view);
                 if (err == FOSSIL_MYSHELL_ERROR_SUCCESS) {
-                    out_value = buffer;
+                    out_value = std::string_view(view.data, view.length);
                 }
                 return err;
             }
 
+            /**
+             * o-Record CRUD (map_epoch)
+             * Returns the current map epoch; views from an earlier epoch are invalid.
+             * Time Complexity: O(1)
+             */
+            uint64_t map_epoch() const {
+                return fossil_myshell_map_epoch(db_);
+            }
+
+            /**
+             * o-Write batches (Batch)
+             * Owns a fossil_bluecrab_myshell_batch_t; fill it, then pass it to apply(). Move-only.
+             */
+            class Batch {
+            public:
+                Batch() : batch_(fossil_myshell_batch_new()) {}
+                Batch(Batch&& other) noexcept : batch_(std::exchange(other.batch_, nullptr)) {}
+                Batch& operator=(Batch&& other) noexcept {
+                    if (this != &other) {
+                        fossil_myshell_batch_free(batch_);
+                        batch_ = std::exchange(other.batch_, nullptr);
+                    }
+                    return *this;
+                }
+                Batch(const Batch&) = delete;
+                Batch& operator=(const Batch&) = delete;
+                ~Batch() { fossil_myshell_batch_free(batch_); }
+
+                fossil_bluecrab_myshell_error_t put(const std::string& key, const std::string& type, const std::string& value) {
+                    return fossil_myshell_batch_put(batch_, key.c_str(), type.c_str(), value.c_str());
+                }
+                fossil_bluecrab_myshell_error_t del(const std::string& key) {
+                    return fossil_myshell_batch_del(batch_, key.c_str());
+                }
+                void clear() { fossil_myshell_batch_clear(batch_); }
+                size_t size() const { return fossil_myshell_batch_count(batch_); }
+                fossil_bluecrab_myshell_batch_t* handle() const { return batch_; }
+
+            private:
+                fossil_bluecrab_myshell_batch_t* batch_;
+            };
+
+            /**
+             * o-Write batches (apply)
+             * Applies a batch in order with one write; after a crash all of it or none is found.
+             * Time Complexity: O(b) (b = batch size in bytes)
+             */
+            fossil_bluecrab_myshell_error_t apply(const Batch& batch) {
+                return fossil_myshell_batch_apply(db_, batch.handle());
+            }
+
+            /**
+             * o-Transactions (Transaction)
+             * Opens a transaction for its lifetime: puts and deletes through the MyShell object are
+             * collected until commit(), and rolled back if the object is destroyed first. Move-only.
+             */
+            class Transaction {
+            public:
+                explicit Transaction(MyShell& shell) : db_(shell.db_), status_(fossil_myshell_begin(shell.db_)) {
+                    if (status_ != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+                        db_ = nullptr;
+                    }
+                }
+                Transaction(Transaction&& other) noexcept
+                    : db_(std::exchange(other.db_, nullptr)), status_(other.status_) {}
+                Transaction& operator=(Transaction&& other) noexcept {
+                    if (this != &other) {
+                        rollback();
+                        db_ = std::exchange(other.db_, nullptr);
+                        status_ = other.status_;
+                    }
+                    return *this;
+                }
+                Transaction(const Transaction&) = delete;
+                Transaction& operator=(const Transaction&) = delete;
+                ~Transaction() { rollback(); }
+
+                /** Whether the transaction is still open. */
+                explicit operator bool() const { return db_ != nullptr; }
+
+                /** Result of opening the transaction. */
+                fossil_bluecrab_myshell_error_t status() const { return status_; }
+
+                /** Writes the collected changes and a commit record as one batch. On failure it stays open. */
+                fossil_bluecrab_myshell_error_t commit(const std::string& message) {
+                    if (!db_) return FOSSIL_MYSHELL_ERROR_TRANSACTION_FAILED;
+                    fossil_bluecrab_myshell_error_t err = fossil_myshell_commit(db_, message.c_str());
+                    if (err == FOSSIL_MYSHELL_ERROR_SUCCESS) {
+                        db_ = nullptr;
+                    }
+                    return err;
+                }
+
+                /** Discards the collected changes. */
+                fossil_bluecrab_myshell_error_t rollback() {
+                    if (!db_) return FOSSIL_MYSHELL_ERROR_TRANSACTION_FAILED;
+                    fossil_bluecrab_myshell_error_t err = fossil_myshell_rollback(db_);
+                    db_ = nullptr;
+                    return err;
+                }
+
+            private:
+                fossil_bluecrab_myshell_t* db_;
+                fossil_bluecrab_myshell_error_t status_;
+            };
+
+            /**
+             * o-Transactions (begin)
+             * Opens a transaction; check it with operator bool or status().
+             * Time Complexity: O(1)
+             */
+            Transaction begin() {
+                return Transaction(*this);
+            }
+
             /**
              * o-Record CRUD (del)
              * Deletes a key/value record from the database.
-             * Time Complexity: O(n)
+             * Time Complexity: O(1) append
              */
             fossil_bluecrab_myshell_error_t del(const std::string& key) {
                 return fossil_myshell_del(db_, key.c_str());
@@ -522,8 +1056,8 @@ namespace fossil {
 
             /**
              * o-Commit
-             * Commits the current changes to the database with a message.
-             * Time Complexity: O(1) for metadata update.
+             * Commits the current changes to the database with a message, recording a snapshot tree.
+             * Time Complexity: O(d log n) (d = keys changed since the last commit)
              */
             fossil_bluecrab_myshell_error_t commit(const std::string& message) {
                 return fossil_myshell_commit(db_, message.c_str());
@@ -540,8 +1074,8 @@ namespace fossil {
 
             /**
              * o-Checkout
-             * Checks out a branch or commit in the database.
-             * Time Complexity: O(1) for branch, O(n) for commit scan.
+             * Checks out a branch or commit in the database, switching to its view of the keys.
+             * Time Complexity: O(1)
              */
             fossil_bluecrab_myshell_error_t checkout(const std::string& branch_or_commit) {
                 return fossil_myshell_checkout(db_, branch_or_commit.c_str());
@@ -550,25 +1084,49 @@ namespace fossil {
             /**
              * o-Merge
              * Merges a source branch into the current branch with a commit message.
-             * Time Complexity: O(n) (n = number of commits in source branch)
+             * Time Complexity: O(k log k + d log n) (k = commits back to the merge base, d = keys changed)
              */
             fossil_bluecrab_myshell_error_t merge(const std::string& source_branch, const std::string& message) {
                 return fossil_myshell_merge(db_, source_branch.c_str(), message.c_str());
             }
 
+            /**
+             * o-Merge
+             * Merges a source branch, asking a callback how to settle conflicting keys.
+             * Time Complexity: O(k log k + d log n) (k = commits back to the merge base, d = keys changed)
+             */
+            fossil_bluecrab_myshell_error_t merge(const std::string& source_branch, const std::string& message,
+                                                  fossil_myshell_conflict_cb cb, void *user = nullptr) {
+                return fossil_myshell_merge_with(db_, source_branch.c_str(), message.c_str(), cb, user);
+            }
+
             /**
              * o-Revert
              * Reverts to a specific commit in the current branch.
-             * Time Complexity: O(n)
+             * Time Complexity: O(1)
              */
             fossil_bluecrab_myshell_error_t revert(const std::string& commit_hash) {
                 return fossil_myshell_revert(db_, commit_hash.c_str());
             }
 
+            /**
+             * o-Merge base
+             * Finds the nearest common ancestor of two branches, tags or commits.
+             * Time Complexity: O(k log k) (k = commits between the two and their merge base)
+             */
+            fossil_bluecrab_myshell_error_t merge_base(const std::string& a, const std::string& b, std::string& out_hash) {
+                char buffer[17];
+                fossil_bluecrab_myshell_error_t err = fossil_myshell_merge_base(db_, a.c_str(), b.c_str(), buffer, sizeof(buffer));
+                if (err == FOSSIL_MYSHELL_ERROR_SUCCESS) {
+                    out_hash = buffer;
+                }
+                return err;
+            }
+
             /**
              * o-Staging (stage)
              * Stages a key/value pair for the next commit.
-             * Time Complexity: O(1) for append, O(n) for update.
+             * Time Complexity: O(1) amortized, in memory
              */
             fossil_bluecrab_myshell_error_t stage(const std::string& key, const std::string& type, const std::string& value) {
                 return fossil_myshell_stage(db_, key.c_str(), type.c_str(), value.c_str());
@@ -577,16 +1135,25 @@ namespace fossil {
             /**
              * o-Staging (unstage)
              * Unstages a key/value pair from the staging area.
-             * Time Complexity: O(n)
+             * Time Complexity: O(1), in memory
              */
             fossil_bluecrab_myshell_error_t unstage(const std::string& key) {
                 return fossil_myshell_unstage(db_, key.c_str());
             }
 
+            /**
+             * o-Staging (set_stage_journal)
+             * Turns journaling of the staging area on or off.
+             * Time Complexity: O(1), or O(s) to turn it on (s = staged keys)
+             */
+            fossil_bluecrab_myshell_error_t set_stage_journal(bool enabled) {
+                return fossil_myshell_set_stage_journal(db_, enabled);
+            }
+
             /**
              * o-Tag
              * Tags a specific commit with a name.
-             * Time Complexity: O(n)
+             * Time Complexity: O(1)
              */
             fossil_bluecrab_myshell_error_t tag(const std::string& commit_hash, const std::string& tag_name) {
                 return fossil_myshell_tag(db_, commit_hash.c_str(), tag_name.c_str());
@@ -595,7 +1162,8 @@ namespace fossil {
             /**
              * o-History iteration (log)
              * Iterates over the commit log, invoking the callback for each commit.
-             * Time Complexity: O(n)
+             * Commit hashes are re-derived only for commits not verified before.
+             * Time Complexity: O(c log c) (c = number of commits)
              */
             fossil_bluecrab_myshell_error_t log(fossil_myshell_commit_cb cb, void* user) {
                 return fossil_myshell_log(db_, cb, user);
@@ -622,22 +1190,41 @@ namespace fossil {
             /**
              * o-Utility (diff)
              * Computes the difference between two database files and outputs the result.
-             * Time Complexity: O(n)
+             * Time Complexity: O(c + s)
              */
             fossil_bluecrab_myshell_error_t diff(const MyShell& other, std::string& out_diff) {
-                char buffer[4096] = {0};
-                fossil_bluecrab_myshell_error_t err = fossil_myshell_diff(
+                std::string text;
+                fossil_bluecrab_myshell_error_t err = fossil_myshell_diff_stream(
                     db_,
                     other.db_,
-                    buffer,
-                    sizeof(buffer)
+                    [](char change, const char* before, const char* after, void* user) {
+                        std::string& out = *static_cast<std::string*>(user);
+                        out += change;
+                        out += ' ';
+                        out += change == '+' ? after : before;
+                        if (change == '~') {
+                            out += "~ ";
+                            out += after;
+                        }
+                        return true;
+                    },
+                    &text
                 );
                 if (err == FOSSIL_MYSHELL_ERROR_SUCCESS) {
-                    out_diff = buffer;
+                    out_diff = std::move(text);
                 }
                 return err;
             }
 
+            /**
+             * o-Utility (diff)
+             * Streams the difference between two database files to a callback.
+             * Time Complexity: O(c + s)
+             */
+            fossil_bluecrab_myshell_error_t diff(const MyShell& other, fossil_myshell_diff_cb cb, void* user) {
+                return fossil_myshell_diff_stream(db_, other.db_, cb, user);
+            }
+
             /**
              * o-Utility (errstr)
              * Converts an error code to a human-readable string.
@@ -649,13 +1236,93 @@ namespace fossil {
 
             /**
              * o-Utility (check_integrity)
-             * Validates database integrity (hash chain, file size, corruption).
-             * Time Complexity: O(n)
+             * Validates database integrity (hash chain, file size, corruption) since the last checkpoint.
+             * Time Complexity: O(k) (k = records appended since the last checkpoint)
              */
             fossil_bluecrab_myshell_error_t check_integrity() {
                 return fossil_myshell_check_integrity(db_);
             }
 
+            /**
+             * o-Utility (check_integrity_full)
+             * Validates the integrity of the whole file, ignoring checkpoints.
+             * Time Complexity: O(n)
+             */
+            fossil_bluecrab_myshell_error_t check_integrity_full() {
+                return fossil_myshell_check_integrity_full(db_);
+            }
+
+            /**
+             * o-Utility (check_integrity_parallel)
+             * Validates the whole file on several threads, collecting up to max_failures failures
+             * in file order instead of stopping at the first.
+             * Time Complexity: O(n / t + c)
+             */
+            fossil_bluecrab_myshell_error_t check_integrity_parallel(
+                std::vector<fossil_bluecrab_myshell_check_failure_t>& failures, size_t max_failures,
+                size_t threads = 0, fossil_myshell_check_progress_cb progress = nullptr, void* user = nullptr) {
+                size_t count = 0;
+                failures.resize(max_failures);
+                fossil_bluecrab_myshell_error_t result = fossil_myshell_check_integrity_parallel(
+                    db_, threads, failures.data(), max_failures, &count, progress, user);
+                failures.resize(count < max_failures ? count : max_failures);
+                return result;
+            }
+
+            /**
+             * o-Compaction (compact)
+             * Starts a background compaction of the log.
+             * Time Complexity: O(k log k) to start (k = live keys), O(n) in the background (n = file size)
+             */
+            fossil_bluecrab_myshell_error_t compact() {
+                return fossil_myshell_compact(db_);
+            }
+
+            /**
+             * o-Compaction (compact_wait)
+             * Waits for a running compaction and swaps the compacted file in.
+             * Time Complexity: O(n) worst case
+             */
+            fossil_bluecrab_myshell_error_t compact_wait() {
+                return fossil_myshell_compact_wait(db_);
+            }
+
+            /**
+             * o-Compaction (set_compaction)
+             * Sets the garbage ratio that triggers compaction and its copy rate limit.
+             * Time Complexity: O(1)
+             */
+            fossil_bluecrab_myshell_error_t set_compaction(double garbage_ratio, uint64_t max_bytes_per_sec = 0) {
+                return fossil_myshell_set_compaction(db_, garbage_ratio, max_bytes_per_sec);
+            }
+
+            /**
+             * o-Durability (set_durability)
+             * Selects when appended records are fdatasync'ed.
+             * Time Complexity: O(1)
+             */
+            fossil_bluecrab_myshell_error_t set_durability(fossil_bluecrab_myshell_durability_t mode, uint64_t interval_ms = 0) {
+                return fossil_myshell_set_durability(db_, mode, interval_ms);
+            }
+
+            /**
+             * o-Durability (sync)
+             * Writes out grouped records and fdatasyncs the file now.
+             * Time Complexity: O(k) (k = bytes not yet written)
+             */
+            fossil_bluecrab_myshell_error_t sync() {
+                return fossil_myshell_sync(db_);
+            }
+
+            /**
+             * o-Format conversion (convert)
+             * Rewrites a v1 text file as a new v2 binary file.
+             * Time Complexity: O(n)
+             */
+            static fossil_bluecrab_myshell_error_t convert(const std::string& text_path, const std::string& binary_path) {
+                return fossil_myshell_convert(text_path.c_str(), binary_path.c_str());
+            }
+
             /**
              * o-Utility (is_open)
              * Checks if the database handle is open.
@@ -22,7 +22,23 @@
  * Copyright (C) 2014-2025 Fossil Logic. All rights reserved.
  * -----------------------------------------------------------------------------
  */
+#if !defined(_WIN32) && !defined(_WIN64)
+#if !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L   // pread, fsync, nanosleep, mmap
+#endif
+#if !defined(_FILE_OFFSET_BITS)
+#define _FILE_OFFSET_BITS 64      // 64-bit off_t for fseeko / ftello on 32-bit hosts
+#endif
+#endif
 #include "fossil/crabdb/myshell.h"
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#include <io.h>
+#else
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 /**
  * @brief Implements the core logic for the Fossil BlueCrab .myshell file database.
@@ -32,65 +48,64 @@
  * close, put, get, delete, commit, branch, checkout, merge, revert, stage, unstage,
  * tag, log, backup, restore, error string conversion, and integrity checking.
  *
- * ## .myshell File Format Overview
- * - Each .myshell file is a plain text file with lines representing key-value pairs,
- *   commit history, branches, tags, and staged changes.
- * - Key-value pairs are stored as: `key=value #type=TYPE #hash=KEYHASH`
- *   - `TYPE` is the FSON type name (see myshell_fson_type_names).
- *   - `KEYHASH` is a 64-bit hash of the key for integrity verification.
- * - Commits are recorded as: `#commit HASH MESSAGE TIMESTAMP #type=enum`
- * - Branches are recorded as: `#branch HASH BRANCHNAME #type=enum`
- * - Tags are recorded as: `#tag HASH TAGNAME #type=enum`
- * - Staged changes are recorded as: `#stage key=value #type=TYPE #hash=KEYHASH`
- * - Merges are recorded as: `#merge HASH SOURCEBRANCH MESSAGE TIMESTAMP #type=enum`
- * - Backups include a header: `#backup_hash=HASH`
- * - FSON type system header: `#fson_types=null,bool,i8,i16,i32,i64,u8,u16,u32,u64,f32,f64,oct,hex,bin,char,cstr,array,object,enum,datetime,duration`
+ * ## .myshell File Format Overview (v2, binary)
+ * - Each .myshell file starts with an 8-byte header: the magic `MYSH`, the
+ *   format version (2) and three reserved zero bytes.
+ * - The rest of the file is an append-only log of length-prefixed records.
+ *   Every record is a 16-byte header followed by its key and value bytes
+ *   (integers are little-endian):
+ *   | Offset | Size | Field                                                  |
+ *   |--------|------|--------------------------------------------------------|
+ *   | 0      | 4    | CRC-32 of bytes 4..15 plus the key and value bytes     |
+ *   | 4      | 1    | Record kind (put, del, stage, unstage, commit, ...)    |
+ *   | 5      | 1    | FSON type, as an index into myshell_fson_type_names    |
+ *   | 6      | 2    | Reserved, zero                                         |
+ *   | 8      | 4    | Key length                                             |
+ *   | 12     | 4    | Value length                                           |
+ * - What the key and value of each record kind hold:
+ *   - put: the key and its value.
+ *   - del: a tombstone; the key, no value.
+ *   - stage, unstage: the staging area's journal, written only when it is
+ *     journaled; a stage holds the key and its value, an unstage only the key.
+ *   - commit: key = commit hash (16 hex digits), value = `TIMESTAMP\nMESSAGE`,
+ *     or for snapshot commits `tree ROOT\nparent PARENT\nTIMESTAMP\nMESSAGE`,
+ *     whose hash is that of the value itself.
+ *   - branch: key = branch name, value = branch hash.
+ *   - tag: key = tag name, value = hash of the tagged commit.
+ *   - merge: key = merge hash, value = `TIMESTAMP\nSOURCEBRANCH\nMESSAGE`, or
+ *     for merges of two snapshots `tree ROOT\nparent OURS\nmerge THEIRS\n`
+ *     followed by that, hashed like a snapshot commit.
+ *   - batch: no key, value = byte length (u64) of the records right after it,
+ *     which were written together; recovery keeps all of them or none.
+ *   - node: no key, value = one snapshot tree node: its depth byte, then
+ *     18-byte entries (slot, leaf flag, u64 id, u64 key hash). Its id is the
+ *     hash of the value.
+ *   - blob: a put kept only because a snapshot tree refers to it.
+ *   - checkout, head: key = branch name (empty when detached), value = commit
+ *     hash and tree root as 32 hex digits; replay switches to that branch's
+ *     view. Older compactions wrote head records; they replay the same way.
+ *   - checkpoint: no key, value = 16 hex digits giving the offset up to which
+ *     the file passed an integrity check, the checkpoint itself included.
+ * - A later record for a key supersedes earlier ones, and a tombstone removes
+ *   the key, so puts, deletes and staging never rewrite existing data.
+ * - Keys and values are length-delimited, so they may hold any bytes
+ *   (newlines, '=', '#hash=' ...) and are not limited to a line buffer.
+ * - Backups are the file image behind a text header: `#backup_hash=HASH` and
+ *   `#fson_types=null,bool,i8,i16,i32,i64,u8,u16,u32,u64,f32,f64,oct,hex,bin,char,cstr,array,object,enum,datetime,duration`
  *
- * ## Sample .myshell File Contents
+ * ## Text Format (v1)
+ * Files written before v2 are plain text, one line per entry. They are not
+ * opened directly; `fossil_myshell_convert` rewrites one as a v2 file.
  * ```
+ * #fson_types=null,bool,i8,...,duration
  * key1=value1 #type=i32 #hash=0123456789abcdef
- * key2=value2 #type=cstr #hash=abcdef0123456789
+ * #del key2 #hash=abcdef0123456789
  * #commit 0123456789abcdef Initial commit 1712345678 #type=enum
  * #branch 89abcdef01234567 main #type=enum
  * #tag 0123456789abcdef v1.0 #type=enum
  * #stage key3=value3 #type=bool #hash=123456789abcdef0
- * #merge 89abcdef01234567 feature "Merge feature branch" 1712345680 #type=enum
- * ```
- *
- * ## More Sample .myshell File Contents
- * ```
- * username=alice #type=cstr #hash=1a2b3c4d5e6f7890
- * password=secret #type=cstr #hash=0f1e2d3c4b5a6978
- * #commit 1a2b3c4d5e6f7890 Added user 1712345700 #type=enum
- * #branch 0f1e2d3c4b5a6978 dev #type=enum
- * #tag 1a2b3c4d5e6f7890 v2.0 #type=enum
- * ```
- *
- * ## Another Example
- * ```
- * config=enabled #type=bool #hash=deadbeefcafebabe
- * mode=fast #type=enum #hash=beefdeadbabecafe
- * #commit deadbeefcafebabe Config enabled 1712345800 #type=enum
- * #branch beefdeadbabecafe test #type=enum
- * #tag deadbeefcafebabe test-tag #type=enum
- * ```
- *
- * ## Fourth Example
- * ```
- * foo=bar #type=cstr #hash=1111222233334444
- * baz=qux #type=cstr #hash=5555666677778888
- * #commit 1111222233334444 FooBar commit 1712345900 #type=enum
- * #branch 5555666677778888 feature-x #type=enum
- * #tag 1111222233334444 release-x #type=enum
- * ```
- *
- * ## Fifth Example
- * ```
- * alpha=beta #type=cstr #hash=9999aaaabbbbcccc
- * gamma=delta #type=cstr #hash=ddddccccbbbbaaaa
- * #commit 9999aaaabbbbcccc AlphaBeta commit 1712346000 #type=enum
- * #branch ddddccccbbbbaaaa hotfix #type=enum
- * #tag 9999aaaabbbbcccc hotfix-1 #type=enum
+ * #unstage key3 #hash=123456789abcdef0
+ * #merge 89abcdef01234567 feature Merge feature branch 1712345680 #type=enum
  * ```
  *
  * ## Main Functions
@@ -98,30 +113,94 @@
  * - `fossil_myshell_open`: Opens an existing .myshell database file.
  * - `fossil_myshell_create`: Creates a new .myshell database file.
  * - `fossil_myshell_close`: Closes and frees resources for a database.
- * - `fossil_myshell_put`: Inserts or updates a key-value pair (with FSON type and hash).
+ * - `fossil_myshell_put`: Inserts or updates a key-value pair (with FSON type).
  * - `fossil_myshell_get`: Retrieves the value for a given key.
+ * - `fossil_myshell_get_view`: Retrieves a value as a zero-copy view into the file mapping.
+ * - `fossil_myshell_map_epoch`: Returns the epoch that views belong to.
  * - `fossil_myshell_del`: Deletes a key-value pair.
  * - `fossil_myshell_commit`: Records a commit with a message.
  * - `fossil_myshell_branch`: Creates or switches to a branch.
  * - `fossil_myshell_checkout`: Checks out a branch or commit.
  * - `fossil_myshell_merge`: Merges a branch with a commit message.
+ * - `fossil_myshell_merge_with`: Merges a branch, settling conflicts with a callback.
  * - `fossil_myshell_revert`: Reverts to a specific commit.
+ * - `fossil_myshell_merge_base`: Finds the nearest common ancestor of two commits.
  * - `fossil_myshell_stage`: Stages a key-value change.
  * - `fossil_myshell_unstage`: Removes a staged change.
+ * - `fossil_myshell_set_stage_journal`: Journals the staging area to the log.
  * - `fossil_myshell_tag`: Tags a commit.
  * - `fossil_myshell_log`: Iterates commit history.
  * - `fossil_myshell_backup`: Creates a backup of the database.
  * - `fossil_myshell_restore`: Restores a database from backup.
  * - `fossil_myshell_errstr`: Converts error codes to strings.
- * - `fossil_myshell_check_integrity`: Verifies file and commit integrity.
+ * - `fossil_myshell_diff` / `fossil_myshell_diff_stream`: Compares the commits and staged
+ *   entries of two databases by probing each side's in-memory tables with the other's.
+ * - `fossil_myshell_check_integrity`: Verifies record checksums, commit hashes and
+ *   snapshot links appended since the last checkpoint.
+ * - `fossil_myshell_check_integrity_full`: The same check over the whole file.
+ * - `fossil_myshell_check_integrity_parallel`: The full check split into chunks over a
+ *   pool of threads, collecting the first failures instead of stopping at one.
+ * - `fossil_myshell_compact`: Rewrites the log without stale versions, in the background.
+ * - `fossil_myshell_sync`: Writes out grouped appends and fdatasyncs the file.
+ * - `fossil_myshell_convert`: Converts a v1 text file to the v2 binary format.
+ * - `fossil_myshell_batch_*`: Builds a batch of puts and deletes and applies it in one write.
+ * - `fossil_myshell_begin` / `fossil_myshell_rollback`: Open and discard a transaction
+ *   that `fossil_myshell_commit` writes as a single batch.
  *
  * ## Error Handling
  * All functions return a `fossil_bluecrab_myshell_error_t` code indicating success or the type of error.
  *
  * ## Usage Notes
  * - Only files with the ".myshell" extension are supported.
- * - All operations are performed directly on the file; there is no in-memory caching.
- * - Integrity of data is ensured via hashes for keys and commits.
+ * - Values are always read from the file. The handle keeps only an in-memory key
+ *   index of the writes since the head snapshot (key -> offset/length of its
+ *   record), built when the file is opened, and a read-only mapping of the file.
+ *   A get is one hash probe, or a walk down the snapshot tree read in place for
+ *   keys not written since, then a copy out of the mapping
+ *   (`fossil_myshell_get_view` skips even that copy).
+ * - The mapping is replaced by a larger one when a read reaches past it, and
+ *   dropped by compaction; each time the map epoch advances and older views
+ *   become invalid. Where the file cannot be mapped, reads fall back to stdio.
+ * - Scans, such as the open-time replay and integrity checks, decode records in
+ *   place from the mapping by their length prefixes; no record is parsed as text.
+ * - Appends are grouped in memory and written out together at each commit; the
+ *   durability mode (`fossil_myshell_set_durability`) decides when they are also
+ *   fdatasync'ed. On open, a torn or checksum-failing last record left by a
+ *   crash is truncated away.
+ * - A batch (`fossil_myshell_batch_apply`, or a transaction's commit) goes out in
+ *   one write behind a batch record giving its length; if the file ends inside
+ *   that span on open, the whole batch is truncated away.
+ * - The staging area is held in memory, in staging order, and commit writes it
+ *   out as puts in the commit's batch. Journaling it appends a record per stage
+ *   or unstage so that it survives a close or crash.
+ * - Superseded versions and tombstones stay in the file until it is compacted,
+ *   manually or once they exceed the ratio set with `fossil_myshell_set_compaction`.
+ *   Versions a snapshot tree still refers to survive compaction as blobs.
+ * - Each commit records a snapshot: a hash array mapped trie over key hashes
+ *   whose leaves are record ids. Only the nodes on the paths to keys changed
+ *   since the last commit are written; the rest are shared with the parent.
+ * - Commits, merges, branches and tags are held in an in-memory commit graph
+ *   (id -> record, parents, time, generation number) and ref tables, built by
+ *   the same scan as the key index. Checkout, revert, merge and tag resolve
+ *   names with one probe, log reads only commit records, and merge bases are
+ *   found by a generation-ordered walk.
+ * - Each branch sees the keys through its own view: its snapshot tree under an
+ *   index of the writes made on it since. Creating a branch names the current
+ *   view; checking one out parks the current view's index and takes up the
+ *   target's, so neither copies keys. Uncommitted writes stay with their
+ *   branch, also across a reopen; only a detached head with writes cannot be
+ *   left until a branch is made there.
+ * - Merging two snapshot commits is a three-way merge over keys against their
+ *   merge base: only subtrees the merged-in side changed are walked, one-sided
+ *   changes are taken over, and conflicts are settled before anything is
+ *   written. The changes, tree and merge record are appended as one batch.
+ * - Integrity of data is ensured via per-record CRC-32 and commit hashes. Snapshot
+ *   commits form a Merkle chain: a commit's id covers its parent's id and its
+ *   tree root, and every node's id covers its children's. A successful check
+ *   appends a checkpoint, so the next check and log walk re-verify only what was
+ *   appended since; compaction drops checkpoints along with the old layout.
+ *   A parallel check hands chunks of the file to worker threads that only read the
+ *   indexes, and reports every damaged record it finds rather than the first.
  * - The API is designed for simple versioned key-value storage with basic VCS-like features.
  * - The FSON type system is enforced for all key-value and metadata entries.
  */
@@ -171,16 +250,24 @@ static char *myshell_strdup(const char *s) {
     return copy;
 }
 
+/** Copies @p len bytes of @p s into a new NUL-terminated string. */
+static char *myshell_strndup(const char *s, size_t len) {
+    char *copy = (char *)malloc(len + 1);
+    if (copy) {
+        memcpy(copy, s, len);
+        copy[len] = '\0';
+    }
+    return copy;
+}
+
 /**
- * Advanced 64-bit hash algorithm for strings (MurmurHash3 variant).
- * Returns a 64-bit hash value for the given input string.
+ * Advanced 64-bit hash algorithm (MurmurHash3 variant) over @p len bytes, so
+ * keys can be hashed where they lie in a record without NUL-terminating them.
  */
-uint64_t myshell_hash64(const char *str) {
-    if (!str) return 0;
+static uint64_t myshell_hash64n(const char *str, size_t len) {
     uint64_t seed = 0xe17a1465ULL;
     uint64_t m = 0xc6a4a7935bd1e995ULL;
     int r = 47;
-    size_t len = strlen(str);
     uint64_t hash = seed ^ (len * m);
 
     const uint8_t *data = (const uint8_t *)str;
@@ -214,289 +301,3220 @@ uint64_t myshell_hash64(const char *str) {
     return hash;
 }
 
-fossil_bluecrab_myshell_t *fossil_myshell_open(const char *path, fossil_bluecrab_myshell_error_t *err) {
-    if (!path) {
-        if (err) *err = FOSSIL_MYSHELL_ERROR_INVALID_FILE;
-        return NULL;
-    }
+/**
+ * Advanced 64-bit hash algorithm for strings (MurmurHash3 variant).
+ * Returns a 64-bit hash value for the given input string.
+ */
+uint64_t myshell_hash64(const char *str) {
+    if (!str) return 0;
+    return myshell_hash64n(str, strlen(str));
+}
 
-    // Enforce .myshell extension
-    const char *ext = strrchr(path, '.');
-    if (!ext || strcmp(ext, ".myshell") != 0) {
-        if (err) *err = FOSSIL_MYSHELL_ERROR_INVALID_FILE;
-        return NULL;
-    }
+// *****************************************************************************
+// Platform helpers
+// *****************************************************************************
+
+static uint64_t myshell_now_ms(void) {
+#if defined(_WIN32) || defined(_WIN64)
+    return (uint64_t)GetTickCount64();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+#endif
+}
 
-    FILE *file = fopen(path, "rb+");
-    if (!file) {
-        if (err) *err = FOSSIL_MYSHELL_ERROR_FILE_NOT_FOUND;
-        return NULL;
+static void myshell_sleep_ms(uint64_t ms) {
+#if defined(_WIN32) || defined(_WIN64)
+    Sleep((DWORD)ms);
+#else
+    struct timespec ts;
+    ts.tv_sec = (time_t)(ms / 1000u);
+    ts.tv_nsec = (long)(ms % 1000u) * 1000000L;
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
     }
+#endif
+}
 
-    fossil_bluecrab_myshell_t *db = (fossil_bluecrab_myshell_t *)calloc(1, sizeof(fossil_bluecrab_myshell_t));
-    if (!db) {
-        fclose(file);
-        if (err) *err = FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
-        return NULL;
-    }
+/** Flushes stdio buffers and asks the OS to put @p file's data on stable storage. */
+static bool myshell_file_sync(FILE *file) {
+    if (fflush(file) != 0) return false;
+#if defined(_WIN32) || defined(_WIN64)
+    return _commit(_fileno(file)) == 0;
+#elif defined(_POSIX_SYNCHRONIZED_IO) && _POSIX_SYNCHRONIZED_IO > 0
+    return fdatasync(fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
 
-    db->path = myshell_strdup(path);
-    if (!db->path) {
-        fclose(file);
-        free(db);
-        if (err) *err = FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
-        return NULL;
-    }
+/*
+ * A read-only mapping of the first `size` bytes of a database file. Records
+ * are parsed where they lie in it; it is replaced by a larger one once the
+ * file has grown past it (see myshell_map_cover).
+ */
+typedef struct {
+    const char *data;
+    uint64_t    size;
+#if defined(_WIN32) || defined(_WIN64)
+    HANDLE      mapping;
+#endif
+} myshell_map_t;
+
+static bool myshell_map_open(myshell_map_t *map, FILE *file, uint64_t size) {
+    memset(map, 0, sizeof(*map));
+    if (size == 0 || size > (uint64_t)SIZE_MAX) return false;
+#if defined(_WIN32) || defined(_WIN64)
+    HANDLE handle = (HANDLE)_get_osfhandle(_fileno(file));
+    if (handle == INVALID_HANDLE_VALUE) return false;
+    map->mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, (DWORD)(size >> 32), (DWORD)(size & 0xFFFFFFFFu), NULL);
+    if (!map->mapping) return false;
+    map->data = (const char *)MapViewOfFile(map->mapping, FILE_MAP_READ, 0, 0, (SIZE_T)size);
+    if (!map->data) {
+        CloseHandle(map->mapping);
+        map->mapping = NULL;
+        return false;
+    }
+#else
+    void *data = mmap(NULL, (size_t)size, PROT_READ, MAP_SHARED, fileno(file), 0);
+    if (data == MAP_FAILED) return false;
+    map->data = (const char *)data;
+#endif
+    map->size = size;
+    return true;
+}
 
-    db->file = file;
-    db->is_open = true;
+static void myshell_map_close(myshell_map_t *map) {
+    if (!map->data) return;
+#if defined(_WIN32) || defined(_WIN64)
+    UnmapViewOfFile(map->data);
+    CloseHandle(map->mapping);
+    map->mapping = NULL;
+#else
+    munmap((void *)map->data, (size_t)map->size);
+#endif
+    map->data = NULL;
+    map->size = 0;
+}
 
-    if (fseek(file, 0, SEEK_END) != 0) {
-        free(db->path);
-        free(db);
-        fclose(file);
-        if (err) *err = FOSSIL_MYSHELL_ERROR_IO;
+/** Cuts @p file down to @p size bytes. */
+static bool myshell_file_truncate(FILE *file, uint64_t size) {
+    if (fflush(file) != 0) return false;
+#if defined(_WIN32) || defined(_WIN64)
+    return _chsize_s(_fileno(file), (__int64)size) == 0;
+#else
+    return ftruncate(fileno(file), (off_t)size) == 0;
+#endif
+}
+
+// *****************************************************************************
+// Key index
+// *****************************************************************************
+
+/*
+ * The key index maps every key to the byte range of its latest record, so a get
+ * is one hash probe plus one positioned read instead of a scan of the file.
+ * Open addressing with linear probing over a power-of-two table; removal uses
+ * backward-shift deletion, so there are no tombstone slots. Each slot owns a
+ * copy of its key to tell apart keys whose 64-bit hashes collide.
+ */
+typedef struct {
+    uint64_t hash;
+    char    *key;        /* NULL marks an empty slot */
+    uint64_t offset;     /* Offset of the record in the file */
+    size_t   length;     /* Length of the record, header included */
+} myshell_index_slot_t;
+
+typedef struct {
+    myshell_index_slot_t *slots;
+    size_t capacity;
+    size_t count;
+} myshell_index_t;
+
+#define MYSHELL_INDEX_MIN_CAPACITY 64
+
+/* Offset of a slot a write batch holds for a key it is about to index */
+#define MYSHELL_INDEX_RESERVED UINT64_MAX
+
+static myshell_index_t *myshell_index_new(void) {
+    myshell_index_t *index = (myshell_index_t *)calloc(1, sizeof(myshell_index_t));
+    if (!index) return NULL;
+    index->slots = (myshell_index_slot_t *)calloc(MYSHELL_INDEX_MIN_CAPACITY, sizeof(myshell_index_slot_t));
+    if (!index->slots) {
+        free(index);
         return NULL;
     }
-    db->file_size = (size_t)ftell(file);
-    if (fseek(file, 0, SEEK_SET) != 0) {
-        free(db->path);
-        free(db);
-        fclose(file);
-        if (err) *err = FOSSIL_MYSHELL_ERROR_IO;
-        return NULL;
+    index->capacity = MYSHELL_INDEX_MIN_CAPACITY;
+    return index;
+}
+
+static void myshell_index_free(myshell_index_t *index) {
+    if (!index) return;
+    for (size_t i = 0; i < index->capacity; ++i) {
+        free(index->slots[i].key);
     }
+    free(index->slots);
+    free(index);
+}
 
-    struct stat st;
-    if (stat(path, &st) == 0)
-        db->last_modified = st.st_mtime;
-    else
-        db->last_modified = 0;
+static myshell_index_slot_t *myshell_index_find(myshell_index_t *index, const char *key, size_t key_len,
+                                                uint64_t hash) {
+    size_t mask = index->capacity - 1;
+    for (size_t i = (size_t)hash & mask;; i = (i + 1) & mask) {
+        myshell_index_slot_t *slot = &index->slots[i];
+        if (!slot->key) return NULL;
+        if (slot->hash == hash && strncmp(slot->key, key, key_len) == 0 && slot->key[key_len] == '\0') return slot;
+    }
+}
 
-    db->commit_head = myshell_hash64(path);
-    db->error_code = FOSSIL_MYSHELL_ERROR_SUCCESS;
+static bool myshell_index_grow(myshell_index_t *index) {
+    size_t new_capacity = index->capacity * 2;
+    myshell_index_slot_t *slots = (myshell_index_slot_t *)calloc(new_capacity, sizeof(myshell_index_slot_t));
+    if (!slots) return false;
+    size_t mask = new_capacity - 1;
+    for (size_t i = 0; i < index->capacity; ++i) {
+        myshell_index_slot_t *old = &index->slots[i];
+        if (!old->key) continue;
+        size_t j = (size_t)old->hash & mask;
+        while (slots[j].key) j = (j + 1) & mask;
+        slots[j] = *old;
+    }
+    free(index->slots);
+    index->slots = slots;
+    index->capacity = new_capacity;
+    return true;
+}
 
-    // FSON type system: scan file for type hints and validate
-    // (optional: could build a type map or validate lines)
-    // For now, just check that all #type=... fields match known types
-    fseek(file, 0, SEEK_SET);
-    char line[1024];
-    while (fgets(line, sizeof(line), file)) {
-        char *type_comment = strstr(line, "#type=");
-        if (type_comment) {
-            type_comment += 6;
-            char type_name[32] = {0};
-            int i = 0;
-            while (type_comment[i] && !isspace((unsigned char)type_comment[i]) && type_comment[i] != '#' && i < 31) {
-                type_name[i] = type_comment[i];
-                i++;
-            }
-            type_name[i] = '\0';
-            bool valid_type = false;
-            for (size_t j = 0; j <= MYSHELL_FSON_TYPE_DURATION; ++j) {
-                if (strcmp(type_name, myshell_fson_type_names[j]) == 0) {
-                    valid_type = true;
-                    break;
-                }
-            }
-            if (!valid_type) {
-                free(db->path);
-                free(db);
-                fclose(file);
-                if (err) *err = FOSSIL_MYSHELL_ERROR_CONFIG_INVALID;
-                return NULL;
-            }
+/**
+ * Inserts or repoints @p key. Repointing a key already in the index never
+ * allocates. Returns false only on allocation failure.
+ */
+static bool myshell_index_put(myshell_index_t *index, const char *key, size_t key_len,
+                              uint64_t hash, uint64_t offset, size_t length) {
+    myshell_index_slot_t *slot = myshell_index_find(index, key, key_len, hash);
+    if (slot) {
+        slot->offset = offset;
+        slot->length = length;
+        return true;
+    }
+    if ((index->count + 1) * 4 > index->capacity * 3 && !myshell_index_grow(index)) {
+        return false;
+    }
+    size_t mask = index->capacity - 1;
+    size_t i = (size_t)hash & mask;
+    while (index->slots[i].key) i = (i + 1) & mask;
+    char *copy = (char *)malloc(key_len + 1);
+    if (!copy) return false;
+    memcpy(copy, key, key_len);
+    copy[key_len] = '\0';
+    index->slots[i].hash = hash;
+    index->slots[i].key = copy;
+    index->slots[i].offset = offset;
+    index->slots[i].length = length;
+    index->count++;
+    return true;
+}
+
+static bool myshell_index_remove(myshell_index_t *index, const char *key, size_t key_len, uint64_t hash) {
+    myshell_index_slot_t *slot = myshell_index_find(index, key, key_len, hash);
+    if (!slot) return false;
+    size_t mask = index->capacity - 1;
+    size_t hole = (size_t)(slot - index->slots);
+    free(slot->key);
+    slot->key = NULL;
+    index->count--;
+    // Backward-shift the rest of the probe run so lookups never stop early.
+    for (size_t i = (hole + 1) & mask; index->slots[i].key; i = (i + 1) & mask) {
+        size_t home = (size_t)index->slots[i].hash & mask;
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            index->slots[hole] = index->slots[i];
+            index->slots[i].key = NULL;
+            hole = i;
         }
     }
-    fseek(file, 0, SEEK_SET);
-
-    if (err) *err = FOSSIL_MYSHELL_ERROR_SUCCESS;
-    return db;
+    return true;
 }
 
-fossil_bluecrab_myshell_t *fossil_myshell_create(const char *path, fossil_bluecrab_myshell_error_t *err) {
-    if (!path) {
-        if (err) *err = FOSSIL_MYSHELL_ERROR_INVALID_FILE;
-        return NULL;
+/** Empties @p index, keeping its capacity. */
+static void myshell_index_clear(myshell_index_t *index) {
+    for (size_t i = 0; i < index->capacity; ++i) {
+        free(index->slots[i].key);
+        index->slots[i].key = NULL;
     }
+    index->count = 0;
+}
 
-    // Enforce .myshell extension
-    const char *ext = strrchr(path, '.');
-    if (!ext || strcmp(ext, ".myshell") != 0) {
-        if (err) *err = FOSSIL_MYSHELL_ERROR_INVALID_FILE;
-        return NULL;
-    }
+/*
+ * The object table maps the 64-bit content id of every blob and tree node in
+ * the file to the record holding it, so snapshots are reached by id without a
+ * scan. Same probing as the key index; ids are never removed, and a later
+ * record with the same content simply repoints its id.
+ */
+typedef enum {
+    MYSHELL_OBJECT_BLOB = 1,
+    MYSHELL_OBJECT_NODE
+} myshell_object_kind_t;
+
+typedef struct {
+    uint64_t id;
+    uint64_t offset;     /* Offset of the record in the file */
+    size_t   length;     /* Length of the record, header included */
+    uint8_t  kind;       /* 0 marks an empty slot */
+} myshell_object_t;
+
+typedef struct {
+    myshell_object_t *slots;
+    size_t capacity;
+    size_t count;
+} myshell_objects_t;
+
+static bool myshell_objects_init(myshell_objects_t *objects) {
+    objects->slots = (myshell_object_t *)calloc(MYSHELL_INDEX_MIN_CAPACITY, sizeof(myshell_object_t));
+    objects->capacity = objects->slots ? MYSHELL_INDEX_MIN_CAPACITY : 0;
+    objects->count = 0;
+    return objects->slots != NULL;
+}
 
-    // Check if file already exists
-    FILE *check = fopen(path, "rb");
-    if (check) {
-        fclose(check);
-        if (err) *err = FOSSIL_MYSHELL_ERROR_ALREADY_EXISTS;
-        return NULL;
+static const myshell_object_t *myshell_objects_find(const myshell_objects_t *objects, uint64_t id, uint8_t kind) {
+    size_t mask = objects->capacity - 1;
+    for (size_t i = (size_t)id & mask;; i = (i + 1) & mask) {
+        const myshell_object_t *slot = &objects->slots[i];
+        if (!slot->kind) return NULL;
+        if (slot->id == id) return slot->kind == kind ? slot : NULL;
     }
+}
 
-    FILE *file = fopen(path, "wb+");
-    if (!file) {
-        if (err) *err = FOSSIL_MYSHELL_ERROR_IO;
-        return NULL;
-    }
+/** Grows the table until @p more new ids fit without growing again. Returns false on allocation failure. */
+static bool myshell_objects_reserve(myshell_objects_t *objects, size_t more) {
+    size_t capacity = objects->capacity;
+    while ((objects->count + more) * 4 > capacity * 3) capacity *= 2;
+    if (capacity == objects->capacity) return true;
+    myshell_object_t *slots = (myshell_object_t *)calloc(capacity, sizeof(myshell_object_t));
+    if (!slots) return false;
+    for (size_t i = 0; i < objects->capacity; ++i) {
+        if (!objects->slots[i].kind) continue;
+        size_t j = (size_t)objects->slots[i].id & (capacity - 1);
+        while (slots[j].kind) j = (j + 1) & (capacity - 1);
+        slots[j] = objects->slots[i];
+    }
+    free(objects->slots);
+    objects->slots = slots;
+    objects->capacity = capacity;
+    return true;
+}
 
-    // Write FSON type system header for new file
-    fprintf(file, "#fson_types=");
-    for (size_t i = 0; i <= MYSHELL_FSON_TYPE_DURATION; ++i) {
-        fprintf(file, "%s", myshell_fson_type_names[i]);
-        if (i < MYSHELL_FSON_TYPE_DURATION) fprintf(file, ",");
-    }
-    fprintf(file, "\n");
+/**
+ * Inserts or repoints object @p id. Repointing an id already in the table
+ * never allocates. Returns false only on allocation failure.
+ */
+static bool myshell_objects_put(myshell_objects_t *objects, uint64_t id, uint8_t kind, uint64_t offset,
+                                size_t length) {
+    size_t mask = objects->capacity - 1;
+    size_t i = (size_t)id & mask;
+    while (objects->slots[i].kind && objects->slots[i].id != id) i = (i + 1) & mask;
+    if (!objects->slots[i].kind) {
+        if (!myshell_objects_reserve(objects, 1)) return false;
+        mask = objects->capacity - 1;
+        for (i = (size_t)id & mask; objects->slots[i].kind; i = (i + 1) & mask) {}
+        objects->count++;
+    }
+    objects->slots[i].id = id;
+    objects->slots[i].kind = kind;
+    objects->slots[i].offset = offset;
+    objects->slots[i].length = length;
+    return true;
+}
 
-    fossil_bluecrab_myshell_t *db = (fossil_bluecrab_myshell_t *)calloc(1, sizeof(fossil_bluecrab_myshell_t));
-    if (!db) {
-        fclose(file);
-        if (err) *err = FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
-        return NULL;
+/** Drops the ids of every record at or past @p end, as when those records are taken back. */
+static void myshell_objects_truncate(myshell_objects_t *objects, uint64_t end) {
+    size_t mask = objects->capacity - 1;
+    for (size_t i = 0; i < objects->capacity;) {
+        if (!objects->slots[i].kind || objects->slots[i].offset < end) {
+            ++i;
+            continue;
+        }
+        // Backward-shift the rest of the probe run; slot i is looked at again
+        size_t hole = i;
+        objects->slots[hole].kind = 0;
+        objects->count--;
+        for (size_t j = (hole + 1) & mask; objects->slots[j].kind; j = (j + 1) & mask) {
+            size_t home = (size_t)objects->slots[j].id & mask;
+            if (((j - home) & mask) >= ((j - hole) & mask)) {
+                objects->slots[hole] = objects->slots[j];
+                objects->slots[j].kind = 0;
+                hole = j;
+            }
+        }
     }
+}
 
-    db->path = myshell_strdup(path);
-    if (!db->path) {
-        fclose(file);
-        free(db);
-        if (err) *err = FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
-        return NULL;
+// *****************************************************************************
+// Commit graph
+// *****************************************************************************
+
+/*
+ * The commit graph holds every commit and merge in the file by id: where its
+ * record is, its parents, its time and its generation number, one more than
+ * that of its highest parent, so an ancestor always has a lower generation
+ * than its descendants. Branches and tags live in the ref tables with the
+ * commit they point at. Both are built by the scan that builds the key index
+ * and kept current on append, so resolving a name or walking ancestry never
+ * reads the file. Same probing as the object table.
+ */
+typedef struct {
+    uint64_t  id;
+    uint64_t  parents[2];  /* first parent and merged-in parent, 0 = none */
+    uint64_t  root;        /* snapshot tree root, 0 = empty tree */
+    uint64_t  offset;      /* Offset of the commit or merge record */
+    size_t    length;      /* Length of the record, header included */
+    long long timestamp;
+    uint32_t  generation;  /* 0 marks an empty slot */
+    uint8_t   kind;        /* MYSHELL_RECORD_COMMIT or MYSHELL_RECORD_MERGE */
+    uint8_t   type;        /* FSON type of the record */
+    bool      snapshot;    /* whether the commit has a tree */
+} myshell_graph_commit_t;
+
+typedef struct {
+    myshell_graph_commit_t *slots;
+    size_t   capacity;
+    size_t   count;
+    uint64_t last;         /* latest commit entered, parent of those that name none */
+} myshell_graph_t;
+
+static bool myshell_graph_init(myshell_graph_t *graph) {
+    graph->slots = (myshell_graph_commit_t *)calloc(MYSHELL_INDEX_MIN_CAPACITY, sizeof(myshell_graph_commit_t));
+    graph->capacity = graph->slots ? MYSHELL_INDEX_MIN_CAPACITY : 0;
+    graph->count = 0;
+    graph->last = 0;
+    return graph->slots != NULL;
+}
+
+static const myshell_graph_commit_t *myshell_graph_find(const myshell_graph_t *graph, uint64_t id) {
+    size_t mask = graph->capacity - 1;
+    for (size_t i = (size_t)id & mask;; i = (i + 1) & mask) {
+        const myshell_graph_commit_t *slot = &graph->slots[i];
+        if (!slot->generation) return NULL;
+        if (slot->id == id) return slot;
     }
+}
 
-    db->file = file;
-    db->is_open = true;
-    fseek(file, 0, SEEK_END);
-    db->file_size = (size_t)ftell(file);
-    fseek(file, 0, SEEK_SET);
-    db->last_modified = time(NULL);
-    db->commit_head = myshell_hash64(path);
-    db->error_code = FOSSIL_MYSHELL_ERROR_SUCCESS;
+/** Grows the graph so that one more commit fits without growing it. Returns false on allocation failure. */
+static bool myshell_graph_reserve(myshell_graph_t *graph) {
+    if ((graph->count + 1) * 4 <= graph->capacity * 3) return true;
+    size_t capacity = graph->capacity * 2;
+    myshell_graph_commit_t *slots = (myshell_graph_commit_t *)calloc(capacity, sizeof(myshell_graph_commit_t));
+    if (!slots) return false;
+    for (size_t i = 0; i < graph->capacity; ++i) {
+        if (!graph->slots[i].generation) continue;
+        size_t j = (size_t)graph->slots[i].id & (capacity - 1);
+        while (slots[j].generation) j = (j + 1) & (capacity - 1);
+        slots[j] = graph->slots[i];
+    }
+    free(graph->slots);
+    graph->slots = slots;
+    graph->capacity = capacity;
+    return true;
+}
 
-    if (err) *err = FOSSIL_MYSHELL_ERROR_SUCCESS;
-    return db;
+/**
+ * Inserts or repoints commit @p commit, working out its generation from the
+ * parents already in the graph. Returns false only on allocation failure.
+ */
+static bool myshell_graph_put(myshell_graph_t *graph, const myshell_graph_commit_t *commit) {
+    if (!myshell_graph_reserve(graph)) return false;
+    uint32_t generation = 1;
+    for (size_t p = 0; p < 2; ++p) {
+        const myshell_graph_commit_t *parent = commit->parents[p] && commit->parents[p] != commit->id
+                                             ? myshell_graph_find(graph, commit->parents[p]) : NULL;
+        if (parent && parent->generation >= generation) generation = parent->generation + 1;
+    }
+    size_t mask = graph->capacity - 1;
+    size_t i = (size_t)commit->id & mask;
+    while (graph->slots[i].generation && graph->slots[i].id != commit->id) i = (i + 1) & mask;
+    if (!graph->slots[i].generation) graph->count++;
+    graph->slots[i] = *commit;
+    graph->slots[i].generation = generation;
+    graph->last = commit->id;
+    return true;
 }
 
-void fossil_myshell_close(fossil_bluecrab_myshell_t *db) {
-    if (db) {
-        if (db->file) {
-            fclose(db->file);
-            db->file = NULL;
-        }
-        if (db->path) {
-            free(db->path);
-            db->path = NULL;
-        }
-        if (db->branch) {
-            free(db->branch);
-            db->branch = NULL;
-        }
-        if (db->author) {
-            free(db->author);
-            db->author = NULL;
-        }
-        if (db->commit_message) {
-            free(db->commit_message);
-            db->commit_message = NULL;
-        }
-        if (db->parent_branch) {
-            free(db->parent_branch);
-            db->parent_branch = NULL;
+/*
+ * The merge base of two commits is found by walking down from both at once in
+ * generation order, highest first, marking every commit with the sides it is
+ * reachable from. A commit leaves the queue only after all its descendants in
+ * the walk, so its marks are final by then, and the first one marked from
+ * both sides is a nearest common ancestor; nothing below it is visited.
+ */
+typedef struct {
+    uint64_t id;          /* 0 marks an empty slot */
+    uint8_t  sides;       /* 1 = reachable from the first commit, 2 = from the second */
+} myshell_graph_mark_t;
+
+typedef struct {
+    uint64_t id;
+    uint32_t generation;
+} myshell_graph_visit_t;
+
+typedef struct {
+    myshell_graph_mark_t  *marks;
+    size_t                 mark_cap;
+    size_t                 mark_count;
+    myshell_graph_visit_t *heap;  /* max-heap on generation */
+    size_t                 heap_len;
+    size_t                 heap_cap;
+} myshell_graph_walk_t;
+
+/** Finds or adds the mark for @p id; NULL on allocation failure. */
+static myshell_graph_mark_t *myshell_graph_walk_mark(myshell_graph_walk_t *walk, uint64_t id) {
+    if ((walk->mark_count + 1) * 4 > walk->mark_cap * 3) {
+        size_t capacity = walk->mark_cap ? walk->mark_cap * 2 : MYSHELL_INDEX_MIN_CAPACITY;
+        myshell_graph_mark_t *marks = (myshell_graph_mark_t *)calloc(capacity, sizeof(myshell_graph_mark_t));
+        if (!marks) return NULL;
+        for (size_t i = 0; i < walk->mark_cap; ++i) {
+            if (!walk->marks[i].id) continue;
+            size_t j = (size_t)walk->marks[i].id & (capacity - 1);
+            while (marks[j].id) j = (j + 1) & (capacity - 1);
+            marks[j] = walk->marks[i];
         }
-        free(db);
-    }
+        free(walk->marks);
+        walk->marks = marks;
+        walk->mark_cap = capacity;
+    }
+    size_t mask = walk->mark_cap - 1;
+    size_t i = (size_t)id & mask;
+    while (walk->marks[i].id && walk->marks[i].id != id) i = (i + 1) & mask;
+    if (!walk->marks[i].id) {
+        walk->marks[i].id = id;
+        walk->mark_count++;
+    }
+    return &walk->marks[i];
 }
 
-fossil_bluecrab_myshell_error_t fossil_myshell_put(fossil_bluecrab_myshell_t *db, const char *key, const char *type, const char *value) {
-    if (!db || !db->is_open) {
-        return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
-    }
-    if (!key || !type || !value) {
-        return FOSSIL_MYSHELL_ERROR_INVALID_QUERY;
-    }
-    if (key[0] == '\0' || type[0] == '\0') {
-        return FOSSIL_MYSHELL_ERROR_INVALID_QUERY;
+static bool myshell_graph_walk_push(myshell_graph_walk_t *walk, uint64_t id, uint32_t generation) {
+    if (walk->heap_len == walk->heap_cap) {
+        size_t capacity = walk->heap_cap ? walk->heap_cap * 2 : 64;
+        myshell_graph_visit_t *heap = (myshell_graph_visit_t *)realloc(walk->heap, capacity * sizeof(*heap));
+        if (!heap) return false;
+        walk->heap = heap;
+        walk->heap_cap = capacity;
+    }
+    size_t i = walk->heap_len++;
+    while (i > 0 && walk->heap[(i - 1) / 2].generation < generation) {
+        walk->heap[i] = walk->heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    walk->heap[i].id = id;
+    walk->heap[i].generation = generation;
+    return true;
+}
+
+static myshell_graph_visit_t myshell_graph_walk_pop(myshell_graph_walk_t *walk) {
+    myshell_graph_visit_t top = walk->heap[0];
+    myshell_graph_visit_t last = walk->heap[--walk->heap_len];
+    size_t i = 0;
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= walk->heap_len) break;
+        if (child + 1 < walk->heap_len && walk->heap[child + 1].generation > walk->heap[child].generation) child++;
+        if (walk->heap[child].generation <= last.generation) break;
+        walk->heap[i] = walk->heap[child];
+        i = child;
+    }
+    if (walk->heap_len) walk->heap[i] = last;
+    return top;
+}
+
+/** Finds a nearest common ancestor of commits @p a and @p b; NOT_FOUND if they share none. */
+static fossil_bluecrab_myshell_error_t myshell_graph_merge_base(const myshell_graph_t *graph, uint64_t a, uint64_t b,
+                                                                uint64_t *base) {
+    const myshell_graph_commit_t *start[2] = { myshell_graph_find(graph, a), myshell_graph_find(graph, b) };
+    if (!start[0] || !start[1]) return FOSSIL_MYSHELL_ERROR_NOT_FOUND;
+    if (a == b) {
+        *base = a;
+        return FOSSIL_MYSHELL_ERROR_SUCCESS;
     }
 
-    // Validate type against FSON type system
-    fossil_bluecrab_myshell_fson_type_t type_id = MYSHELL_FSON_TYPE_NULL;
-    bool valid_type = false;
-    for (size_t i = 0; i <= MYSHELL_FSON_TYPE_DURATION; ++i) {
-        if (strcmp(type, myshell_fson_type_names[i]) == 0) {
-            type_id = (fossil_bluecrab_myshell_fson_type_t)i;
-            valid_type = true;
+    myshell_graph_walk_t walk;
+    memset(&walk, 0, sizeof(walk));
+    fossil_bluecrab_myshell_error_t result = FOSSIL_MYSHELL_ERROR_NOT_FOUND;
+    for (size_t side = 0; side < 2; ++side) {
+        myshell_graph_mark_t *mark = myshell_graph_walk_mark(&walk, start[side]->id);
+        if (!mark || !myshell_graph_walk_push(&walk, start[side]->id, start[side]->generation)) {
+            result = FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+            walk.heap_len = 0;
             break;
         }
+        mark->sides |= (uint8_t)(1u << side);
+    }
+    while (walk.heap_len) {
+        myshell_graph_visit_t visit = myshell_graph_walk_pop(&walk);
+        uint8_t sides = myshell_graph_walk_mark(&walk, visit.id)->sides;
+        if (sides == 3) {
+            *base = visit.id;
+            result = FOSSIL_MYSHELL_ERROR_SUCCESS;
+            break;
+        }
+        const myshell_graph_commit_t *commit = myshell_graph_find(graph, visit.id);
+        for (size_t p = 0; commit && p < 2; ++p) {
+            const myshell_graph_commit_t *parent = commit->parents[p]
+                                                 ? myshell_graph_find(graph, commit->parents[p]) : NULL;
+            if (!parent || parent->generation >= commit->generation) continue;
+            myshell_graph_mark_t *mark = myshell_graph_walk_mark(&walk, parent->id);
+            if (!mark) {
+                result = FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+                walk.heap_len = 0;
+                break;
+            }
+            if ((mark->sides | sides) == mark->sides) continue;
+            bool queued = mark->sides != 0;
+            mark->sides |= sides;
+            if (!queued && !myshell_graph_walk_push(&walk, parent->id, parent->generation)) {
+                result = FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+                walk.heap_len = 0;
+                break;
+            }
+        }
     }
-    if (!valid_type) {
-        return FOSSIL_MYSHELL_ERROR_INVALID_TYPE;
-    }
+    free(walk.marks);
+    free(walk.heap);
+    return result;
+}
 
-    uint64_t key_hash = myshell_hash64(key);
+/*
+ * A ref table maps each branch or tag name to the commit its latest record
+ * points at. Names are never removed; a later record repoints the name.
+ */
+typedef struct {
+    uint64_t hash;
+    char    *name;       /* NULL marks an empty slot */
+    uint64_t target;     /* commit the ref points at */
+    uint8_t  type;       /* FSON type of the latest record */
+} myshell_ref_t;
+
+typedef struct {
+    myshell_ref_t *slots;
+    size_t capacity;
+    size_t count;
+} myshell_refs_t;
+
+static bool myshell_refs_init(myshell_refs_t *refs) {
+    refs->slots = (myshell_ref_t *)calloc(MYSHELL_INDEX_MIN_CAPACITY, sizeof(myshell_ref_t));
+    refs->capacity = refs->slots ? MYSHELL_INDEX_MIN_CAPACITY : 0;
+    refs->count = 0;
+    return refs->slots != NULL;
+}
 
-    fseek(db->file, 0, SEEK_SET);
-    char temp_path[256];
-    snprintf(temp_path, sizeof(temp_path), "%s.tmp", db->path);
-    FILE *temp_file = fopen(temp_path, "wb");
-    if (!temp_file) {
-        return FOSSIL_MYSHELL_ERROR_IO;
+static void myshell_refs_free(myshell_refs_t *refs) {
+    for (size_t i = 0; i < refs->capacity; ++i) {
+        free(refs->slots[i].name);
     }
+    free(refs->slots);
+}
 
-    char line[1024];
-    bool updated = false;
-    while (fgets(line, sizeof(line), db->file)) {
-        char *eq = strchr(line, '=');
-        if (eq) {
-            *eq = '\0';
-            char *hash_comment = strstr(eq + 1, "#hash=");
-            if (hash_comment) {
-                uint64_t file_hash = 0;
-                sscanf(hash_comment, "#hash=%" SCNx64, &file_hash);
-                if (strcmp(line, key) == 0 && file_hash == key_hash) {
-                    // Overwrite with new value and type
-                    fprintf(temp_file, "%s=%s #type=%s #hash=%016" PRIx64 "\n", key, value, myshell_fson_type_to_string(type_id), key_hash);
-                    updated = true;
-                    *eq = '='; // Restore
-                    continue;
-                }
-            } else {
-                if (strcmp(line, key) == 0) {
-                    // Overwrite with new value and type
-                    fprintf(temp_file, "%s=%s #type=%s #hash=%016" PRIx64 "\n", key, value, myshell_fson_type_to_string(type_id), key_hash);
-                    updated = true;
-                    *eq = '='; // Restore
-                    continue;
-                }
-            }
-            *eq = '='; // Restore
+static const myshell_ref_t *myshell_refs_find(const myshell_refs_t *refs, const char *name, size_t name_len) {
+    uint64_t hash = myshell_hash64n(name, name_len);
+    size_t mask = refs->capacity - 1;
+    for (size_t i = (size_t)hash & mask;; i = (i + 1) & mask) {
+        const myshell_ref_t *slot = &refs->slots[i];
+        if (!slot->name) return NULL;
+        if (slot->hash == hash && strncmp(slot->name, name, name_len) == 0 && slot->name[name_len] == '\0') {
+            return slot;
         }
-        fputs(line, temp_file);
     }
+}
 
-    if (!updated) {
-        // Add new entry with FSON type and hash
-        fprintf(temp_file, "%s=%s #type=%s #hash=%016" PRIx64 "\n", key, value, myshell_fson_type_to_string(type_id), key_hash);
+/**
+ * Inserts or repoints ref @p name. Repointing a ref that exists never
+ * allocates. Returns false only on allocation failure.
+ */
+static bool myshell_refs_put(myshell_refs_t *refs, const char *name, size_t name_len, uint64_t target,
+                             uint8_t type) {
+    myshell_ref_t *known = (myshell_ref_t *)myshell_refs_find(refs, name, name_len);
+    if (known) {
+        known->target = target;
+        known->type = type;
+        return true;
+    }
+    if ((refs->count + 1) * 4 > refs->capacity * 3) {
+        size_t capacity = refs->capacity * 2;
+        myshell_ref_t *slots = (myshell_ref_t *)calloc(capacity, sizeof(myshell_ref_t));
+        if (!slots) return false;
+        for (size_t i = 0; i < refs->capacity; ++i) {
+            if (!refs->slots[i].name) continue;
+            size_t j = (size_t)refs->slots[i].hash & (capacity - 1);
+            while (slots[j].name) j = (j + 1) & (capacity - 1);
+            slots[j] = refs->slots[i];
+        }
+        free(refs->slots);
+        refs->slots = slots;
+        refs->capacity = capacity;
+    }
+    uint64_t hash = myshell_hash64n(name, name_len);
+    size_t mask = refs->capacity - 1;
+    size_t i = (size_t)hash & mask;
+    for (;; i = (i + 1) & mask) {
+        myshell_ref_t *slot = &refs->slots[i];
+        if (!slot->name) break;
+        if (slot->hash == hash && strncmp(slot->name, name, name_len) == 0 && slot->name[name_len] == '\0') {
+            slot->target = target;
+            slot->type = type;
+            return true;
+        }
     }
+    char *copy = myshell_strndup(name, name_len);
+    if (!copy) return false;
+    refs->slots[i].hash = hash;
+    refs->slots[i].name = copy;
+    refs->slots[i].target = target;
+    refs->slots[i].type = type;
+    refs->count++;
+    return true;
+}
 
-    fclose(temp_file);
-    fclose(db->file);
+// *****************************************************************************
+// Record format (v2)
+// *****************************************************************************
 
-    if (remove(db->path) != 0) {
-        remove(temp_path);
-        return FOSSIL_MYSHELL_ERROR_IO;
-    }
-    if (rename(temp_path, db->path) != 0) {
-        return FOSSIL_MYSHELL_ERROR_IO;
-    }
+/*
+ * A record is a fixed 16-byte header followed by the key and value bytes, so
+ * a reader takes the lengths from the header and copies the payload without
+ * looking at it. The CRC covers everything after itself; a record that fails
+ * it, or that runs past the end of the file, is a torn or damaged write.
+ */
+#define MYSHELL_MAGIC              "MYSH"
+#define MYSHELL_FORMAT_VERSION     2
+#define MYSHELL_FILE_HEADER_SIZE   8
+#define MYSHELL_RECORD_HEADER_SIZE 16
+
+typedef enum {
+    MYSHELL_RECORD_PUT = 1,
+    MYSHELL_RECORD_DEL,
+    MYSHELL_RECORD_STAGE,
+    MYSHELL_RECORD_UNSTAGE,
+    MYSHELL_RECORD_COMMIT,
+    MYSHELL_RECORD_BRANCH,
+    MYSHELL_RECORD_TAG,
+    MYSHELL_RECORD_MERGE,
+    MYSHELL_RECORD_BATCH,
+    MYSHELL_RECORD_NODE,
+    MYSHELL_RECORD_BLOB,
+    MYSHELL_RECORD_CHECKOUT,
+    MYSHELL_RECORD_HEAD,
+    MYSHELL_RECORD_CHECKPOINT
+} myshell_record_kind_t;
 
-    db->file = fopen(db->path, "rb+");
-    if (!db->file) {
-        return FOSSIL_MYSHELL_ERROR_IO;
+/**
+ * One decoded record. Key and value point into the mapping or a read buffer
+ * and are not NUL-terminated; their lengths delimit them.
+ */
+typedef struct {
+    uint8_t     kind;
+    uint8_t     type;        /* FSON type index */
+    const char *key;
+    uint32_t    key_len;
+    const char *value;
+    uint32_t    value_len;
+    uint64_t    offset;      /* where the record starts in the file */
+    size_t      size;        /* header plus payload */
+} myshell_record_t;
+
+static const uint32_t myshell_crc32_nibbles[16] = {
+    0x00000000u, 0x1db71064u, 0x3b6e20c8u, 0x26d930acu, 0x76dc4190u, 0x6b6b51f4u, 0x4db26158u, 0x5005713cu,
+    0xedb88320u, 0xf00f9344u, 0xd6d6a3e8u, 0xcb61b38cu, 0x9b64c2b0u, 0x86d3d2d4u, 0xa00ae278u, 0xbdbdf21cu
+};
+
+/** CRC-32 (IEEE 802.3) of @p len bytes, continuing from @p crc (start with 0). */
+static uint32_t myshell_crc32(uint32_t crc, const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+    crc = ~crc;
+    while (len--) {
+        crc ^= *p++;
+        crc = (crc >> 4) ^ myshell_crc32_nibbles[crc & 0x0f];
+        crc = (crc >> 4) ^ myshell_crc32_nibbles[crc & 0x0f];
     }
+    return ~crc;
+}
 
-    db->file_size = (size_t)ftell(db->file);
-    db->last_modified = time(NULL);
-    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+static void myshell_put_u32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t myshell_get_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/** fseek with a 64-bit offset: long is 32 bits on Windows and 32-bit hosts. */
+static int myshell_fseek(FILE *file, uint64_t offset, int whence) {
+#if defined(_WIN32) || defined(_WIN64)
+    return _fseeki64(file, (__int64)offset, whence);
+#else
+    return fseeko(file, (off_t)offset, whence);
+#endif
+}
+
+/** ftell with a 64-bit result; negative on failure. */
+static int64_t myshell_ftell(FILE *file) {
+#if defined(_WIN32) || defined(_WIN64)
+    return (int64_t)_ftelli64(file);
+#else
+    return (int64_t)ftello(file);
+#endif
+}
+
+/** Fills in a record header, checksum included, for the given payload. */
+static void myshell_record_header(uint8_t header[MYSHELL_RECORD_HEADER_SIZE], uint8_t kind, uint8_t type,
+                                  const char *key, uint32_t key_len, const char *value, uint32_t value_len) {
+    header[4] = kind;
+    header[5] = type;
+    header[6] = 0;
+    header[7] = 0;
+    myshell_put_u32(header + 8, key_len);
+    myshell_put_u32(header + 12, value_len);
+    uint32_t crc = myshell_crc32(0, header + 4, MYSHELL_RECORD_HEADER_SIZE - 4);
+    crc = myshell_crc32(crc, key, key_len);
+    crc = myshell_crc32(crc, value, value_len);
+    myshell_put_u32(header, crc);
+}
+
+/** Encodes a whole record (header, key, value) at @p out. */
+static void myshell_record_encode(char *out, uint8_t kind, uint8_t type, const char *key, uint32_t key_len,
+                                  const char *value, uint32_t value_len) {
+    myshell_record_header((uint8_t *)out, kind, type, key, key_len, value, value_len);
+    memcpy(out + MYSHELL_RECORD_HEADER_SIZE, key, key_len);
+    if (value_len) memcpy(out + MYSHELL_RECORD_HEADER_SIZE + key_len, value, value_len);
+}
+
+static bool myshell_record_header_valid(const uint8_t *header) {
+    return header[4] >= MYSHELL_RECORD_PUT && header[4] <= MYSHELL_RECORD_CHECKPOINT &&
+           header[6] == 0 && header[7] == 0;
+}
+
+/**
+ * Decodes the record occupying exactly @p len bytes at @p buf, checking its
+ * header and checksum. Key and value point into @p buf.
+ */
+static bool myshell_record_decode(const char *buf, size_t len, myshell_record_t *rec) {
+    const uint8_t *header = (const uint8_t *)buf;
+    if (len < MYSHELL_RECORD_HEADER_SIZE || !myshell_record_header_valid(header)) return false;
+    uint32_t key_len = myshell_get_u32(header + 8);
+    uint32_t value_len = myshell_get_u32(header + 12);
+    if ((uint64_t)key_len + value_len != len - MYSHELL_RECORD_HEADER_SIZE) return false;
+    uint32_t crc = myshell_crc32(0, header + 4, len - 4);
+    if (crc != myshell_get_u32(header)) return false;
+    rec->kind = header[4];
+    rec->type = header[5];
+    rec->key = buf + MYSHELL_RECORD_HEADER_SIZE;
+    rec->key_len = key_len;
+    rec->value = rec->key + key_len;
+    rec->value_len = value_len;
+    rec->size = len;
+    return true;
+}
+
+/** Writes one record straight to @p file (used when building a whole file). */
+static bool myshell_record_write(FILE *file, uint8_t kind, uint8_t type, const char *key, uint32_t key_len,
+                                 const char *value, uint32_t value_len) {
+    uint8_t header[MYSHELL_RECORD_HEADER_SIZE];
+    myshell_record_header(header, kind, type, key, key_len, value, value_len);
+    return fwrite(header, 1, sizeof(header), file) == sizeof(header) &&
+           fwrite(key, 1, key_len, file) == key_len &&
+           (value_len == 0 || fwrite(value, 1, value_len, file) == value_len);
+}
+
+static bool myshell_file_header_write(FILE *file) {
+    uint8_t header[MYSHELL_FILE_HEADER_SIZE] = { 'M', 'Y', 'S', 'H', MYSHELL_FORMAT_VERSION, 0, 0, 0 };
+    return fwrite(header, 1, sizeof(header), file) == sizeof(header);
+}
+
+/** Checks the magic and version at the current position of @p file. */
+static fossil_bluecrab_myshell_error_t myshell_file_header_read(FILE *file) {
+    uint8_t header[MYSHELL_FILE_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+        memcmp(header, MYSHELL_MAGIC, 4) != 0) {
+        return ferror(file) ? FOSSIL_MYSHELL_ERROR_IO : FOSSIL_MYSHELL_ERROR_VERSION_UNSUPPORTED;
+    }
+    if (header[4] != MYSHELL_FORMAT_VERSION) {
+        return FOSSIL_MYSHELL_ERROR_VERSION_UNSUPPORTED;
+    }
+    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+}
+
+/*
+ * A cursor reads records sequentially from [offset, end) of a file: in place
+ * from a mapping when it has one, otherwise through stdio into a buffer. On a
+ * damaged record it stops with `result` set: CORRUPTED when the record runs
+ * past `end` (a torn write), INTEGRITY when its checksum or header is wrong.
+ * `rec.size` then still tells how long the record claimed to be.
+ */
+typedef struct {
+    FILE       *file;
+    const char *map;       /* mapping of the file covering [0, end), or NULL */
+    char       *buf;
+    size_t      cap;
+    uint64_t    offset;
+    uint64_t    end;
+    fossil_bluecrab_myshell_error_t result;
+} myshell_cursor_t;
+
+/** Opens a cursor; @p map, when given, must cover [0, end) of @p file. */
+static bool myshell_cursor_open(myshell_cursor_t *cur, FILE *file, const char *map, uint64_t start, uint64_t end) {
+    memset(cur, 0, sizeof(*cur));
+    cur->file = file;
+    cur->map = map;
+    cur->offset = start;
+    cur->end = end;
+    if (!map && myshell_fseek(file, start, SEEK_SET) != 0) {
+        cur->result = FOSSIL_MYSHELL_ERROR_IO;
+        return false;
+    }
+    return true;
+}
+
+static void myshell_cursor_close(myshell_cursor_t *cur) {
+    free(cur->buf);
+    cur->buf = NULL;
+}
+
+/** Reads the next record into @p rec. Returns false at the end or on error (see cur->result). */
+static bool myshell_cursor_next(myshell_cursor_t *cur, myshell_record_t *rec) {
+    if (cur->result != FOSSIL_MYSHELL_ERROR_SUCCESS || cur->offset >= cur->end) return false;
+    uint64_t remaining = cur->end - cur->offset;
+    rec->offset = cur->offset;
+    rec->size = MYSHELL_RECORD_HEADER_SIZE;
+
+    uint8_t copy[MYSHELL_RECORD_HEADER_SIZE];
+    const uint8_t *header = copy;
+    if (remaining < sizeof(copy)) {
+        cur->result = FOSSIL_MYSHELL_ERROR_CORRUPTED;
+        return false;
+    }
+    if (cur->map) {
+        header = (const uint8_t *)cur->map + cur->offset;
+    } else if (fread(copy, 1, sizeof(copy), cur->file) != sizeof(copy)) {
+        cur->result = ferror(cur->file) ? FOSSIL_MYSHELL_ERROR_IO : FOSSIL_MYSHELL_ERROR_CORRUPTED;
+        return false;
+    }
+    uint32_t key_len = myshell_get_u32(header + 8);
+    uint32_t value_len = myshell_get_u32(header + 12);
+    uint64_t size = (uint64_t)MYSHELL_RECORD_HEADER_SIZE + key_len + value_len;
+    if (!myshell_record_header_valid(header)) {
+        cur->result = FOSSIL_MYSHELL_ERROR_INTEGRITY;
+        return false;
+    }
+    if (size > remaining) {
+        cur->result = FOSSIL_MYSHELL_ERROR_CORRUPTED;
+        return false;
+    }
+    rec->size = (size_t)size;
+
+    const char *payload;
+    if (cur->map) {
+        payload = cur->map + cur->offset + MYSHELL_RECORD_HEADER_SIZE;
+    } else {
+        size_t need = (size_t)key_len + value_len;
+        if (need > cur->cap) {
+            size_t cap = cur->cap ? cur->cap : 1024;
+            while (cap < need) cap *= 2;
+            char *grown = (char *)realloc(cur->buf, cap);
+            if (!grown) {
+                cur->result = FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+                return false;
+            }
+            cur->buf = grown;
+            cur->cap = cap;
+        }
+        if (fread(cur->buf, 1, need, cur->file) != need) {
+            cur->result = ferror(cur->file) ? FOSSIL_MYSHELL_ERROR_IO : FOSSIL_MYSHELL_ERROR_CORRUPTED;
+            return false;
+        }
+        payload = cur->buf;
+    }
+
+    uint32_t crc = myshell_crc32(0, header + 4, MYSHELL_RECORD_HEADER_SIZE - 4);
+    crc = myshell_crc32(crc, payload, (size_t)key_len + value_len);
+    if (crc != myshell_get_u32(header)) {
+        cur->result = FOSSIL_MYSHELL_ERROR_INTEGRITY;
+        return false;
+    }
+
+    rec->kind = header[4];
+    rec->type = header[5];
+    rec->key = payload;
+    rec->key_len = key_len;
+    rec->value = payload + key_len;
+    rec->value_len = value_len;
+    cur->offset += size;
+    return true;
+}
+
+/** Whether a record's key equals the C string @p str. */
+static bool myshell_record_key_is(const myshell_record_t *rec, const char *str) {
+    return strlen(str) == rec->key_len && memcmp(rec->key, str, rec->key_len) == 0;
+}
+
+/** Commit hashes cover `MESSAGE:TIMESTAMP`. */
+static uint64_t myshell_commit_hash(const char *message, size_t message_len, long long timestamp) {
+    size_t size = message_len + 32;
+    char small[256];
+    char *data = size <= sizeof(small) ? small : (char *)malloc(size);
+    if (!data) return 0;
+    memcpy(data, message, message_len);
+    int n = snprintf(data + message_len, size - message_len, ":%lld", timestamp);
+    uint64_t hash = myshell_hash64n(data, message_len + (size_t)n);
+    if (data != small) free(data);
+    return hash;
+}
+
+/** Parses the 16-hex-digit hash a commit key or branch/tag value carries. */
+static bool myshell_hash_parse(const char *text, size_t len, uint64_t *hash) {
+    if (len != 16) return false;
+    uint64_t h = 0;
+    for (size_t i = 0; i < len; ++i) {
+        char c = text[i];
+        int digit = (c >= '0' && c <= '9') ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10
+                  : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+        if (digit < 0) return false;
+        h = h << 4 | (uint64_t)digit;
+    }
+    *hash = h;
+    return true;
+}
+
+/*
+ * A snapshot commit's value starts with the root of its tree and its parent,
+ * `tree HASH\nparent HASH\n`, ahead of `TIMESTAMP\nMESSAGE`; its id is the
+ * hash of the whole value. Commits written before snapshots carry only the
+ * timestamp and message and are identified by myshell_commit_hash.
+ */
+#define MYSHELL_COMMIT_TREE_SIZE 46
+
+/** Reads the tree root and parent of a snapshot commit; false for older commits. */
+static bool myshell_commit_snapshot(const myshell_record_t *rec, uint64_t *root, uint64_t *parent) {
+    const char *v = rec->value;
+    return rec->value_len >= MYSHELL_COMMIT_TREE_SIZE && memcmp(v, "tree ", 5) == 0 && v[21] == '\n' &&
+           memcmp(v + 22, "parent ", 7) == 0 && v[45] == '\n' &&
+           myshell_hash_parse(v + 5, 16, root) && myshell_hash_parse(v + 29, 16, parent);
+}
+
+/*
+ * A merge that combined two snapshots adds the tip it merged in after the
+ * parent, `tree HASH\nparent HASH\nmerge HASH\n`, ahead of
+ * `TIMESTAMP\nSOURCEBRANCH\nMESSAGE`, and is likewise identified by the hash
+ * of its value.
+ */
+#define MYSHELL_MERGE_TREE_SIZE (MYSHELL_COMMIT_TREE_SIZE + 23)
+
+/** Reads the tree root and both parents of a snapshot merge; false for older merges. */
+static bool myshell_merge_snapshot(const myshell_record_t *rec, uint64_t *root, uint64_t *parent, uint64_t *merged) {
+    const char *v = rec->value;
+    return rec->value_len >= MYSHELL_MERGE_TREE_SIZE && myshell_commit_snapshot(rec, root, parent) &&
+           memcmp(v + MYSHELL_COMMIT_TREE_SIZE, "merge ", 6) == 0 && v[MYSHELL_MERGE_TREE_SIZE - 1] == '\n' &&
+           myshell_hash_parse(v + MYSHELL_COMMIT_TREE_SIZE + 6, 16, merged);
+}
+
+/** Splits a commit value `TIMESTAMP\nMESSAGE`, after the tree lines of a snapshot commit. */
+static bool myshell_commit_parse(const myshell_record_t *rec, long long *timestamp, const char **message,
+                                 size_t *message_len) {
+    uint64_t root, parent;
+    const char *value = rec->value;
+    size_t value_len = rec->value_len;
+    if (myshell_commit_snapshot(rec, &root, &parent)) {
+        value += MYSHELL_COMMIT_TREE_SIZE;
+        value_len -= MYSHELL_COMMIT_TREE_SIZE;
+    }
+    const char *nl = (const char *)memchr(value, '\n', value_len);
+    if (!nl || nl == value || nl - value > 20) return false;
+    char digits[24];
+    memcpy(digits, value, (size_t)(nl - value));
+    digits[nl - value] = '\0';
+    char *end = NULL;
+    *timestamp = strtoll(digits, &end, 10);
+    if (*end != '\0') return false;
+    *message = nl + 1;
+    *message_len = value_len - (size_t)(nl + 1 - value);
+    return true;
+}
+
+/** Whether @p id, parsed from a commit's key, is the id the commit's content hashes to. */
+static bool myshell_commit_id_valid(const myshell_record_t *rec, uint64_t id, const char *message,
+                                    size_t message_len, long long timestamp) {
+    uint64_t root, parent;
+    if (myshell_commit_snapshot(rec, &root, &parent)) {
+        return id == myshell_hash64n(rec->value, rec->value_len);
+    }
+    return id == myshell_commit_hash(message, message_len, timestamp);
+}
+
+/** A put or blob record's content id: its key, value and type hashed together. */
+static uint64_t myshell_blob_id(const myshell_record_t *rec) {
+    uint64_t h = myshell_hash64n(rec->key, rec->key_len);
+    h ^= myshell_hash64n(rec->value, rec->value_len) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    return (h ^ rec->type) * 0xc6a4a7935bd1e995ULL;
+}
+
+/** Parses a checkout or head value, `COMMITHASHROOTHASH`. */
+static bool myshell_head_parse(const myshell_record_t *rec, uint64_t *commit, uint64_t *root) {
+    return rec->value_len == 32 && myshell_hash_parse(rec->value, 16, commit) &&
+           myshell_hash_parse(rec->value + 16, 16, root);
+}
+
+/*
+ * Appended records are grouped in memory and reach the file in one write: when
+ * the group buffer fills, on commit, and before anything reads the file back.
+ * The durability mode decides when the file is also fdatasync'ed, so a commit
+ * costs one write plus at most one sync however many records it carries.
+ */
+#define MYSHELL_LOG_BUFFER (64 * 1024)
+
+typedef struct {
+    char    *pending;          /* appended records not yet written to the file */
+    size_t   pending_len;
+    size_t   pending_cap;
+    uint64_t written;          /* bytes already in the file; pending follows them */
+    uint64_t last_sync_ms;
+    fossil_bluecrab_myshell_durability_t durability;
+    uint64_t sync_interval_ms;
+} myshell_log_t;
+
+/** Grows @p buf (holding @p len bytes) so @p needed more fit. */
+static bool myshell_buffer_reserve(char **buf, size_t *cap, size_t len, size_t needed) {
+    if (len + needed <= *cap) return true;
+    size_t grown_cap = *cap ? *cap : 4096;
+    while (grown_cap < len + needed) grown_cap *= 2;
+    char *grown = (char *)realloc(*buf, grown_cap);
+    if (!grown) return false;
+    *buf = grown;
+    *cap = grown_cap;
+    return true;
+}
+
+/*
+ * The staging area lives in memory: each staged change is a put record in
+ * one buffer, in the order it was staged, and the staged index points at the
+ * latest record for each key. Staging a key is an append to the buffer and a
+ * hash probe; nothing reaches the file until commit writes the staged changes
+ * as one batch. A handle can journal stage and unstage records to the log as
+ * well, so the staging area survives a crash; open replays them, and a
+ * snapshot commit empties it again.
+ */
+#define MYSHELL_STAGE_PACK (64 * 1024)
+
+typedef struct {
+    char  *records;            /* staged changes as put records, in staging order */
+    size_t len;
+    size_t cap;
+    size_t garbage;            /* bytes of records restaged or unstaged since */
+    bool   journal;            /* also append stage and unstage records to the log */
+} myshell_stage_t;
+
+/*
+ * Every branch sees the keys through its own view: the snapshot tree of the
+ * commit it sits on, overlaid with the puts and deletes made on it since.
+ * Reads try the overlay, then fall through to the tree. Only the checked-out
+ * view is live; the others are parked with their overlays, so creating a
+ * branch or switching to one copies nothing.
+ */
+typedef struct {
+    char    *branch;           /* the branch this view belongs to */
+    uint64_t head;             /* commit the overlay sits on */
+    myshell_index_t *keys;     /* key -> put record, or del record with length 0 */
+} myshell_view_t;
+
+/*
+ * Per-handle state hung off db->cache. The file is an append-only log: a put
+ * appends a new version of its record, a delete appends a del tombstone, and
+ * the indexes point at the latest record for each key. Records that were
+ * superseded, and the tombstones themselves, are counted as garbage.
+ */
+struct myshell_compaction;
+
+typedef struct {
+    myshell_index_t *keys;     /* overlay of the checked-out view: key -> latest put or del record (length 0) */
+    myshell_index_t *staged;   /* staged key -> its latest record in stage */
+    myshell_stage_t  stage;    /* the staging area */
+    uint64_t garbage;          /* bytes of superseded records and tombstones */
+    double   compact_ratio;    /* auto-compact at garbage/file size, 0 = manual only */
+    uint64_t compact_rate;     /* compaction copy limit in bytes/s, 0 = unlimited */
+    struct myshell_compaction *compaction; /* running background compaction, if any */
+    myshell_log_t log;
+    myshell_map_t map;         /* read-only mapping of the written part of the file */
+    uint64_t map_epoch;        /* bumped whenever the mapping is replaced or dropped */
+    fossil_bluecrab_myshell_batch_t *txn; /* writes of the open transaction, if any */
+    myshell_objects_t objects; /* content id -> blob or tree node record */
+    myshell_graph_t graph;     /* commit id -> record, parents and generation */
+    myshell_refs_t branches;   /* branch name -> commit */
+    myshell_refs_t tags;       /* tag name -> commit */
+    uint64_t head;             /* commit the checked-out view sits on, 0 = none yet */
+    uint64_t head_root;        /* root node of its snapshot, 0 = empty tree */
+    char    *head_branch;      /* branch of the checked-out view, NULL when detached */
+    myshell_view_t *views;     /* parked views of the other branches */
+    size_t   view_count;
+    size_t   view_cap;
+    uint64_t verified;         /* the file up to here passed an integrity check */
+    uint64_t log_verified;     /* commit ids up to here were checked by a log walk */
+} myshell_store_t;
+
+static void myshell_store_free(myshell_store_t *store) {
+    if (!store) return;
+    myshell_index_free(store->keys);
+    myshell_index_free(store->staged);
+    free(store->stage.records);
+    for (size_t i = 0; i < store->view_count; ++i) {
+        free(store->views[i].branch);
+        myshell_index_free(store->views[i].keys);
+    }
+    free(store->views);
+    free(store->objects.slots);
+    free(store->graph.slots);
+    myshell_refs_free(&store->branches);
+    myshell_refs_free(&store->tags);
+    free(store->head_branch);
+    fossil_myshell_batch_free(store->txn);
+    myshell_map_close(&store->map);
+    free(store->log.pending);
+    free(store);
+}
+
+/** Drops the mapping; views handed out so far become invalid. */
+static void myshell_map_drop(myshell_store_t *store) {
+    if (store->map.data) {
+        myshell_map_close(&store->map);
+        store->map_epoch++;
+    }
+}
+
+/**
+ * Returns a mapping that covers [0, end) of the file, remapping the whole
+ * written file when the current one is too short. Returns NULL when the file
+ * cannot be mapped; callers then fall back to stdio.
+ */
+static const char *myshell_map_cover(fossil_bluecrab_myshell_t *db, uint64_t end) {
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    if (store->map.data && store->map.size >= end) {
+        return store->map.data;
+    }
+    if (end > store->log.written) {
+        return NULL;
+    }
+    myshell_map_drop(store);
+    if (!myshell_map_open(&store->map, db->file, store->log.written)) {
+        return NULL;
+    }
+    return store->map.data;
+}
+
+static myshell_store_t *myshell_store_new(void) {
+    myshell_store_t *store = (myshell_store_t *)calloc(1, sizeof(myshell_store_t));
+    if (!store) return NULL;
+    store->keys = myshell_index_new();
+    store->staged = myshell_index_new();
+    bool tables = myshell_objects_init(&store->objects) && myshell_graph_init(&store->graph) &&
+                  myshell_refs_init(&store->branches) && myshell_refs_init(&store->tags);
+    if (!store->keys || !store->staged || !tables) {
+        myshell_store_free(store);
+        return NULL;
+    }
+    return store;
+}
+
+/** Moves the checked-out view to snapshot @p commit, which now holds all its writes. */
+static void myshell_store_set_head(myshell_store_t *store, uint64_t commit, uint64_t root) {
+    store->head = commit;
+    store->head_root = root;
+    myshell_index_clear(store->keys);
+}
+
+/** Index of the parked view of @p branch, or view_count when there is none. */
+static size_t myshell_view_find(const myshell_store_t *store, const char *branch, size_t branch_len) {
+    size_t i = 0;
+    for (; i < store->view_count; ++i) {
+        const char *name = store->views[i].branch;
+        if (strncmp(name, branch, branch_len) == 0 && name[branch_len] == '\0') break;
+    }
+    return i;
+}
+
+/** Counts the records of the writes in overlay @p keys as garbage. */
+static void myshell_view_discard(myshell_store_t *store, const myshell_index_t *keys) {
+    for (size_t i = 0; i < keys->capacity; ++i) {
+        if (keys->slots[i].key) store->garbage += keys->slots[i].length;
+    }
+}
+
+/** Drops parked view @p at; the records of its writes become garbage. */
+static void myshell_view_drop(myshell_store_t *store, size_t at) {
+    myshell_view_t *view = &store->views[at];
+    myshell_view_discard(store, view->keys);
+    free(view->branch);
+    myshell_index_free(view->keys);
+    store->views[at] = store->views[--store->view_count];
+}
+
+/**
+ * Switches to the view of branch @p branch (empty: detached) on snapshot
+ * @p commit. The current view's writes are parked under its branch; a
+ * detached view's are dropped, so callers refuse to leave one with writes.
+ * The target's parked writes are taken up if it still sits on @p commit.
+ * O(1) in the number of keys. Returns false only on allocation failure.
+ */
+static bool myshell_view_switch(myshell_store_t *store, uint64_t commit, uint64_t root,
+                                const char *branch, size_t branch_len) {
+    char *name = branch_len > 0 ? myshell_strndup(branch, branch_len) : NULL;
+    if (branch_len > 0 && !name) return false;
+    if (store->head_branch && store->keys->count > 0) {
+        if (store->view_count == store->view_cap) {
+            size_t cap = store->view_cap ? store->view_cap * 2 : 4;
+            myshell_view_t *grown = (myshell_view_t *)realloc(store->views, cap * sizeof(*grown));
+            if (!grown) {
+                free(name);
+                return false;
+            }
+            store->views = grown;
+            store->view_cap = cap;
+        }
+        myshell_index_t *fresh = myshell_index_new();
+        if (!fresh) {
+            free(name);
+            return false;
+        }
+        myshell_view_t *parked = &store->views[store->view_count++];
+        parked->branch = store->head_branch;
+        parked->head = store->head;
+        parked->keys = store->keys;
+        store->head_branch = NULL;
+        store->keys = fresh;
+    }
+    myshell_view_discard(store, store->keys);
+    myshell_store_set_head(store, commit, root);
+    free(store->head_branch);
+    store->head_branch = name;
+
+    size_t at = name ? myshell_view_find(store, branch, branch_len) : store->view_count;
+    if (at < store->view_count && store->views[at].head != commit) {
+        myshell_view_drop(store, at);
+    } else if (at < store->view_count) {
+        myshell_index_t *keys = store->keys;
+        store->keys = store->views[at].keys;
+        store->views[at].keys = keys;
+        myshell_view_drop(store, at);
+    }
+    return true;
+}
+
+/** Drops restaged and unstaged records from the staging area, keeping the order of the rest. */
+static void myshell_stage_pack(myshell_store_t *store) {
+    myshell_stage_t *stage = &store->stage;
+    size_t out = 0;
+    for (size_t pos = 0; pos < stage->len;) {
+        const uint8_t *header = (const uint8_t *)stage->records + pos;
+        uint32_t key_len = myshell_get_u32(header + 8);
+        size_t size = MYSHELL_RECORD_HEADER_SIZE + (size_t)key_len + myshell_get_u32(header + 12);
+        const char *key = stage->records + pos + MYSHELL_RECORD_HEADER_SIZE;
+        myshell_index_slot_t *slot = myshell_index_find(store->staged, key, key_len, myshell_hash64n(key, key_len));
+        if (slot && slot->offset == pos) {
+            memmove(stage->records + out, stage->records + pos, size);
+            slot->offset = out;
+            out += size;
+        }
+        pos += size;
+    }
+    stage->len = out;
+    stage->garbage = 0;
+}
+
+/** Stages a change of @p key, superseding any staged before. Returns false only on allocation failure. */
+static bool myshell_stage_put(myshell_store_t *store, uint8_t type, const char *key, size_t key_len,
+                              const char *value, size_t value_len) {
+    myshell_stage_t *stage = &store->stage;
+    size_t needed = MYSHELL_RECORD_HEADER_SIZE + key_len + value_len;
+    if (!myshell_buffer_reserve(&stage->records, &stage->cap, stage->len, needed)) return false;
+    uint64_t key_hash = myshell_hash64n(key, key_len);
+    myshell_index_slot_t *old = myshell_index_find(store->staged, key, key_len, key_hash);
+    size_t old_length = old ? old->length : 0;
+    if (!myshell_index_put(store->staged, key, key_len, key_hash, stage->len, needed)) return false;
+    myshell_record_encode(stage->records + stage->len, MYSHELL_RECORD_PUT, type, key, (uint32_t)key_len,
+                          value, (uint32_t)value_len);
+    stage->len += needed;
+    stage->garbage += old_length;
+    if (stage->garbage >= MYSHELL_STAGE_PACK && stage->garbage * 2 >= stage->len) {
+        myshell_stage_pack(store);
+    }
+    return true;
+}
+
+/** Unstages @p key. Returns false if it was not staged. */
+static bool myshell_stage_remove(myshell_store_t *store, const char *key, size_t key_len) {
+    uint64_t key_hash = myshell_hash64n(key, key_len);
+    myshell_index_slot_t *slot = myshell_index_find(store->staged, key, key_len, key_hash);
+    if (!slot) return false;
+    store->stage.garbage += slot->length;
+    myshell_index_remove(store->staged, key, key_len, key_hash);
+    return true;
+}
+
+static void myshell_stage_clear(myshell_store_t *store) {
+    store->stage.len = 0;
+    store->stage.garbage = 0;
+    myshell_index_clear(store->staged);
+}
+
+/**
+ * Enters a commit or merge record in the commit graph. A snapshot commit names
+ * its parent; an older commit follows the one before it in the log. A merge
+ * has the tip of the branch it merged in as second parent; a snapshot merge
+ * names both parents, an older one follows the head.
+ */
+static bool myshell_store_graph(myshell_store_t *store, const myshell_record_t *rec, uint64_t id) {
+    myshell_graph_commit_t commit;
+    memset(&commit, 0, sizeof(commit));
+    commit.id = id;
+    commit.offset = rec->offset;
+    commit.length = rec->size;
+    commit.kind = rec->kind;
+    commit.type = rec->type;
+    if (rec->kind == MYSHELL_RECORD_COMMIT) {
+        const char *message;
+        size_t message_len;
+        commit.snapshot = myshell_commit_snapshot(rec, &commit.root, &commit.parents[0]);
+        if (!commit.snapshot) commit.parents[0] = store->graph.last;
+        myshell_commit_parse(rec, &commit.timestamp, &message, &message_len);
+    } else {
+        // `TIMESTAMP\nSOURCEBRANCH\nMESSAGE`, after the tree lines of a snapshot merge
+        const char *value = rec->value;
+        commit.snapshot = myshell_merge_snapshot(rec, &commit.root, &commit.parents[0], &commit.parents[1]);
+        if (commit.snapshot) value += MYSHELL_MERGE_TREE_SIZE;
+        size_t value_len = rec->value_len - (size_t)(value - rec->value);
+        const char *nl = (const char *)memchr(value, '\n', value_len);
+        if (!commit.snapshot) {
+            commit.parents[0] = store->head ? store->head : store->graph.last;
+            const char *source = nl ? nl + 1 : NULL;
+            const char *end = source ? (const char *)memchr(source, '\n', value_len - (size_t)(source - value)) : NULL;
+            const myshell_ref_t *ref = end ? myshell_refs_find(&store->branches, source, (size_t)(end - source)) : NULL;
+            if (ref) commit.parents[1] = ref->target;
+        }
+        for (const char *p = value; nl && p < nl && *p >= '0' && *p <= '9'; ++p) {
+            commit.timestamp = commit.timestamp * 10 + (*p - '0');
+        }
+    }
+    return myshell_graph_put(&store->graph, &commit);
+}
+
+/**
+ * Replays one record. Puts and deletes go to the checked-out view's overlay,
+ * where later records supersede earlier ones for the same key. Blobs and
+ * tree nodes are entered in the object table, commits and merges in the
+ * commit graph, branches and tags in the ref tables, snapshot commits move
+ * the view to their tree, checkouts switch views, and checkpoints advance the
+ * verified prefix. A branch pointed at the head names the checked-out view;
+ * one moved elsewhere drops the writes parked on it. Stage and unstage
+ * records edit the staging area, which a snapshot commit empties. Returns
+ * false only on allocation failure.
+ */
+static bool myshell_store_apply(myshell_store_t *store, const myshell_record_t *rec) {
+    bool tombstone = rec->kind == MYSHELL_RECORD_DEL;
+    uint64_t id, root, parent, merged;
+    size_t view;
+    switch (rec->kind) {
+        case MYSHELL_RECORD_PUT:
+        case MYSHELL_RECORD_DEL:
+            break;
+        case MYSHELL_RECORD_STAGE:
+            // Journal records: compaction drops them all and journals the staging area afresh
+            store->garbage += rec->size;
+            return myshell_stage_put(store, rec->type, rec->key, rec->key_len, rec->value, rec->value_len);
+        case MYSHELL_RECORD_UNSTAGE:
+            store->garbage += rec->size;
+            myshell_stage_remove(store, rec->key, rec->key_len);
+            return true;
+        case MYSHELL_RECORD_BLOB:
+            return myshell_objects_put(&store->objects, myshell_blob_id(rec), MYSHELL_OBJECT_BLOB,
+                                       rec->offset, rec->size);
+        case MYSHELL_RECORD_NODE:
+            return myshell_objects_put(&store->objects, myshell_hash64n(rec->value, rec->value_len),
+                                       MYSHELL_OBJECT_NODE, rec->offset, rec->size);
+        case MYSHELL_RECORD_COMMIT:
+        case MYSHELL_RECORD_MERGE:
+            if (!myshell_hash_parse(rec->key, rec->key_len, &id)) return true;
+            if (!myshell_store_graph(store, rec, id)) return false;
+            if (rec->kind == MYSHELL_RECORD_MERGE) {
+                if (myshell_merge_snapshot(rec, &root, &parent, &merged)) {
+                    myshell_store_set_head(store, id, root);
+                }
+            } else if (myshell_commit_snapshot(rec, &root, &parent)) {
+                // A snapshot commit wrote out whatever was staged before it
+                myshell_store_set_head(store, id, root);
+                myshell_stage_clear(store);
+            }
+            return true;
+        case MYSHELL_RECORD_CHECKOUT:
+        case MYSHELL_RECORD_HEAD:
+            if (!myshell_head_parse(rec, &id, &root)) return true;
+            return myshell_view_switch(store, id, root, rec->key, rec->key_len);
+        case MYSHELL_RECORD_CHECKPOINT:
+            // Compaction drops every checkpoint, so each one is garbage at once
+            store->garbage += rec->size;
+            if (myshell_hash_parse(rec->value, rec->value_len, &id) && id <= rec->offset + rec->size && id > store->verified) {
+                store->verified = id;
+            }
+            return true;
+        case MYSHELL_RECORD_BRANCH:
+            if (!myshell_hash_parse(rec->value, rec->value_len, &id)) id = 0;
+            if (!myshell_refs_put(&store->branches, rec->key, rec->key_len, id, rec->type)) return false;
+            view = myshell_view_find(store, rec->key, rec->key_len);
+            if (view < store->view_count && (store->views[view].head != id || id == store->head)) {
+                myshell_view_drop(store, view);
+            }
+            // Only a head not yet named after the branch takes a copy of its name
+            if (id != 0 && id == store->head &&
+                !(store->head_branch && strncmp(store->head_branch, rec->key, rec->key_len) == 0 &&
+                  store->head_branch[rec->key_len] == '\0')) {
+                char *name = myshell_strndup(rec->key, rec->key_len);
+                if (!name) return false;
+                free(store->head_branch);
+                store->head_branch = name;
+            }
+            return true;
+        case MYSHELL_RECORD_TAG:
+            if (!myshell_hash_parse(rec->value, rec->value_len, &id)) id = 0;
+            return myshell_refs_put(rec->kind == MYSHELL_RECORD_BRANCH ? &store->branches : &store->tags,
+                                    rec->key, rec->key_len, id, rec->type);
+        default:
+            return true;
+    }
+
+    uint64_t key_hash = myshell_hash64n(rec->key, rec->key_len);
+    if (!tombstone && !myshell_objects_put(&store->objects, myshell_blob_id(rec), MYSHELL_OBJECT_BLOB,
+                                           rec->offset, rec->size)) {
+        return false;
+    }
+    myshell_index_slot_t *old = myshell_index_find(store->keys, rec->key, rec->key_len, key_hash);
+    if (old) store->garbage += old->length;
+    if (tombstone) store->garbage += rec->size;
+    return myshell_index_put(store->keys, rec->key, rec->key_len, key_hash, rec->offset, tombstone ? 0 : rec->size);
+}
+
+/** Reads exactly @p len bytes at @p offset without moving the stdio position. */
+static bool myshell_pread(FILE *file, void *buf, size_t len, uint64_t offset) {
+#if defined(_WIN32) || defined(_WIN64)
+    HANDLE handle = (HANDLE)_get_osfhandle(_fileno(file));
+    if (handle == INVALID_HANDLE_VALUE) return false;
+    OVERLAPPED ov;
+    memset(&ov, 0, sizeof(ov));
+    ov.Offset = (DWORD)(offset & 0xFFFFFFFFu);
+    ov.OffsetHigh = (DWORD)(offset >> 32);
+    DWORD got = 0;
+    return ReadFile(handle, buf, (DWORD)len, &got, &ov) && got == (DWORD)len;
+#else
+    int fd = fileno(file);
+    char *p = (char *)buf;
+    while (len > 0) {
+        ssize_t n = pread(fd, p, len, (off_t)offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    return true;
+#endif
+}
+
+/**
+ * Whether no intact record starts anywhere in (from, size): the bytes from a
+ * damaged record on are then leftovers of an append cut short, such as a
+ * zero-filled tail a file system extended the file with before the data
+ * reached it, rather than records that corruption cut off. @p map, when
+ * given, covers [0, size).
+ */
+static bool myshell_tail_is_torn(FILE *file, const char *map, uint64_t from, uint64_t size) {
+    size_t len = (size_t)(size - from);
+    char *heap = NULL;
+    const char *tail = map ? map + from : NULL;
+    if (!tail) {
+        heap = (char *)malloc(len);
+        if (!heap || !myshell_pread(file, heap, len, from)) {
+            free(heap);
+            return false;
+        }
+        tail = heap;
+    }
+    bool torn = true;
+    for (size_t p = 1; torn && p + MYSHELL_RECORD_HEADER_SIZE <= len; ++p) {
+        const uint8_t *header = (const uint8_t *)tail + p;
+        if (!myshell_record_header_valid(header)) continue;
+        uint64_t rec_len = (uint64_t)MYSHELL_RECORD_HEADER_SIZE + myshell_get_u32(header + 8) +
+                           myshell_get_u32(header + 12);
+        myshell_record_t rec;
+        torn = rec_len > len - p || !myshell_record_decode(tail + p, (size_t)rec_len, &rec);
+    }
+    free(heap);
+    return torn;
+}
+
+/**
+ * Scans the whole file once, validating FSON types and replaying the log into
+ * a fresh store that replaces db->cache. Also refreshes db->file_size. Files
+ * without the v2 header (such as v1 text files) are VERSION_UNSUPPORTED; an
+ * empty file is given a header.
+ */
+static fossil_bluecrab_myshell_error_t myshell_store_load(fossil_bluecrab_myshell_t *db) {
+    if (myshell_fseek(db->file, 0, SEEK_END) != 0) {
+        return FOSSIL_MYSHELL_ERROR_IO;
+    }
+    int64_t size = myshell_ftell(db->file);
+    if (size < 0 || myshell_fseek(db->file, 0, SEEK_SET) != 0) {
+        return FOSSIL_MYSHELL_ERROR_IO;
+    }
+    if (size == 0) {
+        if (!myshell_file_header_write(db->file) || fflush(db->file) != 0) {
+            return FOSSIL_MYSHELL_ERROR_IO;
+        }
+        size = MYSHELL_FILE_HEADER_SIZE;
+        myshell_fseek(db->file, 0, SEEK_SET);
+    }
+    fossil_bluecrab_myshell_error_t result = myshell_file_header_read(db->file);
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        return result;
+    }
+
+    myshell_store_t *store = myshell_store_new();
+    if (!store) return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+
+    // The replay parses records in place from a mapping of the file when it can
+    store->log.written = (uint64_t)size;
+    myshell_cursor_t cur;
+    myshell_record_t rec;
+    uint64_t batch_start = 0;
+    uint64_t batch_end = 0;
+    myshell_map_open(&store->map, db->file, (uint64_t)size);
+    myshell_cursor_open(&cur, db->file, store->map.data, MYSHELL_FILE_HEADER_SIZE, (uint64_t)size);
+    while (result == FOSSIL_MYSHELL_ERROR_SUCCESS && myshell_cursor_next(&cur, &rec)) {
+        if (rec.type > MYSHELL_FSON_TYPE_DURATION) {
+            result = FOSSIL_MYSHELL_ERROR_CONFIG_INVALID;
+        } else if (rec.kind == MYSHELL_RECORD_BATCH) {
+            if (rec.key_len != 0 || rec.value_len != 8) {
+                result = FOSSIL_MYSHELL_ERROR_CORRUPTED;
+            }
+            const uint8_t *span = (const uint8_t *)rec.value;
+            batch_start = rec.offset;
+            batch_end = rec.offset + rec.size + ((uint64_t)myshell_get_u32(span + 4) << 32 | myshell_get_u32(span));
+        }
+        if (result == FOSSIL_MYSHELL_ERROR_SUCCESS && !myshell_store_apply(store, &rec)) {
+            result = FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+        }
+    }
+    myshell_cursor_close(&cur);
+
+    // Every record is appended whole, so a last record that runs past the end
+    // of the file or fails its checksum is a write cut short by a crash and is
+    // dropped, and so is a damaged record, all-zero header included, with no
+    // intact record anywhere after it. A damaged record followed by intact
+    // ones is real corruption.
+    uint64_t end = cur.offset;
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        result = cur.result;
+        bool torn = result == FOSSIL_MYSHELL_ERROR_CORRUPTED ||
+                    (result == FOSSIL_MYSHELL_ERROR_INTEGRITY &&
+                     (rec.offset + rec.size == (uint64_t)size ||
+                      myshell_tail_is_torn(db->file, store->map.data, end, (uint64_t)size)));
+
+        // A batch is all or nothing: if the file ends inside one, even on a
+        // record boundary, it goes whole and the shorter file is replayed again
+        if (batch_end > (uint64_t)size || (torn && batch_end > end && rec.offset >= batch_start)) {
+            myshell_store_free(store);
+            if (!myshell_file_truncate(db->file, batch_start)) {
+                return FOSSIL_MYSHELL_ERROR_IO;
+            }
+            return myshell_store_load(db);
+        }
+        if (torn) {
+            myshell_map_close(&store->map);
+            result = myshell_file_truncate(db->file, end) ? FOSSIL_MYSHELL_ERROR_SUCCESS : FOSSIL_MYSHELL_ERROR_IO;
+        } else if (result == FOSSIL_MYSHELL_ERROR_INTEGRITY) {
+            result = FOSSIL_MYSHELL_ERROR_CORRUPTED;
+        }
+    }
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        myshell_store_free(store);
+        return result;
+    }
+
+    if (db->cache) {
+        store->map_epoch = ((myshell_store_t *)db->cache)->map_epoch + 1;
+    }
+    myshell_store_free((myshell_store_t *)db->cache);
+    db->cache = store;
+    db->file_size = (size_t)end;
+    store->log.written = end;
+    store->log.last_sync_ms = myshell_now_ms();
+    myshell_fseek(db->file, 0, SEEK_SET);
+    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+}
+
+/**
+ * Writes the group buffer to the end of the file in one write. Anything that
+ * reads the file back, or writes to it directly, flushes first.
+ */
+static fossil_bluecrab_myshell_error_t myshell_log_flush(fossil_bluecrab_myshell_t *db) {
+    myshell_log_t *log = &((myshell_store_t *)db->cache)->log;
+    if (log->pending_len == 0) {
+        return FOSSIL_MYSHELL_ERROR_SUCCESS;
+    }
+    if (myshell_fseek(db->file, 0, SEEK_END) != 0 ||
+        fwrite(log->pending, 1, log->pending_len, db->file) != log->pending_len ||
+        fflush(db->file) != 0) {
+        return FOSSIL_MYSHELL_ERROR_IO;
+    }
+    log->written += log->pending_len;
+    log->pending_len = 0;
+    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+}
+
+/** Flushes the group buffer and makes the file durable. */
+static fossil_bluecrab_myshell_error_t myshell_log_sync(fossil_bluecrab_myshell_t *db) {
+    myshell_log_t *log = &((myshell_store_t *)db->cache)->log;
+    fossil_bluecrab_myshell_error_t result = myshell_log_flush(db);
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        return result;
+    }
+    if (!myshell_file_sync(db->file)) {
+        return FOSSIL_MYSHELL_ERROR_IO;
+    }
+    log->last_sync_ms = myshell_now_ms();
+    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+}
+
+/**
+ * Applies the durability mode after an append: a commit is a group boundary
+ * (written out, and synced in COMMIT mode); INTERVAL syncs once the interval
+ * has passed; a full group buffer is written out in every mode.
+ */
+static fossil_bluecrab_myshell_error_t myshell_log_settle(fossil_bluecrab_myshell_t *db, bool commit) {
+    myshell_log_t *log = &((myshell_store_t *)db->cache)->log;
+    if (log->durability == FOSSIL_MYSHELL_DURABILITY_COMMIT && commit) {
+        return myshell_log_sync(db);
+    }
+    if (log->durability == FOSSIL_MYSHELL_DURABILITY_INTERVAL &&
+        myshell_now_ms() - log->last_sync_ms >= log->sync_interval_ms) {
+        return myshell_log_sync(db);
+    }
+    if (commit || log->pending_len >= MYSHELL_LOG_BUFFER) {
+        return myshell_log_flush(db);
+    }
+    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+}
+
+/**
+ * Encodes one record into the log's group buffer. Returns the record's offset
+ * in the file and its length.
+ */
+static fossil_bluecrab_myshell_error_t myshell_append_record(fossil_bluecrab_myshell_t *db, uint8_t kind, uint8_t type,
+                                                             const char *key, size_t key_len,
+                                                             const char *value, size_t value_len,
+                                                             uint64_t *offset, size_t *length) {
+    myshell_log_t *log = &((myshell_store_t *)db->cache)->log;
+    if (key_len > UINT32_MAX || value_len > UINT32_MAX) {
+        return FOSSIL_MYSHELL_ERROR_CAPACITY_EXCEEDED;
+    }
+    size_t needed = MYSHELL_RECORD_HEADER_SIZE + key_len + value_len;
+    if (!myshell_buffer_reserve(&log->pending, &log->pending_cap, log->pending_len, needed)) {
+        return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+    }
+    myshell_record_encode(log->pending + log->pending_len, kind, type, key, (uint32_t)key_len,
+                          value, (uint32_t)value_len);
+
+    *offset = log->written + log->pending_len;
+    *length = needed;
+    log->pending_len += needed;
+    db->file_size = (size_t)(log->written + log->pending_len);
+    db->last_modified = time(NULL);
+    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+}
+
+/** Drops the records appended from @p offset on, all of them still in the group buffer. */
+static void myshell_log_truncate(fossil_bluecrab_myshell_t *db, uint64_t offset) {
+    myshell_log_t *log = &((myshell_store_t *)db->cache)->log;
+    log->pending_len = (size_t)(offset - log->written);
+    db->file_size = (size_t)offset;
+}
+
+/**
+ * Copies out a record the index points at: from the group buffer if it has
+ * not been written yet, from the current mapping if it covers the record,
+ * otherwise with a positioned read of the file.
+ */
+static bool myshell_read_at(const fossil_bluecrab_myshell_t *db, void *buf, size_t len, uint64_t offset) {
+    const myshell_store_t *store = (const myshell_store_t *)db->cache;
+    const myshell_log_t *log = &store->log;
+    if (offset >= log->written) {
+        if (offset - log->written + len > log->pending_len) return false;
+        memcpy(buf, log->pending + (offset - log->written), len);
+        return true;
+    }
+    if (store->map.data && offset + len <= store->map.size) {
+        memcpy(buf, store->map.data + offset, len);
+        return true;
+    }
+    return myshell_pread(db->file, buf, len, offset);
+}
+
+/**
+ * Returns the bytes of a record the index points at without copying them: in
+ * the group buffer if the record has not been written yet, otherwise in the
+ * mapping, remapped when the file has grown past it. Returns NULL when the
+ * file cannot be mapped.
+ */
+static const char *myshell_record_at(fossil_bluecrab_myshell_t *db, uint64_t offset, size_t len) {
+    const myshell_log_t *log = &((const myshell_store_t *)db->cache)->log;
+    if (offset >= log->written) {
+        if (offset - log->written + len > log->pending_len) return NULL;
+        return log->pending + (offset - log->written);
+    }
+    const char *map = myshell_map_cover(db, offset + len);
+    return map ? map + offset : NULL;
+}
+
+// *****************************************************************************
+// Write batches
+// *****************************************************************************
+
+/*
+ * A batch holds its puts and deletes already encoded as records, so applying
+ * it is one copy into the group buffer and one write. In the file the records
+ * follow a batch record giving their total length: a crash that leaves the
+ * file ending inside that span drops the whole batch on the next open.
+ * A transaction is a batch hung off the handle, plus an index of its keys so
+ * reads inside the transaction see its own writes.
+ */
+struct fossil_bluecrab_myshell_batch {
+    char            *records;  /* encoded put and del records, in order */
+    size_t           len;
+    size_t           cap;
+    size_t           count;
+    myshell_index_t *keys;     /* transactions only: key -> latest record, length 0 once deleted */
+};
+
+static fossil_bluecrab_myshell_error_t myshell_batch_add(fossil_bluecrab_myshell_batch_t *batch, uint8_t kind,
+                                                         uint8_t type, const char *key, const char *value) {
+    size_t key_len = strlen(key);
+    size_t value_len = value ? strlen(value) : 0;
+    if (key_len > UINT32_MAX || value_len > UINT32_MAX) {
+        return FOSSIL_MYSHELL_ERROR_CAPACITY_EXCEEDED;
+    }
+    size_t needed = MYSHELL_RECORD_HEADER_SIZE + key_len + value_len;
+    if (!myshell_buffer_reserve(&batch->records, &batch->cap, batch->len, needed)) {
+        return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+    }
+    if (batch->keys && !myshell_index_put(batch->keys, key, key_len, myshell_hash64n(key, key_len), batch->len,
+                                          kind == MYSHELL_RECORD_DEL ? 0 : needed)) {
+        return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+    }
+    myshell_record_encode(batch->records + batch->len, kind, type, key, (uint32_t)key_len, value, (uint32_t)value_len);
+    batch->len += needed;
+    batch->count++;
+    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+}
+
+/** Decodes the record at @p pos of @p batch, which lands at @p base + pos in the file. */
+static void myshell_batch_record(const fossil_bluecrab_myshell_batch_t *batch, size_t pos, uint64_t base,
+                                 myshell_record_t *rec) {
+    const uint8_t *header = (const uint8_t *)batch->records + pos;
+    rec->kind = header[4];
+    rec->type = header[5];
+    rec->key_len = myshell_get_u32(header + 8);
+    rec->value_len = myshell_get_u32(header + 12);
+    rec->key = batch->records + pos + MYSHELL_RECORD_HEADER_SIZE;
+    rec->value = rec->key + rec->key_len;
+    rec->offset = base + pos;
+    rec->size = MYSHELL_RECORD_HEADER_SIZE + (size_t)rec->key_len + rec->value_len;
+}
+
+/** Frees the key slots myshell_batch_reserve took for the records of @p batch before @p end. */
+static void myshell_batch_release(myshell_store_t *store, const fossil_bluecrab_myshell_batch_t *batch, size_t end) {
+    myshell_record_t rec;
+    for (size_t pos = 0; pos < end; pos += rec.size) {
+        myshell_batch_record(batch, pos, 0, &rec);
+        uint64_t key_hash = myshell_hash64n(rec.key, rec.key_len);
+        const myshell_index_slot_t *slot = myshell_index_find(store->keys, rec.key, rec.key_len, key_hash);
+        if (slot && slot->offset == MYSHELL_INDEX_RESERVED) {
+            myshell_index_remove(store->keys, rec.key, rec.key_len, key_hash);
+        }
+    }
+}
+
+/**
+ * Makes room for everything writing @p batch needs: the group buffer space,
+ * the object ids of its values and a key slot for each key the view has no
+ * write for yet. Once this succeeds, appending and applying the batch cannot
+ * fail, so a batch is never left half applied. On failure nothing is held.
+ */
+static fossil_bluecrab_myshell_error_t myshell_batch_reserve(fossil_bluecrab_myshell_t *db,
+                                                             const fossil_bluecrab_myshell_batch_t *batch) {
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    myshell_log_t *log = &store->log;
+    if (!myshell_buffer_reserve(&log->pending, &log->pending_cap, log->pending_len,
+                                MYSHELL_RECORD_HEADER_SIZE + 8 + batch->len)) {
+        return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+    }
+    size_t count = 0;
+    myshell_record_t rec;
+    for (size_t pos = 0; pos < batch->len; pos += rec.size) {
+        myshell_batch_record(batch, pos, 0, &rec);
+        uint64_t key_hash = myshell_hash64n(rec.key, rec.key_len);
+        if (!myshell_index_find(store->keys, rec.key, rec.key_len, key_hash) &&
+            !myshell_index_put(store->keys, rec.key, rec.key_len, key_hash, MYSHELL_INDEX_RESERVED, 0)) {
+            myshell_batch_release(store, batch, pos);
+            return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+        }
+        count++;
+    }
+    if (!myshell_objects_reserve(&store->objects, count)) {
+        myshell_batch_release(store, batch, batch->len);
+        return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+    }
+    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+}
+
+/**
+ * Appends @p batch, reserved beforehand, to the group buffer behind a batch
+ * record spanning it, whose offset goes to @p marker_offset. The records are
+ * not indexed yet; returns where they start.
+ */
+static uint64_t myshell_batch_append(fossil_bluecrab_myshell_t *db, const fossil_bluecrab_myshell_batch_t *batch,
+                                     uint64_t *marker_offset) {
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    myshell_log_t *log = &store->log;
+    uint8_t span_bytes[8];
+    myshell_put_u32(span_bytes, (uint32_t)batch->len);
+    myshell_put_u32(span_bytes + 4, (uint32_t)((uint64_t)batch->len >> 32));
+    size_t length;
+    myshell_append_record(db, MYSHELL_RECORD_BATCH, MYSHELL_FSON_TYPE_NULL, "", 0,
+                          (const char *)span_bytes, sizeof(span_bytes), marker_offset, &length);
+
+    uint64_t base = log->written + log->pending_len;
+    if (batch->len) memcpy(log->pending + log->pending_len, batch->records, batch->len);
+    log->pending_len += batch->len;
+    db->file_size = (size_t)(log->written + log->pending_len);
+    return base;
+}
+
+/** Indexes the records of @p batch appended at @p base. Cannot fail once the batch was reserved. */
+static void myshell_batch_index(myshell_store_t *store, const fossil_bluecrab_myshell_batch_t *batch, uint64_t base) {
+    // The batch record itself only matters until the file is compacted
+    store->garbage += MYSHELL_RECORD_HEADER_SIZE + 8;
+    myshell_record_t rec;
+    for (size_t pos = 0; pos < batch->len; pos += rec.size) {
+        myshell_batch_record(batch, pos, base, &rec);
+        myshell_store_apply(store, &rec);
+    }
+}
+
+/**
+ * Appends @p batch to the group buffer behind a batch record spanning it,
+ * whose offset goes to @p marker_offset, and indexes its records. All or
+ * nothing: on failure neither the file nor the index has changed.
+ */
+static fossil_bluecrab_myshell_error_t myshell_batch_write(fossil_bluecrab_myshell_t *db,
+                                                           const fossil_bluecrab_myshell_batch_t *batch,
+                                                           uint64_t *marker_offset) {
+    fossil_bluecrab_myshell_error_t result = myshell_batch_reserve(db, batch);
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        return result;
+    }
+    uint64_t base = myshell_batch_append(db, batch, marker_offset);
+    myshell_batch_index((myshell_store_t *)db->cache, batch, base);
+    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+}
+
+/**
+ * Takes back everything appended from @p marker_offset on, before any of it
+ * was indexed: the records leave the group buffer, the object ids entered for
+ * them are dropped and the key slots held for @p batch (if given) are freed.
+ */
+static void myshell_batch_undo(fossil_bluecrab_myshell_t *db, const fossil_bluecrab_myshell_batch_t *batch,
+                               uint64_t marker_offset) {
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    if (batch) {
+        myshell_batch_release(store, batch, batch->len);
+    }
+    myshell_log_truncate(db, marker_offset);
+    myshell_objects_truncate(&store->objects, marker_offset);
+}
+
+/**
+ * Stretches the batch record at @p marker_offset, still in the group buffer,
+ * over everything appended after it since: a transaction's commit and the
+ * tree nodes of its snapshot join the batch.
+ */
+static void myshell_batch_extend(fossil_bluecrab_myshell_t *db, uint64_t marker_offset) {
+    myshell_log_t *log = &((myshell_store_t *)db->cache)->log;
+    size_t marker = MYSHELL_RECORD_HEADER_SIZE + 8;
+    char *p = log->pending + (marker_offset - log->written);
+    uint64_t span = log->written + log->pending_len - (marker_offset + marker);
+    uint8_t span_bytes[8];
+    myshell_put_u32(span_bytes, (uint32_t)span);
+    myshell_put_u32(span_bytes + 4, (uint32_t)(span >> 32));
+    myshell_record_encode(p, MYSHELL_RECORD_BATCH, MYSHELL_FSON_TYPE_NULL, "", 0,
+                          (const char *)span_bytes, sizeof(span_bytes));
+}
+
+/** The open transaction's latest record for @p key, if it wrote one (length 0: deleted). */
+static const myshell_index_slot_t *myshell_txn_find(const myshell_store_t *store, const char *key) {
+    if (!store->txn) return NULL;
+    return myshell_index_find(store->txn->keys, key, strlen(key), myshell_hash64(key));
+}
+
+// *****************************************************************************
+// Snapshot trees
+// *****************************************************************************
+
+/*
+ * Every commit records a snapshot of all live keys as an immutable hash trie
+ * (a HAMT) stored content-addressed in the log. A node holds up to 32 entries,
+ * picked by 5 bits of the key hash per level; an entry is either a leaf (the
+ * id of the blob, i.e. the put record, holding the key's value) or a child
+ * node. Node records hold `DEPTH` then 18 bytes per entry: slot, 0 (child) or
+ * 1 (leaf), the 64-bit id it refers to and, for leaves, the key hash. A node's
+ * id is the hash of those bytes, so equal subtrees are one record.
+ *
+ * A commit copies only the path from the root to each key changed since the
+ * head snapshot and writes only those nodes; everything else is shared with
+ * the parent. A node is kept canonical (no child holding a single leaf), so
+ * equal key sets give equal trees whatever the order of the writes. A read
+ * that misses the view's overlay walks down from its root in place, reading
+ * the node records straight out of the mapping.
+ */
+#define MYSHELL_TREE_BITS  5
+#define MYSHELL_TREE_DEPTH 13  /* levels 0..12 consume the 64 hash bits; 13 holds full-hash collisions */
+#define MYSHELL_TREE_ENTRY 18
+
+typedef struct myshell_tree_node myshell_tree_node_t;
+
+typedef struct {
+    uint8_t  slot;
+    uint8_t  leaf;             /* 1: ref is a blob id, 0: ref is a child node id */
+    uint64_t ref;
+    uint64_t key_hash;         /* leaves only */
+    myshell_tree_node_t *child; /* the child once loaded or built, else NULL */
+} myshell_tree_entry_t;
+
+struct myshell_tree_node {
+    uint8_t depth;
+    bool    dirty;             /* changed since it was loaded: must be written */
+    myshell_tree_entry_t *entries;
+    size_t  count;
+    size_t  cap;
+};
+
+static size_t myshell_tree_slot(uint64_t key_hash, uint8_t depth) {
+    return depth >= MYSHELL_TREE_DEPTH ? 0 : (size_t)(key_hash >> (MYSHELL_TREE_BITS * depth)) & 31u;
+}
+
+static void myshell_tree_free(myshell_tree_node_t *node) {
+    if (!node) return;
+    for (size_t i = 0; i < node->count; ++i) {
+        myshell_tree_free(node->entries[i].child);
+    }
+    free(node->entries);
+    free(node);
+}
+
+static myshell_tree_node_t *myshell_tree_new(uint8_t depth) {
+    myshell_tree_node_t *node = (myshell_tree_node_t *)calloc(1, sizeof(myshell_tree_node_t));
+    if (node) node->depth = depth;
+    return node;
+}
+
+/** Inserts @p entry at position @p at of @p node. */
+static bool myshell_tree_insert_at(myshell_tree_node_t *node, size_t at, const myshell_tree_entry_t *entry) {
+    if (node->count == node->cap) {
+        size_t cap = node->cap ? node->cap * 2 : 4;
+        myshell_tree_entry_t *grown = (myshell_tree_entry_t *)realloc(node->entries, cap * sizeof(*grown));
+        if (!grown) return false;
+        node->entries = grown;
+        node->cap = cap;
+    }
+    memmove(node->entries + at + 1, node->entries + at, (node->count - at) * sizeof(*entry));
+    node->entries[at] = *entry;
+    node->count++;
+    node->dirty = true;
+    return true;
+}
+
+static void myshell_tree_remove_at(myshell_tree_node_t *node, size_t at) {
+    myshell_tree_free(node->entries[at].child);
+    memmove(node->entries + at, node->entries + at + 1, (node->count - at - 1) * sizeof(myshell_tree_entry_t));
+    node->count--;
+    node->dirty = true;
+}
+
+/**
+ * Decodes the record behind object @p obj into @p rec: in place when it can be
+ * mapped, else copied into @p *heap, which the caller frees. The bytes stay
+ * valid only until the next append or remap.
+ */
+static fossil_bluecrab_myshell_error_t myshell_object_record(fossil_bluecrab_myshell_t *db, const myshell_object_t *obj,
+                                                             myshell_record_t *rec, char **heap) {
+    *heap = NULL;
+    const char *bytes = myshell_record_at(db, obj->offset, obj->length);
+    if (!bytes) {
+        *heap = (char *)malloc(obj->length);
+        if (!*heap) return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+        if (!myshell_read_at(db, *heap, obj->length, obj->offset)) return FOSSIL_MYSHELL_ERROR_IO;
+        bytes = *heap;
+    }
+    if (!myshell_record_decode(bytes, obj->length, rec)) {
+        return FOSSIL_MYSHELL_ERROR_INDEX_CORRUPTED;
+    }
+    rec->offset = obj->offset;
+    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+}
+
+/**
+ * Like myshell_object_record, but for reads on a hot path: a record found in
+ * place is taken as it is, without checking its checksum again, as the replay
+ * or the append that indexed it already did.
+ */
+static fossil_bluecrab_myshell_error_t myshell_object_peek(fossil_bluecrab_myshell_t *db, const myshell_object_t *obj,
+                                                           myshell_record_t *rec, char **heap) {
+    const char *bytes = myshell_record_at(db, obj->offset, obj->length);
+    if (!bytes) {
+        return myshell_object_record(db, obj, rec, heap);
+    }
+    *heap = NULL;
+    const uint8_t *header = (const uint8_t *)bytes;
+    uint32_t key_len = myshell_get_u32(header + 8);
+    uint32_t value_len = myshell_get_u32(header + 12);
+    if ((uint64_t)MYSHELL_RECORD_HEADER_SIZE + key_len + value_len != obj->length) {
+        return FOSSIL_MYSHELL_ERROR_INDEX_CORRUPTED;
+    }
+    rec->kind = header[4];
+    rec->type = header[5];
+    rec->key = bytes + MYSHELL_RECORD_HEADER_SIZE;
+    rec->key_len = key_len;
+    rec->value = rec->key + key_len;
+    rec->value_len = value_len;
+    rec->offset = obj->offset;
+    rec->size = obj->length;
+    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+}
+
+/** Decodes the entries of a node record's value; their children are left unloaded. */
+static bool myshell_tree_decode(const myshell_record_t *rec, myshell_tree_node_t *node) {
+    if (rec->kind != MYSHELL_RECORD_NODE || rec->value_len < 1 ||
+        (rec->value_len - 1) % MYSHELL_TREE_ENTRY != 0) {
+        return false;
+    }
+    const uint8_t *p = (const uint8_t *)rec->value;
+    size_t count = (rec->value_len - 1) / MYSHELL_TREE_ENTRY;
+    node->depth = p[0];
+    node->entries = (myshell_tree_entry_t *)calloc(count ? count : 1, sizeof(myshell_tree_entry_t));
+    if (!node->entries) return false;
+    node->cap = count ? count : 1;
+    for (p += 1; node->count < count; p += MYSHELL_TREE_ENTRY) {
+        myshell_tree_entry_t *e = &node->entries[node->count++];
+        e->slot = p[0];
+        e->leaf = p[1];
+        e->ref = (uint64_t)myshell_get_u32(p + 6) << 32 | myshell_get_u32(p + 2);
+        e->key_hash = (uint64_t)myshell_get_u32(p + 14) << 32 | myshell_get_u32(p + 10);
+    }
+    return true;
+}
+
+/** Loads node @p id (0: the empty tree) as a fresh in-memory node at @p depth. */
+static fossil_bluecrab_myshell_error_t myshell_tree_load(fossil_bluecrab_myshell_t *db, uint64_t id, uint8_t depth,
+                                                         myshell_tree_node_t **out) {
+    *out = myshell_tree_new(depth);
+    if (!*out) return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+    if (id == 0) return FOSSIL_MYSHELL_ERROR_SUCCESS;
+    const myshell_object_t *obj = myshell_objects_find(&((myshell_store_t *)db->cache)->objects, id, MYSHELL_OBJECT_NODE);
+    if (!obj) return FOSSIL_MYSHELL_ERROR_INDEX_CORRUPTED;
+    myshell_record_t rec;
+    char *heap;
+    fossil_bluecrab_myshell_error_t result = myshell_object_record(db, obj, &rec, &heap);
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS && (!myshell_tree_decode(&rec, *out) || (*out)->depth != depth)) {
+        result = FOSSIL_MYSHELL_ERROR_INDEX_CORRUPTED;
+    }
+    free(heap);
+    return result;
+}
+
+/** Whether blob @p id is the record of key @p key. */
+static fossil_bluecrab_myshell_error_t myshell_blob_key_is(fossil_bluecrab_myshell_t *db, uint64_t id,
+                                                           const char *key, size_t key_len, bool *equal) {
+    const myshell_object_t *obj = myshell_objects_find(&((myshell_store_t *)db->cache)->objects, id, MYSHELL_OBJECT_BLOB);
+    if (!obj) return FOSSIL_MYSHELL_ERROR_INDEX_CORRUPTED;
+    myshell_record_t rec;
+    char *heap;
+    fossil_bluecrab_myshell_error_t result = myshell_object_peek(db, obj, &rec, &heap);
+    *equal = result == FOSSIL_MYSHELL_ERROR_SUCCESS && rec.key_len == key_len && memcmp(rec.key, key, key_len) == 0;
+    free(heap);
+    return result;
+}
+
+/** Finds the leaf of @p node for the key, or the position a new entry for @p slot goes to. */
+static fossil_bluecrab_myshell_error_t myshell_tree_seek(fossil_bluecrab_myshell_t *db, const myshell_tree_node_t *node,
+                                                         uint64_t key_hash, const char *key, size_t key_len,
+                                                         size_t *at, bool *found) {
+    *found = false;
+    if (node->depth < MYSHELL_TREE_DEPTH) {
+        size_t slot = myshell_tree_slot(key_hash, node->depth);
+        for (*at = 0; *at < node->count && node->entries[*at].slot < slot; ++*at) {}
+        *found = *at < node->count && node->entries[*at].slot == slot;
+        return FOSSIL_MYSHELL_ERROR_SUCCESS;
+    }
+
+    // A collision bucket: leaves sorted by key hash, told apart by their keys
+    for (*at = 0; *at < node->count && node->entries[*at].key_hash <= key_hash; ++*at) {
+        if (node->entries[*at].key_hash < key_hash) continue;
+        fossil_bluecrab_myshell_error_t result = myshell_blob_key_is(db, node->entries[*at].ref, key, key_len, found);
+        if (result != FOSSIL_MYSHELL_ERROR_SUCCESS || *found) return result;
+    }
+    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+}
+
+/** Makes sure the child of entry @p e is loaded. */
+static fossil_bluecrab_myshell_error_t myshell_tree_child(fossil_bluecrab_myshell_t *db, const myshell_tree_node_t *node,
+                                                          myshell_tree_entry_t *e) {
+    if (e->child) return FOSSIL_MYSHELL_ERROR_SUCCESS;
+    return myshell_tree_load(db, e->ref, (uint8_t)(node->depth + 1), &e->child);
+}
+
+/** Points @p key at blob @p blob in the tree under @p node, copying the path to it. */
+static fossil_bluecrab_myshell_error_t myshell_tree_put(fossil_bluecrab_myshell_t *db, myshell_tree_node_t *node,
+                                                        uint64_t key_hash, const char *key, size_t key_len,
+                                                        uint64_t blob) {
+    size_t at;
+    bool found;
+    fossil_bluecrab_myshell_error_t result = myshell_tree_seek(db, node, key_hash, key, key_len, &at, &found);
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) return result;
+    myshell_tree_entry_t leaf = { (uint8_t)myshell_tree_slot(key_hash, node->depth), 1, blob, key_hash, NULL };
+    if (!found) {
+        return myshell_tree_insert_at(node, at, &leaf) ? FOSSIL_MYSHELL_ERROR_SUCCESS : FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+    }
+
+    myshell_tree_entry_t *e = &node->entries[at];
+    if (e->leaf && e->ref == blob) {
+        return FOSSIL_MYSHELL_ERROR_SUCCESS;
+    }
+    if (e->leaf) {
+        bool same = node->depth >= MYSHELL_TREE_DEPTH;
+        if (!same && e->key_hash == key_hash) {
+            result = myshell_blob_key_is(db, e->ref, key, key_len, &same);
+            if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) return result;
+        }
+        if (same) {
+            e->ref = blob;
+            node->dirty = true;
+            return FOSSIL_MYSHELL_ERROR_SUCCESS;
+        }
+
+        // Two keys share this slot: push the existing leaf one level down
+        myshell_tree_node_t *child = myshell_tree_new((uint8_t)(node->depth + 1));
+        myshell_tree_entry_t moved = *e;
+        moved.slot = (uint8_t)myshell_tree_slot(e->key_hash, child ? child->depth : 0);
+        if (!child || !myshell_tree_insert_at(child, 0, &moved)) {
+            myshell_tree_free(child);
+            return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+        }
+        e->leaf = 0;
+        e->ref = 0;
+        e->key_hash = 0;
+        e->child = child;
+        node->dirty = true;
+    }
+    result = myshell_tree_child(db, node, e);
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        result = myshell_tree_put(db, e->child, key_hash, key, key_len, blob);
+    }
+    if (e->child && e->child->dirty) node->dirty = true;
+    return result;
+}
+
+/** Removes @p key from the tree under @p node, folding up children left with a single leaf. */
+static fossil_bluecrab_myshell_error_t myshell_tree_del(fossil_bluecrab_myshell_t *db, myshell_tree_node_t *node,
+                                                        uint64_t key_hash, const char *key, size_t key_len) {
+    size_t at;
+    bool found;
+    fossil_bluecrab_myshell_error_t result = myshell_tree_seek(db, node, key_hash, key, key_len, &at, &found);
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS || !found) return result;
+
+    myshell_tree_entry_t *e = &node->entries[at];
+    if (e->leaf) {
+        bool same = node->depth >= MYSHELL_TREE_DEPTH;
+        if (!same && e->key_hash == key_hash) {
+            result = myshell_blob_key_is(db, e->ref, key, key_len, &same);
+        }
+        if (same) myshell_tree_remove_at(node, at);
+        return result;
+    }
+    result = myshell_tree_child(db, node, e);
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        result = myshell_tree_del(db, e->child, key_hash, key, key_len);
+    }
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS || !e->child->dirty) return result;
+    node->dirty = true;
+    if (e->child->count == 0) {
+        myshell_tree_remove_at(node, at);
+    } else if (e->child->count == 1 && e->child->entries[0].leaf) {
+        myshell_tree_node_t *child = e->child;
+        uint8_t slot = e->slot;
+        *e = child->entries[0];
+        e->slot = slot;
+        child->count = 0;
+        myshell_tree_free(child);
+    }
+    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+}
+
+/**
+ * Finds the blob @p key points at in the tree @p root; 0 when the key is not
+ * there. Node records are read in place, one per level; only a collision
+ * bucket at the bottom is loaded as a node.
+ */
+static fossil_bluecrab_myshell_error_t myshell_tree_lookup(fossil_bluecrab_myshell_t *db, uint64_t root,
+                                                           uint64_t key_hash, const char *key, size_t key_len,
+                                                           uint64_t *blob) {
+    const myshell_objects_t *objects = &((myshell_store_t *)db->cache)->objects;
+    *blob = 0;
+    uint8_t depth = 0;
+    for (; root && depth < MYSHELL_TREE_DEPTH; ++depth) {
+        const myshell_object_t *obj = myshell_objects_find(objects, root, MYSHELL_OBJECT_NODE);
+        if (!obj) return FOSSIL_MYSHELL_ERROR_INDEX_CORRUPTED;
+        myshell_record_t rec;
+        char *heap;
+        fossil_bluecrab_myshell_error_t result = myshell_object_peek(db, obj, &rec, &heap);
+        if (result == FOSSIL_MYSHELL_ERROR_SUCCESS &&
+            (rec.kind != MYSHELL_RECORD_NODE || rec.value_len < 1 || (rec.value_len - 1) % MYSHELL_TREE_ENTRY != 0 ||
+             (uint8_t)rec.value[0] != depth)) {
+            result = FOSSIL_MYSHELL_ERROR_INDEX_CORRUPTED;
+        }
+        if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+            free(heap);
+            return result;
+        }
+
+        // Entries are sorted by slot; the key's slot holds a leaf, a child or nothing
+        size_t slot = myshell_tree_slot(key_hash, depth);
+        const uint8_t *p = (const uint8_t *)rec.value + 1;
+        const uint8_t *end = (const uint8_t *)rec.value + rec.value_len;
+        for (; p < end && p[0] < slot; p += MYSHELL_TREE_ENTRY) {}
+        bool hit = p < end && p[0] == slot;
+        bool leaf = hit && p[1];
+        uint64_t ref = hit ? (uint64_t)myshell_get_u32(p + 6) << 32 | myshell_get_u32(p + 2) : 0;
+        uint64_t leaf_hash = hit ? (uint64_t)myshell_get_u32(p + 14) << 32 | myshell_get_u32(p + 10) : 0;
+        free(heap);
+        if (!leaf) {
+            root = ref;
+            continue;
+        }
+        if (leaf_hash != key_hash) return FOSSIL_MYSHELL_ERROR_SUCCESS;
+        bool same = false;
+        result = myshell_blob_key_is(db, ref, key, key_len, &same);
+        if (same) *blob = ref;
+        return result;
+    }
+    if (!root) return FOSSIL_MYSHELL_ERROR_SUCCESS;
+
+    // Keys whose whole hash collides share a bucket, told apart by their keys
+    myshell_tree_node_t *bucket;
+    size_t at;
+    bool found = false;
+    fossil_bluecrab_myshell_error_t result = myshell_tree_load(db, root, depth, &bucket);
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        result = myshell_tree_seek(db, bucket, key_hash, key, key_len, &at, &found);
+    }
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS && found) *blob = bucket->entries[at].ref;
+    myshell_tree_free(bucket);
+    return result;
+}
+
+/**
+ * Finds the record holding @p key's value in the checked-out view: the
+ * overlay's latest put, else the blob the head snapshot has for it.
+ * NOT_FOUND when the overlay deleted the key or neither has it.
+ */
+static fossil_bluecrab_myshell_error_t myshell_view_get(fossil_bluecrab_myshell_t *db, const char *key, size_t key_len,
+                                                        uint64_t key_hash, uint64_t *offset, size_t *length) {
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    const myshell_index_slot_t *slot = myshell_index_find(store->keys, key, key_len, key_hash);
+    if (slot) {
+        *offset = slot->offset;
+        *length = slot->length;
+        return slot->length ? FOSSIL_MYSHELL_ERROR_SUCCESS : FOSSIL_MYSHELL_ERROR_NOT_FOUND;
+    }
+    uint64_t blob;
+    fossil_bluecrab_myshell_error_t result = myshell_tree_lookup(db, store->head_root, key_hash, key, key_len, &blob);
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) return result;
+    if (!blob) return FOSSIL_MYSHELL_ERROR_NOT_FOUND;
+    const myshell_object_t *obj = myshell_objects_find(&store->objects, blob, MYSHELL_OBJECT_BLOB);
+    if (!obj) return FOSSIL_MYSHELL_ERROR_INDEX_CORRUPTED;
+    *offset = obj->offset;
+    *length = obj->length;
+    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+}
+
+/**
+ * Appends one record and replays it into the store like a record read back
+ * from the file, so the in-memory state never differs from a reopen.
+ */
+static fossil_bluecrab_myshell_error_t myshell_append_applied(fossil_bluecrab_myshell_t *db, uint8_t kind, uint8_t type,
+                                                              const char *key, size_t key_len,
+                                                              const char *value, size_t value_len) {
+    uint64_t offset;
+    size_t length;
+    fossil_bluecrab_myshell_error_t result = myshell_append_record(db, kind, type, key, key_len, value, value_len,
+                                                                   &offset, &length);
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) return result;
+    myshell_record_t rec;
+    myshell_record_decode(myshell_record_at(db, offset, length), length, &rec);
+    rec.offset = offset;
+    return myshell_store_apply((myshell_store_t *)db->cache, &rec) ? FOSSIL_MYSHELL_ERROR_SUCCESS
+                                                                    : FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+}
+
+/**
+ * Journals the whole staging area: a stage record for each staged key, in
+ * staging order. Used when journaling is turned on and after compaction,
+ * which drops the journal records it copies.
+ */
+static fossil_bluecrab_myshell_error_t myshell_stage_journal(fossil_bluecrab_myshell_t *db) {
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    myshell_stage_pack(store);
+    fossil_bluecrab_myshell_error_t result = FOSSIL_MYSHELL_ERROR_SUCCESS;
+    for (size_t pos = 0; pos < store->stage.len && result == FOSSIL_MYSHELL_ERROR_SUCCESS;) {
+        myshell_record_t rec;
+        const uint8_t *header = (const uint8_t *)store->stage.records + pos;
+        size_t size = MYSHELL_RECORD_HEADER_SIZE + (size_t)myshell_get_u32(header + 8) + myshell_get_u32(header + 12);
+        myshell_record_decode(store->stage.records + pos, size, &rec);
+        uint64_t offset;
+        size_t length;
+        result = myshell_append_record(db, MYSHELL_RECORD_STAGE, rec.type, rec.key, rec.key_len, rec.value,
+                                       rec.value_len, &offset, &length);
+        store->garbage += length;
+        pos += size;
+    }
+    return result;
+}
+
+/** Writes the changed nodes under @p node, children first, and returns its id (0 for an empty root). */
+static fossil_bluecrab_myshell_error_t myshell_tree_store(fossil_bluecrab_myshell_t *db, myshell_tree_node_t *node,
+                                                          uint64_t *id) {
+    fossil_bluecrab_myshell_error_t result = FOSSIL_MYSHELL_ERROR_SUCCESS;
+    for (size_t i = 0; i < node->count && result == FOSSIL_MYSHELL_ERROR_SUCCESS; ++i) {
+        myshell_tree_entry_t *e = &node->entries[i];
+        if (e->child && e->child->dirty) result = myshell_tree_store(db, e->child, &e->ref);
+    }
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS || node->count == 0) {
+        *id = 0;
+        return result;
+    }
+
+    size_t len = 1 + node->count * MYSHELL_TREE_ENTRY;
+    uint8_t *bytes = (uint8_t *)malloc(len);
+    if (!bytes) return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+    bytes[0] = node->depth;
+    for (size_t i = 0; i < node->count; ++i) {
+        const myshell_tree_entry_t *e = &node->entries[i];
+        uint8_t *p = bytes + 1 + i * MYSHELL_TREE_ENTRY;
+        p[0] = e->slot;
+        p[1] = e->leaf;
+        myshell_put_u32(p + 2, (uint32_t)e->ref);
+        myshell_put_u32(p + 6, (uint32_t)(e->ref >> 32));
+        myshell_put_u32(p + 10, (uint32_t)e->key_hash);
+        myshell_put_u32(p + 14, (uint32_t)(e->key_hash >> 32));
+    }
+    *id = myshell_hash64n((const char *)bytes, len);
+
+    // A node some earlier commit already wrote is shared, not written again
+    if (!myshell_objects_find(&((myshell_store_t *)db->cache)->objects, *id, MYSHELL_OBJECT_NODE)) {
+        result = myshell_append_applied(db, MYSHELL_RECORD_NODE, MYSHELL_FSON_TYPE_OBJECT, "", 0,
+                                        (const char *)bytes, len);
+    }
+    free(bytes);
+    node->dirty = false;
+    return result;
+}
+
+/**
+ * Builds the snapshot of the checked-out view: the head tree with every key
+ * of its overlay put or removed, then every key of @p batch (if given), whose
+ * records are appended at @p base but not indexed yet. Writes only the nodes
+ * that changed and returns the root id. The ids it enters for new nodes and
+ * for values only the batch holds point at or past @p base, so taking those
+ * records back takes them along.
+ */
+static fossil_bluecrab_myshell_error_t myshell_snapshot_write(fossil_bluecrab_myshell_t *db,
+                                                              const fossil_bluecrab_myshell_batch_t *batch,
+                                                              uint64_t base, uint64_t *root) {
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    size_t batch_len = batch ? batch->len : 0;
+    *root = store->head_root;
+    if (store->keys->count == 0 && batch_len == 0) {
+        return FOSSIL_MYSHELL_ERROR_SUCCESS;
+    }
+    myshell_tree_node_t *tree;
+    fossil_bluecrab_myshell_error_t result = myshell_tree_load(db, store->head_root, 0, &tree);
+    for (size_t i = 0; i < store->keys->capacity && result == FOSSIL_MYSHELL_ERROR_SUCCESS; ++i) {
+        const myshell_index_slot_t *live = &store->keys->slots[i];
+        if (!live->key || live->offset == MYSHELL_INDEX_RESERVED) continue;
+        size_t key_len = strlen(live->key);
+        if (live->length == 0) {
+            result = myshell_tree_del(db, tree, live->hash, live->key, key_len);
+            continue;
+        }
+        myshell_object_t obj = { 0, live->offset, live->length, MYSHELL_OBJECT_BLOB };
+        myshell_record_t rec;
+        char *heap;
+        result = myshell_object_record(db, &obj, &rec, &heap);
+        uint64_t blob = result == FOSSIL_MYSHELL_ERROR_SUCCESS ? myshell_blob_id(&rec) : 0;
+        free(heap);
+        if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) break;
+        if (!myshell_objects_put(&store->objects, blob, MYSHELL_OBJECT_BLOB, live->offset, live->length)) {
+            result = FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+        } else {
+            result = myshell_tree_put(db, tree, live->hash, live->key, key_len, blob);
+        }
+    }
+    myshell_record_t rec;
+    for (size_t pos = 0; pos < batch_len && result == FOSSIL_MYSHELL_ERROR_SUCCESS; pos += rec.size) {
+        myshell_batch_record(batch, pos, base, &rec);
+        uint64_t key_hash = myshell_hash64n(rec.key, rec.key_len);
+        if (rec.kind == MYSHELL_RECORD_DEL) {
+            result = myshell_tree_del(db, tree, key_hash, rec.key, rec.key_len);
+            continue;
+        }
+        uint64_t blob = myshell_blob_id(&rec);
+        if (!myshell_objects_find(&store->objects, blob, MYSHELL_OBJECT_BLOB) &&
+            !myshell_objects_put(&store->objects, blob, MYSHELL_OBJECT_BLOB, rec.offset, rec.size)) {
+            result = FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+        } else {
+            result = myshell_tree_put(db, tree, key_hash, rec.key, rec.key_len, blob);
+        }
+    }
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS && tree->dirty) {
+        result = myshell_tree_store(db, tree, root);
+    }
+    myshell_tree_free(tree);
+    return result;
+}
+
+/**
+ * Resolves @p name to a commit through the ref tables and the commit graph: a
+ * branch, then a tag, then a commit id. A name that is none of those may still
+ * be a commit named by the hash of that name, as revert and tag took them
+ * before commit ids were written out. @p is_branch, if given, tells whether a
+ * branch matched. O(1).
+ */
+static fossil_bluecrab_myshell_error_t myshell_graph_resolve(const myshell_store_t *store, const char *name,
+                                                             uint64_t *commit, bool *is_branch) {
+    size_t name_len = strlen(name);
+    const myshell_ref_t *ref = myshell_refs_find(&store->branches, name, name_len);
+    if (is_branch) *is_branch = ref != NULL;
+    if (!ref) ref = myshell_refs_find(&store->tags, name, name_len);
+    if (ref) {
+        *commit = ref->target;
+        return FOSSIL_MYSHELL_ERROR_SUCCESS;
+    }
+    if (myshell_hash_parse(name, name_len, commit) && myshell_graph_find(&store->graph, *commit)) {
+        return FOSSIL_MYSHELL_ERROR_SUCCESS;
+    }
+    *commit = myshell_hash64n(name, name_len);
+    return myshell_graph_find(&store->graph, *commit) ? FOSSIL_MYSHELL_ERROR_SUCCESS
+                                                       : FOSSIL_MYSHELL_ERROR_NOT_FOUND;
+}
+
+// *****************************************************************************
+// Log compaction
+// *****************************************************************************
+
+/*
+ * Compaction rewrites the log into `<path>.compact` keeping only the latest
+ * record of every live key plus all history records, then
+ * swaps it in with an atomic rename. The copy runs on a background thread and
+ * reads only the prefix of the file that existed when it started; that prefix
+ * never changes because the log is append-only, so the owning thread keeps
+ * reading and appending to the old file meanwhile. Records appended after the
+ * start (the tail) are copied over by the owning thread when it installs the
+ * result, just before the rename.
+ */
+#define MYSHELL_COMPACT_MIN_GARBAGE (16 * 1024)
+
+#if defined(_WIN32) || defined(_WIN64)
+typedef CRITICAL_SECTION myshell_mutex_t;
+typedef HANDLE myshell_thread_t;
+#define myshell_mutex_init(m)    InitializeCriticalSection(m)
+#define myshell_mutex_destroy(m) DeleteCriticalSection(m)
+#define myshell_mutex_lock(m)    EnterCriticalSection(m)
+#define myshell_mutex_unlock(m)  LeaveCriticalSection(m)
+#else
+typedef pthread_mutex_t myshell_mutex_t;
+typedef pthread_t myshell_thread_t;
+#define myshell_mutex_init(m)    pthread_mutex_init(m, NULL)
+#define myshell_mutex_destroy(m) pthread_mutex_destroy(m)
+#define myshell_mutex_lock(m)    pthread_mutex_lock(m)
+#define myshell_mutex_unlock(m)  pthread_mutex_unlock(m)
+#endif
+
+typedef struct myshell_compaction {
+    char            *path;        /* live database file */
+    char            *temp_path;   /* `<path>.compact` being written */
+    FILE            *out;
+    myshell_store_t *store;       /* index of the compacted file */
+    uint64_t        *live;        /* sorted offsets of the records to keep */
+    size_t           live_count;
+    uint64_t        *blobs;       /* sorted ids of the blobs some snapshot refers to */
+    size_t           blob_count;
+    uint64_t         end;         /* old file size at start; later records are the tail */
+    uint64_t         out_size;
+    uint64_t         rate;        /* bytes/s, 0 = unlimited */
+    myshell_thread_t thread;
+    myshell_mutex_t  mutex;       /* guards done and cancel */
+    bool             done;
+    bool             cancel;
+    fossil_bluecrab_myshell_error_t result;
+} myshell_compaction_t;
+
+/** Replaces @p path with @p temp_path in one step. */
+static bool myshell_replace_file(const char *temp_path, const char *path) {
+#if defined(_WIN32) || defined(_WIN64)
+    return MoveFileExA(temp_path, path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return rename(temp_path, path) == 0;
+#endif
+}
+
+static int myshell_offset_cmp(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void myshell_compaction_free(myshell_compaction_t *job) {
+    if (!job) return;
+    if (job->out) fclose(job->out);
+    if (job->temp_path) remove(job->temp_path);
+    myshell_store_free(job->store);
+    myshell_mutex_destroy(&job->mutex);
+    free(job->live);
+    free(job->blobs);
+    free(job->temp_path);
+    free(job->path);
+    free(job);
+}
+
+static bool myshell_compaction_cancelled(myshell_compaction_t *job) {
+    myshell_mutex_lock(&job->mutex);
+    bool cancel = job->cancel;
+    myshell_mutex_unlock(&job->mutex);
+    return cancel;
+}
+
+/**
+ * Returns the kind a record is copied as, 0 to drop it. History records,
+ * checkouts and tree nodes are kept; data records if some branch's view
+ * still holds them, and otherwise as blobs while a snapshot refers to them.
+ * Deletes are kept while a view holds them, as its next snapshot still has
+ * to see them. Staging journal records are dropped, as the staging area is
+ * journaled again on install. Batch records are dropped: the compacted file
+ * is swapped in whole anyway.
+ */
+static uint8_t myshell_compaction_keeps(const myshell_compaction_t *job, const myshell_record_t *rec) {
+    uint64_t id;
+    switch (rec->kind) {
+        case MYSHELL_RECORD_PUT:
+        case MYSHELL_RECORD_BLOB:
+            if (bsearch(&rec->offset, job->live, job->live_count, sizeof(uint64_t), myshell_offset_cmp)) {
+                return MYSHELL_RECORD_PUT;
+            }
+            id = myshell_blob_id(rec);
+            return job->blob_count && bsearch(&id, job->blobs, job->blob_count, sizeof(uint64_t), myshell_offset_cmp)
+                   ? MYSHELL_RECORD_BLOB : 0;
+        case MYSHELL_RECORD_DEL:
+            return bsearch(&rec->offset, job->live, job->live_count, sizeof(uint64_t), myshell_offset_cmp)
+                   ? MYSHELL_RECORD_DEL : 0;
+        case MYSHELL_RECORD_STAGE:
+        case MYSHELL_RECORD_UNSTAGE:
+        case MYSHELL_RECORD_BATCH:
+        case MYSHELL_RECORD_CHECKPOINT:
+            return 0;
+        default:
+            return rec->kind;
+    }
+}
+
+/** Appends one record to the compacted file and indexes it there. */
+static fossil_bluecrab_myshell_error_t myshell_compaction_emit(myshell_compaction_t *job, const myshell_record_t *rec) {
+    if (!myshell_record_write(job->out, rec->kind, rec->type, rec->key, rec->key_len, rec->value, rec->value_len)) {
+        return FOSSIL_MYSHELL_ERROR_IO;
+    }
+    myshell_record_t moved = *rec;
+    moved.offset = job->out_size;
+    if (!myshell_store_apply(job->store, &moved)) {
+        return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+    }
+    job->out_size += rec->size;
+    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+}
+
+/** Sleeps while more than job->rate bytes per second have been read since @p started. */
+static void myshell_compaction_throttle(const myshell_compaction_t *job, uint64_t started, uint64_t read) {
+    if (!job->rate) return;
+    uint64_t due = read * 1000u / job->rate;
+    uint64_t elapsed = myshell_now_ms() - started;
+    if (due > elapsed + 10) {
+        myshell_sleep_ms(due - elapsed > 100 ? 100 : due - elapsed);
+    }
+}
+
+/**
+ * Background pass 1: collects the blob ids the leaves of every tree node in
+ * [header, end) refer to, sorted. Any tree a commit ever had counts, so
+ * blobs of superseded history are kept too.
+ */
+static fossil_bluecrab_myshell_error_t myshell_compaction_blobs(myshell_compaction_t *job, FILE *in, const char *map,
+                                                                uint64_t started) {
+    fossil_bluecrab_myshell_error_t result = FOSSIL_MYSHELL_ERROR_SUCCESS;
+    size_t cap = 0;
+    myshell_cursor_t cur;
+    myshell_record_t rec;
+    myshell_cursor_open(&cur, in, map, MYSHELL_FILE_HEADER_SIZE, job->end);
+    while (result == FOSSIL_MYSHELL_ERROR_SUCCESS && myshell_cursor_next(&cur, &rec)) {
+        if (myshell_compaction_cancelled(job)) {
+            result = FOSSIL_MYSHELL_ERROR_CONCURRENCY;
+            break;
+        }
+        myshell_compaction_throttle(job, started, cur.offset);
+        if (rec.kind != MYSHELL_RECORD_NODE) continue;
+        myshell_tree_node_t node;
+        memset(&node, 0, sizeof(node));
+        if (!myshell_tree_decode(&rec, &node)) {
+            result = FOSSIL_MYSHELL_ERROR_INDEX_CORRUPTED;
+        }
+        for (size_t j = 0; j < node.count && result == FOSSIL_MYSHELL_ERROR_SUCCESS; ++j) {
+            if (!node.entries[j].leaf) continue;
+            if (job->blob_count == cap) {
+                cap = cap ? cap * 2 : 64;
+                uint64_t *grown = (uint64_t *)realloc(job->blobs, cap * sizeof(uint64_t));
+                if (!grown) {
+                    result = FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+                    break;
+                }
+                job->blobs = grown;
+            }
+            job->blobs[job->blob_count++] = node.entries[j].ref;
+        }
+        free(node.entries);
+    }
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        result = cur.result;
+    }
+    myshell_cursor_close(&cur);
+    if (job->blob_count) qsort(job->blobs, job->blob_count, sizeof(uint64_t), myshell_offset_cmp);
+    return result;
+}
+
+/**
+ * Background pass 2: copies the kept records of [header, end). Both passes
+ * together read at no more than job->rate.
+ */
+static fossil_bluecrab_myshell_error_t myshell_compaction_copy(myshell_compaction_t *job) {
+    FILE *in = fopen(job->path, "rb");
+    if (!in) return FOSSIL_MYSHELL_ERROR_IO;
+
+    uint64_t started = myshell_now_ms();
+    myshell_cursor_t cur;
+    myshell_record_t rec;
+    myshell_map_t map;
+    myshell_map_open(&map, in, job->end);
+    fossil_bluecrab_myshell_error_t result = myshell_compaction_blobs(job, in, map.data, started);
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        myshell_map_close(&map);
+        fclose(in);
+        return result;
+    }
+    myshell_cursor_open(&cur, in, map.data, MYSHELL_FILE_HEADER_SIZE, job->end);
+    while (myshell_cursor_next(&cur, &rec)) {
+        if (myshell_compaction_cancelled(job)) {
+            result = FOSSIL_MYSHELL_ERROR_CONCURRENCY;
+            break;
+        }
+        uint8_t kind = myshell_compaction_keeps(job, &rec);
+        if (kind) {
+            rec.kind = kind;
+            result = myshell_compaction_emit(job, &rec);
+            if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) break;
+        }
+        myshell_compaction_throttle(job, started, job->end + cur.offset);
+    }
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        result = cur.result;
+    }
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS && cur.offset != job->end) {
+        result = FOSSIL_MYSHELL_ERROR_IO;
+    }
+    myshell_cursor_close(&cur);
+    myshell_map_close(&map);
+    fclose(in);
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS && fflush(job->out) != 0) {
+        result = FOSSIL_MYSHELL_ERROR_IO;
+    }
+    return result;
+}
+
+#if defined(_WIN32) || defined(_WIN64)
+static DWORD WINAPI myshell_compaction_main(LPVOID arg) {
+#else
+static void *myshell_compaction_main(void *arg) {
+#endif
+    myshell_compaction_t *job = (myshell_compaction_t *)arg;
+    fossil_bluecrab_myshell_error_t result = myshell_compaction_copy(job);
+    myshell_mutex_lock(&job->mutex);
+    job->result = result;
+    job->done = true;
+    myshell_mutex_unlock(&job->mutex);
+#if defined(_WIN32) || defined(_WIN64)
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
+static void myshell_compaction_join(myshell_compaction_t *job) {
+#if defined(_WIN32) || defined(_WIN64)
+    WaitForSingleObject(job->thread, INFINITE);
+    CloseHandle(job->thread);
+#else
+    pthread_join(job->thread, NULL);
+#endif
+}
+
+/** Snapshots the latest record offsets and starts the background copy. */
+static fossil_bluecrab_myshell_error_t myshell_compaction_start(fossil_bluecrab_myshell_t *db) {
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    if (myshell_log_flush(db) != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        return FOSSIL_MYSHELL_ERROR_IO;
+    }
+    myshell_compaction_t *job = (myshell_compaction_t *)calloc(1, sizeof(myshell_compaction_t));
+    if (!job) return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+    myshell_mutex_init(&job->mutex);
+
+    size_t path_len = strlen(db->path);
+    job->path = myshell_strdup(db->path);
+    job->temp_path = (char *)malloc(path_len + sizeof(".compact"));
+    size_t live = store->keys->count;
+    for (size_t i = 0; i < store->view_count; ++i) live += store->views[i].keys->count;
+    job->live = (uint64_t *)malloc((live + 1) * sizeof(uint64_t));
+    job->store = myshell_store_new();
+    if (!job->path || !job->temp_path || !job->live || !job->store) {
+        free(job->temp_path);
+        job->temp_path = NULL;
+        myshell_compaction_free(job);
+        return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+    }
+    memcpy(job->temp_path, db->path, path_len);
+    memcpy(job->temp_path + path_len, ".compact", sizeof(".compact"));
+
+    for (size_t v = 0; v <= store->view_count; ++v) {
+        const myshell_index_t *keys = v < store->view_count ? store->views[v].keys : store->keys;
+        for (size_t i = 0; i < keys->capacity; ++i) {
+            if (keys->slots[i].key) job->live[job->live_count++] = keys->slots[i].offset;
+        }
+    }
+    qsort(job->live, job->live_count, sizeof(uint64_t), myshell_offset_cmp);
+    job->end = (uint64_t)db->file_size;
+    job->rate = store->compact_rate;
+    job->out_size = MYSHELL_FILE_HEADER_SIZE;
+
+    job->out = fopen(job->temp_path, "wb");
+    if (!job->out || !myshell_file_header_write(job->out)) {
+        myshell_compaction_free(job);
+        return FOSSIL_MYSHELL_ERROR_IO;
+    }
+
+#if defined(_WIN32) || defined(_WIN64)
+    job->thread = CreateThread(NULL, 0, myshell_compaction_main, job, 0, NULL);
+    bool started = job->thread != NULL;
+#else
+    bool started = pthread_create(&job->thread, NULL, myshell_compaction_main, job) == 0;
+#endif
+    if (!started) {
+        myshell_compaction_free(job);
+        return FOSSIL_MYSHELL_ERROR_CONCURRENCY;
+    }
+    store->compaction = job;
+    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+}
+
+/**
+ * Waits for the background copy, then carries over the tail, swaps the new
+ * file in and adopts its index. On any failure the old file stays in use.
+ */
+static fossil_bluecrab_myshell_error_t myshell_compaction_finish(fossil_bluecrab_myshell_t *db) {
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    myshell_compaction_t *job = store->compaction;
+    myshell_compaction_join(job);
+    store->compaction = NULL;
+
+    fossil_bluecrab_myshell_error_t result = job->result;
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        result = myshell_log_flush(db);
+    }
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        myshell_cursor_t cur;
+        myshell_record_t rec;
+        myshell_cursor_open(&cur, db->file, myshell_map_cover(db, (uint64_t)db->file_size), job->end,
+                            (uint64_t)db->file_size);
+        while (result == FOSSIL_MYSHELL_ERROR_SUCCESS && myshell_cursor_next(&cur, &rec)) {
+            result = myshell_compaction_emit(job, &rec);
+        }
+        if (result == FOSSIL_MYSHELL_ERROR_SUCCESS) {
+            result = cur.result;
+        }
+        myshell_cursor_close(&cur);
+    }
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS && !myshell_file_sync(job->out)) {
+        result = FOSSIL_MYSHELL_ERROR_IO;
+    }
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        myshell_compaction_free(job);
+        return result;
+    }
+
+    fclose(job->out);
+    job->out = NULL;
+    myshell_map_drop(store);
+    fclose(db->file);
+    bool replaced = myshell_replace_file(job->temp_path, db->path);
+    db->file = fopen(db->path, "rb+");
+    if (!db->file) {
+        db->is_open = false;
+        myshell_compaction_free(job);
+        return FOSSIL_MYSHELL_ERROR_IO;
+    }
+    if (!replaced) {
+        myshell_compaction_free(job);
+        return FOSSIL_MYSHELL_ERROR_IO;
+    }
+    free(job->temp_path);
+    job->temp_path = NULL;
+
+    myshell_store_t *fresh = job->store;
+    job->store = NULL;
+    fresh->compact_ratio = store->compact_ratio;
+    fresh->compact_rate = store->compact_rate;
+    fresh->map_epoch = store->map_epoch + 1;
+    fresh->txn = store->txn;
+    store->txn = NULL;
+    myshell_index_free(fresh->staged);
+    free(fresh->stage.records);
+    fresh->staged = store->staged;
+    fresh->stage = store->stage;
+    store->staged = NULL;
+    store->stage.records = NULL;
+    fresh->log = store->log;
+    fresh->log.written = job->out_size;
+    fresh->log.last_sync_ms = myshell_now_ms();
+    store->log.pending = NULL;
+    myshell_store_free(store);
+    db->cache = fresh;
+    db->file_size = (size_t)job->out_size;
+    db->last_modified = time(NULL);
+    myshell_compaction_free(job);
+    return fresh->stage.journal ? myshell_stage_journal(db) : FOSSIL_MYSHELL_ERROR_SUCCESS;
+}
+
+/** Stops a running compaction without installing it (used by close). */
+static void myshell_compaction_cancel(fossil_bluecrab_myshell_t *db) {
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    myshell_compaction_t *job = store ? store->compaction : NULL;
+    if (!job) return;
+    myshell_mutex_lock(&job->mutex);
+    job->cancel = true;
+    myshell_mutex_unlock(&job->mutex);
+    myshell_compaction_join(job);
+    store->compaction = NULL;
+    myshell_compaction_free(job);
+}
+
+/**
+ * Called after every write: installs a finished compaction, or starts one
+ * once garbage crosses the configured ratio. Failures are left in
+ * db->error_code; the write itself already succeeded.
+ */
+static void myshell_compaction_tick(fossil_bluecrab_myshell_t *db) {
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    fossil_bluecrab_myshell_error_t result = FOSSIL_MYSHELL_ERROR_SUCCESS;
+    if (store->compaction) {
+        myshell_compaction_t *job = store->compaction;
+        myshell_mutex_lock(&job->mutex);
+        bool done = job->done;
+        myshell_mutex_unlock(&job->mutex);
+        if (done) result = myshell_compaction_finish(db);
+    } else if (store->compact_ratio > 0.0 && store->garbage >= MYSHELL_COMPACT_MIN_GARBAGE &&
+               (double)store->garbage >= store->compact_ratio * (double)db->file_size) {
+        result = myshell_compaction_start(db);
+    }
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        db->error_code = result;
+    }
+}
+
+fossil_bluecrab_myshell_t *fossil_myshell_open(const char *path, fossil_bluecrab_myshell_error_t *err) {
+    if (!path) {
+        if (err) *err = FOSSIL_MYSHELL_ERROR_INVALID_FILE;
+        return NULL;
+    }
+
+    // Enforce .myshell extension
+    const char *ext = strrchr(path, '.');
+    if (!ext || strcmp(ext, ".myshell") != 0) {
+        if (err) *err = FOSSIL_MYSHELL_ERROR_INVALID_FILE;
+        return NULL;
+    }
+
+    FILE *file = fopen(path, "rb+");
+    if (!file) {
+        if (err) *err = FOSSIL_MYSHELL_ERROR_FILE_NOT_FOUND;
+        return NULL;
+    }
+
+    fossil_bluecrab_myshell_t *db = (fossil_bluecrab_myshell_t *)calloc(1, sizeof(fossil_bluecrab_myshell_t));
+    if (!db) {
+        fclose(file);
+        if (err) *err = FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+        return NULL;
+    }
+
+    db->path = myshell_strdup(path);
+    if (!db->path) {
+        fclose(file);
+        free(db);
+        if (err) *err = FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+        return NULL;
+    }
+
+    db->file = file;
+    db->is_open = true;
+
+    if (myshell_fseek(file, 0, SEEK_END) != 0) {
+        free(db->path);
+        free(db);
+        fclose(file);
+        if (err) *err = FOSSIL_MYSHELL_ERROR_IO;
+        return NULL;
+    }
+    int64_t size = myshell_ftell(file);
+    db->file_size = (size_t)size;
+    if (size < 0 || myshell_fseek(file, 0, SEEK_SET) != 0) {
+        free(db->path);
+        free(db);
+        fclose(file);
+        if (err) *err = FOSSIL_MYSHELL_ERROR_IO;
+        return NULL;
+    }
+
+    struct stat st;
+    if (stat(path, &st) == 0)
+        db->last_modified = st.st_mtime;
+    else
+        db->last_modified = 0;
+
+    db->commit_head = myshell_hash64(path);
+    db->error_code = FOSSIL_MYSHELL_ERROR_SUCCESS;
+
+    // Check the format header, validate FSON types and replay the log into the key index in one pass.
+    fossil_bluecrab_myshell_error_t load = myshell_store_load(db);
+    if (load != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        free(db->path);
+        free(db);
+        fclose(file);
+        if (err) *err = load;
+        return NULL;
+    }
+
+    // Resume at the head snapshot, on the branch last checked out
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    if (store->head) {
+        db->commit_head = store->head;
+    }
+    if (store->head_branch) {
+        db->branch = myshell_strdup(store->head_branch);
+    }
+
+    if (err) *err = FOSSIL_MYSHELL_ERROR_SUCCESS;
+    return db;
+}
+
+fossil_bluecrab_myshell_t *fossil_myshell_create(const char *path, fossil_bluecrab_myshell_error_t *err) {
+    if (!path) {
+        if (err) *err = FOSSIL_MYSHELL_ERROR_INVALID_FILE;
+        return NULL;
+    }
+
+    // Enforce .myshell extension
+    const char *ext = strrchr(path, '.');
+    if (!ext || strcmp(ext, ".myshell") != 0) {
+        if (err) *err = FOSSIL_MYSHELL_ERROR_INVALID_FILE;
+        return NULL;
+    }
+
+    // Check if file already exists
+    FILE *check = fopen(path, "rb");
+    if (check) {
+        fclose(check);
+        if (err) *err = FOSSIL_MYSHELL_ERROR_ALREADY_EXISTS;
+        return NULL;
+    }
+
+    FILE *file = fopen(path, "wb+");
+    if (!file) {
+        if (err) *err = FOSSIL_MYSHELL_ERROR_IO;
+        return NULL;
+    }
+
+    // Write the v2 format header for the new file
+    if (!myshell_file_header_write(file)) {
+        fclose(file);
+        remove(path);
+        if (err) *err = FOSSIL_MYSHELL_ERROR_IO;
+        return NULL;
+    }
+
+    fossil_bluecrab_myshell_t *db = (fossil_bluecrab_myshell_t *)calloc(1, sizeof(fossil_bluecrab_myshell_t));
+    if (!db) {
+        fclose(file);
+        if (err) *err = FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+        return NULL;
+    }
+
+    db->path = myshell_strdup(path);
+    if (!db->path) {
+        fclose(file);
+        free(db);
+        if (err) *err = FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+        return NULL;
+    }
+
+    db->cache = myshell_store_new();
+    if (!db->cache) {
+        fclose(file);
+        free(db->path);
+        free(db);
+        if (err) *err = FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+        return NULL;
+    }
+
+    db->file = file;
+    db->is_open = true;
+    fflush(file);
+    myshell_fseek(file, 0, SEEK_END);
+    db->file_size = (size_t)myshell_ftell(file);
+    myshell_fseek(file, 0, SEEK_SET);
+    ((myshell_store_t *)db->cache)->log.written = db->file_size;
+    ((myshell_store_t *)db->cache)->log.last_sync_ms = myshell_now_ms();
+    db->last_modified = time(NULL);
+    db->commit_head = myshell_hash64(path);
+    db->error_code = FOSSIL_MYSHELL_ERROR_SUCCESS;
+
+    if (err) *err = FOSSIL_MYSHELL_ERROR_SUCCESS;
+    return db;
+}
+
+void fossil_myshell_close(fossil_bluecrab_myshell_t *db) {
+    if (db) {
+        myshell_compaction_cancel(db);
+        if (db->file && db->cache) {
+            myshell_store_t *store = (myshell_store_t *)db->cache;
+            if (store->log.durability == FOSSIL_MYSHELL_DURABILITY_NONE) {
+                myshell_log_flush(db);
+            } else {
+                myshell_log_sync(db);
+            }
+        }
+        if (db->file) {
+            fclose(db->file);
+            db->file = NULL;
+        }
+        if (db->path) {
+            free(db->path);
+            db->path = NULL;
+        }
+        if (db->branch) {
+            free(db->branch);
+            db->branch = NULL;
+        }
+        if (db->author) {
+            free(db->author);
+            db->author = NULL;
+        }
+        if (db->commit_message) {
+            free(db->commit_message);
+            db->commit_message = NULL;
+        }
+        if (db->parent_branch) {
+            free(db->parent_branch);
+            db->parent_branch = NULL;
+        }
+        myshell_store_free((myshell_store_t *)db->cache);
+        db->cache = NULL;
+        free(db);
+    }
+}
+
+fossil_bluecrab_myshell_error_t fossil_myshell_put(fossil_bluecrab_myshell_t *db, const char *key, const char *type, const char *value) {
+    if (!db || !db->is_open) {
+        return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
+    }
+    if (!key || !type || !value) {
+        return FOSSIL_MYSHELL_ERROR_INVALID_QUERY;
+    }
+    if (key[0] == '\0' || type[0] == '\0') {
+        return FOSSIL_MYSHELL_ERROR_INVALID_QUERY;
+    }
+
+    // Validate type against FSON type system
+    fossil_bluecrab_myshell_fson_type_t type_id = MYSHELL_FSON_TYPE_NULL;
+    bool valid_type = false;
+    for (size_t i = 0; i <= MYSHELL_FSON_TYPE_DURATION; ++i) {
+        if (strcmp(type, myshell_fson_type_names[i]) == 0) {
+            type_id = (fossil_bluecrab_myshell_fson_type_t)i;
+            valid_type = true;
+            break;
+        }
+    }
+    if (!valid_type) {
+        return FOSSIL_MYSHELL_ERROR_INVALID_TYPE;
+    }
+
+    size_t key_len = strlen(key);
+    uint64_t key_hash = myshell_hash64n(key, key_len);
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    if (store->txn) {
+        return myshell_batch_add(store->txn, MYSHELL_RECORD_PUT, (uint8_t)type_id, key, value);
+    }
+
+    // Append the new version; the previous one (if any) becomes garbage. A
+    // version the index cannot take is dropped again, so nothing is left queued
+    uint64_t offset;
+    size_t length;
+    fossil_bluecrab_myshell_error_t result = myshell_append_record(db, MYSHELL_RECORD_PUT, (uint8_t)type_id,
+        key, key_len, value, strlen(value), &offset, &length);
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        return result;
+    }
+    myshell_index_slot_t *old = myshell_index_find(store->keys, key, key_len, key_hash);
+    size_t old_length = old ? old->length : 0;
+    if (!myshell_index_put(store->keys, key, key_len, key_hash, offset, length)) {
+        myshell_log_truncate(db, offset);
+        return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+    }
+    store->garbage += old_length;
+    result = myshell_log_settle(db, false);
+    myshell_compaction_tick(db);
+    return result;
 }
 
 fossil_bluecrab_myshell_error_t fossil_myshell_get(
@@ -508,1255 +3526,2430 @@ fossil_bluecrab_myshell_error_t fossil_myshell_get(
     if (!db || !db->is_open) {
         return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
     }
-    if (!key || !out_value || out_size == 0) {
-        return FOSSIL_MYSHELL_ERROR_INVALID_QUERY;
+    if (!key || !out_value || out_size == 0) {
+        return FOSSIL_MYSHELL_ERROR_INVALID_QUERY;
+    }
+    if (key[0] == '\0') {
+        return FOSSIL_MYSHELL_ERROR_INVALID_QUERY;
+    }
+
+    // Inside a transaction its own writes are seen first, then the branch's
+    // own, then its snapshot
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    const myshell_index_slot_t *pending = myshell_txn_find(store, key);
+    if (pending && pending->length == 0) {
+        return FOSSIL_MYSHELL_ERROR_NOT_FOUND;
+    }
+    uint64_t offset = pending ? pending->offset : 0;
+    size_t length = pending ? pending->length : 0;
+    const char *bytes = pending ? store->txn->records + offset : NULL;
+    if (!pending) {
+        fossil_bluecrab_myshell_error_t found = myshell_view_get(db, key, strlen(key), myshell_hash64(key),
+                                                                 &offset, &length);
+        if (found != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+            return found;
+        }
+        bytes = myshell_record_at(db, offset, length);
+    }
+
+    // Decode the record in place (mapping or group buffer); only when the
+    // file cannot be mapped is it copied out with a positioned read
+    char small[512];
+    char *buf = NULL;
+    if (!bytes) {
+        buf = length <= sizeof(small) ? small : (char *)malloc(length);
+        if (!buf) {
+            return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+        }
+        bytes = myshell_read_at(db, buf, length, offset) ? buf : NULL;
+    }
+    fossil_bluecrab_myshell_error_t result = FOSSIL_MYSHELL_ERROR_SUCCESS;
+    myshell_record_t rec;
+    if (!bytes) {
+        result = FOSSIL_MYSHELL_ERROR_IO;
+    } else if (!myshell_record_decode(bytes, length, &rec) ||
+               (rec.kind != MYSHELL_RECORD_PUT && rec.kind != MYSHELL_RECORD_BLOB) || !myshell_record_key_is(&rec, key)) {
+        result = FOSSIL_MYSHELL_ERROR_INDEX_CORRUPTED;
+    } else if (rec.value_len >= out_size) {
+        result = FOSSIL_MYSHELL_ERROR_BUFFER_TOO_SMALL;
+    } else {
+        memcpy(out_value, rec.value, rec.value_len);
+        out_value[rec.value_len] = '\0';
+    }
+    if (buf && buf != small) {
+        free(buf);
+    }
+    return result;
+}
+
+fossil_bluecrab_myshell_error_t fossil_myshell_get_view(
+    fossil_bluecrab_myshell_t *db,
+    const char *key,
+    fossil_bluecrab_myshell_view_t *out_view
+) {
+    if (!db || !db->is_open) {
+        return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
+    }
+    if (!key || key[0] == '\0' || !out_view) {
+        return FOSSIL_MYSHELL_ERROR_INVALID_QUERY;
+    }
+
+    // Values written by the open transaction are not in the file yet
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    const myshell_index_slot_t *pending = myshell_txn_find(store, key);
+    if (pending) {
+        return pending->length == 0 ? FOSSIL_MYSHELL_ERROR_NOT_FOUND : FOSSIL_MYSHELL_ERROR_UNSUPPORTED;
+    }
+    uint64_t offset;
+    size_t length;
+    fossil_bluecrab_myshell_error_t found = myshell_view_get(db, key, strlen(key), myshell_hash64(key),
+                                                             &offset, &length);
+    if (found != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        return found;
+    }
+
+    // A view must outlive later appends, so it always points into the
+    // mapping: a record still in the group buffer is written out first
+    if (offset + length > store->log.written &&
+        myshell_log_flush(db) != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        return FOSSIL_MYSHELL_ERROR_IO;
+    }
+    const char *map = myshell_map_cover(db, offset + length);
+    if (!map) {
+        return FOSSIL_MYSHELL_ERROR_UNSUPPORTED;
+    }
+    myshell_record_t rec;
+    if (!myshell_record_decode(map + offset, length, &rec) ||
+        (rec.kind != MYSHELL_RECORD_PUT && rec.kind != MYSHELL_RECORD_BLOB) || !myshell_record_key_is(&rec, key)) {
+        return FOSSIL_MYSHELL_ERROR_INDEX_CORRUPTED;
+    }
+    out_view->data = rec.value;
+    out_view->length = rec.value_len;
+    out_view->epoch = store->map_epoch;
+    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+}
+
+uint64_t fossil_myshell_map_epoch(const fossil_bluecrab_myshell_t *db) {
+    if (!db || !db->cache) {
+        return 0;
+    }
+    return ((const myshell_store_t *)db->cache)->map_epoch;
+}
+
+fossil_bluecrab_myshell_error_t fossil_myshell_del(fossil_bluecrab_myshell_t *db, const char *key) {
+    if (!db || !db->is_open) {
+        return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
+    }
+    if (!key || key[0] == '\0') {
+        return FOSSIL_MYSHELL_ERROR_INVALID_QUERY;
+    }
+
+    size_t key_len = strlen(key);
+    uint64_t key_hash = myshell_hash64n(key, key_len);
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    const myshell_index_slot_t *pending = myshell_txn_find(store, key);
+    uint64_t offset;
+    size_t length;
+    fossil_bluecrab_myshell_error_t result = pending ? FOSSIL_MYSHELL_ERROR_SUCCESS
+                                                     : myshell_view_get(db, key, key_len, key_hash, &offset, &length);
+    if (pending ? pending->length == 0 : result != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        return pending ? FOSSIL_MYSHELL_ERROR_NOT_FOUND : result;
+    }
+    if (store->txn) {
+        return myshell_batch_add(store->txn, MYSHELL_RECORD_DEL, MYSHELL_FSON_TYPE_NULL, key, NULL);
+    }
+
+    // Append a tombstone; it and a put of this branch it supersedes become
+    // garbage, while a version in the snapshot stays behind for its commit
+    myshell_index_slot_t *old = myshell_index_find(store->keys, key, key_len, key_hash);
+    size_t old_length = old ? old->length : 0;
+    result = myshell_append_record(db, MYSHELL_RECORD_DEL, MYSHELL_FSON_TYPE_NULL,
+        key, key_len, NULL, 0, &offset, &length);
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        return result;
+    }
+    if (!myshell_index_put(store->keys, key, key_len, key_hash, offset, 0)) {
+        myshell_log_truncate(db, offset);
+        return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+    }
+    store->garbage += old_length + length;
+    result = myshell_log_settle(db, false);
+    myshell_compaction_tick(db);
+    return result;
+}
+
+fossil_bluecrab_myshell_error_t fossil_myshell_commit(fossil_bluecrab_myshell_t *db, const char *message) {
+    if (!db) {
+        return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
+    }
+    if (!db->is_open) {
+        return FOSSIL_MYSHELL_ERROR_LOCKED;
+    }
+    if (!message || strlen(message) == 0) {
+        return FOSSIL_MYSHELL_ERROR_INVALID_QUERY;
+    }
+
+    // Store the commit message
+    if (db->commit_message) {
+        free(db->commit_message);
+    }
+    db->commit_message = myshell_strdup(message);
+    if (!db->commit_message) {
+        return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+    }
+    db->commit_timestamp = time(NULL);
+
+    // Optionally, create a new commit object (simulate by updating author and parent_branch)
+    if (db->author) {
+        free(db->author);
+    }
+    db->author = myshell_strdup("system");
+    if (!db->author) {
+        return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+    }
+
+    if (db->parent_branch) {
+        free(db->parent_branch);
+    }
+    db->parent_branch = db->branch ? myshell_strdup(db->branch) : NULL;
+    if (db->branch && !db->parent_branch) {
+        return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+    }
+
+    db->next_commit_hash = 0;
+
+    // Staged changes and then an open transaction's writes go out first, as
+    // one batch later stretched over the snapshot and commit records as well.
+    // Applying the commit record empties the staging area.
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    myshell_log_t *log = &store->log;
+    size_t staged = 0;
+    if (store->staged->count > 0) {
+        myshell_stage_pack(store);
+        staged = store->stage.len;
+    }
+    if (store->txn && store->txn->count > 0 &&
+        !myshell_buffer_reserve(&store->stage.records, &store->stage.cap, staged, store->txn->len)) {
+        return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+    }
+    fossil_bluecrab_myshell_batch_t flush;
+    memset(&flush, 0, sizeof(flush));
+    flush.records = store->stage.records;
+    flush.len = staged;
+    if (store->txn && store->txn->count > 0) {
+        memcpy(store->stage.records + staged, store->txn->records, store->txn->len);
+        flush.len += store->txn->len;
+    }
+    bool batched = flush.len > 0;
+
+    // Everything that can fail happens before anything is indexed: a failed
+    // commit takes back what it appended and leaves the staging area and the
+    // transaction as they were, so a retry writes them once
+    size_t value_size = strlen(message) + MYSHELL_COMMIT_TREE_SIZE + 32;
+    char *value = (char *)malloc(value_size);
+    if (!value) {
+        return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+    }
+    uint64_t marker_offset = log->written + log->pending_len;
+    uint64_t base = 0;
+    fossil_bluecrab_myshell_error_t result = batched ? myshell_batch_reserve(db, &flush)
+                                                     : FOSSIL_MYSHELL_ERROR_SUCCESS;
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        free(value);
+        return result;
+    }
+    if (batched) {
+        base = myshell_batch_append(db, &flush, &marker_offset);
+    }
+
+    // Snapshot the keys: only the tree nodes on the paths to changed keys are new
+    uint64_t root = 0;
+    result = myshell_snapshot_write(db, batched ? &flush : NULL, base, &root);
+
+    // The current branch, if it is one, moves to the new commit. Room for the
+    // commit and branch records and for the names they set is taken up front
+    size_t branch_len = db->branch ? strlen(db->branch) : 0;
+    bool moves = db->branch && myshell_refs_find(&store->branches, db->branch, branch_len);
+    size_t needed = 2 * MYSHELL_RECORD_HEADER_SIZE + 16 + value_size + (moves ? branch_len + 16 : 0);
+    char *head_name = NULL;
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS && moves &&
+        !(store->head_branch && strcmp(store->head_branch, db->branch) == 0)) {
+        head_name = myshell_strdup(db->branch);
+        if (!head_name) result = FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+    }
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS &&
+        (!myshell_buffer_reserve(&log->pending, &log->pending_cap, log->pending_len, needed) ||
+         !myshell_graph_reserve(&store->graph))) {
+        result = FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+    }
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        myshell_batch_undo(db, batched ? &flush : NULL, marker_offset);
+        free(head_name);
+        free(value);
+        return result;
+    }
+
+    // Nothing below can fail. The commit is content-addressed: its id is the
+    // hash of tree, parent, time and message. Commits are typed enum.
+    if (batched) {
+        myshell_batch_index(store, &flush, base);
+    }
+    int value_len = snprintf(value, value_size, "tree %016" PRIx64 "\nparent %016" PRIx64 "\n%lld\n%s", root,
+                             store->head, (long long)db->commit_timestamp, message);
+    uint64_t id = myshell_hash64n(value, (size_t)value_len);
+    char hash_str[17];
+    snprintf(hash_str, sizeof(hash_str), "%016" PRIx64, id);
+    myshell_append_applied(db, MYSHELL_RECORD_COMMIT, MYSHELL_FSON_TYPE_ENUM, hash_str, 16, value, (size_t)value_len);
+    free(value);
+    if (head_name) {
+        free(store->head_branch);
+        store->head_branch = head_name;
+    }
+    if (moves) {
+        myshell_append_applied(db, MYSHELL_RECORD_BRANCH, MYSHELL_FSON_TYPE_ENUM, db->branch, branch_len,
+                               hash_str, 16);
+    }
+    if (batched) {
+        myshell_batch_extend(db, marker_offset);
+    }
+    fossil_myshell_batch_free(store->txn);
+    store->txn = NULL;
+
+    // Update commit hashes (chain)
+    db->prev_commit_hash = db->commit_head;
+    db->commit_head = id;
+
+    // The commit closes the group: everything since the last one goes out together
+    return myshell_log_settle(db, true);
+}
+
+fossil_bluecrab_myshell_error_t fossil_myshell_branch(fossil_bluecrab_myshell_t *db, const char *branch_name) {
+    if (!db) {
+        return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
+    }
+    if (!db->is_open) {
+        return FOSSIL_MYSHELL_ERROR_LOCKED;
+    }
+    if (!branch_name || branch_name[0] == '\0') {
+        return FOSSIL_MYSHELL_ERROR_INVALID_QUERY;
+    }
+
+    // Check for schema mismatch or unsupported version (simulate)
+    if (db->commit_head == 0) {
+        return FOSSIL_MYSHELL_ERROR_SCHEMA_MISMATCH;
+    }
+
+    // Update branch pointer
+    if (db->branch) {
+        free(db->branch);
+    }
+    db->branch = myshell_strdup(branch_name);
+    if (!db->branch) {
+        return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+    }
+
+    // Set parent branch if not already set
+    if (!db->parent_branch) {
+        db->parent_branch = myshell_strdup(db->branch);
+        if (!db->parent_branch) {
+            return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+        }
+    }
+
+    // The branch starts at the head commit; before the first snapshot commit
+    // it is identified by the hash of its name
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    db->commit_head = store->head ? store->head : myshell_hash64(branch_name);
+
+    // FSON type system: branch is always type "enum"
+    fossil_bluecrab_myshell_fson_type_t type_id = MYSHELL_FSON_TYPE_ENUM;
+
+    // Write the branch record; it is also what checkout resolves the name by
+    char hash_str[17];
+    snprintf(hash_str, sizeof(hash_str), "%016" PRIx64, db->commit_head);
+    fossil_bluecrab_myshell_error_t result = myshell_append_applied(db, MYSHELL_RECORD_BRANCH, (uint8_t)type_id,
+        branch_name, strlen(branch_name), hash_str, 16);
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        result = myshell_log_settle(db, false);
+    }
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        return result;
+    }
+
+    // Update branch pointers and commit chain (simple simulation)
+    db->prev_commit_hash = db->commit_head;
+    db->next_commit_hash = 0; // No next commit yet
+
+    // Optionally, reset commit message and timestamp for new branch
+    if (db->commit_message) {
+        free(db->commit_message);
+        db->commit_message = NULL;
+    }
+    db->commit_timestamp = 0;
+
+    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+}
+
+/**
+ * Checks out snapshot commit @p target with tree @p root by switching views:
+ * the current branch's uncommitted writes are parked with it, and those
+ * parked on the target branch come back. O(1) whatever the number of keys.
+ * Writes on a detached head have no branch to wait on, and an open
+ * transaction is the handle's own, so either makes it fail with CONCURRENCY.
+ */
+static fossil_bluecrab_myshell_error_t myshell_checkout_snapshot(fossil_bluecrab_myshell_t *db, const char *name,
+                                                                 bool is_branch, uint64_t target, uint64_t root) {
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    if (store->txn || (!store->head_branch && store->keys->count > 0)) {
+        return FOSSIL_MYSHELL_ERROR_CONCURRENCY;
+    }
+
+    char value[33];
+    snprintf(value, sizeof(value), "%016" PRIx64 "%016" PRIx64, target, root);
+    const char *branch = is_branch ? name : "";
+    fossil_bluecrab_myshell_error_t result = myshell_append_applied(db, MYSHELL_RECORD_CHECKOUT, MYSHELL_FSON_TYPE_ENUM,
+                                    branch, strlen(branch), value, 32);
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        result = myshell_log_settle(db, false);
+    }
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        return result;
+    }
+
+    char *copy = myshell_strdup(name);
+    if (!copy) {
+        return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+    }
+    free(db->branch);
+    db->branch = copy;
+    db->commit_head = target;
+    db->last_modified = time(NULL);
+    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+}
+
+fossil_bluecrab_myshell_error_t fossil_myshell_checkout(fossil_bluecrab_myshell_t *db, const char *branch_or_commit) {
+    if (!db) {
+        return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
+    }
+    if (!db->is_open) {
+        return FOSSIL_MYSHELL_ERROR_LOCKED;
     }
-    if (key[0] == '\0') {
+    if (!branch_or_commit || branch_or_commit[0] == '\0') {
         return FOSSIL_MYSHELL_ERROR_INVALID_QUERY;
     }
 
-    uint64_t key_hash = myshell_hash64(key);
-
-    fseek(db->file, 0, SEEK_SET);
-    char line[1024];
-    while (fgets(line, sizeof(line), db->file)) {
-        char *eq = strchr(line, '=');
-        if (eq) {
-            *eq = '\0';
-            char *hash_comment = strstr(eq + 1, "#hash=");
-            char *type_comment = strstr(eq + 1, "#type=");
-            if (hash_comment) {
-                uint64_t file_hash = 0;
-                sscanf(hash_comment, "#hash=%" SCNx64, &file_hash);
-                if (strcmp(line, key) == 0 && file_hash == key_hash) {
-                    // Extract value (between '=' and #type or #hash)
-                    size_t value_len = 0;
-                    if (type_comment && type_comment > eq + 1) {
-                        value_len = type_comment - (eq + 1);
-                    } else {
-                        value_len = hash_comment - (eq + 1);
-                    }
-                    // Trim trailing whitespace/newline from value_len
-                    while (value_len > 0 && ((eq + 1)[value_len - 1] == '\n' || (eq + 1)[value_len - 1] == ' ')) {
-                        value_len--;
-                    }
-                    if (value_len >= out_size) {
-                        *eq = '='; // Restore
-                        return FOSSIL_MYSHELL_ERROR_BUFFER_TOO_SMALL;
-                    }
-                    strncpy(out_value, eq + 1, value_len);
-                    out_value[value_len] = '\0';
-                    *eq = '='; // Restore
-                    return FOSSIL_MYSHELL_ERROR_SUCCESS;
-                }
+    // Branch, tag and commit names resolve through the commit graph
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    uint64_t target;
+    bool is_branch;
+    fossil_bluecrab_myshell_error_t result = myshell_graph_resolve(store, branch_or_commit, &target, &is_branch);
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        return result;
+    }
+
+    // A commit with a snapshot: switch to its view
+    const myshell_graph_commit_t *commit = myshell_graph_find(&store->graph, target);
+    if (commit && commit->snapshot) {
+        return myshell_checkout_snapshot(db, branch_or_commit, is_branch, target, commit->root);
+    }
+
+    // Otherwise only the branch pointer moves, as it did before snapshots
+    char *name = myshell_strdup(branch_or_commit);
+    if (!name) {
+        return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+    }
+    free(db->branch);
+    db->branch = name;
+    db->commit_head = target;
+
+    db->last_modified = time(NULL);
+
+    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+}
+
+/*
+ * A three-way merge compares the tree of the merged-in tip ("theirs") with
+ * that of the merge base, walking the two together and skipping every shared
+ * subtree, so it only visits keys theirs changed. Each such key is looked up
+ * in the base and in the head's tree ("ours"): a key ours left as it was in
+ * the base takes theirs' version, one both sides changed the same way is
+ * fine, and one they changed differently is a conflict. Conflicts are all
+ * settled before anything is written, then the changes taken from theirs go
+ * out as puts and deletes in one batch with the snapshot and merge record.
+ */
+typedef struct {
+    char    *key;
+    uint64_t key_hash;
+    uint64_t base;             /* blob ids, 0 = absent on that side */
+    uint64_t ours;
+    uint64_t theirs;
+    bool     take;             /* apply theirs' version */
+} myshell_merge_change_t;
+
+typedef struct {
+    uint64_t base_root;
+    uint64_t ours_root;
+    uint64_t theirs_root;
+    myshell_merge_change_t *changes;
+    size_t   count;
+    size_t   cap;
+} myshell_merge_t;
+
+static void myshell_merge_free(myshell_merge_t *merge) {
+    for (size_t i = 0; i < merge->count; ++i) free(merge->changes[i].key);
+    free(merge->changes);
+}
+
+/**
+ * Looks at one leaf that differs between the base and theirs. A leaf of
+ * theirs is a change unless the base has the same blob for its key; a leaf
+ * of the base only matters when theirs deleted its key.
+ */
+static fossil_bluecrab_myshell_error_t myshell_merge_leaf(fossil_bluecrab_myshell_t *db, myshell_merge_t *merge,
+                                                          const myshell_tree_entry_t *e, bool theirs) {
+    const myshell_object_t *obj = myshell_objects_find(&((myshell_store_t *)db->cache)->objects, e->ref,
+                                                       MYSHELL_OBJECT_BLOB);
+    if (!obj) return FOSSIL_MYSHELL_ERROR_INDEX_CORRUPTED;
+    myshell_object_t blob = *obj;
+    myshell_record_t rec;
+    char *heap;
+    fossil_bluecrab_myshell_error_t result = myshell_object_record(db, &blob, &rec, &heap);
+    char *key = result == FOSSIL_MYSHELL_ERROR_SUCCESS ? myshell_strndup(rec.key, rec.key_len) : NULL;
+    size_t key_len = rec.key_len;
+    free(heap);
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) return result;
+    if (!key) return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+
+    uint64_t other;
+    result = myshell_tree_lookup(db, theirs ? merge->base_root : merge->theirs_root, e->key_hash, key, key_len,
+                                 &other);
+    bool change = result == FOSSIL_MYSHELL_ERROR_SUCCESS && (theirs ? other != e->ref : other == 0);
+    uint64_t ours = 0;
+    if (change) {
+        result = myshell_tree_lookup(db, merge->ours_root, e->key_hash, key, key_len, &ours);
+    }
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS || !change) {
+        free(key);
+        return result;
+    }
+    if (merge->count == merge->cap) {
+        size_t cap = merge->cap ? merge->cap * 2 : 16;
+        myshell_merge_change_t *grown = (myshell_merge_change_t *)realloc(merge->changes, cap * sizeof(*grown));
+        if (!grown) {
+            free(key);
+            return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+        }
+        merge->changes = grown;
+        merge->cap = cap;
+    }
+    myshell_merge_change_t *c = &merge->changes[merge->count++];
+    c->key = key;
+    c->key_hash = e->key_hash;
+    c->base = theirs ? other : e->ref;
+    c->theirs = theirs ? e->ref : 0;
+    c->ours = ours;
+    c->take = false;
+    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+}
+
+/** Visits every leaf under the tree entry @p e (a node's entries are at @p depth). */
+static fossil_bluecrab_myshell_error_t myshell_merge_leaves(fossil_bluecrab_myshell_t *db, myshell_merge_t *merge,
+                                                            const myshell_tree_entry_t *e, uint8_t depth,
+                                                            bool theirs) {
+    if (e->leaf) return myshell_merge_leaf(db, merge, e, theirs);
+    myshell_tree_node_t *node;
+    fossil_bluecrab_myshell_error_t result = myshell_tree_load(db, e->ref, depth, &node);
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        myshell_tree_free(node);
+        return result;
+    }
+    for (size_t i = 0; i < node->count && result == FOSSIL_MYSHELL_ERROR_SUCCESS; ++i) {
+        result = myshell_merge_leaves(db, merge, &node->entries[i], (uint8_t)(depth + 1), theirs);
+    }
+    myshell_tree_free(node);
+    return result;
+}
+
+/**
+ * Walks the base tree @p base and theirs @p theirs together at @p depth,
+ * matching their entries slot by slot in sorted order. A subtree both point
+ * at is skipped whole; two differing child nodes are walked one level down;
+ * any other entry, on one side only or a leaf against a different entry, has
+ * the keys under it compared through myshell_merge_leaves. At the last level
+ * slots no longer order keys, so every entry of both nodes goes there.
+ */
+static fossil_bluecrab_myshell_error_t myshell_merge_walk(fossil_bluecrab_myshell_t *db, myshell_merge_t *merge,
+                                                          uint64_t base, uint64_t theirs, uint8_t depth) {
+    if (base == theirs) return FOSSIL_MYSHELL_ERROR_SUCCESS;
+    myshell_tree_node_t *a = NULL, *b = NULL;
+    fossil_bluecrab_myshell_error_t result = myshell_tree_load(db, base, depth, &a);
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS) result = myshell_tree_load(db, theirs, depth, &b);
+
+    size_t i = 0, j = 0;
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS && depth >= MYSHELL_TREE_DEPTH) {
+        for (; i < a->count && result == FOSSIL_MYSHELL_ERROR_SUCCESS; ++i) {
+            result = myshell_merge_leaves(db, merge, &a->entries[i], (uint8_t)(depth + 1), false);
+        }
+        for (; j < b->count && result == FOSSIL_MYSHELL_ERROR_SUCCESS; ++j) {
+            result = myshell_merge_leaves(db, merge, &b->entries[j], (uint8_t)(depth + 1), true);
+        }
+    }
+    while (result == FOSSIL_MYSHELL_ERROR_SUCCESS && (i < a->count || j < b->count)) {
+        const myshell_tree_entry_t *x = i < a->count ? &a->entries[i] : NULL;
+        const myshell_tree_entry_t *y = j < b->count ? &b->entries[j] : NULL;
+        if (x && y && x->slot == y->slot) {
+            if (x->leaf == y->leaf && x->ref == y->ref) {
+                // Shared: theirs changed nothing below
+            } else if (!x->leaf && !y->leaf) {
+                result = myshell_merge_walk(db, merge, x->ref, y->ref, (uint8_t)(depth + 1));
             } else {
-                if (strcmp(line, key) == 0) {
-                    // Extract value (up to end or comment)
-                    size_t value_len = out_size - 1;
-                    char *comment = strchr(eq + 1, '#');
-                    if (comment) {
-                        value_len = comment - (eq + 1);
-                        // Trim trailing whitespace/newline from value_len
-                        while (value_len > 0 && ((eq + 1)[value_len - 1] == '\n' || (eq + 1)[value_len - 1] == ' ')) {
-                            value_len--;
-                        }
-                        if (value_len >= out_size) {
-                            *eq = '='; // Restore
-                            return FOSSIL_MYSHELL_ERROR_BUFFER_TOO_SMALL;
-                        }
-                    }
-                    strncpy(out_value, eq + 1, value_len);
-                    out_value[value_len] = '\0';
-                    *eq = '='; // Restore
-                    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+                result = myshell_merge_leaves(db, merge, x, (uint8_t)(depth + 1), false);
+                if (result == FOSSIL_MYSHELL_ERROR_SUCCESS) {
+                    result = myshell_merge_leaves(db, merge, y, (uint8_t)(depth + 1), true);
                 }
             }
-            *eq = '='; // Restore
+            i++;
+            j++;
+        } else if (x && (!y || x->slot < y->slot)) {
+            result = myshell_merge_leaves(db, merge, x, (uint8_t)(depth + 1), false);
+            i++;
+        } else {
+            result = myshell_merge_leaves(db, merge, y, (uint8_t)(depth + 1), true);
+            j++;
         }
     }
+    myshell_tree_free(a);
+    myshell_tree_free(b);
+    return result;
+}
 
-    return FOSSIL_MYSHELL_ERROR_NOT_FOUND;
+/** Copies the value of blob @p id as a string into @p *out; NULL for 0 (no value). */
+static fossil_bluecrab_myshell_error_t myshell_blob_value(fossil_bluecrab_myshell_t *db, uint64_t id, char **out) {
+    *out = NULL;
+    if (!id) return FOSSIL_MYSHELL_ERROR_SUCCESS;
+    const myshell_object_t *obj = myshell_objects_find(&((myshell_store_t *)db->cache)->objects, id, MYSHELL_OBJECT_BLOB);
+    if (!obj) return FOSSIL_MYSHELL_ERROR_INDEX_CORRUPTED;
+    myshell_object_t blob = *obj;
+    myshell_record_t rec;
+    char *heap;
+    fossil_bluecrab_myshell_error_t result = myshell_object_record(db, &blob, &rec, &heap);
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS && !(*out = myshell_strndup(rec.value, rec.value_len))) {
+        result = FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+    }
+    free(heap);
+    return result;
 }
 
-fossil_bluecrab_myshell_error_t fossil_myshell_del(fossil_bluecrab_myshell_t *db, const char *key) {
+/**
+ * Decides each change: taken when ours still has the base version, skipped
+ * when ours already matches theirs, and otherwise handed to @p cb. Without a
+ * callback a conflict fails the merge with CONCURRENCY.
+ */
+static fossil_bluecrab_myshell_error_t myshell_merge_resolve(fossil_bluecrab_myshell_t *db, myshell_merge_t *merge,
+                                                             fossil_myshell_conflict_cb cb, void *user) {
+    for (size_t i = 0; i < merge->count; ++i) {
+        myshell_merge_change_t *c = &merge->changes[i];
+        if (c->ours == c->theirs) continue;
+        if (c->ours == c->base) {
+            c->take = true;
+            continue;
+        }
+        if (!cb) return FOSSIL_MYSHELL_ERROR_CONCURRENCY;
+        char *values[3];
+        fossil_bluecrab_myshell_error_t result = myshell_blob_value(db, c->base, &values[0]);
+        if (result == FOSSIL_MYSHELL_ERROR_SUCCESS) result = myshell_blob_value(db, c->ours, &values[1]);
+        if (result == FOSSIL_MYSHELL_ERROR_SUCCESS) result = myshell_blob_value(db, c->theirs, &values[2]);
+        fossil_bluecrab_myshell_merge_choice_t choice = FOSSIL_MYSHELL_MERGE_ABORT;
+        if (result == FOSSIL_MYSHELL_ERROR_SUCCESS) {
+            choice = cb(c->key, values[0], values[1], values[2], user);
+        }
+        for (int v = 0; v < 3; ++v) free(values[v]);
+        if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) return result;
+        if (choice == FOSSIL_MYSHELL_MERGE_ABORT) return FOSSIL_MYSHELL_ERROR_TRANSACTION_FAILED;
+        c->take = choice == FOSSIL_MYSHELL_MERGE_THEIRS;
+    }
+    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+}
+
+/** Appends a put of theirs' version of each taken change, or a delete where theirs removed the key. */
+static fossil_bluecrab_myshell_error_t myshell_merge_apply(fossil_bluecrab_myshell_t *db, const myshell_merge_t *merge) {
+    fossil_bluecrab_myshell_error_t result = FOSSIL_MYSHELL_ERROR_SUCCESS;
+    for (size_t i = 0; i < merge->count && result == FOSSIL_MYSHELL_ERROR_SUCCESS; ++i) {
+        const myshell_merge_change_t *c = &merge->changes[i];
+        if (!c->take) continue;
+        if (!c->theirs) {
+            result = myshell_append_applied(db, MYSHELL_RECORD_DEL, MYSHELL_FSON_TYPE_NULL, c->key, strlen(c->key),
+                                            NULL, 0);
+            continue;
+        }
+        // The blob's bytes may move with the append, so they are copied first
+        const myshell_object_t *obj = myshell_objects_find(&((myshell_store_t *)db->cache)->objects, c->theirs,
+                                                           MYSHELL_OBJECT_BLOB);
+        if (!obj) return FOSSIL_MYSHELL_ERROR_INDEX_CORRUPTED;
+        myshell_object_t blob = *obj;
+        myshell_record_t rec;
+        char *heap;
+        char *copy = NULL;
+        result = myshell_object_record(db, &blob, &rec, &heap);
+        if (result == FOSSIL_MYSHELL_ERROR_SUCCESS && !(copy = (char *)malloc(rec.key_len + rec.value_len + 1))) {
+            result = FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+        }
+        if (result == FOSSIL_MYSHELL_ERROR_SUCCESS) {
+            memcpy(copy, rec.key, rec.key_len);
+            memcpy(copy + rec.key_len, rec.value, rec.value_len);
+        }
+        free(heap);
+        if (result == FOSSIL_MYSHELL_ERROR_SUCCESS) {
+            result = myshell_append_applied(db, MYSHELL_RECORD_PUT, rec.type, copy, rec.key_len, copy + rec.key_len,
+                                            rec.value_len);
+        }
+        free(copy);
+    }
+    return result;
+}
+
+/** Records a merge without merging data, for heads and branches from before snapshots. */
+static fossil_bluecrab_myshell_error_t myshell_merge_legacy(fossil_bluecrab_myshell_t *db, const char *source_branch,
+                                                            const char *message,
+                                                            fossil_bluecrab_myshell_fson_type_t branch_type) {
+    // Prepare commit data for hashing, include source branch name
+    size_t data_size = strlen(source_branch) + strlen(message) + 48;
+    char *commit_data = (char *)malloc(data_size);
+    if (!commit_data) {
+        return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+    }
+    snprintf(commit_data, data_size, "Merge %s: %s:%lld", source_branch, message, (long long)db->commit_timestamp);
+
+    // Update commit hashes (chain)
+    db->prev_commit_hash = db->commit_head;
+    db->commit_head = myshell_hash64(commit_data);
+    db->next_commit_hash = 0;
+
+    // Append merge info to file for history, include FSON type; the value
+    // reuses commit_data's buffer, which is large enough for it
+    char hash_str[17];
+    snprintf(hash_str, sizeof(hash_str), "%016" PRIx64, db->commit_head);
+    int value_len = snprintf(commit_data, data_size, "%lld\n%s\n%s", (long long)db->commit_timestamp,
+                             source_branch, message);
+    fossil_bluecrab_myshell_error_t result = myshell_append_applied(db, MYSHELL_RECORD_MERGE, (uint8_t)branch_type,
+        hash_str, 16, commit_data, (size_t)value_len);
+    free(commit_data);
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        return result;
+    }
+
+    // A merge is a commit, so it closes the group as well
+    return myshell_log_settle(db, true);
+}
+
+/**
+ * Merges snapshot commit @p theirs into the head: finds the merge base,
+ * settles the changes theirs made since, and writes the merged snapshot with
+ * a merge record naming both parents, all as one batch.
+ */
+static fossil_bluecrab_myshell_error_t myshell_merge_snapshot_into(fossil_bluecrab_myshell_t *db,
+                                                                   const char *source_branch, const char *message,
+                                                                   fossil_bluecrab_myshell_fson_type_t branch_type,
+                                                                   const myshell_graph_commit_t *theirs,
+                                                                   fossil_myshell_conflict_cb cb, void *user) {
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    uint64_t ours = store->head, theirs_id = theirs->id;
+    myshell_merge_t merge;
+    memset(&merge, 0, sizeof(merge));
+    merge.ours_root = store->head_root;
+    merge.theirs_root = theirs->root;
+
+    // Unrelated histories merge against the empty tree
+    uint64_t base = 0;
+    fossil_bluecrab_myshell_error_t result = myshell_graph_merge_base(&store->graph, ours, theirs_id, &base);
+    if (result == FOSSIL_MYSHELL_ERROR_NOT_FOUND) {
+        base = 0;
+        result = FOSSIL_MYSHELL_ERROR_SUCCESS;
+    }
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) return result;
+    if (base == theirs_id) {
+        return FOSSIL_MYSHELL_ERROR_SUCCESS; // Already contains theirs
+    }
+    const myshell_graph_commit_t *base_commit = base ? myshell_graph_find(&store->graph, base) : NULL;
+    merge.base_root = base_commit && base_commit->snapshot ? base_commit->root : 0;
+
+    result = myshell_merge_walk(db, &merge, merge.base_root, merge.theirs_root, 0);
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        result = myshell_merge_resolve(db, &merge, cb, user);
+    }
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        myshell_merge_free(&merge);
+        return result;
+    }
+
+    // Everything from here on lands in one batch
+    fossil_bluecrab_myshell_batch_t empty;
+    memset(&empty, 0, sizeof(empty));
+    uint64_t marker_offset = 0;
+    uint64_t root = 0;
+    result = myshell_batch_write(db, &empty, &marker_offset);
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS) result = myshell_merge_apply(db, &merge);
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS) result = myshell_snapshot_write(db, NULL, 0, &root);
+    myshell_merge_free(&merge);
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) return result;
+
+    size_t value_size = strlen(source_branch) + strlen(message) + MYSHELL_MERGE_TREE_SIZE + 32;
+    char *value = (char *)malloc(value_size);
+    if (!value) return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+    int value_len = snprintf(value, value_size, "tree %016" PRIx64 "\nparent %016" PRIx64 "\nmerge %016" PRIx64
+                             "\n%lld\n%s\n%s", root, ours, theirs_id, (long long)db->commit_timestamp,
+                             source_branch, message);
+    uint64_t id = myshell_hash64n(value, (size_t)value_len);
+    char hash_str[17];
+    snprintf(hash_str, sizeof(hash_str), "%016" PRIx64, id);
+    result = myshell_append_applied(db, MYSHELL_RECORD_MERGE, (uint8_t)branch_type, hash_str, 16, value,
+                                    (size_t)value_len);
+    free(value);
+
+    // The current branch, if it is one, moves to the merge
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS && db->branch &&
+        myshell_refs_find(&store->branches, db->branch, strlen(db->branch))) {
+        result = myshell_append_applied(db, MYSHELL_RECORD_BRANCH, MYSHELL_FSON_TYPE_ENUM,
+                                        db->branch, strlen(db->branch), hash_str, 16);
+    }
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) return result;
+    myshell_batch_extend(db, marker_offset);
+
+    db->prev_commit_hash = ours;
+    db->commit_head = id;
+    db->merge_commit_hash = theirs_id;
+    db->next_commit_hash = 0;
+    return myshell_log_settle(db, true);
+}
+
+fossil_bluecrab_myshell_error_t fossil_myshell_merge_with(fossil_bluecrab_myshell_t *db, const char *source_branch,
+                                                          const char *message, fossil_myshell_conflict_cb cb,
+                                                          void *user) {
+    if (!db) {
+        return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
+    }
+    if (!db->is_open) {
+        return FOSSIL_MYSHELL_ERROR_LOCKED;
+    }
+    if (!source_branch || source_branch[0] == '\0' || !message || message[0] == '\0') {
+        return FOSSIL_MYSHELL_ERROR_INVALID_QUERY;
+    }
+
+    // Check for schema mismatch or unsupported version (simulate)
+    if (db->commit_head == 0) {
+        return FOSSIL_MYSHELL_ERROR_SCHEMA_MISMATCH;
+    }
+
+    // Find the source branch and its record type in the ref table
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    const myshell_ref_t *ref = myshell_refs_find(&store->branches, source_branch, strlen(source_branch));
+    if (!ref) {
+        return FOSSIL_MYSHELL_ERROR_NOT_FOUND;
+    }
+    fossil_bluecrab_myshell_fson_type_t branch_type = ref->type <= MYSHELL_FSON_TYPE_DURATION
+        ? (fossil_bluecrab_myshell_fson_type_t)ref->type : MYSHELL_FSON_TYPE_ENUM;
+
+    // Create a merge commit
+    if (db->commit_message) {
+        free(db->commit_message);
+    }
+    db->commit_message = myshell_strdup(message);
+    if (!db->commit_message) {
+        return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+    }
+    db->commit_timestamp = time(NULL);
+
+    // Snapshots on both sides merge their keys; otherwise only the merge is recorded
+    const myshell_graph_commit_t *head = store->head ? myshell_graph_find(&store->graph, store->head) : NULL;
+    const myshell_graph_commit_t *theirs = myshell_graph_find(&store->graph, ref->target);
+    if (!head || !head->snapshot || !theirs || !theirs->snapshot) {
+        return myshell_merge_legacy(db, source_branch, message, branch_type);
+    }
+    if (store->txn || store->keys->count > 0) {
+        return FOSSIL_MYSHELL_ERROR_CONCURRENCY;
+    }
+    return myshell_merge_snapshot_into(db, source_branch, message, branch_type, theirs, cb, user);
+}
+
+fossil_bluecrab_myshell_error_t fossil_myshell_merge(fossil_bluecrab_myshell_t *db, const char *source_branch, const char *message) {
+    return fossil_myshell_merge_with(db, source_branch, message, NULL, NULL);
+}
+
+fossil_bluecrab_myshell_error_t fossil_myshell_revert(fossil_bluecrab_myshell_t *db, const char *commit_hash) {
+    if (!db) {
+        return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
+    }
+    if (!db->is_open) {
+        return FOSSIL_MYSHELL_ERROR_LOCKED;
+    }
+    if (!commit_hash || commit_hash[0] == '\0') {
+        return FOSSIL_MYSHELL_ERROR_INVALID_QUERY;
+    }
+
+    // The commit is found by its id in the commit graph
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    uint64_t hash;
+    if (myshell_graph_resolve(store, commit_hash, &hash, NULL) != FOSSIL_MYSHELL_ERROR_SUCCESS ||
+        !myshell_graph_find(&store->graph, hash)) {
+        return FOSSIL_MYSHELL_ERROR_NOT_FOUND;
+    }
+
+    // Set commit_head to the specified commit hash
+    db->commit_head = hash;
+
+    db->last_modified = time(NULL);
+
+    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+}
+
+fossil_bluecrab_myshell_error_t fossil_myshell_merge_base(fossil_bluecrab_myshell_t *db, const char *a, const char *b,
+                                                          char *out_hash, size_t out_size) {
+    if (!db) {
+        return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
+    }
+    if (!db->is_open) {
+        return FOSSIL_MYSHELL_ERROR_LOCKED;
+    }
+    if (!a || !b || !out_hash || a[0] == '\0' || b[0] == '\0') {
+        return FOSSIL_MYSHELL_ERROR_INVALID_QUERY;
+    }
+    if (out_size < 17) {
+        return FOSSIL_MYSHELL_ERROR_BUFFER_TOO_SMALL;
+    }
+
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    uint64_t first, second, base = 0;
+    fossil_bluecrab_myshell_error_t result = myshell_graph_resolve(store, a, &first, NULL);
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        result = myshell_graph_resolve(store, b, &second, NULL);
+    }
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        result = myshell_graph_merge_base(&store->graph, first, second, &base);
+    }
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        return result;
+    }
+    snprintf(out_hash, out_size, "%016" PRIx64, base);
+    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+}
+
+fossil_bluecrab_myshell_error_t fossil_myshell_stage(fossil_bluecrab_myshell_t *db, const char *key, const char *type, const char *value) {
+    if (!db || !db->is_open) {
+        return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
+    }
+    if (!key || !type || !value) {
+        return FOSSIL_MYSHELL_ERROR_INVALID_QUERY;
+    }
+    if (key[0] == '\0' || type[0] == '\0') {
+        return FOSSIL_MYSHELL_ERROR_INVALID_QUERY;
+    }
+
+    // Validate type against FSON type system
+    fossil_bluecrab_myshell_fson_type_t type_id = MYSHELL_FSON_TYPE_NULL;
+    bool valid_type = false;
+    for (size_t i = 0; i <= MYSHELL_FSON_TYPE_DURATION; ++i) {
+        if (strcmp(type, myshell_fson_type_names[i]) == 0) {
+            type_id = (fossil_bluecrab_myshell_fson_type_t)i;
+            valid_type = true;
+            break;
+        }
+    }
+    if (!valid_type) {
+        return FOSSIL_MYSHELL_ERROR_CONFIG_INVALID;
+    }
+
+    size_t key_len = strlen(key);
+    size_t value_len = strlen(value);
+    if (key_len > UINT32_MAX || value_len > UINT32_MAX) {
+        return FOSSIL_MYSHELL_ERROR_CAPACITY_EXCEEDED;
+    }
+
+    // Staging stays in memory unless the handle journals it
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    if (!store->stage.journal) {
+        return myshell_stage_put(store, (uint8_t)type_id, key, key_len, value, value_len)
+            ? FOSSIL_MYSHELL_ERROR_SUCCESS : FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+    }
+    fossil_bluecrab_myshell_error_t result = myshell_append_applied(db, MYSHELL_RECORD_STAGE, (uint8_t)type_id,
+                                                                    key, key_len, value, value_len);
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        return result;
+    }
+    result = myshell_log_settle(db, false);
+    myshell_compaction_tick(db);
+    return result;
+}
+
+fossil_bluecrab_myshell_error_t fossil_myshell_unstage(fossil_bluecrab_myshell_t *db, const char *key) {
+    if (!db || !db->is_open) {
+        return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
+    }
+    if (!key || key[0] == '\0') {
+        return FOSSIL_MYSHELL_ERROR_INVALID_QUERY;
+    }
+
+    size_t key_len = strlen(key);
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    if (!myshell_index_find(store->staged, key, key_len, myshell_hash64n(key, key_len))) {
+        return FOSSIL_MYSHELL_ERROR_NOT_FOUND;
+    }
+    if (!store->stage.journal) {
+        myshell_stage_remove(store, key, key_len);
+        return FOSSIL_MYSHELL_ERROR_SUCCESS;
+    }
+    fossil_bluecrab_myshell_error_t result = myshell_append_applied(db, MYSHELL_RECORD_UNSTAGE,
+                                                                    MYSHELL_FSON_TYPE_NULL, key, key_len, NULL, 0);
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        return result;
+    }
+    result = myshell_log_settle(db, false);
+    myshell_compaction_tick(db);
+    return result;
+}
+
+fossil_bluecrab_myshell_error_t fossil_myshell_set_stage_journal(fossil_bluecrab_myshell_t *db, bool enabled) {
     if (!db || !db->is_open) {
         return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
     }
-    if (!key || key[0] == '\0') {
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    if (store->stage.journal == enabled) {
+        return FOSSIL_MYSHELL_ERROR_SUCCESS;
+    }
+    store->stage.journal = enabled;
+    if (!enabled) {
+        return FOSSIL_MYSHELL_ERROR_SUCCESS;
+    }
+
+    // What is already staged goes into the journal first
+    fossil_bluecrab_myshell_error_t result = myshell_stage_journal(db);
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        result = myshell_log_settle(db, false);
+    }
+    return result;
+}
+
+fossil_bluecrab_myshell_error_t fossil_myshell_tag(fossil_bluecrab_myshell_t *db, const char *commit_hash, const char *tag_name) {
+    if (!db) {
+        return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
+    }
+    if (!db->is_open) {
+        return FOSSIL_MYSHELL_ERROR_LOCKED;
+    }
+    if (!commit_hash || !tag_name || tag_name[0] == '\0') {
         return FOSSIL_MYSHELL_ERROR_INVALID_QUERY;
     }
 
-    uint64_t key_hash = myshell_hash64(key);
-
-    // Read all lines, rewrite excluding the deleted key (matching both key, hash, and type)
-    fseek(db->file, 0, SEEK_SET);
-    char temp_path[256];
-    snprintf(temp_path, sizeof(temp_path), "%s.tmp", db->path);
-    FILE *temp_file = fopen(temp_path, "wb");
-    if (!temp_file) {
-        return FOSSIL_MYSHELL_ERROR_IO;
+    // The commit is found by its id in the commit graph
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    uint64_t hash;
+    fossil_bluecrab_myshell_error_t result = myshell_graph_resolve(store, commit_hash, &hash, NULL);
+    const myshell_graph_commit_t *commit = result == FOSSIL_MYSHELL_ERROR_SUCCESS
+                                         ? myshell_graph_find(&store->graph, hash) : NULL;
+    if (!commit) {
+        return FOSSIL_MYSHELL_ERROR_NOT_FOUND;
     }
+    fossil_bluecrab_myshell_fson_type_t commit_type = commit->type <= MYSHELL_FSON_TYPE_DURATION
+        ? (fossil_bluecrab_myshell_fson_type_t)commit->type : MYSHELL_FSON_TYPE_ENUM;
 
-    char line[1024];
-    bool found = false;
-    while (fgets(line, sizeof(line), db->file)) {
-        char *eq = strchr(line, '=');
-        if (eq) {
-            *eq = '\0';
-            char *hash_comment = strstr(eq + 1, "#hash=");
-            char *type_comment = strstr(eq + 1, "#type=");
-            if (hash_comment) {
-                uint64_t file_hash = 0;
-                sscanf(hash_comment, "#hash=%" SCNx64, &file_hash);
-                if (strcmp(line, key) == 0 && file_hash == key_hash) {
-                    // Optionally validate type against FSON type system
-                    if (type_comment) {
-                        char type_name[32] = {0};
-                        int i = 0;
-                        type_comment += 6;
-                        while (type_comment[i] && !isspace((unsigned char)type_comment[i]) && type_comment[i] != '#' && i < 31) {
-                            type_name[i] = type_comment[i];
-                            i++;
-                        }
-                        type_name[i] = '\0';
-                        bool valid_type = false;
-                        for (size_t j = 0; j <= MYSHELL_FSON_TYPE_DURATION; ++j) {
-                            if (strcmp(type_name, myshell_fson_type_names[j]) == 0) {
-                                valid_type = true;
-                                break;
-                            }
-                        }
-                        // If type is valid, skip line (delete)
-                        if (valid_type) {
-                            found = true;
-                            *eq = '='; // Restore
-                            continue;
-                        }
-                    } else {
-                        // No type info, still skip line
-                        found = true;
-                        *eq = '='; // Restore
-                        continue;
-                    }
-                }
-            } else {
-                if (strcmp(line, key) == 0) {
-                    found = true; // Skip this line
-                    *eq = '='; // Restore
-                    continue;
-                }
-            }
-            *eq = '='; // Restore
-        }
-        fputs(line, temp_file);
+    // Write tag info to the file for history (simple append), include FSON type
+    char hash_str[17];
+    snprintf(hash_str, sizeof(hash_str), "%016" PRIx64, hash);
+    result = myshell_append_applied(db, MYSHELL_RECORD_TAG, (uint8_t)commit_type,
+        tag_name, strlen(tag_name), hash_str, 16);
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        result = myshell_log_settle(db, false);
+    }
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        return result;
     }
 
-    fclose(temp_file);
-    fclose(db->file);
+    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+}
 
-    if (found) {
-        if (remove(db->path) != 0) {
-            remove(temp_path);
-            db->file = fopen(db->path, "rb+");
-            if (!db->file) return FOSSIL_MYSHELL_ERROR_IO;
-            return FOSSIL_MYSHELL_ERROR_IO;
-        }
-        if (rename(temp_path, db->path) != 0) {
-            db->file = fopen(db->path, "rb+");
-            if (!db->file) return FOSSIL_MYSHELL_ERROR_IO;
-            return FOSSIL_MYSHELL_ERROR_IO;
-        }
-        db->file = fopen(db->path, "rb+");
-        if (!db->file) {
-            return FOSSIL_MYSHELL_ERROR_IO;
-        }
-        db->last_modified = time(NULL);
-        return FOSSIL_MYSHELL_ERROR_SUCCESS;
-    } else {
-        remove(temp_path); // No change
-        db->file = fopen(db->path, "rb+");
-        if (!db->file) {
-            return FOSSIL_MYSHELL_ERROR_IO;
-        }
-        return FOSSIL_MYSHELL_ERROR_NOT_FOUND;
-    }
+/** Orders objects by where their records are in the file. */
+static int myshell_object_offset_cmp(const void *a, const void *b) {
+    uint64_t x = ((const myshell_object_t *)a)->offset, y = ((const myshell_object_t *)b)->offset;
+    return x < y ? -1 : x > y;
 }
 
-fossil_bluecrab_myshell_error_t fossil_myshell_commit(fossil_bluecrab_myshell_t *db, const char *message) {
+fossil_bluecrab_myshell_error_t fossil_myshell_log(fossil_bluecrab_myshell_t *db, fossil_myshell_commit_cb cb, void *user) {
     if (!db) {
         return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
     }
     if (!db->is_open) {
         return FOSSIL_MYSHELL_ERROR_LOCKED;
     }
-    if (!message || strlen(message) == 0) {
+    if (!cb) {
         return FOSSIL_MYSHELL_ERROR_INVALID_QUERY;
     }
 
-    // Store the commit message
-    if (db->commit_message) {
-        free(db->commit_message);
-    }
-    db->commit_message = myshell_strdup(message);
-    if (!db->commit_message) {
+    // The commit graph knows where every commit record is, so only those are
+    // read, in file order, rather than every record in the file. Records are
+    // parsed in place; only what the callback sees is copied out to be
+    // NUL-terminated. Commit ids are re-derived only past what an integrity
+    // check or an earlier walk already verified.
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    const myshell_graph_t *graph = &store->graph;
+    uint64_t trusted = store->verified > store->log_verified ? store->verified : store->log_verified;
+    myshell_object_t *commits = (myshell_object_t *)malloc((graph->count + 1) * sizeof(myshell_object_t));
+    if (!commits) {
         return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
     }
-    db->commit_timestamp = time(NULL);
-
-    // Prepare commit data for hashing
-    char commit_data[1024];
-    if (snprintf(commit_data, sizeof(commit_data), "%s:%lld", message, (long long)db->commit_timestamp) < 0) {
-        return FOSSIL_MYSHELL_ERROR_IO;
+    size_t count = 0;
+    for (size_t i = 0; i < graph->capacity; ++i) {
+        const myshell_graph_commit_t *slot = &graph->slots[i];
+        if (slot->generation && slot->kind == MYSHELL_RECORD_COMMIT) {
+            commits[count].id = slot->id;
+            commits[count].offset = slot->offset;
+            commits[count].length = slot->length;
+            commits[count].kind = 0;
+            count++;
+        }
     }
+    qsort(commits, count, sizeof(myshell_object_t), myshell_object_offset_cmp);
+
+    fossil_bluecrab_myshell_error_t result = FOSSIL_MYSHELL_ERROR_SUCCESS;
+    char hash_str[17];
+    char *text = NULL;
+    size_t text_cap = 0;
+    for (size_t i = 0; i < count && result == FOSSIL_MYSHELL_ERROR_SUCCESS; ++i) {
+        myshell_record_t rec;
+        char *heap;
+        result = myshell_object_record(db, &commits[i], &rec, &heap);
+        if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+            break;
+        }
+        long long timestamp = 0;
+        const char *message;
+        size_t message_len;
+        if (!myshell_commit_parse(&rec, &timestamp, &message, &message_len)) {
+            result = FOSSIL_MYSHELL_ERROR_PARSE_FAILED;
+        } else if (commits[i].offset >= trusted &&
+                   !myshell_commit_id_valid(&rec, commits[i].id, message, message_len, timestamp)) {
+            result = FOSSIL_MYSHELL_ERROR_INTEGRITY;
+        } else if (!myshell_buffer_reserve(&text, &text_cap, 0, message_len + 1)) {
+            result = FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+        } else {
+            memcpy(text, message, message_len);
+            text[message_len] = '\0';
+        }
+        free(heap);
+        if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+            break;
+        }
+        // A callback that writes may finish a compaction, which renumbers offsets
+        if (db->cache == store && commits[i].offset + commits[i].length > store->log_verified) {
+            store->log_verified = commits[i].offset + commits[i].length;
+        }
+        snprintf(hash_str, sizeof(hash_str), "%016" PRIx64, commits[i].id);
+        if (!cb(hash_str, text, user)) {
+            break;
+        }
+    }
+    free(text);
+    free(commits);
+    return result;
+}
 
-    // Update commit hashes (chain)
-    db->prev_commit_hash = db->commit_head;
-    db->commit_head = myshell_hash64(commit_data);
-
-    // Optionally, create a new commit object (simulate by updating author and parent_branch)
-    if (db->author) {
-        free(db->author);
+fossil_bluecrab_myshell_error_t fossil_myshell_backup(fossil_bluecrab_myshell_t *db, const char *backup_path) {
+    if (!db || !db->is_open) {
+        return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
     }
-    db->author = myshell_strdup("system");
-    if (!db->author) {
-        return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+    if (!backup_path || backup_path[0] == '\0') {
+        return FOSSIL_MYSHELL_ERROR_CONFIG_INVALID;
     }
 
-    if (db->parent_branch) {
-        free(db->parent_branch);
+    FILE *backup_file = fopen(backup_path, "wb");
+    if (!backup_file) {
+        return FOSSIL_MYSHELL_ERROR_BACKUP_FAILED;
     }
-    db->parent_branch = db->branch ? myshell_strdup(db->branch) : NULL;
-    if (db->branch && !db->parent_branch) {
-        return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+
+    // Write a hash of the backup path as a comment for integrity
+    uint64_t backup_hash = myshell_hash64(backup_path);
+    if (fprintf(backup_file, "#backup_hash=%016" PRIx64 "\n", backup_hash) < 0) {
+        fclose(backup_file);
+        return FOSSIL_MYSHELL_ERROR_IO;
     }
 
-    db->next_commit_hash = 0;
+    // Write FSON type system header for backup file
+    fprintf(backup_file, "#fson_types=");
+    for (size_t i = 0; i <= MYSHELL_FSON_TYPE_DURATION; ++i) {
+        fprintf(backup_file, "%s", myshell_fson_type_names[i]);
+        if (i < MYSHELL_FSON_TYPE_DURATION) fprintf(backup_file, ",");
+    }
+    fprintf(backup_file, "\n");
 
-    // Write commit info to the file for history (simple append)
-    if (fseek(db->file, 0, SEEK_END) != 0) {
+    // The file image (format header included) follows the text header
+    if (myshell_log_flush(db) != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        fclose(backup_file);
         return FOSSIL_MYSHELL_ERROR_IO;
     }
-    // FSON v2: commit lines can optionally include a #type=enum for commit type
-    // For compatibility, always append #type=enum to commit lines
-    if (fprintf(db->file, "#commit %016" PRIx64 " %s %lld #type=%s\n",
-                    db->commit_head, message, (long long)db->commit_timestamp,
-                    myshell_fson_type_to_string(MYSHELL_FSON_TYPE_ENUM)) < 0) {
-        return FOSSIL_MYSHELL_ERROR_IO;
+    myshell_fseek(db->file, 0, SEEK_SET);
+    char buffer[4096];
+    size_t bytes;
+    while ((bytes = fread(buffer, 1, sizeof(buffer), db->file)) > 0) {
+        if (fwrite(buffer, 1, bytes, backup_file) != bytes) {
+            fclose(backup_file);
+            return FOSSIL_MYSHELL_ERROR_IO;
+        }
     }
-    fflush(db->file);
 
-    db->last_modified = time(NULL);
+    if (ferror(db->file)) {
+        fclose(backup_file);
+        return FOSSIL_MYSHELL_ERROR_IO;
+    }
 
+    fclose(backup_file);
+    myshell_fseek(db->file, 0, SEEK_END); // Restore file position
     return FOSSIL_MYSHELL_ERROR_SUCCESS;
 }
 
-fossil_bluecrab_myshell_error_t fossil_myshell_branch(fossil_bluecrab_myshell_t *db, const char *branch_name) {
-    if (!db) {
+fossil_bluecrab_myshell_error_t fossil_myshell_restore(const char *backup_path, const char *target_path) {
+    if (!backup_path || !target_path) {
         return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
     }
-    if (!db->is_open) {
-        return FOSSIL_MYSHELL_ERROR_LOCKED;
-    }
-    if (!branch_name || branch_name[0] == '\0') {
-        return FOSSIL_MYSHELL_ERROR_INVALID_QUERY;
-    }
 
-    // Check for schema mismatch or unsupported version (simulate)
-    if (db->commit_head == 0) {
-        return FOSSIL_MYSHELL_ERROR_SCHEMA_MISMATCH;
+    FILE *backup_file = fopen(backup_path, "rb");
+    if (!backup_file) {
+        return FOSSIL_MYSHELL_ERROR_FILE_NOT_FOUND;
     }
 
-    // Update branch pointer
-    if (db->branch) {
-        free(db->branch);
-    }
-    db->branch = myshell_strdup(branch_name);
-    if (!db->branch) {
-        return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+    // Verify backup hash for integrity (first line should be "#backup_hash=...")
+    char hash_line[128];
+    uint64_t expected_hash = myshell_hash64(backup_path);
+    if (fgets(hash_line, sizeof(hash_line), backup_file)) {
+        uint64_t file_hash = 0;
+        if (strncmp(hash_line, "#backup_hash=", 13) == 0) {
+            sscanf(hash_line, "#backup_hash=%" SCNx64, &file_hash);
+            if (file_hash != expected_hash) {
+                fclose(backup_file);
+                return FOSSIL_MYSHELL_ERROR_INTEGRITY;
+            }
+        } else {
+            fclose(backup_file);
+            return FOSSIL_MYSHELL_ERROR_CORRUPTED;
+        }
+    } else {
+        fclose(backup_file);
+        return FOSSIL_MYSHELL_ERROR_CORRUPTED;
     }
 
-    // Set parent branch if not already set
-    if (!db->parent_branch) {
-        db->parent_branch = myshell_strdup(db->branch);
-        if (!db->parent_branch) {
-            return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+    // Next line should be FSON type system header
+    char fson_line[256];
+    if (fgets(fson_line, sizeof(fson_line), backup_file)) {
+        if (strncmp(fson_line, "#fson_types=", 12) != 0) {
+            fclose(backup_file);
+            return FOSSIL_MYSHELL_ERROR_CONFIG_INVALID;
+        }
+        // Optionally, validate that all types in header are known
+        char *types = fson_line + 12;
+        char *token = strtok(types, ",\n");
+        while (token) {
+            bool valid_type = false;
+            for (size_t i = 0; i <= MYSHELL_FSON_TYPE_DURATION; ++i) {
+                if (strcmp(token, myshell_fson_type_names[i]) == 0) {
+                    valid_type = true;
+                    break;
+                }
+            }
+            if (!valid_type) {
+                fclose(backup_file);
+                return FOSSIL_MYSHELL_ERROR_CONFIG_INVALID;
+            }
+            token = strtok(NULL, ",\n");
         }
+    } else {
+        fclose(backup_file);
+        return FOSSIL_MYSHELL_ERROR_CONFIG_INVALID;
     }
 
-    // Update commit_head to branch hash
-    db->commit_head = myshell_hash64(branch_name);
-
-    // FSON type system: branch is always type "enum"
-    fossil_bluecrab_myshell_fson_type_t type_id = MYSHELL_FSON_TYPE_ENUM;
-
-    // Optionally, write branch info to the file for history (simple append)
-    if (fseek(db->file, 0, SEEK_END) != 0) {
+    // What follows the text header is the database file image
+    FILE *target_file = fopen(target_path, "wb");
+    if (!target_file) {
+        fclose(backup_file);
         return FOSSIL_MYSHELL_ERROR_IO;
     }
-    if (fprintf(db->file, "#branch %016" PRIx64 " %s #type=%s\n", db->commit_head, branch_name, myshell_fson_type_to_string(type_id)) < 0) {
-        return FOSSIL_MYSHELL_ERROR_IO;
+
+    char buffer[4096];
+    size_t bytes;
+    while ((bytes = fread(buffer, 1, sizeof(buffer), backup_file)) > 0) {
+        if (fwrite(buffer, 1, bytes, target_file) != bytes) {
+            fclose(backup_file);
+            fclose(target_file);
+            return FOSSIL_MYSHELL_ERROR_IO;
+        }
     }
-    fflush(db->file);
 
-    db->last_modified = time(NULL);
+    if (ferror(backup_file)) {
+        fclose(backup_file);
+        fclose(target_file);
+        return FOSSIL_MYSHELL_ERROR_IO;
+    }
 
-    // Update branch pointers and commit chain (simple simulation)
-    db->prev_commit_hash = db->commit_head;
-    db->next_commit_hash = 0; // No next commit yet
+    fclose(backup_file);
+    fclose(target_file);
+    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+}
 
-    // Optionally, reset commit message and timestamp for new branch
-    if (db->commit_message) {
-        free(db->commit_message);
-        db->commit_message = NULL;
+const char *fossil_myshell_errstr(fossil_bluecrab_myshell_error_t err) {
+    switch (err) {
+        case FOSSIL_MYSHELL_ERROR_SUCCESS: return "Success";
+        case FOSSIL_MYSHELL_ERROR_INVALID_FILE: return "Invalid file";
+        case FOSSIL_MYSHELL_ERROR_FILE_NOT_FOUND: return "File not found";
+        case FOSSIL_MYSHELL_ERROR_IO: return "I/O error";
+        case FOSSIL_MYSHELL_ERROR_INVALID_QUERY: return "Invalid query";
+        case FOSSIL_MYSHELL_ERROR_CONCURRENCY: return "Concurrency error";
+        case FOSSIL_MYSHELL_ERROR_NOT_FOUND: return "Not found";
+        case FOSSIL_MYSHELL_ERROR_PERMISSION_DENIED: return "Permission denied";
+        case FOSSIL_MYSHELL_ERROR_CORRUPTED: return "Corrupted data";
+        case FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY: return "Out of memory";
+        case FOSSIL_MYSHELL_ERROR_UNSUPPORTED: return "Unsupported operation";
+        case FOSSIL_MYSHELL_ERROR_LOCKED: return "Resource locked";
+        case FOSSIL_MYSHELL_ERROR_TIMEOUT: return "Operation timed out";
+        case FOSSIL_MYSHELL_ERROR_ALREADY_EXISTS: return "Already exists";
+        case FOSSIL_MYSHELL_ERROR_BACKUP_FAILED: return "Backup failed";
+        case FOSSIL_MYSHELL_ERROR_PARSE_FAILED: return "Parse failed";
+        case FOSSIL_MYSHELL_ERROR_RESTORE_FAILED: return "Restore failed";
+        case FOSSIL_MYSHELL_ERROR_LOCK_FAILED: return "Lock failed";
+        case FOSSIL_MYSHELL_ERROR_SCHEMA_MISMATCH: return "Schema mismatch";
+        case FOSSIL_MYSHELL_ERROR_VERSION_UNSUPPORTED: return "Version unsupported";
+        case FOSSIL_MYSHELL_ERROR_INDEX_CORRUPTED: return "Index corrupted";
+        case FOSSIL_MYSHELL_ERROR_INTEGRITY: return "Integrity check failed";
+        case FOSSIL_MYSHELL_ERROR_TRANSACTION_FAILED: return "Transaction failed";
+        case FOSSIL_MYSHELL_ERROR_CAPACITY_EXCEEDED: return "Capacity exceeded";
+        case FOSSIL_MYSHELL_ERROR_CONFIG_INVALID: return "Invalid configuration";
+        case FOSSIL_MYSHELL_ERROR_UNKNOWN:
+        default:
+            return "Unknown error";
     }
-    db->commit_timestamp = 0;
+}
 
-    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+/**
+ * The Merkle links of a snapshot commit at @p offset: its parent must be an
+ * earlier commit and its root a tree node. Ids are content hashes, so a
+ * commit that checks out vouches for the history and the snapshot below it.
+ */
+static bool myshell_commit_links_valid(const myshell_store_t *store, uint64_t offset, uint64_t root,
+                                       uint64_t parent) {
+    const myshell_graph_commit_t *prev = parent ? myshell_graph_find(&store->graph, parent) : NULL;
+    if (parent && (!prev || prev->offset >= offset)) return false;
+    return !root || myshell_objects_find(&store->objects, root, MYSHELL_OBJECT_NODE);
 }
 
-fossil_bluecrab_myshell_error_t fossil_myshell_checkout(fossil_bluecrab_myshell_t *db, const char *branch_or_commit) {
-    if (!db) {
-        return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
+/** Every entry of a tree node must refer to a blob or node the file holds. */
+static bool myshell_node_links_valid(const myshell_store_t *store, const myshell_record_t *rec) {
+    const uint8_t *p = (const uint8_t *)rec->value + 1;
+    for (size_t i = 0; i < (rec->value_len - 1) / MYSHELL_TREE_ENTRY; ++i, p += MYSHELL_TREE_ENTRY) {
+        uint64_t ref = (uint64_t)myshell_get_u32(p + 6) << 32 | myshell_get_u32(p + 2);
+        if (!myshell_objects_find(&store->objects, ref, p[1] ? MYSHELL_OBJECT_BLOB : MYSHELL_OBJECT_NODE)) {
+            return false;
+        }
     }
-    if (!db->is_open) {
-        return FOSSIL_MYSHELL_ERROR_LOCKED;
+    return true;
+}
+
+/**
+ * Checks one record whose checksum already passed. Only reads the store, so
+ * workers of a parallel check call it concurrently; those leave the commit
+ * chain (@p links false) to a pass of their own.
+ */
+static fossil_bluecrab_myshell_error_t myshell_check_record(const myshell_store_t *store, const myshell_record_t *rec,
+                                                            bool links) {
+    uint64_t head, root, parent, merged;
+    // Every FSON type must be a known one
+    if (rec->type > MYSHELL_FSON_TYPE_DURATION) {
+        return FOSSIL_MYSHELL_ERROR_CONFIG_INVALID;
     }
-    if (!branch_or_commit || branch_or_commit[0] == '\0') {
-        return FOSSIL_MYSHELL_ERROR_INVALID_QUERY;
+    // Commit integrity: check hash
+    if (rec->kind == MYSHELL_RECORD_COMMIT) {
+        uint64_t parsed_hash = 0;
+        long long timestamp = 0;
+        const char *message;
+        size_t message_len;
+        if (!myshell_hash_parse(rec->key, rec->key_len, &parsed_hash) ||
+            !myshell_commit_parse(rec, &timestamp, &message, &message_len)) {
+            return FOSSIL_MYSHELL_ERROR_PARSE_FAILED;
+        }
+        if (!myshell_commit_id_valid(rec, parsed_hash, message, message_len, timestamp)) {
+            return FOSSIL_MYSHELL_ERROR_INTEGRITY;
+        }
+        if (links && myshell_commit_snapshot(rec, &root, &parent) &&
+            !myshell_commit_links_valid(store, rec->offset, root, parent)) {
+            return FOSSIL_MYSHELL_ERROR_INTEGRITY;
+        }
     }
-
-    uint64_t hash = myshell_hash64(branch_or_commit);
-
-    bool branch_found = false;
-    bool commit_found = false;
-    char found_branch_name[512] = {0};
-    fseek(db->file, 0, SEEK_SET);
-    char line[1024];
-    while (fgets(line, sizeof(line), db->file)) {
-        if (strncmp(line, "#branch ", 8) == 0) {
-            char hash_str[17] = {0};
-            char name[512] = {0};
-            int n = sscanf(line, "#branch %16s %511s", hash_str, name);
-            if (n >= 2) {
-                uint64_t parsed_hash = 0;
-                sscanf(hash_str, "%" SCNx64, &parsed_hash);
-                if ((strcmp(name, branch_or_commit) == 0) || (parsed_hash == hash)) {
-                    branch_found = true;
-                    strncpy(found_branch_name, name, sizeof(found_branch_name));
-                    found_branch_name[sizeof(found_branch_name) - 1] = '\0';
-                    break;
-                }
-            }
-        } else if (strncmp(line, "#commit ", 8) == 0) {
-            char hash_str[17] = {0};
-            int n = sscanf(line, "#commit %16s", hash_str);
-            if (n >= 1) {
-                uint64_t parsed_hash = 0;
-                sscanf(hash_str, "%" SCNx64, &parsed_hash);
-                if (parsed_hash == hash) {
-                    commit_found = true;
-                    break;
-                }
-            }
+    // A snapshot merge is content-addressed like a snapshot commit
+    else if (rec->kind == MYSHELL_RECORD_MERGE && myshell_merge_snapshot(rec, &root, &parent, &merged)) {
+        uint64_t parsed_hash = 0;
+        if (!myshell_hash_parse(rec->key, rec->key_len, &parsed_hash)) {
+            return FOSSIL_MYSHELL_ERROR_PARSE_FAILED;
+        }
+        if (parsed_hash != myshell_hash64n(rec->value, rec->value_len)) {
+            return FOSSIL_MYSHELL_ERROR_INTEGRITY;
+        }
+        if (links && (!myshell_commit_links_valid(store, rec->offset, root, parent) ||
+                      !myshell_commit_links_valid(store, rec->offset, 0, merged))) {
+            return FOSSIL_MYSHELL_ERROR_INTEGRITY;
         }
     }
-
-    if (!branch_found && !commit_found) {
-        return FOSSIL_MYSHELL_ERROR_NOT_FOUND;
+    // Data records, blobs and tombstones must name a key
+    else if ((rec->kind <= MYSHELL_RECORD_UNSTAGE || rec->kind == MYSHELL_RECORD_BLOB) && rec->key_len == 0) {
+        return FOSSIL_MYSHELL_ERROR_PARSE_FAILED;
     }
-
-    // Set branch name and update commit_head to hash
-    if (db->branch) {
-        free(db->branch);
+    // A batch record carries only the length of the batch after it
+    else if (rec->kind == MYSHELL_RECORD_BATCH && (rec->key_len != 0 || rec->value_len != 8)) {
+        return FOSSIL_MYSHELL_ERROR_PARSE_FAILED;
     }
-    db->branch = myshell_strdup(branch_found ? found_branch_name : branch_or_commit);
-    if (!db->branch) {
-        return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+    // A tree node is its depth plus whole entries
+    else if (rec->kind == MYSHELL_RECORD_NODE) {
+        if (rec->key_len != 0 || rec->value_len < 1 || (rec->value_len - 1) % MYSHELL_TREE_ENTRY != 0) {
+            return FOSSIL_MYSHELL_ERROR_PARSE_FAILED;
+        }
+        if (!myshell_node_links_valid(store, rec)) {
+            return FOSSIL_MYSHELL_ERROR_INTEGRITY;
+        }
+    }
+    // Checkout and head records name a commit and its tree
+    else if ((rec->kind == MYSHELL_RECORD_CHECKOUT || rec->kind == MYSHELL_RECORD_HEAD) &&
+             !myshell_head_parse(rec, &head, &root)) {
+        return FOSSIL_MYSHELL_ERROR_PARSE_FAILED;
     }
-    db->commit_head = hash;
-
-    db->last_modified = time(NULL);
-
     return FOSSIL_MYSHELL_ERROR_SUCCESS;
 }
 
-fossil_bluecrab_myshell_error_t fossil_myshell_merge(fossil_bluecrab_myshell_t *db, const char *source_branch, const char *message) {
-    if (!db) {
+/**
+ * Flushes the log and checks the file's size and header before its records
+ * are checked. Sets @p end to the end of the records.
+ */
+static fossil_bluecrab_myshell_error_t myshell_check_begin(fossil_bluecrab_myshell_t *db, uint64_t *end) {
+    if (!db || !db->is_open) {
         return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
     }
-    if (!db->is_open) {
-        return FOSSIL_MYSHELL_ERROR_LOCKED;
+
+    // Check file size consistency
+    if (myshell_log_flush(db) != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        return FOSSIL_MYSHELL_ERROR_IO;
     }
-    if (!source_branch || source_branch[0] == '\0' || !message || message[0] == '\0') {
-        return FOSSIL_MYSHELL_ERROR_INVALID_QUERY;
+    if (myshell_fseek(db->file, 0, SEEK_END) != 0)
+        return FOSSIL_MYSHELL_ERROR_IO;
+    int64_t current_size = myshell_ftell(db->file);
+    if (current_size < 0)
+        return FOSSIL_MYSHELL_ERROR_IO;
+    if ((uint64_t)current_size != (uint64_t)db->file_size) {
+        return FOSSIL_MYSHELL_ERROR_CORRUPTED;
     }
+    if (myshell_fseek(db->file, 0, SEEK_SET) != 0)
+        return FOSSIL_MYSHELL_ERROR_IO;
+    *end = (uint64_t)db->file_size;
+    return myshell_file_header_read(db->file);
+}
 
-    // Check for schema mismatch or unsupported version (simulate)
-    if (db->commit_head == 0) {
-        return FOSSIL_MYSHELL_ERROR_SCHEMA_MISMATCH;
+/**
+ * Records how far the file is verified, the checkpoint itself included, so
+ * the next check starts there. Not while compacting: the checkpoint's offset
+ * would not carry over to the compacted file.
+ */
+static fossil_bluecrab_myshell_error_t myshell_check_settle(fossil_bluecrab_myshell_t *db, uint64_t end) {
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    if (end <= store->verified || store->compaction) {
+        return FOSSIL_MYSHELL_ERROR_SUCCESS;
     }
-
-    // Find the source branch and optionally record its hash/name and type
-    uint64_t source_hash = myshell_hash64(source_branch);
-    bool branch_found = false;
-    char found_branch_name[512] = {0};
-    fossil_bluecrab_myshell_fson_type_t branch_type = MYSHELL_FSON_TYPE_ENUM;
-    fseek(db->file, 0, SEEK_SET);
-    char line[1024];
-    while (fgets(line, sizeof(line), db->file)) {
-        if (strncmp(line, "#branch ", 8) == 0) {
-            char hash_str[17] = {0};
-            char name[512] = {0};
-            char type_name[32] = {0};
-            int n = sscanf(line, "#branch %16s %511s #type=%31s", hash_str, name, type_name);
-            if (n >= 2) {
-                uint64_t parsed_hash = 0;
-                sscanf(hash_str, "%" SCNx64, &parsed_hash);
-                if ((strcmp(name, source_branch) == 0) || (parsed_hash == source_hash)) {
-                    branch_found = true;
-                    strncpy(found_branch_name, name, sizeof(found_branch_name) - 1);
-                    found_branch_name[sizeof(found_branch_name) - 1] = '\0';
-                    if (n == 3) {
-                        for (size_t i = 0; i <= MYSHELL_FSON_TYPE_DURATION; ++i) {
-                            if (strcmp(type_name, myshell_fson_type_names[i]) == 0) {
-                                branch_type = (fossil_bluecrab_myshell_fson_type_t)i;
-                                break;
-                            }
-                        }
-                    }
-                    break;
-                }
-            }
-        }
+    char value[17];
+    snprintf(value, sizeof(value), "%016" PRIx64, end + MYSHELL_RECORD_HEADER_SIZE + 16);
+    fossil_bluecrab_myshell_error_t result =
+        myshell_append_applied(db, MYSHELL_RECORD_CHECKPOINT, MYSHELL_FSON_TYPE_NULL, "", 0, value, 16);
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        result = myshell_log_settle(db, false);
     }
+    return result;
+}
 
-    if (!branch_found) {
-        return FOSSIL_MYSHELL_ERROR_NOT_FOUND;
+/**
+ * Checks the records from the verified checkpoint on, or all of them when
+ * @p full, and on success appends a checkpoint at the end of the file.
+ */
+static fossil_bluecrab_myshell_error_t myshell_check_integrity(fossil_bluecrab_myshell_t *db, bool full) {
+    uint64_t end = 0;
+    fossil_bluecrab_myshell_error_t result = myshell_check_begin(db, &end);
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        return result;
     }
 
-    // Create a merge commit
-    if (db->commit_message) {
-        free(db->commit_message);
+    // Records before the last checkpoint passed an earlier check and are
+    // skipped unless a full check is asked for. Every other record's checksum
+    // is verified by the cursor as it reads it.
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    uint64_t start = MYSHELL_FILE_HEADER_SIZE;
+    if (!full && store->verified > start && store->verified <= end) {
+        start = store->verified;
     }
-    db->commit_message = myshell_strdup(message);
-    if (!db->commit_message) {
-        return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+    myshell_cursor_t cur;
+    myshell_record_t rec;
+    myshell_cursor_open(&cur, db->file, myshell_map_cover(db, end), start, end);
+    while (result == FOSSIL_MYSHELL_ERROR_SUCCESS && myshell_cursor_next(&cur, &rec)) {
+        result = myshell_check_record(store, &rec, true);
     }
-    db->commit_timestamp = time(NULL);
-
-    // Prepare commit data for hashing, include source branch name
-    char commit_data[1024];
-    if (snprintf(commit_data, sizeof(commit_data), "Merge %s: %s:%lld", found_branch_name, message, (long long)db->commit_timestamp) < 0) {
-        return FOSSIL_MYSHELL_ERROR_IO;
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        result = cur.result;
     }
+    myshell_cursor_close(&cur);
 
-    // Update commit hashes (chain)
-    db->prev_commit_hash = db->commit_head;
-    db->commit_head = myshell_hash64(commit_data);
-    db->next_commit_hash = 0;
-
-    // Optionally, append merge info to file for history, include FSON type
-    if (fseek(db->file, 0, SEEK_END) == 0) {
-        fprintf(db->file, "#merge %016" PRIx64 " %s %s %lld #type=%s\n",
-                db->commit_head, found_branch_name, message, (long long)db->commit_timestamp,
-                myshell_fson_type_to_string(branch_type));
-        fflush(db->file);
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        result = myshell_check_settle(db, end);
     }
+    return result;
+}
 
-    db->last_modified = time(NULL);
-    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+fossil_bluecrab_myshell_error_t fossil_myshell_check_integrity(fossil_bluecrab_myshell_t *db) {
+    return myshell_check_integrity(db, false);
 }
 
-fossil_bluecrab_myshell_error_t fossil_myshell_revert(fossil_bluecrab_myshell_t *db, const char *commit_hash) {
-    if (!db) {
-        return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
-    }
-    if (!db->is_open) {
-        return FOSSIL_MYSHELL_ERROR_LOCKED;
-    }
-    if (!commit_hash || commit_hash[0] == '\0') {
-        return FOSSIL_MYSHELL_ERROR_INVALID_QUERY;
-    }
+fossil_bluecrab_myshell_error_t fossil_myshell_check_integrity_full(fossil_bluecrab_myshell_t *db) {
+    return myshell_check_integrity(db, true);
+}
 
-    uint64_t hash = myshell_hash64(commit_hash);
-
-    bool commit_found = false;
-    fossil_bluecrab_myshell_fson_type_t found_type = MYSHELL_FSON_TYPE_NULL;
-    fseek(db->file, 0, SEEK_SET);
-    char line[1024];
-    while (fgets(line, sizeof(line), db->file)) {
-        if (strncmp(line, "#commit ", 8) == 0) {
-            char hash_str[17] = {0};
-            char type_name[32] = {0};
-            int n = sscanf(line, "#commit %16s %*[^#] #type=%31s", hash_str, type_name);
-            if (n >= 1) {
-                uint64_t parsed_hash = 0;
-                sscanf(hash_str, "%" SCNx64, &parsed_hash);
-                if (parsed_hash == hash) {
-                    commit_found = true;
-                    // Validate FSON type if present
-                    if (n == 2) {
-                        for (size_t i = 0; i <= MYSHELL_FSON_TYPE_DURATION; ++i) {
-                            if (strcmp(type_name, myshell_fson_type_names[i]) == 0) {
-                                found_type = (fossil_bluecrab_myshell_fson_type_t)i;
-                                break;
-                            }
-                        }
-                        // If type is not valid, treat as config error
-                        if (found_type == MYSHELL_FSON_TYPE_NULL && strcmp(type_name, myshell_fson_type_names[0]) != 0) {
-                            return FOSSIL_MYSHELL_ERROR_CONFIG_INVALID;
-                        }
-                    } else {
-                        found_type = MYSHELL_FSON_TYPE_ENUM;
-                    }
-                    break;
-                }
+/*
+ * A parallel check splits the file into chunks at record boundaries, found by
+ * hopping from header to header without reading payloads, and hands the
+ * chunks to a pool of workers. The calling thread works too and waits for the
+ * rest, so the store the workers read does not change underneath them. A
+ * damaged record's header still gives its length, so a chunk carries on past
+ * it and keeps the first failures it finds; they are merged in file order at
+ * the end, after a last pass that checks the commit chain across chunks.
+ */
+#define MYSHELL_CHECK_CHUNKS_PER_THREAD 4
+#define MYSHELL_CHECK_MIN_CHUNK (64 * 1024)
+#define MYSHELL_CHECK_MAX_THREADS 64
+
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+    uint64_t records;         /* records checked */
+    size_t   found;           /* failures found; the first `kept` are in `failures` */
+    size_t   kept;
+    fossil_bluecrab_myshell_check_failure_t *failures;
+} myshell_check_chunk_t;
+
+typedef struct {
+    const myshell_store_t *store;
+    const char *path;         /* opened by each worker when there is no mapping */
+    const char *map;          /* mapping covering every chunk, or NULL */
+    myshell_check_chunk_t *chunks;
+    size_t   chunk_count;
+    size_t   next;            /* next chunk to hand out */
+    size_t   keep;            /* failures kept per chunk, at least one */
+    fossil_myshell_check_progress_cb progress;
+    void    *user;
+    myshell_mutex_t mutex;
+} myshell_check_job_t;
+
+static void myshell_check_fail(myshell_check_chunk_t *chunk, size_t keep, uint64_t offset,
+                               fossil_bluecrab_myshell_error_t error) {
+    if (chunk->kept < keep) {
+        chunk->failures[chunk->kept].offset = offset;
+        chunk->failures[chunk->kept].error = error;
+        chunk->kept++;
+    }
+    chunk->found++;
+}
+
+/** Checks every record of one chunk, carrying on past damaged ones. */
+static void myshell_check_chunk(const myshell_check_job_t *job, myshell_check_chunk_t *chunk, FILE *file) {
+    myshell_cursor_t cur;
+    myshell_record_t rec;
+    uint64_t offset = chunk->start;
+    while (offset < chunk->end) {
+        myshell_cursor_open(&cur, file, job->map, offset, chunk->end);
+        while (myshell_cursor_next(&cur, &rec)) {
+            fossil_bluecrab_myshell_error_t result = myshell_check_record(job->store, &rec, false);
+            if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+                myshell_check_fail(chunk, job->keep, rec.offset, result);
             }
+            chunk->records++;
         }
+        myshell_cursor_close(&cur);
+        if (cur.result == FOSSIL_MYSHELL_ERROR_SUCCESS) break;
+        myshell_check_fail(chunk, job->keep, cur.offset, cur.result);
+        // Headers were vetted by the split, so only a bad checksum can be
+        // stepped over; anything else ends the chunk.
+        if (cur.result != FOSSIL_MYSHELL_ERROR_INTEGRITY) break;
+        chunk->records++;
+        offset = cur.offset + rec.size;
     }
+}
 
-    if (!commit_found) {
-        return FOSSIL_MYSHELL_ERROR_NOT_FOUND;
+#if defined(_WIN32) || defined(_WIN64)
+static DWORD WINAPI myshell_check_main(LPVOID arg) {
+#else
+static void *myshell_check_main(void *arg) {
+#endif
+    myshell_check_job_t *job = (myshell_check_job_t *)arg;
+    FILE *file = job->map ? NULL : fopen(job->path, "rb");
+    for (;;) {
+        myshell_mutex_lock(&job->mutex);
+        size_t i = job->next < job->chunk_count ? job->next++ : job->chunk_count;
+        myshell_mutex_unlock(&job->mutex);
+        if (i == job->chunk_count) break;
+
+        myshell_check_chunk_t *chunk = &job->chunks[i];
+        if (job->map || file) {
+            myshell_check_chunk(job, chunk, file);
+        } else {
+            myshell_check_fail(chunk, job->keep, chunk->start, FOSSIL_MYSHELL_ERROR_IO);
+        }
+        if (job->progress) {
+            fossil_bluecrab_myshell_check_progress_t progress = {
+                i, job->chunk_count, chunk->start, chunk->end, chunk->records, chunk->found
+            };
+            myshell_mutex_lock(&job->mutex);
+            job->progress(&progress, job->user);
+            myshell_mutex_unlock(&job->mutex);
+        }
     }
-
-    // Set commit_head to the specified commit hash
-    db->commit_head = hash;
-
-    db->last_modified = time(NULL);
-
-    // Optionally, could store found_type in db if needed for future type-aware logic
-
-    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+    if (file) fclose(file);
+#if defined(_WIN32) || defined(_WIN64)
+    return 0;
+#else
+    return NULL;
+#endif
 }
 
-fossil_bluecrab_myshell_error_t fossil_myshell_stage(fossil_bluecrab_myshell_t *db, const char *key, const char *type, const char *value) {
-    if (!db || !db->is_open) {
-        return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
-    }
-    if (!key || !type || !value) {
-        return FOSSIL_MYSHELL_ERROR_INVALID_QUERY;
-    }
-    if (key[0] == '\0' || type[0] == '\0') {
-        return FOSSIL_MYSHELL_ERROR_INVALID_QUERY;
-    }
+static size_t myshell_cpu_count(void) {
+#if defined(_WIN32) || defined(_WIN64)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors ? (size_t)info.dwNumberOfProcessors : 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (size_t)n : 1;
+#endif
+}
 
-    // Validate type against FSON type system
-    fossil_bluecrab_myshell_fson_type_t type_id = MYSHELL_FSON_TYPE_NULL;
-    bool valid_type = false;
-    for (size_t i = 0; i <= MYSHELL_FSON_TYPE_DURATION; ++i) {
-        if (strcmp(type, myshell_fson_type_names[i]) == 0) {
-            type_id = (fossil_bluecrab_myshell_fson_type_t)i;
-            valid_type = true;
+/**
+ * Splits [start, end) into at most @p want + 1 chunks of at least @p target
+ * bytes, cutting only at record boundaries. Stops early at a header that is
+ * damaged or runs past @p end, setting @p framing to the error and @p stop to
+ * its offset; the chunks cover everything before it.
+ */
+static size_t myshell_check_split(FILE *file, const char *map, uint64_t start, uint64_t end, uint64_t target,
+                                  myshell_check_chunk_t *chunks, fossil_bluecrab_myshell_error_t *framing,
+                                  uint64_t *stop) {
+    size_t count = 0;
+    uint64_t offset = start, chunk_start = start;
+    *framing = FOSSIL_MYSHELL_ERROR_SUCCESS;
+    while (offset < end) {
+        uint8_t copy[MYSHELL_RECORD_HEADER_SIZE];
+        const uint8_t *header = copy;
+        if (end - offset < MYSHELL_RECORD_HEADER_SIZE) {
+            *framing = FOSSIL_MYSHELL_ERROR_CORRUPTED;
+            break;
+        }
+        if (map) {
+            header = (const uint8_t *)map + offset;
+        } else if (!myshell_pread(file, copy, sizeof(copy), offset)) {
+            *framing = FOSSIL_MYSHELL_ERROR_IO;
+            break;
+        }
+        uint64_t size = (uint64_t)MYSHELL_RECORD_HEADER_SIZE + myshell_get_u32(header + 8) +
+                        myshell_get_u32(header + 12);
+        if (!myshell_record_header_valid(header)) {
+            *framing = FOSSIL_MYSHELL_ERROR_INTEGRITY;
+            break;
+        }
+        if (size > end - offset) {
+            *framing = FOSSIL_MYSHELL_ERROR_CORRUPTED;
             break;
         }
+        offset += size;
+        if (offset - chunk_start >= target && offset < end) {
+            chunks[count].start = chunk_start;
+            chunks[count].end = offset;
+            count++;
+            chunk_start = offset;
+        }
     }
-    if (!valid_type) {
-        return FOSSIL_MYSHELL_ERROR_CONFIG_INVALID;
+    *stop = offset;
+    if (offset > chunk_start) {
+        chunks[count].start = chunk_start;
+        chunks[count].end = offset;
+        count++;
     }
+    return count;
+}
 
-    uint64_t key_hash = myshell_hash64(key);
+static int myshell_check_failure_cmp(const void *a, const void *b) {
+    uint64_t x = ((const fossil_bluecrab_myshell_check_failure_t *)a)->offset;
+    uint64_t y = ((const fossil_bluecrab_myshell_check_failure_t *)b)->offset;
+    return x < y ? -1 : x > y;
+}
 
-    // Remove any previous staged entry for this key before adding new
-    fseek(db->file, 0, SEEK_SET);
-    char temp_path[256];
-    snprintf(temp_path, sizeof(temp_path), "%s.tmp", db->path);
-    FILE *temp_file = fopen(temp_path, "wb");
-    if (!temp_file) {
-        return FOSSIL_MYSHELL_ERROR_IO;
+fossil_bluecrab_myshell_error_t fossil_myshell_check_integrity_parallel(
+    fossil_bluecrab_myshell_t *db, size_t threads, fossil_bluecrab_myshell_check_failure_t *failures,
+    size_t max_failures, size_t *failure_count, fossil_myshell_check_progress_cb progress, void *user) {
+    if (failure_count) *failure_count = 0;
+    if (max_failures > 0 && !failures) {
+        return FOSSIL_MYSHELL_ERROR_INVALID_QUERY;
     }
-
-    char line[1024];
-    while (fgets(line, sizeof(line), db->file)) {
-        if (strncmp(line, "#stage ", 7) == 0) {
-            char *eq = strchr(line + 7, '=');
-            if (eq) {
-                *eq = '\0';
-                char *hash_comment = strstr(eq + 1, "#hash=");
-                if (hash_comment) {
-                    uint64_t file_hash = 0;
-                    sscanf(hash_comment, "#hash=%" SCNx64, &file_hash);
-                    if (strcmp(line + 7, key) == 0 && file_hash == key_hash) {
-                        *eq = '='; // Restore
-                        continue;
-                    }
-                } else {
-                    if (strcmp(line + 7, key) == 0) {
-                        *eq = '='; // Restore
-                        continue;
-                    }
-                }
-                *eq = '='; // Restore
+    uint64_t end = 0;
+    fossil_bluecrab_myshell_error_t result = myshell_check_begin(db, &end);
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        return result;
+    }
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    const char *map = myshell_map_cover(db, end);
+
+    if (threads == 0) threads = myshell_cpu_count();
+    if (threads > MYSHELL_CHECK_MAX_THREADS) threads = MYSHELL_CHECK_MAX_THREADS;
+    size_t want = threads * MYSHELL_CHECK_CHUNKS_PER_THREAD;
+    uint64_t span = end - MYSHELL_FILE_HEADER_SIZE;
+    uint64_t target = span / want > MYSHELL_CHECK_MIN_CHUNK ? span / want : MYSHELL_CHECK_MIN_CHUNK;
+
+    myshell_check_job_t job;
+    memset(&job, 0, sizeof(job));
+    job.store = store;
+    job.path = db->path;
+    job.map = map;
+    job.keep = max_failures ? max_failures : 1;
+    job.progress = progress;
+    job.user = user;
+    job.chunks = (myshell_check_chunk_t *)calloc(want + 1, sizeof(myshell_check_chunk_t));
+    if (!job.chunks) return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+
+    fossil_bluecrab_myshell_error_t framing;
+    uint64_t stop;
+    job.chunk_count = myshell_check_split(db->file, map, MYSHELL_FILE_HEADER_SIZE, end, target, job.chunks,
+                                          &framing, &stop);
+    for (size_t i = 0; i < job.chunk_count; ++i) {
+        job.chunks[i].failures = (fossil_bluecrab_myshell_check_failure_t *)malloc(
+            job.keep * sizeof(fossil_bluecrab_myshell_check_failure_t));
+        if (!job.chunks[i].failures) result = FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+    }
+
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        // The calling thread is one of the workers; a helper that cannot be
+        // started only means fewer of them.
+        myshell_thread_t helpers[MYSHELL_CHECK_MAX_THREADS];
+        size_t started = 0;
+        myshell_mutex_init(&job.mutex);
+        while (started + 1 < threads && started + 1 < job.chunk_count) {
+#if defined(_WIN32) || defined(_WIN64)
+            helpers[started] = CreateThread(NULL, 0, myshell_check_main, &job, 0, NULL);
+            if (!helpers[started]) break;
+#else
+            if (pthread_create(&helpers[started], NULL, myshell_check_main, &job) != 0) break;
+#endif
+            started++;
+        }
+        myshell_check_main(&job);
+        for (size_t i = 0; i < started; ++i) {
+#if defined(_WIN32) || defined(_WIN64)
+            WaitForSingleObject(helpers[i], INFINITE);
+            CloseHandle(helpers[i]);
+#else
+            pthread_join(helpers[i], NULL);
+#endif
+        }
+        myshell_mutex_destroy(&job.mutex);
+    }
+
+    // Gather every chunk's failures, the split's and those of the commit
+    // chain, which the graph holds whole, then keep the first ones.
+    size_t total = 0, gathered = 0, cap = 1;
+    for (size_t i = 0; i < job.chunk_count; ++i) cap += job.chunks[i].kept;
+    for (size_t i = 0; i < store->graph.capacity; ++i) {
+        if (store->graph.slots[i].generation && store->graph.slots[i].snapshot) cap++;
+    }
+    fossil_bluecrab_myshell_check_failure_t *all = NULL;
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        all = (fossil_bluecrab_myshell_check_failure_t *)malloc(cap * sizeof(*all));
+        if (!all) result = FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+    }
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        for (size_t i = 0; i < job.chunk_count; ++i) {
+            memcpy(all + gathered, job.chunks[i].failures, job.chunks[i].kept * sizeof(*all));
+            gathered += job.chunks[i].kept;
+            total += job.chunks[i].found;
+        }
+        if (framing != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+            all[gathered].offset = stop;
+            all[gathered].error = framing;
+            gathered++;
+            total++;
+        }
+        for (size_t i = 0; i < store->graph.capacity; ++i) {
+            const myshell_graph_commit_t *c = &store->graph.slots[i];
+            if (c->generation && c->snapshot &&
+                (!myshell_commit_links_valid(store, c->offset, c->root, c->parents[0]) ||
+                 !myshell_commit_links_valid(store, c->offset, 0, c->parents[1]))) {
+                all[gathered].offset = c->offset;
+                all[gathered].error = FOSSIL_MYSHELL_ERROR_INTEGRITY;
+                gathered++;
+                total++;
             }
         }
-        fputs(line, temp_file);
+        qsort(all, gathered, sizeof(*all), myshell_check_failure_cmp);
+        // A commit whose record is damaged can show up twice
+        size_t unique = 0;
+        for (size_t i = 0; i < gathered; ++i) {
+            if (unique > 0 && all[unique - 1].offset == all[i].offset) {
+                total--;
+                continue;
+            }
+            all[unique++] = all[i];
+        }
+        size_t copied = unique < max_failures ? unique : max_failures;
+        if (copied) memcpy(failures, all, copied * sizeof(*all));
+        if (failure_count) *failure_count = total;
+        result = total ? all[0].error : myshell_check_settle(db, end);
     }
 
-    // Add new staged entry at the end, using FSON type system
-    fprintf(temp_file, "#stage %s=%s #type=%s #hash=%016" PRIx64 "\n", key, value, myshell_fson_type_to_string(type_id), key_hash);
+    free(all);
+    for (size_t i = 0; i < job.chunk_count; ++i) free(job.chunks[i].failures);
+    free(job.chunks);
+    return result;
+}
 
-    fclose(temp_file);
-    fclose(db->file);
+/*
+ * A diff is a hash join over tables both handles already hold: each commit in
+ * one graph is probed for in the other, and each staged key in one staged
+ * index likewise, then the other side's leftovers are found the same way. Only
+ * the records being rendered are read, one at a time into scratch buffers that
+ * grow to the largest one, so memory stays flat however long the history is.
+ */
+typedef struct {
+    char  *record;
+    size_t record_cap;
+    char  *line;
+    size_t line_cap;
+} myshell_diff_side_t;
+
+static bool myshell_diff_reserve(char **buf, size_t *cap, size_t need) {
+    if (need <= *cap) return true;
+    size_t grown_cap = *cap ? *cap : 256;
+    while (grown_cap < need) grown_cap *= 2;
+    char *grown = (char *)realloc(*buf, grown_cap);
+    if (!grown) return false;
+    *buf = grown;
+    *cap = grown_cap;
+    return true;
+}
 
-    if (remove(db->path) != 0) {
-        remove(temp_path);
-        db->file = fopen(db->path, "rb+");
-        if (!db->file) return FOSSIL_MYSHELL_ERROR_IO;
-        return FOSSIL_MYSHELL_ERROR_IO;
+/** Reads and decodes the record at [offset, offset + length) of @p db into @p side. */
+static fossil_bluecrab_myshell_error_t myshell_diff_read(const fossil_bluecrab_myshell_t *db, myshell_diff_side_t *side,
+                                                         uint64_t offset, size_t length, myshell_record_t *rec) {
+    if (!myshell_diff_reserve(&side->record, &side->record_cap, length)) {
+        return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
     }
-    if (rename(temp_path, db->path) != 0) {
-        db->file = fopen(db->path, "rb+");
-        if (!db->file) return FOSSIL_MYSHELL_ERROR_IO;
+    if (!myshell_read_at(db, side->record, length, offset)) {
         return FOSSIL_MYSHELL_ERROR_IO;
     }
-
-    db->file = fopen(db->path, "rb+");
-    if (!db->file) {
-        return FOSSIL_MYSHELL_ERROR_IO;
+    if (!myshell_record_decode(side->record, length, rec)) {
+        return FOSSIL_MYSHELL_ERROR_CORRUPTED;
     }
+    rec->offset = offset;
+    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+}
 
-    db->last_modified = time(NULL);
+/** Renders a graph commit of @p db as a v1-style text line in side->line. */
+static fossil_bluecrab_myshell_error_t myshell_diff_commit_line(const fossil_bluecrab_myshell_t *db,
+                                                                myshell_diff_side_t *side,
+                                                                const myshell_graph_commit_t *commit) {
+    myshell_record_t rec;
+    fossil_bluecrab_myshell_error_t result = myshell_diff_read(db, side, commit->offset, commit->length, &rec);
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) return result;
+    long long timestamp = 0;
+    const char *message;
+    size_t message_len;
+    if (!myshell_commit_parse(&rec, &timestamp, &message, &message_len)) {
+        return FOSSIL_MYSHELL_ERROR_PARSE_FAILED;
+    }
+    if (!myshell_diff_reserve(&side->line, &side->line_cap, message_len + 64)) {
+        return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+    }
+    snprintf(side->line, side->line_cap, "#commit %016" PRIx64 " %.*s %lld #type=%s\n", commit->id,
+             (int)message_len, message, timestamp,
+             myshell_fson_type_to_string((fossil_bluecrab_myshell_fson_type_t)rec.type));
     return FOSSIL_MYSHELL_ERROR_SUCCESS;
 }
 
-fossil_bluecrab_myshell_error_t fossil_myshell_unstage(fossil_bluecrab_myshell_t *db, const char *key) {
-    if (!db || !db->is_open) {
-        return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
+/** Renders the staged change of a key of @p db as a v1-style text line in side->line. */
+static fossil_bluecrab_myshell_error_t myshell_diff_stage_line(const fossil_bluecrab_myshell_t *db,
+                                                               myshell_diff_side_t *side,
+                                                               const myshell_index_slot_t *slot) {
+    myshell_record_t rec;
+    if (!myshell_record_decode(((const myshell_store_t *)db->cache)->stage.records + slot->offset, slot->length,
+                               &rec)) {
+        return FOSSIL_MYSHELL_ERROR_INDEX_CORRUPTED;
     }
-    if (!key || key[0] == '\0') {
-        return FOSSIL_MYSHELL_ERROR_INVALID_QUERY;
+    if (!myshell_diff_reserve(&side->line, &side->line_cap, (size_t)rec.key_len + rec.value_len + 32)) {
+        return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
     }
+    snprintf(side->line, side->line_cap, "#stage %s=%.*s #type=%s\n", slot->key, (int)rec.value_len, rec.value,
+             myshell_fson_type_to_string((fossil_bluecrab_myshell_fson_type_t)rec.type));
+    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+}
 
-    uint64_t key_hash = myshell_hash64(key);
-
-    // Read all lines, rewrite excluding the unstaged key (matching key, hash, and FSON type)
-    fseek(db->file, 0, SEEK_SET);
-    char temp_path[256];
-    snprintf(temp_path, sizeof(temp_path), "%s.tmp", db->path);
-    FILE *temp_file = fopen(temp_path, "wb");
-    if (!temp_file) {
-        return FOSSIL_MYSHELL_ERROR_IO;
+/**
+ * Emits the commits of @p from missing in @p to (as @p change) and, when
+ * @p changed, those present in both whose lines differ. Clears @p more when
+ * the callback asks to stop.
+ */
+static fossil_bluecrab_myshell_error_t myshell_diff_commits(const fossil_bluecrab_myshell_t *from,
+                                                            const fossil_bluecrab_myshell_t *to, char change,
+                                                            bool changed, myshell_diff_side_t sides[2],
+                                                            fossil_myshell_diff_cb cb, void *user, bool *more) {
+    const myshell_graph_t *a = &((const myshell_store_t *)from->cache)->graph;
+    const myshell_graph_t *b = &((const myshell_store_t *)to->cache)->graph;
+    fossil_bluecrab_myshell_error_t result = FOSSIL_MYSHELL_ERROR_SUCCESS;
+    for (size_t i = 0; *more && result == FOSSIL_MYSHELL_ERROR_SUCCESS && i < a->capacity; ++i) {
+        const myshell_graph_commit_t *commit = &a->slots[i];
+        if (!commit->generation || commit->kind != MYSHELL_RECORD_COMMIT) continue;
+        const myshell_graph_commit_t *other = myshell_graph_find(b, commit->id);
+        if (!other || other->kind != MYSHELL_RECORD_COMMIT) {
+            result = myshell_diff_commit_line(from, &sides[0], commit);
+            if (result == FOSSIL_MYSHELL_ERROR_SUCCESS) {
+                *more = change == '-' ? cb('-', sides[0].line, NULL, user) : cb('+', NULL, sides[0].line, user);
+            }
+        } else if (changed && (commit->type != other->type || commit->timestamp != other->timestamp)) {
+            // Ids cover the message and timestamp, so only a differing type
+            // (or timestamp, on a collision) makes the lines differ.
+            result = myshell_diff_commit_line(from, &sides[0], commit);
+            if (result == FOSSIL_MYSHELL_ERROR_SUCCESS) {
+                result = myshell_diff_commit_line(to, &sides[1], other);
+            }
+            if (result == FOSSIL_MYSHELL_ERROR_SUCCESS && strcmp(sides[0].line, sides[1].line) != 0) {
+                *more = cb('~', sides[0].line, sides[1].line, user);
+            }
+        }
     }
+    return result;
+}
 
-    char line[1024];
-    bool found = false;
-    while (fgets(line, sizeof(line), db->file)) {
-        if (strncmp(line, "#stage ", 7) == 0) {
-            char *eq = strchr(line + 7, '=');
-            if (eq) {
-                *eq = '\0';
-                char *hash_comment = strstr(eq + 1, "#hash=");
-                char *type_comment = strstr(eq + 1, "#type=");
-                bool valid_type = false;
-                if (type_comment) {
-                    char type_name[32] = {0};
-                    int i = 0;
-                    type_comment += 6;
-                    while (type_comment[i] && !isspace((unsigned char)type_comment[i]) && type_comment[i] != '#' && i < 31) {
-                        type_name[i] = type_comment[i];
-                        i++;
-                    }
-                    type_name[i] = '\0';
-                    for (size_t j = 0; j <= MYSHELL_FSON_TYPE_DURATION; ++j) {
-                        if (strcmp(type_name, myshell_fson_type_names[j]) == 0) {
-                            valid_type = true;
-                            break;
-                        }
-                    }
-                }
-                if (hash_comment) {
-                    uint64_t file_hash = 0;
-                    sscanf(hash_comment, "#hash=%" SCNx64, &file_hash);
-                    if (strcmp(line + 7, key) == 0 && file_hash == key_hash && (type_comment == NULL || valid_type)) {
-                        found = true; // Skip this line
-                        *eq = '='; // Restore
-                        continue;
-                    }
-                } else {
-                    if (strcmp(line + 7, key) == 0 && (type_comment == NULL || valid_type)) {
-                        found = true; // Skip this line
-                        *eq = '='; // Restore
-                        continue;
-                    }
-                }
-                *eq = '='; // Restore
+/** The staged-key counterpart of myshell_diff_commits. */
+static fossil_bluecrab_myshell_error_t myshell_diff_stages(const fossil_bluecrab_myshell_t *from,
+                                                           const fossil_bluecrab_myshell_t *to, char change,
+                                                           bool changed, myshell_diff_side_t sides[2],
+                                                           fossil_myshell_diff_cb cb, void *user, bool *more) {
+    const myshell_index_t *a = ((const myshell_store_t *)from->cache)->staged;
+    myshell_index_t *b = ((const myshell_store_t *)to->cache)->staged;
+    fossil_bluecrab_myshell_error_t result = FOSSIL_MYSHELL_ERROR_SUCCESS;
+    for (size_t i = 0; *more && result == FOSSIL_MYSHELL_ERROR_SUCCESS && i < a->capacity; ++i) {
+        const myshell_index_slot_t *slot = &a->slots[i];
+        if (!slot->key) continue;
+        const myshell_index_slot_t *other = myshell_index_find(b, slot->key, strlen(slot->key), slot->hash);
+        if (!other) {
+            result = myshell_diff_stage_line(from, &sides[0], slot);
+            if (result == FOSSIL_MYSHELL_ERROR_SUCCESS) {
+                *more = change == '-' ? cb('-', sides[0].line, NULL, user) : cb('+', NULL, sides[0].line, user);
+            }
+        } else if (changed) {
+            result = myshell_diff_stage_line(from, &sides[0], slot);
+            if (result == FOSSIL_MYSHELL_ERROR_SUCCESS) {
+                result = myshell_diff_stage_line(to, &sides[1], other);
+            }
+            if (result == FOSSIL_MYSHELL_ERROR_SUCCESS && strcmp(sides[0].line, sides[1].line) != 0) {
+                *more = cb('~', sides[0].line, sides[1].line, user);
             }
         }
-        fputs(line, temp_file);
     }
+    return result;
+}
 
-    fclose(temp_file);
-    fclose(db->file);
-
-    if (found) {
-        if (remove(db->path) != 0) {
-            remove(temp_path);
-            db->file = fopen(db->path, "rb+");
-            if (!db->file) return FOSSIL_MYSHELL_ERROR_IO;
-            return FOSSIL_MYSHELL_ERROR_IO;
-        }
-        if (rename(temp_path, db->path) != 0) {
-            db->file = fopen(db->path, "rb+");
-            if (!db->file) return FOSSIL_MYSHELL_ERROR_IO;
-        }
+fossil_bluecrab_myshell_error_t fossil_myshell_diff_stream(const fossil_bluecrab_myshell_t *db1,
+                                                           const fossil_bluecrab_myshell_t *db2,
+                                                           fossil_myshell_diff_cb cb, void *user) {
+    if (!db1 || !db2 || !db1->is_open || !db2->is_open) {
+        return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
+    }
+    if (!cb) {
+        return FOSSIL_MYSHELL_ERROR_INVALID_QUERY;
     }
 
-    db->file = fopen(db->path, "rb+");
-    if (!db->file) {
-        return FOSSIL_MYSHELL_ERROR_IO;
+    // Commits removed or changed, commits added, then the same for staged entries
+    myshell_diff_side_t sides[2];
+    memset(sides, 0, sizeof(sides));
+    bool more = true;
+    fossil_bluecrab_myshell_error_t result = myshell_diff_commits(db1, db2, '-', true, sides, cb, user, &more);
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS && more) {
+        result = myshell_diff_commits(db2, db1, '+', false, sides, cb, user, &more);
+    }
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS && more) {
+        result = myshell_diff_stages(db1, db2, '-', true, sides, cb, user, &more);
+    }
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS && more) {
+        result = myshell_diff_stages(db2, db1, '+', false, sides, cb, user, &more);
+    }
+    for (int i = 0; i < 2; ++i) {
+        free(sides[i].record);
+        free(sides[i].line);
     }
+    return result;
+}
 
-    return found ? FOSSIL_MYSHELL_ERROR_SUCCESS : FOSSIL_MYSHELL_ERROR_NOT_FOUND;
+typedef struct {
+    char  *out;
+    size_t size;
+    size_t pos;
+    bool   overflow;
+} myshell_diff_buffer_t;
+
+static bool myshell_diff_append(char change, const char *before, const char *after, void *user) {
+    myshell_diff_buffer_t *buffer = (myshell_diff_buffer_t *)user;
+    int n = change == '~' ? snprintf(buffer->out + buffer->pos, buffer->size - buffer->pos, "~ %s~ %s", before, after)
+                          : snprintf(buffer->out + buffer->pos, buffer->size - buffer->pos, "%c %s", change,
+                                     change == '-' ? before : after);
+    if (n < 0 || (size_t)n >= buffer->size - buffer->pos) {
+        buffer->overflow = true;
+        return false;
+    }
+    buffer->pos += (size_t)n;
+    return true;
 }
 
-fossil_bluecrab_myshell_error_t fossil_myshell_tag(fossil_bluecrab_myshell_t *db, const char *commit_hash, const char *tag_name) {
-    if (!db) {
+fossil_bluecrab_myshell_error_t fossil_myshell_diff(
+    const fossil_bluecrab_myshell_t *db1,
+    const fossil_bluecrab_myshell_t *db2,
+    char *out_diff,
+    size_t out_size
+) {
+    if (!db1 || !db2 || !db1->is_open || !db2->is_open || !out_diff || out_size == 0) {
         return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
     }
-    if (!db->is_open) {
-        return FOSSIL_MYSHELL_ERROR_LOCKED;
+    myshell_diff_buffer_t buffer = { out_diff, out_size, 0, false };
+    out_diff[0] = '\0';
+    fossil_bluecrab_myshell_error_t result = fossil_myshell_diff_stream(db1, db2, myshell_diff_append, &buffer);
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS && buffer.overflow) {
+        return FOSSIL_MYSHELL_ERROR_CAPACITY_EXCEEDED;
     }
-    if (!commit_hash || !tag_name || tag_name[0] == '\0') {
-        return FOSSIL_MYSHELL_ERROR_INVALID_QUERY;
+    return result;
+}
+
+fossil_bluecrab_myshell_error_t fossil_myshell_compact(fossil_bluecrab_myshell_t *db) {
+    if (!db || !db->is_open) {
+        return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
     }
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    if (store->compaction) {
+        return FOSSIL_MYSHELL_ERROR_SUCCESS; // Already running
+    }
+    return myshell_compaction_start(db);
+}
 
-    uint64_t hash = myshell_hash64(commit_hash);
-
-    bool commit_found = false;
-    fossil_bluecrab_myshell_fson_type_t commit_type = MYSHELL_FSON_TYPE_ENUM;
-    fseek(db->file, 0, SEEK_SET);
-    char line[1024];
-    while (fgets(line, sizeof(line), db->file)) {
-        if (strncmp(line, "#commit ", 8) == 0) {
-            char hash_str[17] = {0};
-            char type_name[32] = {0};
-            int n = sscanf(line, "#commit %16s %*[^#] #type=%31s", hash_str, type_name);
-            if (n >= 1) {
-                uint64_t parsed_hash = 0;
-                sscanf(hash_str, "%" SCNx64, &parsed_hash);
-                if (parsed_hash == hash) {
-                    commit_found = true;
-                    if (n == 2) {
-                        for (size_t i = 0; i <= MYSHELL_FSON_TYPE_DURATION; ++i) {
-                            if (strcmp(type_name, myshell_fson_type_names[i]) == 0) {
-                                commit_type = (fossil_bluecrab_myshell_fson_type_t)i;
-                                break;
-                            }
-                        }
-                    }
-                    break;
-                }
-            }
-        }
+fossil_bluecrab_myshell_error_t fossil_myshell_compact_wait(fossil_bluecrab_myshell_t *db) {
+    if (!db || !db->is_open) {
+        return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
+    }
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    if (!store->compaction) {
+        return FOSSIL_MYSHELL_ERROR_SUCCESS;
     }
+    return myshell_compaction_finish(db);
+}
 
-    if (!commit_found) {
-        return FOSSIL_MYSHELL_ERROR_NOT_FOUND;
+fossil_bluecrab_myshell_error_t fossil_myshell_set_compaction(fossil_bluecrab_myshell_t *db, double garbage_ratio, uint64_t max_bytes_per_sec) {
+    if (!db || !db->is_open) {
+        return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
     }
+    if (!(garbage_ratio >= 0.0 && garbage_ratio <= 1.0)) {
+        return FOSSIL_MYSHELL_ERROR_CONFIG_INVALID;
+    }
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    store->compact_ratio = garbage_ratio;
+    store->compact_rate = max_bytes_per_sec;
+    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+}
 
-    // Write tag info to the file for history (simple append), include FSON type
-    if (fseek(db->file, 0, SEEK_END) != 0) {
-        return FOSSIL_MYSHELL_ERROR_IO;
+fossil_bluecrab_myshell_error_t fossil_myshell_set_durability(fossil_bluecrab_myshell_t *db, fossil_bluecrab_myshell_durability_t mode, uint64_t interval_ms) {
+    if (!db || !db->is_open) {
+        return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
     }
-    if (fprintf(db->file, "#tag %016" PRIx64 " %s #type=%s\n", hash, tag_name, myshell_fson_type_to_string(commit_type)) < 0) {
-        return FOSSIL_MYSHELL_ERROR_IO;
+    if (mode != FOSSIL_MYSHELL_DURABILITY_NONE && mode != FOSSIL_MYSHELL_DURABILITY_INTERVAL &&
+        mode != FOSSIL_MYSHELL_DURABILITY_COMMIT) {
+        return FOSSIL_MYSHELL_ERROR_CONFIG_INVALID;
+    }
+    myshell_log_t *log = &((myshell_store_t *)db->cache)->log;
+    log->durability = mode;
+    log->sync_interval_ms = interval_ms;
+    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+}
+
+fossil_bluecrab_myshell_error_t fossil_myshell_sync(fossil_bluecrab_myshell_t *db) {
+    if (!db || !db->is_open) {
+        return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
     }
-    fflush(db->file);
+    return myshell_log_sync(db);
+}
+
+fossil_bluecrab_myshell_batch_t *fossil_myshell_batch_new(void) {
+    return (fossil_bluecrab_myshell_batch_t *)calloc(1, sizeof(fossil_bluecrab_myshell_batch_t));
+}
+
+void fossil_myshell_batch_free(fossil_bluecrab_myshell_batch_t *batch) {
+    if (!batch) return;
+    myshell_index_free(batch->keys);
+    free(batch->records);
+    free(batch);
+}
 
-    db->last_modified = time(NULL);
+void fossil_myshell_batch_clear(fossil_bluecrab_myshell_batch_t *batch) {
+    if (!batch) return;
+    batch->len = 0;
+    batch->count = 0;
+}
 
-    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+size_t fossil_myshell_batch_count(const fossil_bluecrab_myshell_batch_t *batch) {
+    return batch ? batch->count : 0;
 }
 
-fossil_bluecrab_myshell_error_t fossil_myshell_log(fossil_bluecrab_myshell_t *db, fossil_myshell_commit_cb cb, void *user) {
-    if (!db) {
-        return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
-    }
-    if (!db->is_open) {
-        return FOSSIL_MYSHELL_ERROR_LOCKED;
-    }
-    if (!cb) {
+fossil_bluecrab_myshell_error_t fossil_myshell_batch_put(fossil_bluecrab_myshell_batch_t *batch, const char *key, const char *type, const char *value) {
+    if (!batch || !key || !type || !value || key[0] == '\0' || type[0] == '\0') {
         return FOSSIL_MYSHELL_ERROR_INVALID_QUERY;
     }
-
-    // Iterate over file and invoke callback for each commit line, parsing FSON type if present
-    if (fseek(db->file, 0, SEEK_SET) != 0) {
-        return FOSSIL_MYSHELL_ERROR_IO;
-    }
-    char line[1024];
-    while (fgets(line, sizeof(line), db->file)) {
-        if (strncmp(line, "#commit ", 8) == 0) {
-            char hash_str[17] = {0};
-            char message[512] = {0};
-            long long timestamp = 0;
-            char type_name[32] = {0};
-            int n = sscanf(line, "#commit %16s %511[^\n] %lld #type=%31s", hash_str, message, &timestamp, type_name);
-
-            // FSON type system: parse type if present, default to ENUM
-            // (commit_type is not used, so skip parsing)
-
-            if (n >= 3) {
-                uint64_t parsed_hash = 0;
-                sscanf(hash_str, "%" SCNx64, &parsed_hash);
-                char commit_data[1024];
-                snprintf(commit_data, sizeof(commit_data), "%s:%lld", message, timestamp);
-                uint64_t computed_hash = myshell_hash64(commit_data);
-                if (parsed_hash == computed_hash) {
-                    // Optionally, you could pass commit_type to the callback if its signature supports it
-                    if (!cb(hash_str, message, user)) {
-                        return FOSSIL_MYSHELL_ERROR_SUCCESS;
-                    }
-                } else {
-                    return FOSSIL_MYSHELL_ERROR_INTEGRITY;
-                }
-            } else if (n == 2) {
-                if (!cb(hash_str, message, user)) {
-                    return FOSSIL_MYSHELL_ERROR_SUCCESS;
-                }
-            } else {
-                return FOSSIL_MYSHELL_ERROR_PARSE_FAILED;
-            }
+    for (size_t i = 0; i <= MYSHELL_FSON_TYPE_DURATION; ++i) {
+        if (strcmp(type, myshell_fson_type_names[i]) == 0) {
+            return myshell_batch_add(batch, MYSHELL_RECORD_PUT, (uint8_t)i, key, value);
         }
     }
+    return FOSSIL_MYSHELL_ERROR_INVALID_TYPE;
+}
 
-    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+fossil_bluecrab_myshell_error_t fossil_myshell_batch_del(fossil_bluecrab_myshell_batch_t *batch, const char *key) {
+    if (!batch || !key || key[0] == '\0') {
+        return FOSSIL_MYSHELL_ERROR_INVALID_QUERY;
+    }
+    return myshell_batch_add(batch, MYSHELL_RECORD_DEL, MYSHELL_FSON_TYPE_NULL, key, NULL);
 }
 
-fossil_bluecrab_myshell_error_t fossil_myshell_backup(fossil_bluecrab_myshell_t *db, const char *backup_path) {
+fossil_bluecrab_myshell_error_t fossil_myshell_batch_apply(fossil_bluecrab_myshell_t *db, const fossil_bluecrab_myshell_batch_t *batch) {
     if (!db || !db->is_open) {
         return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
     }
-    if (!backup_path || backup_path[0] == '\0') {
-        return FOSSIL_MYSHELL_ERROR_CONFIG_INVALID;
+    if (!batch) {
+        return FOSSIL_MYSHELL_ERROR_INVALID_QUERY;
     }
-
-    FILE *backup_file = fopen(backup_path, "wb");
-    if (!backup_file) {
-        return FOSSIL_MYSHELL_ERROR_BACKUP_FAILED;
+    if (batch->count == 0) {
+        return FOSSIL_MYSHELL_ERROR_SUCCESS;
     }
 
-    // Write a hash of the backup path as a comment for integrity
-    uint64_t backup_hash = myshell_hash64(backup_path);
-    if (fprintf(backup_file, "#backup_hash=%016" PRIx64 "\n", backup_hash) < 0) {
-        fclose(backup_file);
-        return FOSSIL_MYSHELL_ERROR_IO;
+    // Like a commit, the batch closes the group and goes out in one write
+    uint64_t marker_offset;
+    fossil_bluecrab_myshell_error_t result = myshell_batch_write(db, batch, &marker_offset);
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        return result;
     }
+    result = myshell_log_settle(db, true);
+    myshell_compaction_tick(db);
+    return result;
+}
 
-    // Write FSON type system header for backup file
-    fprintf(backup_file, "#fson_types=");
-    for (size_t i = 0; i <= MYSHELL_FSON_TYPE_DURATION; ++i) {
-        fprintf(backup_file, "%s", myshell_fson_type_names[i]);
-        if (i < MYSHELL_FSON_TYPE_DURATION) fprintf(backup_file, ",");
+fossil_bluecrab_myshell_error_t fossil_myshell_begin(fossil_bluecrab_myshell_t *db) {
+    if (!db || !db->is_open) {
+        return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
     }
-    fprintf(backup_file, "\n");
-
-    fseek(db->file, 0, SEEK_SET);
-    char buffer[4096];
-    size_t bytes;
-    while ((bytes = fread(buffer, 1, sizeof(buffer), db->file)) > 0) {
-        if (fwrite(buffer, 1, bytes, backup_file) != bytes) {
-            fclose(backup_file);
-            return FOSSIL_MYSHELL_ERROR_IO;
-        }
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    if (store->txn) {
+        return FOSSIL_MYSHELL_ERROR_TRANSACTION_FAILED;
     }
-
-    if (ferror(db->file)) {
-        fclose(backup_file);
-        return FOSSIL_MYSHELL_ERROR_IO;
+    fossil_bluecrab_myshell_batch_t *txn = fossil_myshell_batch_new();
+    if (!txn || !(txn->keys = myshell_index_new())) {
+        fossil_myshell_batch_free(txn);
+        return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
     }
-
-    fclose(backup_file);
-    fseek(db->file, 0, SEEK_END); // Restore file position
+    store->txn = txn;
     return FOSSIL_MYSHELL_ERROR_SUCCESS;
 }
 
-fossil_bluecrab_myshell_error_t fossil_myshell_restore(const char *backup_path, const char *target_path) {
-    if (!backup_path || !target_path) {
+fossil_bluecrab_myshell_error_t fossil_myshell_rollback(fossil_bluecrab_myshell_t *db) {
+    if (!db || !db->is_open) {
         return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
     }
-
-    FILE *backup_file = fopen(backup_path, "rb");
-    if (!backup_file) {
-        return FOSSIL_MYSHELL_ERROR_FILE_NOT_FOUND;
+    myshell_store_t *store = (myshell_store_t *)db->cache;
+    if (!store->txn) {
+        return FOSSIL_MYSHELL_ERROR_TRANSACTION_FAILED;
     }
+    fossil_myshell_batch_free(store->txn);
+    store->txn = NULL;
+    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+}
 
-    // Verify backup hash for integrity (first line should be "#backup_hash=...")
-    char hash_line[128];
-    uint64_t expected_hash = myshell_hash64(backup_path);
-    if (fgets(hash_line, sizeof(hash_line), backup_file)) {
-        uint64_t file_hash = 0;
-        if (strncmp(hash_line, "#backup_hash=", 13) == 0) {
-            sscanf(hash_line, "#backup_hash=%" SCNx64, &file_hash);
-            if (file_hash != expected_hash) {
-                fclose(backup_file);
-                return FOSSIL_MYSHELL_ERROR_INTEGRITY;
-            }
-        } else {
-            fclose(backup_file);
-            return FOSSIL_MYSHELL_ERROR_CORRUPTED;
-        }
-    } else {
-        fclose(backup_file);
-        return FOSSIL_MYSHELL_ERROR_CORRUPTED;
-    }
+// *****************************************************************************
+// Text format (v1) conversion
+// *****************************************************************************
 
-    // Next line should be FSON type system header
-    char fson_line[256];
-    if (fgets(fson_line, sizeof(fson_line), backup_file)) {
-        if (strncmp(fson_line, "#fson_types=", 12) != 0) {
-            fclose(backup_file);
-            return FOSSIL_MYSHELL_ERROR_CONFIG_INVALID;
-        }
-        // Optionally, validate that all types in header are known
-        char *types = fson_line + 12;
-        char *token = strtok(types, ",\n");
-        while (token) {
-            bool valid_type = false;
-            for (size_t i = 0; i <= MYSHELL_FSON_TYPE_DURATION; ++i) {
-                if (strcmp(token, myshell_fson_type_names[i]) == 0) {
-                    valid_type = true;
-                    break;
-                }
-            }
-            if (!valid_type) {
-                fclose(backup_file);
-                return FOSSIL_MYSHELL_ERROR_CONFIG_INVALID;
-            }
-            token = strtok(NULL, ",\n");
-        }
+/**
+ * Reads one whole line (including its '\n', if any) into a growable buffer,
+ * unlike a fixed-size fgets which splits long lines. Returns false at EOF.
+ */
+static bool myshell_read_line(FILE *file, char **buf, size_t *cap, size_t *out_len) {
+    size_t len = 0;
+    if (!*buf) {
+        *cap = 1024;
+        *buf = (char *)malloc(*cap);
+        if (!*buf) return false;
+    }
+    while (fgets(*buf + len, (int)(*cap - len), file)) {
+        len += strlen(*buf + len);
+        if (len > 0 && (*buf)[len - 1] == '\n') break;
+        if (len + 1 < *cap) break; // EOF without a trailing newline
+        char *grown = (char *)realloc(*buf, *cap * 2);
+        if (!grown) return false;
+        *buf = grown;
+        *cap *= 2;
+    }
+    *out_len = len;
+    return len > 0;
+}
+
+/**
+ * Splits a key/value record line (NUL-terminated) into its key and value.
+ * Metadata lines starting with '#' and lines without '=' are not records. The
+ * value ends at its #type=/#hash= comments (or the first '#' when the line has
+ * no #hash=), with trailing blanks removed. @p stamped_hash receives the
+ * #hash= stamp and @p has_hash whether one was present.
+ */
+static bool myshell_parse_record(const char *line, const char **key, size_t *key_len,
+                                 const char **value, size_t *value_len,
+                                 uint64_t *stamped_hash, bool *has_hash) {
+    if (line[0] == '#') return false;
+    const char *eq = strchr(line, '=');
+    if (!eq) return false;
+
+    const char *start = eq + 1;
+    const char *hash_comment = strstr(start, "#hash=");
+    const char *end;
+    *stamped_hash = 0;
+    *has_hash = hash_comment != NULL;
+    if (hash_comment) {
+        sscanf(hash_comment, "#hash=%" SCNx64, stamped_hash);
+        const char *type_comment = strstr(start, "#type=");
+        end = (type_comment && type_comment > start) ? type_comment : hash_comment;
     } else {
-        fclose(backup_file);
-        return FOSSIL_MYSHELL_ERROR_CONFIG_INVALID;
+        end = strchr(start, '#');
+        if (!end) end = start + strlen(start);
     }
-
-    FILE *target_file = fopen(target_path, "wb");
-    if (!target_file) {
-        fclose(backup_file);
-        return FOSSIL_MYSHELL_ERROR_IO;
+    while (end > start && (end[-1] == '\n' || end[-1] == '\r' || end[-1] == ' ')) {
+        end--;
     }
 
-    // Write the validated hash and FSON header to the target file
-    fprintf(target_file, "%s", hash_line);
-    fprintf(target_file, "%s", fson_line);
+    *key = line;
+    *key_len = (size_t)(eq - line);
+    *value = start;
+    *value_len = (size_t)(end - start);
+    return true;
+}
 
-    char buffer[4096];
-    size_t bytes;
-    while ((bytes = fread(buffer, 1, sizeof(buffer), backup_file)) > 0) {
-        if (fwrite(buffer, 1, bytes, target_file) != bytes) {
-            fclose(backup_file);
-            fclose(target_file);
-            return FOSSIL_MYSHELL_ERROR_IO;
+/**
+ * Reads the #type= name on a line into @p type, or @p fallback when there is
+ * none. Returns false for a name that is not in the FSON type table.
+ */
+static bool myshell_text_type(const char *line, uint8_t fallback, uint8_t *type) {
+    const char *type_comment = strstr(line, "#type=");
+    *type = fallback;
+    if (!type_comment) return true;
+    type_comment += 6;
+    char type_name[32] = {0};
+    int i = 0;
+    while (type_comment[i] && !isspace((unsigned char)type_comment[i]) && type_comment[i] != '#' && i < 31) {
+        type_name[i] = type_comment[i];
+        i++;
+    }
+    type_name[i] = '\0';
+    for (size_t j = 0; j <= MYSHELL_FSON_TYPE_DURATION; ++j) {
+        if (strcmp(type_name, myshell_fson_type_names[j]) == 0) {
+            *type = (uint8_t)j;
+            return true;
         }
     }
+    return false;
+}
 
-    if (ferror(backup_file)) {
-        fclose(backup_file);
-        fclose(target_file);
-        return FOSSIL_MYSHELL_ERROR_IO;
-    }
-
-    fclose(backup_file);
-    fclose(target_file);
-    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+/**
+ * Parses a `#del key #hash=H` or `#unstage key #hash=H` tombstone line;
+ * @p prefix_len skips the directive. The key runs up to the last " #hash=".
+ */
+static bool myshell_parse_tombstone(const char *line, size_t prefix_len, const char **key,
+                                    size_t *key_len, uint64_t *stamped_hash) {
+    const char *start = line + prefix_len;
+    const char *stamp = NULL;
+    for (const char *p = strstr(start, " #hash="); p; p = strstr(p + 1, " #hash=")) {
+        stamp = p;
+    }
+    if (!stamp || stamp == start) return false;
+    if (sscanf(stamp, " #hash=%" SCNx64, stamped_hash) != 1) return false;
+    *key = start;
+    *key_len = (size_t)(stamp - start);
+    return true;
 }
 
-const char *fossil_myshell_errstr(fossil_bluecrab_myshell_error_t err) {
-    switch (err) {
-        case FOSSIL_MYSHELL_ERROR_SUCCESS: return "Success";
-        case FOSSIL_MYSHELL_ERROR_INVALID_FILE: return "Invalid file";
-        case FOSSIL_MYSHELL_ERROR_FILE_NOT_FOUND: return "File not found";
-        case FOSSIL_MYSHELL_ERROR_IO: return "I/O error";
-        case FOSSIL_MYSHELL_ERROR_INVALID_QUERY: return "Invalid query";
-        case FOSSIL_MYSHELL_ERROR_CONCURRENCY: return "Concurrency error";
-        case FOSSIL_MYSHELL_ERROR_NOT_FOUND: return "Not found";
-        case FOSSIL_MYSHELL_ERROR_PERMISSION_DENIED: return "Permission denied";
-        case FOSSIL_MYSHELL_ERROR_CORRUPTED: return "Corrupted data";
-        case FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY: return "Out of memory";
-        case FOSSIL_MYSHELL_ERROR_UNSUPPORTED: return "Unsupported operation";
-        case FOSSIL_MYSHELL_ERROR_LOCKED: return "Resource locked";
-        case FOSSIL_MYSHELL_ERROR_TIMEOUT: return "Operation timed out";
-        case FOSSIL_MYSHELL_ERROR_ALREADY_EXISTS: return "Already exists";
-        case FOSSIL_MYSHELL_ERROR_BACKUP_FAILED: return "Backup failed";
-        case FOSSIL_MYSHELL_ERROR_PARSE_FAILED: return "Parse failed";
-        case FOSSIL_MYSHELL_ERROR_RESTORE_FAILED: return "Restore failed";
-        case FOSSIL_MYSHELL_ERROR_LOCK_FAILED: return "Lock failed";
-        case FOSSIL_MYSHELL_ERROR_SCHEMA_MISMATCH: return "Schema mismatch";
-        case FOSSIL_MYSHELL_ERROR_VERSION_UNSUPPORTED: return "Version unsupported";
-        case FOSSIL_MYSHELL_ERROR_INDEX_CORRUPTED: return "Index corrupted";
-        case FOSSIL_MYSHELL_ERROR_INTEGRITY: return "Integrity check failed";
-        case FOSSIL_MYSHELL_ERROR_TRANSACTION_FAILED: return "Transaction failed";
-        case FOSSIL_MYSHELL_ERROR_CAPACITY_EXCEEDED: return "Capacity exceeded";
-        case FOSSIL_MYSHELL_ERROR_CONFIG_INVALID: return "Invalid configuration";
-        case FOSSIL_MYSHELL_ERROR_UNKNOWN:
-        default:
-            return "Unknown error";
-    }
+/** Returns the length of the word at @p p (up to a space or the end). */
+static size_t myshell_text_word(const char *p) {
+    size_t len = 0;
+    while (p[len] && p[len] != ' ') len++;
+    return len;
 }
 
-fossil_bluecrab_myshell_error_t fossil_myshell_check_integrity(fossil_bluecrab_myshell_t *db) {
-    if (!db || !db->is_open) {
-        return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
-    }
+/**
+ * Splits the `MESSAGE TIMESTAMP #type=T` tail of a commit or merge line. The
+ * message may contain spaces; the timestamp is the last word before the comments.
+ */
+static bool myshell_text_split_tail(const char *p, const char **message, size_t *message_len, long long *timestamp) {
+    const char *stop = strstr(p, " #type=");
+    if (!stop) stop = p + strlen(p);
+    const char *ts = stop;
+    while (ts > p && ts[-1] != ' ') ts--;
+    if (ts == p || ts == stop) return false;
+    *timestamp = strtoll(ts, NULL, 10);
+    *message = p;
+    *message_len = (size_t)(ts - 1 - p);
+    return true;
+}
 
-    // Check file size consistency
-    if (fseek(db->file, 0, SEEK_END) != 0)
-        return FOSSIL_MYSHELL_ERROR_IO;
-    size_t current_size = (size_t)ftell(db->file);
-    if (current_size != db->file_size) {
-        return FOSSIL_MYSHELL_ERROR_CORRUPTED;
+/**
+ * Writes the v2 record for one v1 line (NUL-terminated, without its newline,
+ * modified in place). Header and unrecognised lines produce nothing.
+ */
+static fossil_bluecrab_myshell_error_t myshell_convert_line(FILE *out, char *line) {
+    bool data = line[0] != '#' || strncmp(line, "#stage ", 7) == 0;
+    uint8_t type;
+    if (!myshell_text_type(line, data ? MYSHELL_FSON_TYPE_CSTR : MYSHELL_FSON_TYPE_ENUM, &type)) {
+        return FOSSIL_MYSHELL_ERROR_CONFIG_INVALID;
     }
-    if (fseek(db->file, 0, SEEK_SET) != 0)
-        return FOSSIL_MYSHELL_ERROR_IO;
 
-    char line[1024];
-    while (fgets(line, sizeof(line), db->file)) {
-        // Commit integrity: check hash and FSON type
-        if (strncmp(line, "#commit ", 8) == 0) {
-            char hash_str[17] = {0};
-            char message[512] = {0};
-            long long timestamp = 0;
-            char type_name[32] = {0};
-            int n = sscanf(line, "#commit %16s %511[^\n] %lld #type=%31s", hash_str, message, &timestamp, type_name);
-
-            if (n == 4) {
-                bool valid_type = false;
-                for (size_t i = 0; i <= MYSHELL_FSON_TYPE_DURATION; ++i) {
-                    if (strcmp(type_name, myshell_fson_type_names[i]) == 0) {
-                        valid_type = true;
-                        break;
-                    }
-                }
-                if (!valid_type) {
-                    return FOSSIL_MYSHELL_ERROR_CONFIG_INVALID;
-                }
-            }
-            if (n >= 3) {
-                uint64_t parsed_hash = 0;
-                sscanf(hash_str, "%" SCNx64, &parsed_hash);
-                char commit_data[1024];
-                snprintf(commit_data, sizeof(commit_data), "%s:%lld", message, timestamp);
-                uint64_t computed_hash = myshell_hash64(commit_data);
-                if (parsed_hash != computed_hash) {
-                    return FOSSIL_MYSHELL_ERROR_INTEGRITY;
-                }
-            } else {
-                return FOSSIL_MYSHELL_ERROR_PARSE_FAILED;
-            }
+    const char *key, *value;
+    size_t key_len, value_len;
+    uint64_t stamped_hash = 0;
+    bool has_hash = true;
+    bool written = true;
+    if (data) {
+        bool staged = line[0] == '#';
+        if (!myshell_parse_record(staged ? line + 7 : line, &key, &key_len, &value, &value_len, &stamped_hash, &has_hash)) {
+            return FOSSIL_MYSHELL_ERROR_SUCCESS;
         }
-        // Branch/tag/merge integrity: check FSON type if present
-        else if (strncmp(line, "#branch ", 8) == 0 ||
-                 strncmp(line, "#tag ", 5) == 0 ||
-                 strncmp(line, "#merge ", 7) == 0) {
-            char type_name[32] = {0};
-            char *type_comment = strstr(line, "#type=");
-            if (type_comment) {
-                type_comment += 6;
-                int i = 0;
-                while (type_comment[i] && !isspace((unsigned char)type_comment[i]) && type_comment[i] != '#' && i < 31) {
-                    type_name[i] = type_comment[i];
-                    i++;
-                }
-                type_name[i] = '\0';
-                bool valid_type = false;
-                for (size_t j = 0; j <= MYSHELL_FSON_TYPE_DURATION; ++j) {
-                    if (strcmp(type_name, myshell_fson_type_names[j]) == 0) {
-                        valid_type = true;
-                        break;
-                    }
-                }
-                if (!valid_type) {
-                    return FOSSIL_MYSHELL_ERROR_CONFIG_INVALID;
-                }
-            }
+        ((char *)key)[key_len] = '\0';
+        if (key_len == 0 || (has_hash && stamped_hash != myshell_hash64(key))) {
+            return FOSSIL_MYSHELL_ERROR_SUCCESS;
         }
-        // Key-value integrity: check hash and FSON type
-        else {
-            char *eq = strchr(line, '=');
-            if (eq) {
-                *eq = '\0';
-                char *hash_comment = strstr(eq + 1, "#hash=");
-                char *type_comment = strstr(eq + 1, "#type=");
-                if (type_comment) {
-                    type_comment += 6;
-                    char type_name[32] = {0};
-                    int i = 0;
-                    while (type_comment[i] && !isspace((unsigned char)type_comment[i]) && type_comment[i] != '#' && i < 31) {
-                        type_name[i] = type_comment[i];
-                        i++;
-                    }
-                    type_name[i] = '\0';
-                    bool valid_type = false;
-                    for (size_t j = 0; j <= MYSHELL_FSON_TYPE_DURATION; ++j) {
-                        if (strcmp(type_name, myshell_fson_type_names[j]) == 0) {
-                            valid_type = true;
-                            break;
-                        }
-                    }
-                    if (!valid_type) {
-                        *eq = '='; // Restore
-                        return FOSSIL_MYSHELL_ERROR_CONFIG_INVALID;
-                    }
-                }
-                if (hash_comment) {
-                    uint64_t file_hash = 0;
-                    sscanf(hash_comment, "#hash=%" SCNx64, &file_hash);
-                    uint64_t key_hash = myshell_hash64(line);
-                    if (file_hash != key_hash) {
-                        *eq = '='; // Restore
-                        return FOSSIL_MYSHELL_ERROR_INTEGRITY;
-                    }
-                }
-                *eq = '='; // Restore
-            }
+        written = myshell_record_write(out, staged ? MYSHELL_RECORD_STAGE : MYSHELL_RECORD_PUT, type,
+                                       key, (uint32_t)key_len, value, (uint32_t)value_len);
+    } else if (strncmp(line, "#del ", 5) == 0 || strncmp(line, "#unstage ", 9) == 0) {
+        bool del = line[1] == 'd';
+        if (!myshell_parse_tombstone(line, del ? 5 : 9, &key, &key_len, &stamped_hash)) {
+            return FOSSIL_MYSHELL_ERROR_SUCCESS;
         }
-    }
-
-    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+        ((char *)key)[key_len] = '\0';
+        if (stamped_hash != myshell_hash64(key)) {
+            return FOSSIL_MYSHELL_ERROR_SUCCESS;
+        }
+        written = myshell_record_write(out, del ? MYSHELL_RECORD_DEL : MYSHELL_RECORD_UNSTAGE, MYSHELL_FSON_TYPE_NULL,
+                                       key, (uint32_t)key_len, NULL, 0);
+    } else if (strncmp(line, "#commit ", 8) == 0 || strncmp(line, "#merge ", 7) == 0) {
+        bool merge = line[1] == 'm';
+        const char *p = line + (merge ? 7 : 8);
+        uint64_t hash;
+        if (!myshell_hash_parse(p, myshell_text_word(p), &hash) || p[16] != ' ') {
+            return FOSSIL_MYSHELL_ERROR_PARSE_FAILED;
+        }
+        p += 17;
+        const char *source = p;
+        size_t source_len = 0;
+        if (merge) {
+            source_len = myshell_text_word(p);
+            if (source_len == 0 || p[source_len] != ' ') return FOSSIL_MYSHELL_ERROR_PARSE_FAILED;
+            p += source_len + 1;
+        }
+        const char *message;
+        size_t message_len;
+        long long timestamp;
+        if (!myshell_text_split_tail(p, &message, &message_len, &timestamp)) {
+            return FOSSIL_MYSHELL_ERROR_PARSE_FAILED;
+        }
+        char hash_str[17];
+        snprintf(hash_str, sizeof(hash_str), "%016" PRIx64, hash);
+        size_t size = source_len + message_len + 48;
+        char *buf = (char *)malloc(size);
+        if (!buf) return FOSSIL_MYSHELL_ERROR_OUT_OF_MEMORY;
+        int n = merge ? snprintf(buf, size, "%lld\n%.*s\n%.*s", timestamp, (int)source_len, source, (int)message_len, message)
+                      : snprintf(buf, size, "%lld\n%.*s", timestamp, (int)message_len, message);
+        written = myshell_record_write(out, merge ? MYSHELL_RECORD_MERGE : MYSHELL_RECORD_COMMIT, type,
+                                       hash_str, 16, buf, (uint32_t)n);
+        free(buf);
+    } else if (strncmp(line, "#branch ", 8) == 0 || strncmp(line, "#tag ", 5) == 0) {
+        bool branch = line[1] == 'b';
+        const char *p = line + (branch ? 8 : 5);
+        uint64_t hash;
+        if (!myshell_hash_parse(p, myshell_text_word(p), &hash) || p[16] != ' ') {
+            return FOSSIL_MYSHELL_ERROR_PARSE_FAILED;
+        }
+        const char *name = p + 17;
+        size_t name_len = myshell_text_word(name);
+        if (name_len == 0) return FOSSIL_MYSHELL_ERROR_PARSE_FAILED;
+        char hash_str[17];
+        snprintf(hash_str, sizeof(hash_str), "%016" PRIx64, hash);
+        written = myshell_record_write(out, branch ? MYSHELL_RECORD_BRANCH : MYSHELL_RECORD_TAG, type,
+                                       name, (uint32_t)name_len, hash_str, 16);
+    }
+    return written ? FOSSIL_MYSHELL_ERROR_SUCCESS : FOSSIL_MYSHELL_ERROR_IO;
 }
 
-fossil_bluecrab_myshell_error_t fossil_myshell_diff(
-    const fossil_bluecrab_myshell_t *db1,
-    const fossil_bluecrab_myshell_t *db2,
-    char *out_diff,
-    size_t out_size
-) {
-    if (!db1 || !db2 || !db1->is_open || !db2->is_open || !out_diff || out_size == 0) {
+fossil_bluecrab_myshell_error_t fossil_myshell_convert(const char *text_path, const char *binary_path) {
+    if (!text_path || !binary_path) {
         return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
     }
 
-    // Advanced diff: compare all commits and staged entries, report adds/removes/changes.
-    fseek(db1->file, 0, SEEK_SET);
-    fseek(db2->file, 0, SEEK_SET);
-
-    char line1[1024], line2[1024];
-    size_t pos = 0;
-
-    // --- Collect commits from both files ---
-    typedef struct { char hash[17]; char line[1024]; } commit_t;
-    commit_t commits1[128], commits2[128];
-    size_t n1 = 0, n2 = 0;
-
-    while (fgets(line1, sizeof(line1), db1->file)) {
-        if (strncmp(line1, "#commit ", 8) == 0) {
-            char hash[17] = {0};
-            sscanf(line1, "#commit %16s", hash);
-            strncpy(commits1[n1].hash, hash, sizeof(commits1[n1].hash));
-            commits1[n1].hash[sizeof(commits1[n1].hash) - 1] = '\0';
-            strncpy(commits1[n1].line, line1, sizeof(line1));
-            n1++;
-        }
-    }
-    while (fgets(line2, sizeof(line2), db2->file)) {
-        if (strncmp(line2, "#commit ", 8) == 0) {
-            char hash[17] = {0};
-            strncpy(commits2[n2].hash, hash, 16);
-            commits2[n2].hash[16] = '\0';
-            strncpy(commits2[n2].line, line2, sizeof(line2));
-            n2++;
-            n2++;
-        }
-    }
-
-    // --- Compare commits ---
-    for (size_t i = 0; i < n1; ++i) {
-        bool found = false;
-        for (size_t j = 0; j < n2; ++j) {
-            if (strcmp(commits1[i].hash, commits2[j].hash) == 0) {
-                found = true;
-                if (strcmp(commits1[i].line, commits2[j].line) != 0) {
-                    int n = snprintf(out_diff + pos, out_size - pos, "~ %s~ %s", commits1[i].line, commits2[j].line);
-                    if (n < 0 || (size_t)n >= out_size - pos) return FOSSIL_MYSHELL_ERROR_CAPACITY_EXCEEDED;
-                    pos += n;
-                }
-                break;
-            }
-        }
-        if (!found) {
-            int n = snprintf(out_diff + pos, out_size - pos, "- %s", commits1[i].line);
-            if (n < 0 || (size_t)n >= out_size - pos) return FOSSIL_MYSHELL_ERROR_CAPACITY_EXCEEDED;
-            pos += n;
-        }
+    // Enforce .myshell extension on the result
+    const char *ext = strrchr(binary_path, '.');
+    if (!ext || strcmp(ext, ".myshell") != 0) {
+        return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
     }
-    for (size_t j = 0; j < n2; ++j) {
-        bool found = false;
-        for (size_t i = 0; i < n1; ++i) {
-            if (strcmp(commits2[j].hash, commits1[i].hash) == 0) {
-                found = true;
-                break;
-            }
-        }
-        if (!found) {
-            int n = snprintf(out_diff + pos, out_size - pos, "+ %s", commits2[j].line);
-            if (n < 0 || (size_t)n >= out_size - pos) return FOSSIL_MYSHELL_ERROR_CAPACITY_EXCEEDED;
-            pos += n;
-        }
+
+    FILE *in = fopen(text_path, "rb");
+    if (!in) {
+        return FOSSIL_MYSHELL_ERROR_FILE_NOT_FOUND;
     }
 
-    // --- Collect staged entries from both files ---
-    typedef struct { char key[256]; char line[1024]; } stage_t;
-    stage_t stages1[128], stages2[128];
-    size_t s1 = 0, s2 = 0;
+    // A file that already carries the v2 header needs no conversion
+    char magic[4];
+    if (fread(magic, 1, sizeof(magic), in) == sizeof(magic) && memcmp(magic, MYSHELL_MAGIC, 4) == 0) {
+        fclose(in);
+        return FOSSIL_MYSHELL_ERROR_INVALID_FILE;
+    }
+    rewind(in);
 
-    fseek(db1->file, 0, SEEK_SET);
-    while (fgets(line1, sizeof(line1), db1->file)) {
-        if (strncmp(line1, "#stage ", 7) == 0) {
-            char *eq = strchr(line1 + 7, '=');
-            if (eq) {
-                size_t klen = eq - (line1 + 7);
-                strncpy(stages1[s1].key, line1 + 7, klen);
-                stages1[s1].key[klen] = '\0';
-                strncpy(stages1[s1].line, line1, sizeof(line1));
-                s1++;
-            }
-        }
+    FILE *check = fopen(binary_path, "rb");
+    if (check) {
+        fclose(check);
+        fclose(in);
+        return FOSSIL_MYSHELL_ERROR_ALREADY_EXISTS;
     }
-    fseek(db2->file, 0, SEEK_SET);
-    while (fgets(line2, sizeof(line2), db2->file)) {
-        if (strncmp(line2, "#stage ", 7) == 0) {
-            char *eq = strchr(line2 + 7, '=');
-            if (eq) {
-                size_t klen = eq - (line2 + 7);
-                strncpy(stages2[s2].key, line2 + 7, klen);
-                stages2[s2].key[klen] = '\0';
-                strncpy(stages2[s2].line, line2, sizeof(line2));
-                s2++;
-            }
-        }
+    FILE *out = fopen(binary_path, "wb");
+    if (!out) {
+        fclose(in);
+        return FOSSIL_MYSHELL_ERROR_IO;
     }
 
-    // --- Compare staged entries ---
-    for (size_t i = 0; i < s1; ++i) {
-        bool found = false;
-        for (size_t j = 0; j < s2; ++j) {
-            if (strcmp(stages1[i].key, stages2[j].key) == 0) {
-                found = true;
-                if (strcmp(stages1[i].line, stages2[j].line) != 0) {
-                    int n = snprintf(out_diff + pos, out_size - pos, "~ %s~ %s", stages1[i].line, stages2[j].line);
-                    if (n < 0 || (size_t)n >= out_size - pos) return FOSSIL_MYSHELL_ERROR_CAPACITY_EXCEEDED;
-                    pos += n;
-                }
-                break;
-            }
+    fossil_bluecrab_myshell_error_t result = myshell_file_header_write(out) ? FOSSIL_MYSHELL_ERROR_SUCCESS
+                                                                            : FOSSIL_MYSHELL_ERROR_IO;
+    char *line = NULL;
+    size_t cap = 0, len = 0;
+    while (result == FOSSIL_MYSHELL_ERROR_SUCCESS && myshell_read_line(in, &line, &cap, &len)) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+            line[--len] = '\0';
         }
-        if (!found) {
-            int n = snprintf(out_diff + pos, out_size - pos, "- %s", stages1[i].line);
-            if (n < 0 || (size_t)n >= out_size - pos) return FOSSIL_MYSHELL_ERROR_CAPACITY_EXCEEDED;
-            pos += n;
+        if (len > 0) {
+            result = myshell_convert_line(out, line);
         }
     }
-    for (size_t j = 0; j < s2; ++j) {
-        bool found = false;
-        for (size_t i = 0; i < s1; ++i) {
-            if (strcmp(stages2[j].key, stages1[i].key) == 0) {
-                found = true;
-                break;
-            }
-        }
-        if (!found) {
-            int n = snprintf(out_diff + pos, out_size - pos, "+ %s", stages2[j].line);
-            if (n < 0 || (size_t)n >= out_size - pos) return FOSSIL_MYSHELL_ERROR_CAPACITY_EXCEEDED;
-            pos += n;
-        }
+    free(line);
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS && ferror(in)) {
+        result = FOSSIL_MYSHELL_ERROR_IO;
     }
-
-    return FOSSIL_MYSHELL_ERROR_SUCCESS;
+    fclose(in);
+    if (result == FOSSIL_MYSHELL_ERROR_SUCCESS && !myshell_file_sync(out)) {
+        result = FOSSIL_MYSHELL_ERROR_IO;
+    }
+    fclose(out);
+    if (result != FOSSIL_MYSHELL_ERROR_SUCCESS) {
+        remove(binary_path);
+    }
+    return result;
 }
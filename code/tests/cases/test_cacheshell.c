@@ -25,6 +25,11 @@
 #include <fossil/pizza/framework.h>
 
 #include "fossil/crabdb/framework.h"
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 // * * * * * * * * * * * * * * * * * * * * * * * *
 // * Fossil Logic Test Utilities
@@ -299,6 +304,576 @@ FOSSIL_TEST(c_test_cacheshell_init_with_limit) {
     fossil_bluecrab_cacheshell_shutdown();
 }
 
+typedef struct {
+    size_t count;
+    char keys[8][32];
+} cacheshell_scan_ctx;
+
+static void cacheshell_scan_cb(const char *key, const void *value, size_t value_size, void *user_data) {
+    cacheshell_scan_ctx *ctx = (cacheshell_scan_ctx*)user_data;
+    if (ctx->count < 8)
+        snprintf(ctx->keys[ctx->count], sizeof(ctx->keys[0]), "%s", key);
+    ctx->count++;
+    (void)value;
+    (void)value_size;
+}
+
+FOSSIL_TEST(c_test_cacheshell_ordered_prefix_scan) {
+    fossil_bluecrab_cacheshell_init(0);
+    fossil_bluecrab_cacheshell_clear();
+    fossil_bluecrab_cacheshell_set("session:2:1", "b");
+    fossil_bluecrab_cacheshell_set("session:1:2", "a2");
+    fossil_bluecrab_cacheshell_set("user:1", "u");
+    fossil_bluecrab_cacheshell_set("session:1:1", "a1");
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_ordered_index(true));
+    fossil_bluecrab_cacheshell_set("session:1:3", "a3"); // maintained after build
+
+    cacheshell_scan_ctx ctx = {0};
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_scan_prefix("session:1:", cacheshell_scan_cb, &ctx) == 3);
+    ASSUME_ITS_EQUAL_CSTR(ctx.keys[0], "session:1:1");
+    ASSUME_ITS_EQUAL_CSTR(ctx.keys[1], "session:1:2");
+    ASSUME_ITS_EQUAL_CSTR(ctx.keys[2], "session:1:3");
+
+    memset(&ctx, 0, sizeof(ctx));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_scan_range("session:1:2", "session:2:1", cacheshell_scan_cb, &ctx) == 2);
+    ASSUME_ITS_EQUAL_CSTR(ctx.keys[0], "session:1:2");
+    ASSUME_ITS_EQUAL_CSTR(ctx.keys[1], "session:1:3");
+
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_delete_prefix("session:") == 4);
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_count() == 1);
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_exists("user:1"));
+
+    fossil_bluecrab_cacheshell_remove("user:1");
+    memset(&ctx, 0, sizeof(ctx));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_scan_prefix("", cacheshell_scan_cb, &ctx) == 0);
+    fossil_bluecrab_cacheshell_shutdown();
+}
+
+FOSSIL_TEST(c_test_cacheshell_range_without_index) {
+    fossil_bluecrab_cacheshell_init(0);
+    fossil_bluecrab_cacheshell_clear();
+    fossil_bluecrab_cacheshell_set("a", "1");
+    fossil_bluecrab_cacheshell_set("b", "2");
+    fossil_bluecrab_cacheshell_set("c", "3");
+
+    cacheshell_scan_ctx ctx = {0};
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_scan_range("b", NULL, cacheshell_scan_cb, &ctx) == 2);
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_delete_range(NULL, "c") == 2);
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_count() == 1);
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_exists("c"));
+    fossil_bluecrab_cacheshell_shutdown();
+}
+
+FOSSIL_TEST(c_test_cacheshell_near_cache_layers) {
+    fossil_bluecrab_cacheshell_init(0);
+    fossil_bluecrab_cacheshell_clear();
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_near_cache(true, 0));
+    fossil_bluecrab_cacheshell_set("hot", "one");
+
+    size_t l1_hits0 = 0, l1_misses0 = 0, shared_hits0 = 0;
+    fossil_bluecrab_cacheshell_layer_stats(&l1_hits0, &l1_misses0, &shared_hits0, NULL);
+
+    char *v = fossil_bluecrab_cacheshell_get("hot", 16); // fills L1
+    ASSUME_ITS_TRUE(v && strcmp(v, "one") == 0);
+    free(v);
+    v = fossil_bluecrab_cacheshell_get("hot", 16);       // served by L1
+    ASSUME_ITS_TRUE(v && strcmp(v, "one") == 0);
+    free(v);
+
+    size_t l1_hits = 0, l1_misses = 0, shared_hits = 0;
+    fossil_bluecrab_cacheshell_layer_stats(&l1_hits, &l1_misses, &shared_hits, NULL);
+    ASSUME_ITS_TRUE(l1_hits == l1_hits0 + 1);
+    ASSUME_ITS_TRUE(l1_misses == l1_misses0 + 1);
+    ASSUME_ITS_TRUE(shared_hits == shared_hits0 + 1);
+
+    // A write must invalidate the cached copy
+    fossil_bluecrab_cacheshell_set("hot", "two");
+    char buf[8] = {0};
+    size_t sz = 0;
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_get_binary_into("hot", buf, sizeof(buf), &sz));
+    ASSUME_ITS_TRUE(sz == 4 && strcmp(buf, "two") == 0);
+
+    fossil_bluecrab_cacheshell_remove("hot");
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_get("hot", 16) == NULL);
+
+    fossil_bluecrab_cacheshell_near_cache(false, 0);
+    fossil_bluecrab_cacheshell_shutdown();
+}
+
+FOSSIL_TEST(c_test_cacheshell_shared_segment) {
+#if !defined(_WIN32) && !defined(_WIN64)
+    const char *name = "/crabdb-test-c-shared";
+    fossil_bluecrab_cacheshell_unlink_shared(name);
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_init_shared(name, 0, 1 << 20));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_set("user:1", "alice"));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_set("user:2", "bob"));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_set("user:1", "a much longer value than before"));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_set_with_ttl("tmp", "x", 60));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_ttl("tmp") > 0);
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_count() == 3);
+    ASSUME_ITS_FALSE(fossil_bluecrab_cacheshell_ordered_index(true));
+    fossil_bluecrab_cacheshell_shutdown(); // detach only
+
+    // Re-attach: the data lives in the segment, not the process
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_init_shared(name, 0, 0));
+    char *out = fossil_bluecrab_cacheshell_get("user:1", 64);
+    ASSUME_ITS_TRUE(out && strcmp(out, "a much longer value than before") == 0);
+    free(out);
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_delete_prefix("user:") == 2);
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_remove("tmp"));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_count() == 0);
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_memory_usage() == 0);
+    fossil_bluecrab_cacheshell_shutdown();
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_unlink_shared(name));
+#endif
+}
+
+FOSSIL_TEST(c_test_cacheshell_hot_and_big_keys) {
+    fossil_bluecrab_cacheshell_init(0);
+    fossil_bluecrab_cacheshell_clear();
+    fossil_bluecrab_cacheshell_set("small", "x");
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_key_tracking(true, 1));
+
+    char big[1000];
+    memset(big, 'b', sizeof(big));
+    fossil_bluecrab_cacheshell_set_binary("big", big, sizeof(big));
+    fossil_bluecrab_cacheshell_set_binary("medium", big, 100);
+
+    for (int i = 0; i < 50; ++i) {
+        char *v = fossil_bluecrab_cacheshell_get("small", 8);
+        free(v);
+    }
+    char *v = fossil_bluecrab_cacheshell_get("medium", 8);
+    free(v);
+
+    fossil_bluecrab_cache_key_stat_t rows[4];
+    size_t n = fossil_bluecrab_cacheshell_top_keys(rows, 4);
+    ASSUME_ITS_TRUE(n >= 1);
+    ASSUME_ITS_TRUE(strcmp(rows[0].key, "small") == 0 && rows[0].value == 50);
+
+    n = fossil_bluecrab_cacheshell_largest_keys(rows, 2);
+    ASSUME_ITS_TRUE(n == 2);
+    ASSUME_ITS_TRUE(strcmp(rows[0].key, "big") == 0 && rows[0].value == 1000);
+    ASSUME_ITS_TRUE(strcmp(rows[1].key, "medium") == 0 && rows[1].value == 100);
+
+    // Removed keys drop out of the big-key report
+    fossil_bluecrab_cacheshell_remove("big");
+    n = fossil_bluecrab_cacheshell_largest_keys(rows, 4);
+    ASSUME_ITS_TRUE(n == 2 && strcmp(rows[0].key, "medium") == 0);
+
+    fossil_bluecrab_cacheshell_key_tracking(false, 0);
+    fossil_bluecrab_cacheshell_shutdown();
+}
+
+static void cacheshell_list_cb(const void *value, size_t size, void *user_data) {
+    char *joined = (char *)user_data;
+    strncat(joined, (const char *)value, size);
+}
+
+FOSSIL_TEST(c_test_cacheshell_collections) {
+    fossil_bluecrab_cacheshell_init(0);
+    fossil_bluecrab_cacheshell_clear();
+
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_hset("user:1", "name", "ada", 3));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_hset("user:1", "lang", "c", 1));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_hset("user:1", "name", "grace", 5));
+    char buf[16] = {0};
+    size_t sz = 0;
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_hget("user:1", "name", buf, sizeof(buf), &sz));
+    ASSUME_ITS_TRUE(sz == 5 && memcmp(buf, "grace", 5) == 0);
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_get("user:1", 16) == NULL); // not a raw value
+    ASSUME_ITS_FALSE(fossil_bluecrab_cacheshell_sadd("user:1", "x"));     // wrong type
+
+    // Grow past the packed limit; fields must survive the upgrade
+    for (int i = 0; i < 100; ++i) {
+        char field[16];
+        snprintf(field, sizeof(field), "f%d", i);
+        ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_hset("user:1", field, &i, sizeof(i)));
+    }
+    int v = -1;
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_hget("user:1", "f77", &v, sizeof(v), NULL) && v == 77);
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_hget("user:1", "lang", buf, sizeof(buf), &sz) && sz == 1);
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_hdel("user:1", "f77"));
+    ASSUME_ITS_FALSE(fossil_bluecrab_cacheshell_hget("user:1", "f77", NULL, 0, NULL));
+
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_lpush("events", "c", 1));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_lpush("events", "b", 1));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_lpush("events", "a", 1));
+    char joined[16] = {0};
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_lrange("events", 0, -1, cacheshell_list_cb, joined) == 3);
+    ASSUME_ITS_TRUE(strcmp(joined, "abc") == 0);
+    joined[0] = '\0';
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_lrange("events", -2, -1, cacheshell_list_cb, joined) == 2);
+    ASSUME_ITS_TRUE(strcmp(joined, "bc") == 0);
+
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_sadd("tags", "red"));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_sadd("tags", "red"));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_sismember("tags", "red"));
+    ASSUME_ITS_FALSE(fossil_bluecrab_cacheshell_sismember("tags", "blue"));
+
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_count() == 3);
+    fossil_bluecrab_cacheshell_shutdown();
+}
+
+FOSSIL_TEST(c_test_cacheshell_compression) {
+    fossil_bluecrab_cacheshell_init(0);
+    fossil_bluecrab_cacheshell_clear();
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_compression(64));
+
+    char text[4096];
+    for (size_t i = 0; i < sizeof(text); ++i)
+        text[i] = "compressible "[i % 13];
+    size_t before = fossil_bluecrab_cacheshell_memory_usage();
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_set_binary("doc", text, sizeof(text)));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_set_binary("tiny", "abc", 3)); // below threshold
+
+    size_t entries = 0, logical = 0, stored = 0;
+    fossil_bluecrab_cacheshell_compression_stats(&entries, &logical, &stored);
+    ASSUME_ITS_TRUE(entries == 1 && logical == sizeof(text) && stored < sizeof(text) / 4);
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_memory_usage() - before < sizeof(text) / 2);
+
+    char out[4096];
+    size_t sz = 0;
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_get_binary_into("doc", out, sizeof(out), &sz));
+    ASSUME_ITS_TRUE(sz == sizeof(text) && memcmp(out, text, sz) == 0);
+    const void *view = fossil_bluecrab_cacheshell_get_binary("doc", &sz);
+    ASSUME_ITS_TRUE(view && sz == sizeof(text) && memcmp(view, text, sz) == 0);
+    char *prefix = fossil_bluecrab_cacheshell_get("doc", 14);
+    ASSUME_ITS_TRUE(prefix && strcmp(prefix, "compressible ") == 0);
+    free(prefix);
+
+    // Overwriting with a small value drops the compressed form
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_set("doc", "short"));
+    fossil_bluecrab_cacheshell_compression_stats(&entries, NULL, NULL);
+    ASSUME_ITS_TRUE(entries == 0);
+
+    fossil_bluecrab_cacheshell_shutdown();
+}
+
+FOSSIL_TEST(c_test_cacheshell_large_objects) {
+    fossil_bluecrab_cacheshell_init(0);
+    fossil_bluecrab_cacheshell_clear();
+    // Budget fits two 64 KiB objects (plus page rounding) but not three
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_large_objects(32 * 1024, 160 * 1024));
+
+    static unsigned char blob[64 * 1024];
+    for (size_t i = 0; i < sizeof(blob); ++i)
+        blob[i] = (unsigned char)(i * 13);
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_set("small", "stays"));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_set_binary("big:a", blob, sizeof(blob)));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_set_binary("big:b", blob, sizeof(blob)));
+
+    size_t count = 0, mapped = 0, evictions = 0;
+    fossil_bluecrab_cacheshell_large_object_stats(&count, &mapped, &evictions);
+    ASSUME_ITS_TRUE(count == 2 && mapped >= 2 * sizeof(blob) && evictions == 0);
+
+    // Reading big:a makes big:b the least recently used
+    size_t sz = 0;
+    const unsigned char *p = (const unsigned char *)fossil_bluecrab_cacheshell_get_binary("big:a", &sz);
+    ASSUME_ITS_TRUE(p && sz == sizeof(blob) && memcmp(p, blob, sz) == 0);
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_set_binary("big:c", blob, sizeof(blob)));
+    ASSUME_ITS_FALSE(fossil_bluecrab_cacheshell_exists("big:b"));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_exists("big:a"));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_exists("small"));
+    fossil_bluecrab_cacheshell_large_object_stats(&count, NULL, &evictions);
+    ASSUME_ITS_TRUE(count == 2 && evictions == 1);
+
+    // A value larger than the whole budget is refused
+    static unsigned char huge[256 * 1024];
+    ASSUME_ITS_FALSE(fossil_bluecrab_cacheshell_set_binary("huge", huge, sizeof(huge)));
+
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_remove("big:a"));
+    fossil_bluecrab_cacheshell_large_object_stats(&count, &mapped, NULL);
+    ASSUME_ITS_TRUE(count == 1);
+    fossil_bluecrab_cacheshell_shutdown();
+}
+
+FOSSIL_TEST(c_test_cacheshell_pin) {
+    fossil_bluecrab_cacheshell_init(0);
+    fossil_bluecrab_cacheshell_clear();
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_set("k", "first"));
+
+    fossil_bluecrab_cache_pin_t *a = NULL, *b = NULL;
+    size_t size = 0;
+    const char *va = (const char *)fossil_bluecrab_cacheshell_pin("k", &size, &a);
+    const char *vb = (const char *)fossil_bluecrab_cacheshell_pin("k", NULL, &b);
+    ASSUME_ITS_TRUE(va && a && size == 6 && strcmp(va, "first") == 0);
+    ASSUME_ITS_TRUE(va == vb); // zero-copy, shared
+
+    // Overwrite and clear: pinned bytes stay intact until the last unpin
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_set("k", "second"));
+    fossil_bluecrab_cacheshell_unpin(a);
+    fossil_bluecrab_cacheshell_clear();
+    ASSUME_ITS_TRUE(strcmp(vb, "first") == 0);
+    fossil_bluecrab_cacheshell_unpin(b);
+
+    fossil_bluecrab_cache_pin_t *missing = (fossil_bluecrab_cache_pin_t *)1;
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_pin("nope", NULL, &missing) == NULL && missing == NULL);
+    fossil_bluecrab_cacheshell_shutdown();
+}
+
+FOSSIL_TEST(c_test_cacheshell_binary_keys) {
+#ifdef _WIN32
+    const char *snapshot_path = ".\\cacheshell_keys.snapshot";
+#else
+    const char *snapshot_path = "/tmp/cacheshell_keys.snapshot";
+#endif
+    const char nul_key[] = { 'a', '\0', 'b' };
+    const char nl_key[] = { 'x', '\n', 'y' };
+
+    fossil_bluecrab_cacheshell_init(0);
+    fossil_bluecrab_cacheshell_clear();
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_set("a", "plain"));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_set_binary_n(nul_key, sizeof(nul_key), "nul", 4));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_set_binary_n(nl_key, sizeof(nl_key), "nl", 3));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_count() == 3); // "a\0b" is not "a"
+
+    char buf[8];
+    size_t size = 0;
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_get_binary_into_n(nul_key, sizeof(nul_key), buf, sizeof(buf), &size));
+    ASSUME_ITS_TRUE(size == 4 && strcmp(buf, "nul") == 0);
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_expire_n(nul_key, sizeof(nul_key), 100));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_ttl_n(nul_key, sizeof(nul_key)) > 0);
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_ttl("a") == -1);
+
+    // Both odd keys survive a save/load round trip
+    remove(snapshot_path);
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_save(snapshot_path));
+    fossil_bluecrab_cacheshell_clear();
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_load(snapshot_path));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_count() == 3);
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_exists_n(nl_key, sizeof(nl_key)));
+
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_remove_n(nul_key, sizeof(nul_key)));
+    ASSUME_ITS_FALSE(fossil_bluecrab_cacheshell_exists_n(nul_key, sizeof(nul_key)));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_exists("a"));
+    fossil_bluecrab_cacheshell_shutdown();
+    remove(snapshot_path);
+}
+
+FOSSIL_TEST(c_test_cacheshell_shared_stale_segment) {
+#if !defined(_WIN32) && !defined(_WIN64)
+    const char *name = "/crabdb-test-c-stale";
+    fossil_bluecrab_cacheshell_unlink_shared(name);
+    // A creator that died right after shm_open leaves an unsized segment
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    ASSUME_ITS_TRUE(fd >= 0);
+    close(fd);
+
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_init_shared(name, 0, 1 << 20));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_set("k", "v"));
+    char buf[4];
+    size_t size = 0;
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_get_binary_into("k", buf, sizeof(buf), &size));
+    ASSUME_ITS_TRUE(size == 2 && strcmp(buf, "v") == 0);
+    // No pointer into the shared segment is handed out
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_get_binary("k", &size) == NULL);
+    fossil_bluecrab_cacheshell_shutdown();
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_unlink_shared(name));
+#endif
+}
+
+FOSSIL_TEST(c_test_cacheshell_collections_save_load) {
+#ifdef _WIN32
+    const char *snapshot_path = ".\\cacheshell_coll.snapshot";
+#else
+    const char *snapshot_path = "/tmp/cacheshell_coll.snapshot";
+#endif
+    fossil_bluecrab_cacheshell_init(0);
+    fossil_bluecrab_cacheshell_clear();
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_set("plain", "v"));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_hset("user:1", "name", "ada", 3));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_sadd("tags", "red"));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_lpush("events", "b", 1));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_lpush("events", "a", 1));
+    // Large enough to leave the packed encoding
+    for (int i = 0; i < 100; ++i) {
+        char field[16];
+        snprintf(field, sizeof(field), "f%d", i);
+        ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_hset("big", field, &i, sizeof(i)));
+        ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_sadd("members", field));
+        ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_lpush("log", "x", 1));
+    }
+
+    remove(snapshot_path);
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_save(snapshot_path));
+    fossil_bluecrab_cacheshell_clear();
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_load(snapshot_path));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_count() == 7);
+
+    char buf[16] = {0};
+    size_t sz = 0;
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_hget("user:1", "name", buf, sizeof(buf), &sz));
+    ASSUME_ITS_TRUE(sz == 3 && memcmp(buf, "ada", 3) == 0);
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_sismember("tags", "red"));
+    ASSUME_ITS_FALSE(fossil_bluecrab_cacheshell_sismember("tags", "blue"));
+    char joined[16] = {0};
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_lrange("events", 0, -1, cacheshell_list_cb, joined) == 2);
+    ASSUME_ITS_TRUE(strcmp(joined, "ab") == 0);
+    int v = -1;
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_hget("big", "f42", &v, sizeof(v), NULL) && v == 42);
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_sismember("members", "f99"));
+    joined[0] = '\0';
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_lrange("log", 97, -1, cacheshell_list_cb, joined) == 3);
+    ASSUME_ITS_TRUE(strcmp(joined, "xxx") == 0);
+    fossil_bluecrab_cacheshell_shutdown();
+    remove(snapshot_path);
+}
+
+FOSSIL_TEST(c_test_cacheshell_collections_binary_safe) {
+#ifdef _WIN32
+    const char *snapshot_path = ".\\cacheshell_bin.snapshot";
+#else
+    const char *snapshot_path = "/tmp/cacheshell_bin.snapshot";
+#endif
+    fossil_bluecrab_cacheshell_init(0);
+    fossil_bluecrab_cacheshell_clear();
+    // Embedded NULs keep keys, fields and members distinct
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_hset_n("h\0a", 3, "f\0x", 3, "1", 1));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_hset_n("h\0a", 3, "f", 1, "2", 1));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_sadd_n("s", 1, "m\0n", 3));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_lpush_n("l\0", 2, "x", 1));
+    ASSUME_ITS_FALSE(fossil_bluecrab_cacheshell_sismember("s", "m"));
+    ASSUME_ITS_FALSE(fossil_bluecrab_cacheshell_hget("h", "f", NULL, 0, NULL));
+
+    remove(snapshot_path);
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_save(snapshot_path));
+    fossil_bluecrab_cacheshell_clear();
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_load(snapshot_path));
+
+    char buf[4] = {0};
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_hget_n("h\0a", 3, "f\0x", 3, buf, sizeof(buf), NULL));
+    ASSUME_ITS_TRUE(buf[0] == '1');
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_hget_n("h\0a", 3, "f", 1, buf, sizeof(buf), NULL));
+    ASSUME_ITS_TRUE(buf[0] == '2');
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_sismember_n("s", 1, "m\0n", 3));
+    char joined[16] = {0};
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_lrange_n("l\0", 2, 0, -1, cacheshell_list_cb, joined) == 1);
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_hdel_n("h\0a", 3, "f\0x", 3));
+    ASSUME_ITS_FALSE(fossil_bluecrab_cacheshell_hget_n("h\0a", 3, "f\0x", 3, NULL, 0, NULL));
+    fossil_bluecrab_cacheshell_shutdown();
+    remove(snapshot_path);
+}
+
+FOSSIL_TEST(c_test_cacheshell_snapshot_format) {
+#ifdef _WIN32
+    const char *snapshot_path = ".\\cacheshell_fmt.snapshot";
+#else
+    const char *snapshot_path = "/tmp/cacheshell_fmt.snapshot";
+#endif
+    fossil_bluecrab_cacheshell_init(0);
+    fossil_bluecrab_cacheshell_clear();
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_set_binary("k", "vv", 2));
+    remove(snapshot_path);
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_save(snapshot_path));
+
+    // Lengths are little-endian u32 key / u64 size on every host
+    static const unsigned char expected[] = {
+        0, 'F', 'C', 'A', 'C', 'H', 'E', '4',
+        0, 1, 0, 0, 0, 'k', 2, 0, 0, 0, 0, 0, 0, 0, 'v', 'v'
+    };
+    unsigned char got[64];
+    FILE *file = fopen(snapshot_path, "rb");
+    ASSUME_ITS_TRUE(file != NULL);
+    size_t n = file ? fread(got, 1, sizeof(got), file) : 0;
+    if (file)
+        fclose(file);
+    ASSUME_ITS_TRUE(n == sizeof(expected) && memcmp(got, expected, sizeof(expected)) == 0);
+
+    // Lengths past the end of the file are rejected before allocating
+    static const unsigned char huge_key[] = {
+        0, 'F', 'C', 'A', 'C', 'H', 'E', '4', 0, 0xFF, 0xFF, 0xFF, 0xFF, 'k'
+    };
+    static const unsigned char huge_value[] = {
+        0, 'F', 'C', 'A', 'C', 'H', 'E', '4',
+        0, 1, 0, 0, 0, 'k', 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x7F, 'v'
+    };
+    file = fopen(snapshot_path, "wb");
+    ASSUME_ITS_TRUE(file && fwrite(huge_key, sizeof(huge_key), 1, file) == 1);
+    if (file)
+        fclose(file);
+    ASSUME_ITS_FALSE(fossil_bluecrab_cacheshell_load(snapshot_path));
+    file = fopen(snapshot_path, "wb");
+    ASSUME_ITS_TRUE(file && fwrite(huge_value, sizeof(huge_value), 1, file) == 1);
+    if (file)
+        fclose(file);
+    ASSUME_ITS_FALSE(fossil_bluecrab_cacheshell_load(snapshot_path));
+    fossil_bluecrab_cacheshell_shutdown();
+    remove(snapshot_path);
+}
+
+static void cacheshell_key_len_cb(const char *key, size_t key_len, const void *value, size_t size,
+                                  void *user_data) {
+    (void)value;
+    (void)size;
+    size_t *total = (size_t *)user_data;
+    if (key[key_len] == '\0')
+        *total += key_len;
+}
+
+FOSSIL_TEST(c_test_cacheshell_scan_binary_keys) {
+    fossil_bluecrab_cacheshell_init(0);
+    fossil_bluecrab_cacheshell_clear();
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_set_binary_n("p\0a", 3, "1", 1));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_set_binary_n("p\0b", 3, "2", 1));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_set_binary_n("p", 1, "3", 1));
+
+    for (int pass = 0; pass < 2; ++pass) {
+        // Unordered table walk first, then the ordered index
+        if (pass == 1)
+            ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_ordered_index(true));
+        size_t total = 0;
+        fossil_bluecrab_cacheshell_iterate_n(cacheshell_key_len_cb, &total);
+        ASSUME_ITS_TRUE(total == 7);
+        total = 0;
+        ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_scan_prefix_n("p\0", 2, cacheshell_key_len_cb, &total) == 2);
+        ASSUME_ITS_TRUE(total == 6);
+        total = 0;
+        ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_scan_range_n("p\0b", 3, NULL, 0, cacheshell_key_len_cb, &total) == 1);
+        ASSUME_ITS_TRUE(total == 3);
+    }
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_delete_range_n("p\0a", 3, "p\0b", 3) == 1);
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_delete_prefix_n("p\0", 2) == 1);
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_count() == 1);
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_exists_n("p", 1));
+    fossil_bluecrab_cacheshell_shutdown();
+}
+
+FOSSIL_TEST(c_test_cacheshell_large_object_pool) {
+    fossil_bluecrab_cacheshell_init(0);
+    fossil_bluecrab_cacheshell_clear();
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_large_objects(32 * 1024, 0));
+
+    static unsigned char blob[64 * 1024];
+    const unsigned char *lo = NULL, *hi = NULL;
+    for (int i = 0; i < 200; ++i) {
+        char key[16];
+        snprintf(key, sizeof(key), "lob:%d", i);
+        memset(blob, i, sizeof(blob));
+        ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_set_binary(key, blob, sizeof(blob)));
+        const unsigned char *p = (const unsigned char *)fossil_bluecrab_cacheshell_get_binary(key, NULL);
+        ASSUME_ITS_TRUE(p && p[0] == (unsigned char)i);
+        if (!lo || p < lo) lo = p;
+        if (!hi || p > hi) hi = p;
+    }
+    // 200 values carved from one pooled mapping, not 200 mappings
+    ASSUME_ITS_TRUE((size_t)(hi - lo) < (size_t)64 * 1024 * 1024);
+    size_t count = 0;
+    fossil_bluecrab_cacheshell_large_object_stats(&count, NULL, NULL);
+    ASSUME_ITS_TRUE(count == 200);
+
+    // A pointer that outlived its value stays mapped; the freed run is reused
+    const unsigned char *stale = (const unsigned char *)fossil_bluecrab_cacheshell_get_binary("lob:7", NULL);
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_remove("lob:7"));
+    volatile unsigned char byte = stale[sizeof(blob) - 1];
+    (void)byte;
+    memset(blob, 0xAB, sizeof(blob));
+    ASSUME_ITS_TRUE(fossil_bluecrab_cacheshell_set_binary("again", blob, sizeof(blob)));
+    const unsigned char *again = (const unsigned char *)fossil_bluecrab_cacheshell_get_binary("again", NULL);
+    ASSUME_ITS_TRUE(again == stale && again[0] == 0xAB);
+    fossil_bluecrab_cacheshell_shutdown();
+}
+
 // * * * * * * * * * * * * * * * * * * * * * * * *
 // * Fossil Logic Test Pool
 // * * * * * * * * * * * * * * * * * * * * * * * *
@@ -317,6 +892,22 @@ FOSSIL_TEST_GROUP(c_cacheshell_database_tests) {
     FOSSIL_TEST_ADD(c_cacheshell_fixture, c_test_cacheshell_threadsafe_toggle);
     FOSSIL_TEST_ADD(c_cacheshell_fixture, c_test_cacheshell_persistence_save_load);
     FOSSIL_TEST_ADD(c_cacheshell_fixture, c_test_cacheshell_init_with_limit);
+    FOSSIL_TEST_ADD(c_cacheshell_fixture, c_test_cacheshell_ordered_prefix_scan);
+    FOSSIL_TEST_ADD(c_cacheshell_fixture, c_test_cacheshell_range_without_index);
+    FOSSIL_TEST_ADD(c_cacheshell_fixture, c_test_cacheshell_near_cache_layers);
+    FOSSIL_TEST_ADD(c_cacheshell_fixture, c_test_cacheshell_shared_segment);
+    FOSSIL_TEST_ADD(c_cacheshell_fixture, c_test_cacheshell_hot_and_big_keys);
+    FOSSIL_TEST_ADD(c_cacheshell_fixture, c_test_cacheshell_collections);
+    FOSSIL_TEST_ADD(c_cacheshell_fixture, c_test_cacheshell_compression);
+    FOSSIL_TEST_ADD(c_cacheshell_fixture, c_test_cacheshell_large_objects);
+    FOSSIL_TEST_ADD(c_cacheshell_fixture, c_test_cacheshell_pin);
+    FOSSIL_TEST_ADD(c_cacheshell_fixture, c_test_cacheshell_binary_keys);
+    FOSSIL_TEST_ADD(c_cacheshell_fixture, c_test_cacheshell_shared_stale_segment);
+    FOSSIL_TEST_ADD(c_cacheshell_fixture, c_test_cacheshell_collections_save_load);
+    FOSSIL_TEST_ADD(c_cacheshell_fixture, c_test_cacheshell_large_object_pool);
+    FOSSIL_TEST_ADD(c_cacheshell_fixture, c_test_cacheshell_collections_binary_safe);
+    FOSSIL_TEST_ADD(c_cacheshell_fixture, c_test_cacheshell_snapshot_format);
+    FOSSIL_TEST_ADD(c_cacheshell_fixture, c_test_cacheshell_scan_binary_keys);
 
     FOSSIL_TEST_REGISTER(c_cacheshell_fixture);
 } // end of tests
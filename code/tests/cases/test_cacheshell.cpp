@@ -301,6 +301,274 @@ FOSSIL_TEST(cpp_test_cacheshell_init_with_limit) {
     CacheShell::shutdown();
 }
 
+FOSSIL_TEST(cpp_test_cacheshell_ordered_prefix_scan) {
+    CacheShell::init(0);
+    CacheShell::clear();
+    CacheShell::set("session:2:1", "b");
+    CacheShell::set("session:1:2", "a2");
+    CacheShell::set("session:1:1", "a1");
+    ASSUME_ITS_TRUE(CacheShell::ordered_index(true));
+
+    std::vector<std::string> keys;
+    size_t n = CacheShell::scan_prefix("session:1:", [&](const std::string& k, const void*, size_t) {
+        keys.push_back(k);
+    });
+    ASSUME_ITS_TRUE(n == 2);
+    ASSUME_ITS_TRUE(keys.size() == 2 && keys[0] == "session:1:1" && keys[1] == "session:1:2");
+
+    keys.clear();
+    ASSUME_ITS_TRUE(CacheShell::scan_range("session:1:2", "session:9", [&](const std::string& k, const void*, size_t) {
+        keys.push_back(k);
+    }) == 2);
+    ASSUME_ITS_TRUE(keys[0] == "session:1:2" && keys[1] == "session:2:1");
+
+    ASSUME_ITS_TRUE(CacheShell::delete_range("session:1:", "session:2:") == 2);
+    ASSUME_ITS_TRUE(CacheShell::delete_prefix("session:") == 1);
+    ASSUME_ITS_TRUE(CacheShell::count() == 0);
+    CacheShell::shutdown();
+}
+
+FOSSIL_TEST(cpp_test_cacheshell_scan_binary_prefix) {
+    using namespace std::string_view_literals;
+    CacheShell::init(0);
+    CacheShell::clear();
+    CacheShell::set("t\0a"sv, "1");
+    CacheShell::set("t\0b"sv, "2");
+    CacheShell::set("t"sv, "3");
+
+    for (int pass = 0; pass < 2; ++pass) {
+        std::vector<std::string> keys;
+        ASSUME_ITS_TRUE(CacheShell::scan_prefix("t\0"sv, [&](const std::string& k, const void*, size_t) {
+            keys.push_back(k);
+        }) == 2);
+        ASSUME_ITS_TRUE(keys.size() == 2 && keys[0].size() == 3 && keys[1].size() == 3);
+
+        keys.clear();
+        ASSUME_ITS_TRUE(CacheShell::scan_range("t\0b"sv, "u"sv, [&](const std::string& k, const void*, size_t) {
+            keys.push_back(k);
+        }) == 1);
+        ASSUME_ITS_TRUE(keys.size() == 1 && keys[0] == "t\0b"sv);
+        ASSUME_ITS_TRUE(CacheShell::ordered_index(true));
+    }
+
+    ASSUME_ITS_TRUE(CacheShell::delete_range("t\0a"sv, "t\0b"sv) == 1);
+    ASSUME_ITS_TRUE(CacheShell::delete_prefix("t\0"sv) == 1);
+    ASSUME_ITS_TRUE(CacheShell::count() == 1 && CacheShell::exists("t"sv));
+    CacheShell::shutdown();
+}
+
+FOSSIL_TEST(cpp_test_cacheshell_near_cache_layers) {
+    CacheShell::init(0);
+    CacheShell::clear();
+    ASSUME_ITS_TRUE(CacheShell::near_cache(true));
+    CacheShell::set("hot", "one");
+
+    auto before = CacheShell::layer_stats();
+    std::string out;
+    ASSUME_ITS_TRUE(CacheShell::get("hot", out) && out == "one");
+    ASSUME_ITS_TRUE(CacheShell::get("hot", out) && out == "one");
+    auto after = CacheShell::layer_stats();
+    ASSUME_ITS_TRUE(after.l1_hits == before.l1_hits + 1);
+    ASSUME_ITS_TRUE(after.shared_hits == before.shared_hits + 1);
+
+    CacheShell::set("hot", "two");
+    std::vector<uint8_t> bytes;
+    ASSUME_ITS_TRUE(CacheShell::get_binary_vector("hot", bytes));
+    ASSUME_ITS_TRUE(bytes.size() == 4 && std::memcmp(bytes.data(), "two", 4) == 0);
+
+    CacheShell::near_cache(false);
+    CacheShell::shutdown();
+}
+
+FOSSIL_TEST(cpp_test_cacheshell_shared_segment) {
+#if !defined(_WIN32) && !defined(_WIN64)
+    const std::string name = "/crabdb-test-cpp-shared";
+    CacheShell::unlink_shared(name);
+    ASSUME_ITS_TRUE(CacheShell::init_shared(name, 16, 1 << 20));
+    ASSUME_ITS_TRUE(CacheShell::set("k", "v1"));
+    CacheShell::shutdown();
+
+    ASSUME_ITS_TRUE(CacheShell::init_shared(name));
+    std::string out;
+    ASSUME_ITS_TRUE(CacheShell::get("k", out) && out == "v1");
+    ASSUME_ITS_TRUE(CacheShell::remove("k"));
+    CacheShell::shutdown();
+    ASSUME_ITS_TRUE(CacheShell::unlink_shared(name));
+#endif
+}
+
+FOSSIL_TEST(cpp_test_cacheshell_hot_and_big_keys) {
+    CacheShell::init(0);
+    CacheShell::clear();
+    ASSUME_ITS_TRUE(CacheShell::key_tracking(true));
+    CacheShell::set("a", "1");
+    CacheShell::set("b", std::string(200, 'z'));
+    std::string out;
+    for (int i = 0; i < 10; ++i)
+        CacheShell::get("a", out);
+
+    auto hot = CacheShell::top_keys(1);
+    ASSUME_ITS_TRUE(hot.size() == 1 && hot[0].key == "a" && hot[0].value == 11);
+    auto big = CacheShell::largest_keys(1);
+    ASSUME_ITS_TRUE(big.size() == 1 && big[0].key == "b" && big[0].value == 201);
+
+    CacheShell::key_tracking(false);
+    CacheShell::shutdown();
+}
+
+FOSSIL_TEST(cpp_test_cacheshell_collections) {
+    CacheShell::init(0);
+    CacheShell::clear();
+
+    ASSUME_ITS_TRUE(CacheShell::hset("user:1", "name", "ada"));
+    std::string out;
+    ASSUME_ITS_TRUE(CacheShell::hget("user:1", "name", out) && out == "ada");
+    ASSUME_ITS_TRUE(CacheShell::hdel("user:1", "name"));
+    ASSUME_ITS_TRUE(CacheShell::count() == 0); // last field removes the key
+
+    ASSUME_ITS_TRUE(CacheShell::lpush("q", "2"));
+    ASSUME_ITS_TRUE(CacheShell::lpush("q", "1"));
+    auto items = CacheShell::lrange("q", 0, -1);
+    ASSUME_ITS_TRUE(items.size() == 2 && items[0] == "1" && items[1] == "2");
+
+    ASSUME_ITS_TRUE(CacheShell::sadd("s", "m"));
+    ASSUME_ITS_TRUE(CacheShell::sismember("s", "m"));
+    ASSUME_ITS_FALSE(CacheShell::sismember("s", "n"));
+
+    // Keys, fields and members are binary-safe
+    using namespace std::string_literals;
+    ASSUME_ITS_TRUE(CacheShell::hset("h\0a"s, "f\0x"s, "1"));
+    ASSUME_ITS_FALSE(CacheShell::hget("h", "f", out));
+    ASSUME_ITS_TRUE(CacheShell::hget("h\0a"s, "f\0x"s, out) && out == "1");
+    ASSUME_ITS_TRUE(CacheShell::sadd("s", "m\0n"s));
+    ASSUME_ITS_TRUE(CacheShell::sismember("s", "m\0n"s));
+    CacheShell::shutdown();
+}
+
+FOSSIL_TEST(cpp_test_cacheshell_compression) {
+    CacheShell::init(0);
+    CacheShell::clear();
+    ASSUME_ITS_TRUE(CacheShell::compression(64));
+
+    std::vector<uint8_t> blob(2048);
+    for (size_t i = 0; i < blob.size(); ++i)
+        blob[i] = static_cast<uint8_t>(i % 16);
+    ASSUME_ITS_TRUE(CacheShell::set_binary("blob", blob.data(), blob.size()));
+
+    auto stats = CacheShell::compression_stats();
+    ASSUME_ITS_TRUE(stats.entries == 1 && stats.logical_bytes == blob.size());
+    ASSUME_ITS_TRUE(stats.stored_bytes < blob.size());
+
+    std::vector<uint8_t> out;
+    ASSUME_ITS_TRUE(CacheShell::get_binary_vector("blob", out) && out == blob);
+    CacheShell::shutdown();
+}
+
+FOSSIL_TEST(cpp_test_cacheshell_large_objects) {
+    CacheShell::init(0);
+    CacheShell::clear();
+    ASSUME_ITS_TRUE(CacheShell::large_objects(16 * 1024));
+
+    std::vector<uint8_t> blob(100 * 1024, 0x5a);
+    blob[1234] = 0x01;
+    ASSUME_ITS_TRUE(CacheShell::set_binary("img", blob.data(), blob.size()));
+    auto stats = CacheShell::large_object_stats();
+    ASSUME_ITS_TRUE(stats.count == 1 && stats.mapped_bytes >= blob.size());
+
+    std::vector<uint8_t> out;
+    ASSUME_ITS_TRUE(CacheShell::get_binary_vector("img", out) && out == blob);
+    ASSUME_ITS_TRUE(CacheShell::remove("img"));
+    ASSUME_ITS_TRUE(CacheShell::large_object_stats().count == 0);
+    CacheShell::shutdown();
+}
+
+FOSSIL_TEST(cpp_test_cacheshell_views_and_typed_values) {
+    CacheShell::init(0);
+    CacheShell::clear();
+
+    // Values longer than the old 4096-byte cap come back whole
+    std::string long_text(10000, 'x');
+    std::string_view key_view = std::string_view("doc:1-ignored").substr(0, 5);
+    ASSUME_ITS_TRUE(CacheShell::set(key_view, long_text));
+    std::string out;
+    ASSUME_ITS_TRUE(CacheShell::get("doc:1", out) && out == long_text);
+    ASSUME_ITS_TRUE(CacheShell::get("doc:1", out, 4) && out == "xxx");
+
+    struct Point { int x; double y; };
+    ASSUME_ITS_TRUE(CacheShell::set("pt", Point{3, 4.5}));
+    Point p{};
+    ASSUME_ITS_TRUE(CacheShell::get("pt", p) && p.x == 3 && p.y == 4.5);
+    ASSUME_ITS_TRUE(CacheShell::get<Point>("pt").has_value());
+    ASSUME_ITS_FALSE(CacheShell::get<int>("pt").has_value()); // size mismatch
+
+    const std::byte raw[3] = {std::byte{1}, std::byte{0}, std::byte{2}};
+    ASSUME_ITS_TRUE(CacheShell::set_binary("raw", std::span<const std::byte>(raw)));
+    std::byte back[3] = {};
+    size_t size = 0;
+    ASSUME_ITS_TRUE(CacheShell::get_binary("raw", std::span<std::byte>(back), &size));
+    ASSUME_ITS_TRUE(size == 3 && back[2] == std::byte{2});
+
+    // A pinned view survives overwrite and removal of its key
+    {
+        CacheShell::PinnedView view = CacheShell::pin("doc:1");
+        ASSUME_ITS_TRUE(static_cast<bool>(view) && view.str() == long_text);
+        ASSUME_ITS_TRUE(CacheShell::set("doc:1", "replaced"));
+        ASSUME_ITS_TRUE(CacheShell::remove("doc:1"));
+        ASSUME_ITS_TRUE(view.size() == long_text.size() + 1 && view.str() == long_text);
+    }
+    ASSUME_ITS_FALSE(static_cast<bool>(CacheShell::pin("doc:1")));
+    CacheShell::shutdown();
+}
+
+FOSSIL_TEST(cpp_test_cacheshell_binary_keys) {
+    CacheShell::init(0);
+    CacheShell::clear();
+
+    using namespace std::string_view_literals;
+    const std::string_view key = "user\0id"sv;
+    ASSUME_ITS_TRUE(CacheShell::set(key, "bytes"));
+    ASSUME_ITS_TRUE(CacheShell::set("user", "prefix"));
+    std::string out;
+    ASSUME_ITS_TRUE(CacheShell::get(key, out) && out == "bytes");
+    ASSUME_ITS_TRUE(CacheShell::get("user", out) && out == "prefix");
+    ASSUME_ITS_TRUE(CacheShell::touch(key));
+    ASSUME_ITS_TRUE(CacheShell::remove(key));
+    ASSUME_ITS_FALSE(CacheShell::exists(key));
+    ASSUME_ITS_TRUE(CacheShell::exists("user"));
+    CacheShell::shutdown();
+}
+
+FOSSIL_TEST(cpp_test_cacheshell_long_string_values) {
+    CacheShell::init(0);
+    CacheShell::clear();
+
+    // Stored as text plus '\0', like the C set(), with no intermediate copy
+    const std::string text(4096, 'q');
+    ASSUME_ITS_TRUE(CacheShell::set("long", text));
+    size_t size = 0;
+    ASSUME_ITS_TRUE(CacheShell::get_binary("long", nullptr, 0, &size) && size == text.size() + 1);
+    std::string out;
+    ASSUME_ITS_TRUE(CacheShell::get("long", out) && out == text);
+
+    ASSUME_ITS_TRUE(CacheShell::set_with_ttl("ttl", std::string_view(text).substr(0, 200), 60));
+    ASSUME_ITS_TRUE(CacheShell::get("ttl", out) && out.size() == 200);
+    ASSUME_ITS_TRUE(CacheShell::ttl("ttl") > 0);
+
+    ASSUME_ITS_TRUE(CacheShell::set("empty", std::string_view()));
+    ASSUME_ITS_TRUE(CacheShell::get_binary("empty", nullptr, 0, &size) && size == 1);
+
+    // The terminator survives the compressed and large-object paths too
+    ASSUME_ITS_TRUE(CacheShell::compression(64));
+    ASSUME_ITS_TRUE(CacheShell::set("packed", text));
+    ASSUME_ITS_TRUE(CacheShell::get("packed", out) && out == text);
+    ASSUME_ITS_TRUE(CacheShell::compression(0));
+    ASSUME_ITS_TRUE(CacheShell::large_objects(1024));
+    ASSUME_ITS_TRUE(CacheShell::set("mapped", text));
+    ASSUME_ITS_TRUE(CacheShell::get_binary("mapped", nullptr, 0, &size) && size == text.size() + 1);
+    ASSUME_ITS_TRUE(CacheShell::get("mapped", out) && out == text);
+    CacheShell::shutdown();
+}
+
 // * * * * * * * * * * * * * * * * * * * * * * * *
 // * Fossil Logic Test Pool
 // * * * * * * * * * * * * * * * * * * * * * * * *
@@ -319,6 +587,17 @@ FOSSIL_TEST_GROUP(cpp_cacheshell_database_tests) {
     FOSSIL_TEST_ADD(cpp_cacheshell_fixture, cpp_test_cacheshell_threadsafe_toggle);
     FOSSIL_TEST_ADD(cpp_cacheshell_fixture, cpp_test_cacheshell_persistence_save_load);
     FOSSIL_TEST_ADD(cpp_cacheshell_fixture, cpp_test_cacheshell_init_with_limit);
+    FOSSIL_TEST_ADD(cpp_cacheshell_fixture, cpp_test_cacheshell_ordered_prefix_scan);
+    FOSSIL_TEST_ADD(cpp_cacheshell_fixture, cpp_test_cacheshell_near_cache_layers);
+    FOSSIL_TEST_ADD(cpp_cacheshell_fixture, cpp_test_cacheshell_shared_segment);
+    FOSSIL_TEST_ADD(cpp_cacheshell_fixture, cpp_test_cacheshell_hot_and_big_keys);
+    FOSSIL_TEST_ADD(cpp_cacheshell_fixture, cpp_test_cacheshell_collections);
+    FOSSIL_TEST_ADD(cpp_cacheshell_fixture, cpp_test_cacheshell_compression);
+    FOSSIL_TEST_ADD(cpp_cacheshell_fixture, cpp_test_cacheshell_large_objects);
+    FOSSIL_TEST_ADD(cpp_cacheshell_fixture, cpp_test_cacheshell_views_and_typed_values);
+    FOSSIL_TEST_ADD(cpp_cacheshell_fixture, cpp_test_cacheshell_binary_keys);
+    FOSSIL_TEST_ADD(cpp_cacheshell_fixture, cpp_test_cacheshell_long_string_values);
+    FOSSIL_TEST_ADD(cpp_cacheshell_fixture, cpp_test_cacheshell_scan_binary_prefix);
 
     FOSSIL_TEST_REGISTER(cpp_cacheshell_fixture);
 } // end of tests
@@ -365,6 +365,1127 @@ FOSSIL_TEST(c_test_myshell_check_integrity_null) {
     ASSUME_ITS_TRUE(err == FOSSIL_MYSHELL_ERROR_INVALID_FILE);
 }
 
+FOSSIL_TEST(c_test_myshell_index_reopen) {
+    fossil_bluecrab_myshell_error_t err;
+    const char *file_name = "test_index_reopen.myshell";
+    fossil_bluecrab_myshell_t *db = fossil_myshell_create(file_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+
+    char key[32], expected[32], value[64];
+    for (int i = 0; i < 100; ++i) {
+        snprintf(key, sizeof(key), "key%d", i);
+        snprintf(expected, sizeof(expected), "value%d", i);
+        ASSUME_ITS_TRUE(fossil_myshell_put(db, key, "cstr", expected) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    }
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "key7", "cstr", "changed") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_del(db, "key8") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+
+    // Values longer than the old 1 KB line buffer come back whole
+    char big[2048];
+    memset(big, 'x', sizeof(big) - 1);
+    big[sizeof(big) - 1] = '\0';
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "big", "cstr", big) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    fossil_myshell_close(db);
+
+    db = fossil_myshell_open(file_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+    for (int i = 0; i < 100; ++i) {
+        snprintf(key, sizeof(key), "key%d", i);
+        snprintf(expected, sizeof(expected), "value%d", i);
+        err = fossil_myshell_get(db, key, value, sizeof(value));
+        if (i == 7) {
+            ASSUME_ITS_EQUAL_CSTR(value, "changed");
+        } else if (i == 8) {
+            ASSUME_ITS_TRUE(err == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+        } else {
+            ASSUME_ITS_TRUE(err == FOSSIL_MYSHELL_ERROR_SUCCESS);
+            ASSUME_ITS_EQUAL_CSTR(value, expected);
+        }
+    }
+    char big_out[4096];
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "big", big_out, sizeof(big_out)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(strcmp(big_out, big) == 0);
+
+    // Records are length-prefixed, so keys that look like metadata are ordinary keys
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "#commit", "cstr", "x") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "#commit", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(value, "x");
+
+    fossil_myshell_close(db);
+    remove(file_name);
+}
+
+static bool c_myshell_count_commits(const char *hash, const char *message, void *user) {
+    (void)hash;
+    (void)message;
+    (*(int *)user)++;
+    return true;
+}
+
+FOSSIL_TEST(c_test_myshell_append_only_log) {
+    fossil_bluecrab_myshell_error_t err;
+    const char *file_name = "test_append_only_log.myshell";
+    fossil_bluecrab_myshell_t *db = fossil_myshell_create(file_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "a", "i32", "1") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "a", "i32", "2") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "b", "cstr", "gone") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_del(db, "b") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_stage(db, "s", "cstr", "x") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_stage(db, "s", "cstr", "y") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_unstage(db, "s") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_commit(db, "two versions of a") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_check_integrity(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    fossil_myshell_close(db);
+
+    // Old versions stay in the file behind the v2 header
+    FILE *file = fopen(file_name, "rb");
+    ASSUME_ITS_TRUE(file != NULL);
+    char contents[2048] = {0};
+    size_t n = fread(contents, 1, sizeof(contents), file);
+    fclose(file);
+    ASSUME_ITS_TRUE(n > 8 && memcmp(contents, "MYSH\2", 5) == 0);
+    bool deleted_value_kept = false;
+    for (size_t i = 0; i + 4 <= n; ++i) {
+        if (memcmp(contents + i, "gone", 4) == 0) deleted_value_kept = true;
+    }
+    ASSUME_ITS_TRUE(deleted_value_kept);
+
+    // Reopening replays the log: latest version wins, tombstones hide keys
+    db = fossil_myshell_open(file_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+    char value[32];
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "a", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(value, "2");
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "b", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    ASSUME_ITS_TRUE(fossil_myshell_del(db, "b") == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    ASSUME_ITS_TRUE(fossil_myshell_unstage(db, "s") == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    ASSUME_ITS_TRUE(fossil_myshell_check_integrity(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    int commits = 0;
+    ASSUME_ITS_TRUE(fossil_myshell_log(db, c_myshell_count_commits, &commits) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(commits == 1);
+
+    fossil_myshell_close(db);
+    remove(file_name);
+}
+
+static long c_myshell_file_size(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return -1;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+FOSSIL_TEST(c_test_myshell_compaction) {
+    fossil_bluecrab_myshell_error_t err;
+    const char *file_name = "test_compaction.myshell";
+    fossil_bluecrab_myshell_t *db = fossil_myshell_create(file_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+
+    char value[32];
+    for (int i = 0; i < 200; ++i) {
+        snprintf(value, sizeof(value), "%d", i);
+        ASSUME_ITS_TRUE(fossil_myshell_put(db, "counter", "i32", value) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    }
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "gone", "cstr", "x") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_del(db, "gone") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_stage(db, "s", "cstr", "staged") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_commit(db, "kept history") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_stage(db, "pending", "cstr", "staged") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    long before = c_myshell_file_size(file_name);
+
+    // Writes made while the copy runs are carried over into the new file
+    ASSUME_ITS_TRUE(fossil_myshell_compact(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "late", "cstr", "carried") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "counter", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_compact_wait(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    long compacted = c_myshell_file_size(file_name);
+    ASSUME_ITS_TRUE(compacted < before / 4);
+
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "counter", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(value, "199");
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "late", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(value, "carried");
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "gone", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "s", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(value, "staged");
+    ASSUME_ITS_TRUE(fossil_myshell_unstage(db, "s") == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    ASSUME_ITS_TRUE(fossil_myshell_unstage(db, "pending") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_check_integrity(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    int commits = 0;
+    ASSUME_ITS_TRUE(fossil_myshell_log(db, c_myshell_count_commits, &commits) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(commits == 1);
+
+    // Crossing the garbage ratio starts a compaction from a write
+    ASSUME_ITS_TRUE(fossil_myshell_set_compaction(db, 1.5, 0) == FOSSIL_MYSHELL_ERROR_CONFIG_INVALID);
+    ASSUME_ITS_TRUE(fossil_myshell_set_compaction(db, 0.5, 0) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    for (int i = 0; i < 1000; ++i) {
+        snprintf(value, sizeof(value), "%d", i);
+        ASSUME_ITS_TRUE(fossil_myshell_put(db, "counter", "i32", value) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    }
+    ASSUME_ITS_TRUE(fossil_myshell_compact_wait(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    // Each put line is over 40 bytes, so without compaction the file would be larger
+    ASSUME_ITS_TRUE(c_myshell_file_size(file_name) < compacted + 1000 * 30);
+    fossil_myshell_close(db);
+
+    db = fossil_myshell_open(file_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "counter", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(value, "999");
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "late", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    fossil_myshell_close(db);
+    remove(file_name);
+}
+
+FOSSIL_TEST(c_test_myshell_durability_and_recovery) {
+    fossil_bluecrab_myshell_error_t err;
+    const char *file_name = "test_durability.myshell";
+    fossil_bluecrab_myshell_t *db = fossil_myshell_create(file_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+    ASSUME_ITS_TRUE(fossil_myshell_set_durability(db, (fossil_bluecrab_myshell_durability_t)42, 0) == FOSSIL_MYSHELL_ERROR_CONFIG_INVALID);
+    ASSUME_ITS_TRUE(fossil_myshell_set_durability(db, FOSSIL_MYSHELL_DURABILITY_COMMIT, 0) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+
+    // Records are grouped until the commit, but reads see them right away
+    long empty = c_myshell_file_size(file_name);
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "a", "cstr", "one") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "b", "cstr", "two") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    char value[32];
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "b", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(value, "two");
+    ASSUME_ITS_TRUE(c_myshell_file_size(file_name) == empty);
+    ASSUME_ITS_TRUE(fossil_myshell_commit(db, "group") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(c_myshell_file_size(file_name) > empty);
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "c", "cstr", "three") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_sync(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_check_integrity(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    fossil_myshell_close(db);
+
+    // Simulate a crash in the middle of an append: a record header whose
+    // payload (1-byte key, 100-byte value) never fully made it to disk
+    FILE *file = fopen(file_name, "ab");
+    ASSUME_ITS_TRUE(file != NULL);
+    const unsigned char torn[] = { 0, 0, 0, 0, 1, 16, 0, 0, 1, 0, 0, 0, 100, 0, 0, 0, 'd', 't', 'o' };
+    fwrite(torn, 1, sizeof(torn), file);
+    fclose(file);
+
+    db = fossil_myshell_open(file_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "c", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(value, "three");
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "d", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "d", "cstr", "whole") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_check_integrity(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    fossil_myshell_close(db);
+
+    db = fossil_myshell_open(file_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "d", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(value, "whole");
+    fossil_myshell_close(db);
+    remove(file_name);
+}
+
+FOSSIL_TEST(c_test_myshell_binary_values) {
+    fossil_bluecrab_myshell_error_t err;
+    const char *file_name = "test_binary_values.myshell";
+    fossil_bluecrab_myshell_t *db = fossil_myshell_create(file_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+
+    // Values the text format could not hold round-trip unchanged
+    const char *tricky = "line one\nline two #hash=0000000000000000 #type=i8 a=b";
+    char big[5000];
+    memset(big, 'y', sizeof(big) - 1);
+    big[sizeof(big) - 1] = '\0';
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "multi\nline key", "cstr", tricky) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "a=b", "cstr", big) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_commit(db, "message\nwith two lines") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    fossil_myshell_close(db);
+
+    db = fossil_myshell_open(file_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+    char value[8192];
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "multi\nline key", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(value, tricky);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "a=b", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(strcmp(value, big) == 0);
+    int commits = 0;
+    ASSUME_ITS_TRUE(fossil_myshell_log(db, c_myshell_count_commits, &commits) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(commits == 1);
+    ASSUME_ITS_TRUE(fossil_myshell_check_integrity(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    fossil_myshell_close(db);
+
+    // A flipped payload byte in the middle of the file fails the record's CRC
+    FILE *file = fopen(file_name, "rb+");
+    ASSUME_ITS_TRUE(file != NULL);
+    fseek(file, 8 + 16 + 3, SEEK_SET);
+    fputc('X', file);
+    fclose(file);
+    db = fossil_myshell_open(file_name, &err);
+    ASSUME_ITS_TRUE(db == NULL);
+    ASSUME_ITS_TRUE(err == FOSSIL_MYSHELL_ERROR_CORRUPTED);
+    remove(file_name);
+}
+
+FOSSIL_TEST(c_test_myshell_mapped_views) {
+    fossil_bluecrab_myshell_error_t err;
+    const char *file_name = "test_mapped_views.myshell";
+    fossil_bluecrab_myshell_t *db = fossil_myshell_create(file_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "first", "cstr", "mapped value") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_commit(db, "initial") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+
+    // A view points straight into the mapping and is stable across reads
+    fossil_bluecrab_myshell_view_t view, again;
+    ASSUME_ITS_TRUE(fossil_myshell_get_view(db, "first", &view) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(view.length == strlen("mapped value"));
+    ASSUME_ITS_TRUE(memcmp(view.data, "mapped value", view.length) == 0);
+    ASSUME_ITS_TRUE(view.epoch == fossil_myshell_map_epoch(db));
+    char value[64];
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "first", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_get_view(db, "first", &again) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(again.data == view.data && again.epoch == view.epoch);
+    ASSUME_ITS_TRUE(fossil_myshell_get_view(db, "missing", &again) == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+
+    // Reading a record appended since then remaps the grown file
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "second", "cstr", "later") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_get_view(db, "second", &again) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(again.length == 5 && memcmp(again.data, "later", 5) == 0);
+    ASSUME_ITS_TRUE(again.epoch != view.epoch);
+
+    // Compaction swaps the file and ends the epoch
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "first", "cstr", "replaced") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    uint64_t before = fossil_myshell_map_epoch(db);
+    ASSUME_ITS_TRUE(fossil_myshell_compact(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_compact_wait(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_map_epoch(db) != before);
+    ASSUME_ITS_TRUE(fossil_myshell_get_view(db, "first", &view) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(view.length == 8 && memcmp(view.data, "replaced", 8) == 0);
+
+    // Scans over the mapping still see everything
+    int commits = 0;
+    ASSUME_ITS_TRUE(fossil_myshell_log(db, c_myshell_count_commits, &commits) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(commits == 1);
+    ASSUME_ITS_TRUE(fossil_myshell_check_integrity(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    fossil_myshell_close(db);
+    remove(file_name);
+}
+
+FOSSIL_TEST(c_test_myshell_batch_and_transaction) {
+    fossil_bluecrab_myshell_error_t err;
+    const char *file_name = "test_batch.myshell";
+    fossil_bluecrab_myshell_t *db = fossil_myshell_create(file_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "kept", "cstr", "before") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_commit(db, "base") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+
+    // A batch applies in order, in one go
+    fossil_bluecrab_myshell_batch_t *batch = fossil_myshell_batch_new();
+    ASSUME_ITS_TRUE(batch != NULL);
+    char key[32];
+    for (int i = 0; i < 1000; ++i) {
+        snprintf(key, sizeof(key), "bulk%d", i);
+        ASSUME_ITS_TRUE(fossil_myshell_batch_put(batch, key, "i32", "7") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    }
+    ASSUME_ITS_TRUE(fossil_myshell_batch_del(batch, "bulk5") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_batch_del(batch, "never-existed") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_batch_put(batch, "bad", "nope", "1") == FOSSIL_MYSHELL_ERROR_INVALID_TYPE);
+    ASSUME_ITS_TRUE(fossil_myshell_batch_count(batch) == 1002);
+    ASSUME_ITS_TRUE(fossil_myshell_batch_apply(db, batch) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    char value[64];
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "bulk999", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "bulk5", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    ASSUME_ITS_TRUE(fossil_myshell_check_integrity(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+
+    // A second batch cut short by a crash is dropped whole on reopen
+    fossil_myshell_batch_clear(batch);
+    ASSUME_ITS_TRUE(fossil_myshell_batch_put(batch, "torn1", "cstr", "x") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_batch_put(batch, "torn2", "cstr", "y") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_batch_apply(db, batch) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    fossil_myshell_batch_free(batch);
+    fossil_myshell_close(db);
+    long size = c_myshell_file_size(file_name);
+    FILE *file = fopen(file_name, "rb");
+    ASSUME_ITS_TRUE(file != NULL);
+    char *image = (char *)malloc((size_t)size);
+    ASSUME_ITS_TRUE(image != NULL && fread(image, 1, (size_t)size, file) == (size_t)size);
+    fclose(file);
+    file = fopen(file_name, "wb");
+    fwrite(image, 1, (size_t)size - 20, file); // the last record is 22 bytes
+    fclose(file);
+    free(image);
+    db = fossil_myshell_open(file_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "torn1", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "bulk0", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+
+    // A transaction sees its own writes and can be rolled back
+    ASSUME_ITS_TRUE(fossil_myshell_begin(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_begin(db) == FOSSIL_MYSHELL_ERROR_TRANSACTION_FAILED);
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "draft", "cstr", "tmp") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_del(db, "kept") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_del(db, "kept") == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "draft", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(value, "tmp");
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "kept", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    ASSUME_ITS_TRUE(fossil_myshell_rollback(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_rollback(db) == FOSSIL_MYSHELL_ERROR_TRANSACTION_FAILED);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "draft", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "kept", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+
+    // Committed, it lands as one commit
+    ASSUME_ITS_TRUE(fossil_myshell_begin(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "final", "cstr", "yes") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_del(db, "kept") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_commit(db, "transaction") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_rollback(db) == FOSSIL_MYSHELL_ERROR_TRANSACTION_FAILED);
+    fossil_myshell_close(db);
+
+    db = fossil_myshell_open(file_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "final", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "kept", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    int commits = 0;
+    ASSUME_ITS_TRUE(fossil_myshell_log(db, c_myshell_count_commits, &commits) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(commits == 2);
+    ASSUME_ITS_TRUE(fossil_myshell_check_integrity(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_compact(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_compact_wait(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "bulk999", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    fossil_myshell_close(db);
+    remove(file_name);
+}
+
+FOSSIL_TEST(c_test_myshell_snapshot_checkout) {
+    fossil_bluecrab_myshell_error_t err;
+    const char *file_name = "test_snapshot.myshell";
+    fossil_bluecrab_myshell_t *db = fossil_myshell_create(file_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+    char key[32];
+    for (int i = 0; i < 500; ++i) {
+        snprintf(key, sizeof(key), "k%d", i);
+        ASSUME_ITS_TRUE(fossil_myshell_put(db, key, "i32", "1") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    }
+    long before = (long)db->file_size;
+    ASSUME_ITS_TRUE(fossil_myshell_commit(db, "first") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    long full_tree = (long)db->file_size - before;
+    char first[17];
+    snprintf(first, sizeof(first), "%016llx", (unsigned long long)db->commit_head);
+    ASSUME_ITS_TRUE(fossil_myshell_branch(db, "feature") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+
+    // A one-key commit shares every untouched subtree with its parent
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "k0", "i32", "2") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_del(db, "k1") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "extra", "cstr", "new") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    before = (long)db->file_size;
+    ASSUME_ITS_TRUE(fossil_myshell_commit(db, "second") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE((long)db->file_size - before < full_tree / 4);
+
+    // Uncommitted changes stay with their branch across a checkout
+    char value[32];
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "k2", "i32", "9") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_checkout(db, first) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "k2", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(value, "1");
+    ASSUME_ITS_TRUE(fossil_myshell_checkout(db, "feature") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "k2", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(value, "9");
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "k2", "i32", "1") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_commit(db, "third") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+
+    // Checking out the first commit restores its keys
+    ASSUME_ITS_TRUE(fossil_myshell_checkout(db, first) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "k0", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(value, "1");
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "k1", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "extra", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "k499", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+
+    // And the branch tip brings the later state back, also after a reopen
+    ASSUME_ITS_TRUE(fossil_myshell_checkout(db, "feature") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "extra", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(value, "new");
+    fossil_myshell_close(db);
+    db = fossil_myshell_open(file_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+    ASSUME_ITS_EQUAL_CSTR(db->branch, "feature");
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "k0", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(value, "2");
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "k1", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+
+    // Compaction keeps the versions older snapshots still refer to
+    ASSUME_ITS_TRUE(fossil_myshell_compact(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_compact_wait(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_check_integrity(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_checkout(db, first) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "k0", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(value, "1");
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "k1", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    fossil_myshell_close(db);
+    db = fossil_myshell_open(file_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "extra", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    ASSUME_ITS_TRUE(fossil_myshell_check_integrity(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    fossil_myshell_close(db);
+    remove(file_name);
+}
+
+typedef struct {
+    char messages[8][32];
+    int count;
+} c_myshell_log_messages_t;
+
+static bool c_myshell_collect_messages(const char *hash, const char *message, void *user) {
+    (void)hash;
+    c_myshell_log_messages_t *log = (c_myshell_log_messages_t *)user;
+    if (log->count < 8) {
+        snprintf(log->messages[log->count], sizeof(log->messages[0]), "%s", message);
+    }
+    log->count++;
+    return true;
+}
+
+FOSSIL_TEST(c_test_myshell_commit_graph) {
+    fossil_bluecrab_myshell_error_t err;
+    const char *file_name = "test_graph.myshell";
+    fossil_bluecrab_myshell_t *db = fossil_myshell_create(file_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "a", "i32", "1") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_commit(db, "base") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    char base[17], topic[17], main_tip[17];
+    snprintf(base, sizeof(base), "%016llx", (unsigned long long)db->commit_head);
+    ASSUME_ITS_TRUE(fossil_myshell_branch(db, "main") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_branch(db, "topic") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "t", "i32", "1") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_commit(db, "topic work") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    snprintf(topic, sizeof(topic), "%016llx", (unsigned long long)db->commit_head);
+    ASSUME_ITS_TRUE(fossil_myshell_checkout(db, "main") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "m", "i32", "1") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_commit(db, "main work") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    snprintf(main_tip, sizeof(main_tip), "%016llx", (unsigned long long)db->commit_head);
+
+    // Branches, tags and commit hashes all resolve through the graph
+    char found[17];
+    ASSUME_ITS_TRUE(fossil_myshell_merge_base(db, "main", "topic", found, sizeof(found)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(found, base);
+    ASSUME_ITS_TRUE(fossil_myshell_merge_base(db, main_tip, topic, found, sizeof(found)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(found, base);
+    ASSUME_ITS_TRUE(fossil_myshell_merge_base(db, "main", base, found, sizeof(found)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(found, base);
+    ASSUME_ITS_TRUE(fossil_myshell_merge_base(db, "main", "main", found, sizeof(found)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(found, main_tip);
+    ASSUME_ITS_TRUE(fossil_myshell_merge_base(db, "main", "nope", found, sizeof(found)) == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    ASSUME_ITS_TRUE(fossil_myshell_merge_base(db, "main", "topic", found, 8) == FOSSIL_MYSHELL_ERROR_BUFFER_TOO_SMALL);
+    ASSUME_ITS_TRUE(fossil_myshell_tag(db, base, "v1") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_tag(db, "0123456789abcdef", "v0") == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    ASSUME_ITS_TRUE(fossil_myshell_merge_base(db, "v1", "topic", found, sizeof(found)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(found, base);
+    ASSUME_ITS_TRUE(fossil_myshell_revert(db, topic) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_revert(db, "0123456789abcdef") == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+
+    // A tag checks out like any other name
+    char value[16];
+    ASSUME_ITS_TRUE(fossil_myshell_checkout(db, "v1") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "t", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "m", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    ASSUME_ITS_TRUE(fossil_myshell_merge(db, "topic", "bring in topic") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_merge(db, "nope", "nothing") == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+
+    // Log reads the commits in the order they were made
+    c_myshell_log_messages_t log;
+    memset(&log, 0, sizeof(log));
+    ASSUME_ITS_TRUE(fossil_myshell_log(db, c_myshell_collect_messages, &log) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(log.count == 3);
+    ASSUME_ITS_EQUAL_CSTR(log.messages[0], "base");
+    ASSUME_ITS_EQUAL_CSTR(log.messages[2], "main work");
+
+    // The graph is rebuilt on open and after compaction
+    fossil_myshell_close(db);
+    db = fossil_myshell_open(file_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+    ASSUME_ITS_TRUE(fossil_myshell_merge_base(db, "main", "topic", found, sizeof(found)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(found, base);
+    ASSUME_ITS_TRUE(fossil_myshell_compact(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_compact_wait(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_merge_base(db, "v1", topic, found, sizeof(found)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(found, base);
+    memset(&log, 0, sizeof(log));
+    ASSUME_ITS_TRUE(fossil_myshell_log(db, c_myshell_collect_messages, &log) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(log.count == 3);
+    ASSUME_ITS_EQUAL_CSTR(log.messages[1], "topic work");
+    ASSUME_ITS_TRUE(fossil_myshell_check_integrity(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    fossil_myshell_close(db);
+    remove(file_name);
+}
+
+FOSSIL_TEST(c_test_myshell_integrity_checkpoint) {
+    fossil_bluecrab_myshell_error_t err;
+    const char *file_name = "test_checkpoint.myshell";
+    fossil_bluecrab_myshell_t *db = fossil_myshell_create(file_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "first", "cstr", "aaaaaaaa") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_commit(db, "one") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+
+    // A check leaves one checkpoint; a check with nothing new adds none
+    ASSUME_ITS_TRUE(fossil_myshell_check_integrity(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    size_t checked = db->file_size;
+    ASSUME_ITS_TRUE(fossil_myshell_check_integrity(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db->file_size == checked);
+    fossil_myshell_close(db);
+
+    // The checkpoint survives a reopen, and new records are checked past it
+    db = fossil_myshell_open(file_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+    ASSUME_ITS_TRUE(fossil_myshell_check_integrity(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db->file_size == checked);
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "second", "cstr", "b") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_commit(db, "two") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_check_integrity(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db->file_size > checked);
+    int commits = 0;
+    ASSUME_ITS_TRUE(fossil_myshell_log(db, c_myshell_count_commits, &commits) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(commits == 2);
+
+    // Damage behind the checkpoint is only seen by a full check
+    FILE *file = fopen(file_name, "r+b");
+    ASSUME_ITS_TRUE(file != NULL);
+    ASSUME_ITS_TRUE(fseek(file, 8 + 16 + 5, SEEK_SET) == 0); // inside the first put's value
+    fputc('z', file);
+    fclose(file);
+    ASSUME_ITS_TRUE(fossil_myshell_check_integrity(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_check_integrity_full(db) != FOSSIL_MYSHELL_ERROR_SUCCESS);
+    fossil_myshell_close(db);
+    remove(file_name);
+}
+
+typedef struct {
+    size_t calls;
+    size_t chunks;
+    uint64_t records;
+} c_myshell_check_progress_t;
+
+static void c_myshell_check_progress(const fossil_bluecrab_myshell_check_progress_t *progress, void *user) {
+    c_myshell_check_progress_t *seen = (c_myshell_check_progress_t *)user;
+    seen->calls++;
+    seen->chunks = progress->chunks;
+    seen->records += progress->records;
+}
+
+FOSSIL_TEST(c_test_myshell_integrity_parallel) {
+    fossil_bluecrab_myshell_error_t err;
+    const char *file_name = "test_parallel_check.myshell";
+    fossil_bluecrab_myshell_t *db = fossil_myshell_create(file_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+    // 3000 puts of 7-byte keys and 100-byte values: 123-byte records back to back
+    char key[16], value[101];
+    memset(value, 'v', 100);
+    value[100] = '\0';
+    for (int i = 0; i < 3000; ++i) {
+        snprintf(key, sizeof(key), "key%04d", i);
+        ASSUME_ITS_TRUE(fossil_myshell_put(db, key, "cstr", value) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    }
+    ASSUME_ITS_TRUE(fossil_myshell_commit(db, "bulk") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+
+    c_myshell_check_progress_t seen = {0, 0, 0};
+    fossil_bluecrab_myshell_check_failure_t failures[8];
+    size_t count = 99;
+    ASSUME_ITS_TRUE(fossil_myshell_check_integrity_parallel(db, 4, failures, 8, &count,
+                                                            c_myshell_check_progress, &seen) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(count == 0);
+    ASSUME_ITS_TRUE(seen.chunks > 1);
+    ASSUME_ITS_TRUE(seen.calls == seen.chunks);
+    ASSUME_ITS_TRUE(seen.records > 3000);
+
+    // Two damaged records far apart are both reported, in file order
+    FILE *file = fopen(file_name, "r+b");
+    ASSUME_ITS_TRUE(file != NULL);
+    ASSUME_ITS_TRUE(fseek(file, 8 + 2000 * 123 + 60, SEEK_SET) == 0);
+    fputc('z', file);
+    ASSUME_ITS_TRUE(fseek(file, 8 + 60, SEEK_SET) == 0);
+    fputc('z', file);
+    fclose(file);
+    ASSUME_ITS_TRUE(fossil_myshell_check_integrity_parallel(db, 4, failures, 8, &count, NULL, NULL) ==
+                    FOSSIL_MYSHELL_ERROR_INTEGRITY);
+    ASSUME_ITS_TRUE(count == 2);
+    ASSUME_ITS_TRUE(failures[0].offset == 8);
+    ASSUME_ITS_TRUE(failures[1].offset == 8 + 2000 * 123);
+    ASSUME_ITS_TRUE(failures[1].error == FOSSIL_MYSHELL_ERROR_INTEGRITY);
+
+    // Only as many failures as asked for are kept, but all are counted
+    ASSUME_ITS_TRUE(fossil_myshell_check_integrity_parallel(db, 0, failures, 1, &count, NULL, NULL) ==
+                    FOSSIL_MYSHELL_ERROR_INTEGRITY);
+    ASSUME_ITS_TRUE(count == 2);
+    ASSUME_ITS_TRUE(failures[0].offset == 8);
+    fossil_myshell_close(db);
+    remove(file_name);
+}
+
+typedef struct {
+    int removed;
+    int added;
+    int changed;
+    int calls;
+    int stop_after;
+} c_myshell_diff_counts_t;
+
+static bool c_myshell_count_diff(char change, const char *before, const char *after, void *user) {
+    c_myshell_diff_counts_t *counts = (c_myshell_diff_counts_t *)user;
+    if (change == '-' && before && !after) counts->removed++;
+    if (change == '+' && !before && after) counts->added++;
+    if (change == '~' && before && after) counts->changed++;
+    return ++counts->calls != counts->stop_after;
+}
+
+FOSSIL_TEST(c_test_myshell_diff_stream) {
+    fossil_bluecrab_myshell_error_t err;
+    const char *name1 = "test_diff_stream_a.myshell";
+    const char *name2 = "test_diff_stream_b.myshell";
+    fossil_bluecrab_myshell_t *db1 = fossil_myshell_create(name1, &err);
+    ASSUME_ITS_TRUE(db1 != NULL);
+    char key[16];
+    for (int i = 0; i < 200; ++i) {
+        snprintf(key, sizeof(key), "k%d", i);
+        ASSUME_ITS_TRUE(fossil_myshell_put(db1, key, "i32", "1") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+        ASSUME_ITS_TRUE(fossil_myshell_commit(db1, key) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    }
+    const char *backup_name = "test_diff_stream.bak";
+    remove(name2);
+    ASSUME_ITS_TRUE(fossil_myshell_backup(db1, backup_name) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_restore(backup_name, name2) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    remove(backup_name);
+    fossil_bluecrab_myshell_t *db2 = fossil_myshell_open(name2, &err);
+    ASSUME_ITS_TRUE(db2 != NULL);
+
+    // Far more commits than fit the old fixed tables, all only in the second file
+    for (int i = 0; i < 300; ++i) {
+        snprintf(key, sizeof(key), "n%d", i);
+        ASSUME_ITS_TRUE(fossil_myshell_put(db2, key, "i32", "2") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+        ASSUME_ITS_TRUE(fossil_myshell_commit(db2, key) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    }
+    ASSUME_ITS_TRUE(fossil_myshell_stage(db1, "a", "i32", "1") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_stage(db1, "b", "i32", "2") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_stage(db2, "b", "i32", "3") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_stage(db2, "c", "i32", "4") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+
+    c_myshell_diff_counts_t counts = {0, 0, 0, 0, -1};
+    ASSUME_ITS_TRUE(fossil_myshell_diff_stream(db1, db2, c_myshell_count_diff, &counts) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(counts.added == 301);
+    ASSUME_ITS_TRUE(counts.removed == 1);
+    ASSUME_ITS_TRUE(counts.changed == 1);
+
+    // The callback can stop the diff
+    c_myshell_diff_counts_t stopped = {0, 0, 0, 0, 5};
+    ASSUME_ITS_TRUE(fossil_myshell_diff_stream(db1, db2, c_myshell_count_diff, &stopped) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(stopped.calls == 5);
+
+    // The buffered form still reports a diff that does not fit
+    char small[64];
+    ASSUME_ITS_TRUE(fossil_myshell_diff(db1, db2, small, sizeof(small)) == FOSSIL_MYSHELL_ERROR_CAPACITY_EXCEEDED);
+    char same[64];
+    ASSUME_ITS_TRUE(fossil_myshell_diff(db1, db1, same, sizeof(same)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(same, "");
+    fossil_myshell_close(db1);
+    fossil_myshell_close(db2);
+    remove(name1);
+    remove(name2);
+}
+
+typedef struct {
+    fossil_bluecrab_myshell_merge_choice_t choice;
+    int  calls;
+    char key[16];
+    char base[16];
+    char ours[16];
+    char theirs[16];
+} c_myshell_conflicts_t;
+
+static fossil_bluecrab_myshell_merge_choice_t c_myshell_settle_conflict(const char *key, const char *base,
+                                                                        const char *ours, const char *theirs,
+                                                                        void *user) {
+    c_myshell_conflicts_t *conflicts = (c_myshell_conflicts_t *)user;
+    conflicts->calls++;
+    snprintf(conflicts->key, sizeof(conflicts->key), "%s", key);
+    snprintf(conflicts->base, sizeof(conflicts->base), "%s", base ? base : "-");
+    snprintf(conflicts->ours, sizeof(conflicts->ours), "%s", ours ? ours : "-");
+    snprintf(conflicts->theirs, sizeof(conflicts->theirs), "%s", theirs ? theirs : "-");
+    return conflicts->choice;
+}
+
+FOSSIL_TEST(c_test_myshell_three_way_merge) {
+    fossil_bluecrab_myshell_error_t err;
+    const char *file_name = "test_three_way_merge.myshell";
+    fossil_bluecrab_myshell_t *db = fossil_myshell_create(file_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "a", "i32", "1") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "b", "i32", "1") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "c", "i32", "1") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_commit(db, "base") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_branch(db, "main") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_branch(db, "topic") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "a", "i32", "2") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_del(db, "b") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "c", "i32", "3") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "n", "i32", "5") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_commit(db, "topic work") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    char topic[17];
+    snprintf(topic, sizeof(topic), "%016llx", (unsigned long long)db->commit_head);
+    ASSUME_ITS_TRUE(fossil_myshell_checkout(db, "main") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "c", "i32", "4") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "m", "i32", "6") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_commit(db, "main work") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    uint64_t main_tip = db->commit_head;
+
+    // Both sides changed c: without a callback the merge fails and writes nothing
+    long size = c_myshell_file_size(file_name);
+    ASSUME_ITS_TRUE(fossil_myshell_merge(db, "topic", "merge topic") == FOSSIL_MYSHELL_ERROR_CONCURRENCY);
+    c_myshell_conflicts_t conflicts;
+    memset(&conflicts, 0, sizeof(conflicts));
+    conflicts.choice = FOSSIL_MYSHELL_MERGE_ABORT;
+    ASSUME_ITS_TRUE(fossil_myshell_merge_with(db, "topic", "merge topic", c_myshell_settle_conflict, &conflicts) ==
+                    FOSSIL_MYSHELL_ERROR_TRANSACTION_FAILED);
+    ASSUME_ITS_TRUE(c_myshell_file_size(file_name) == size);
+    ASSUME_ITS_TRUE(db->commit_head == main_tip);
+
+    // The callback sees all three versions and picks one
+    memset(&conflicts, 0, sizeof(conflicts));
+    conflicts.choice = FOSSIL_MYSHELL_MERGE_THEIRS;
+    ASSUME_ITS_TRUE(fossil_myshell_merge_with(db, "topic", "merge topic", c_myshell_settle_conflict, &conflicts) ==
+                    FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(conflicts.calls == 1);
+    ASSUME_ITS_EQUAL_CSTR(conflicts.key, "c");
+    ASSUME_ITS_EQUAL_CSTR(conflicts.base, "1");
+    ASSUME_ITS_EQUAL_CSTR(conflicts.ours, "4");
+    ASSUME_ITS_EQUAL_CSTR(conflicts.theirs, "3");
+    uint64_t merged = db->commit_head;
+    ASSUME_ITS_TRUE(merged != main_tip);
+
+    // One-sided changes came over, ours stayed
+    char value[16];
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "a", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(value, "2");
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "b", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "c", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(value, "3");
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "n", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(value, "5");
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "m", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(value, "6");
+
+    // The merge has both tips as parents, so merging again does nothing
+    char found[17];
+    ASSUME_ITS_TRUE(fossil_myshell_merge_base(db, "main", "topic", found, sizeof(found)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(found, topic);
+    ASSUME_ITS_TRUE(fossil_myshell_merge(db, "topic", "again") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db->commit_head == merged);
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "x", "i32", "7") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_merge(db, "topic", "dirty") == FOSSIL_MYSHELL_ERROR_CONCURRENCY);
+    ASSUME_ITS_TRUE(fossil_myshell_commit(db, "after merge") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+
+    // The merged tree survives a reopen, a checkout away and back, and compaction
+    fossil_myshell_close(db);
+    db = fossil_myshell_open(file_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+    ASSUME_ITS_TRUE(fossil_myshell_check_integrity(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_checkout(db, "topic") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "m", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    ASSUME_ITS_TRUE(fossil_myshell_checkout(db, "main") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_compact(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_compact_wait(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "c", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(value, "3");
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "x", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "b", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    ASSUME_ITS_TRUE(fossil_myshell_check_integrity_full(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    fossil_myshell_close(db);
+    remove(file_name);
+}
+
+FOSSIL_TEST(c_test_myshell_staging_area) {
+    fossil_bluecrab_myshell_error_t err;
+    const char *file_name = "test_staging_area.myshell";
+    fossil_bluecrab_myshell_t *db = fossil_myshell_create(file_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+    ASSUME_ITS_TRUE(fossil_myshell_commit(db, "empty") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+
+    // Staging stays in memory: the file does not grow until the commit
+    long size = c_myshell_file_size(file_name);
+    char key[16], value[16];
+    for (int i = 0; i < 10000; ++i) {
+        snprintf(key, sizeof(key), "k%d", i);
+        ASSUME_ITS_TRUE(fossil_myshell_stage(db, key, "i32", "1") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    }
+    for (int i = 0; i < 10000; i += 2) {
+        snprintf(key, sizeof(key), "k%d", i);
+        ASSUME_ITS_TRUE(fossil_myshell_stage(db, key, "i32", "2") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    }
+    ASSUME_ITS_TRUE(fossil_myshell_unstage(db, "k3") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_unstage(db, "k3") == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    ASSUME_ITS_TRUE(c_myshell_file_size(file_name) == size);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "k0", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+
+    // The commit puts the latest staged version of each key and empties the staging area
+    ASSUME_ITS_TRUE(fossil_myshell_commit(db, "staged keys") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "k0", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(value, "2");
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "k9999", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(value, "1");
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "k3", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    ASSUME_ITS_TRUE(fossil_myshell_unstage(db, "k1") == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+
+    // Without a journal staged changes end with the handle
+    ASSUME_ITS_TRUE(fossil_myshell_stage(db, "lost", "i32", "1") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    fossil_myshell_close(db);
+    db = fossil_myshell_open(file_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+    ASSUME_ITS_TRUE(fossil_myshell_unstage(db, "lost") == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "k1", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+
+    // A journaled staging area survives reopening and compaction
+    ASSUME_ITS_TRUE(fossil_myshell_stage(db, "early", "i32", "1") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_set_stage_journal(db, true) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_stage(db, "late", "i32", "2") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_stage(db, "dropped", "i32", "3") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_unstage(db, "dropped") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_compact(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_compact_wait(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    fossil_myshell_close(db);
+    db = fossil_myshell_open(file_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+    ASSUME_ITS_TRUE(fossil_myshell_unstage(db, "dropped") == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    ASSUME_ITS_TRUE(fossil_myshell_commit(db, "journaled") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "early", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "late", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(value, "2");
+
+    // The commit emptied the journaled staging area as well
+    fossil_myshell_close(db);
+    db = fossil_myshell_open(file_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+    ASSUME_ITS_TRUE(fossil_myshell_unstage(db, "late") == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    ASSUME_ITS_TRUE(fossil_myshell_check_integrity_full(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    fossil_myshell_close(db);
+    remove(file_name);
+}
+
+FOSSIL_TEST(c_test_myshell_convert_text) {
+    fossil_bluecrab_myshell_error_t err;
+    const char *text_name = "test_convert_v1.myshell";
+    const char *binary_name = "test_convert_v2.myshell";
+    FILE *file = fopen(text_name, "wb");
+    ASSUME_ITS_TRUE(file != NULL);
+    fputs("#fson_types=null,bool,i8,i16,i32,i64,u8,u16,u32,u64,f32,f64,oct,hex,bin,char,cstr,array,object,enum,datetime,duration\n", file);
+    fputs("alpha=1 #type=i32 #hash=14fb89debecff448\n", file);
+    fputs("beta=old #type=cstr #hash=b9b1c399729b7c70\n", file);
+    fputs("beta=new #type=cstr #hash=b9b1c399729b7c70\n", file);
+    fputs("gamma=x #type=cstr #hash=785fcfaddf3e7861\n", file);
+    fputs("#del gamma #hash=785fcfaddf3e7861\n", file);
+    fputs("forged=x #type=cstr #hash=0123456789abcdef\n", file);
+    fputs("#stage s=1 #type=bool #hash=4317746ba43a8bf8\n", file);
+    fputs("#commit 4a2b6bca170157c8 First import 1712345678 #type=enum\n", file);
+    fputs("#branch 39772c1993ffe589 main #type=enum\n", file);
+    fclose(file);
+
+    // v1 files are not opened directly
+    fossil_bluecrab_myshell_t *db = fossil_myshell_open(text_name, &err);
+    ASSUME_ITS_TRUE(db == NULL);
+    ASSUME_ITS_TRUE(err == FOSSIL_MYSHELL_ERROR_VERSION_UNSUPPORTED);
+
+    ASSUME_ITS_TRUE(fossil_myshell_convert(text_name, binary_name) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_convert(text_name, binary_name) == FOSSIL_MYSHELL_ERROR_ALREADY_EXISTS);
+    ASSUME_ITS_TRUE(fossil_myshell_convert(binary_name, "test_convert_again.myshell") == FOSSIL_MYSHELL_ERROR_INVALID_FILE);
+
+    db = fossil_myshell_open(binary_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+    char value[32];
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "alpha", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(value, "1");
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "beta", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(value, "new");
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "gamma", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "forged", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    ASSUME_ITS_TRUE(fossil_myshell_unstage(db, "s") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_checkout(db, "main") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    int commits = 0;
+    ASSUME_ITS_TRUE(fossil_myshell_log(db, c_myshell_count_commits, &commits) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(commits == 1);
+    ASSUME_ITS_TRUE(fossil_myshell_check_integrity(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    fossil_myshell_close(db);
+    remove(text_name);
+    remove(binary_name);
+}
+
+FOSSIL_TEST(c_test_myshell_branch_views) {
+    fossil_bluecrab_myshell_error_t err;
+    const char *file_name = "test_branch_views.myshell";
+    fossil_bluecrab_myshell_t *db = fossil_myshell_create(file_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+    char key[16], value[16];
+    for (int i = 0; i < 2000; ++i) {
+        snprintf(key, sizeof(key), "k%d", i);
+        ASSUME_ITS_TRUE(fossil_myshell_put(db, key, "i32", "1") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    }
+    ASSUME_ITS_TRUE(fossil_myshell_commit(db, "base") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    char base[17];
+    snprintf(base, sizeof(base), "%016llx", (unsigned long long)db->commit_head);
+    ASSUME_ITS_TRUE(fossil_myshell_branch(db, "main") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+
+    // A branch is one ref record, however many keys its snapshot holds
+    size_t before = db->file_size;
+    ASSUME_ITS_TRUE(fossil_myshell_branch(db, "topic") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db->file_size - before < 64);
+
+    // Each branch keeps its own uncommitted writes over the shared snapshot
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "a", "cstr", "topic") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_del(db, "k0") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_checkout(db, "main") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "a", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "k0", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "a", "cstr", "main") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_checkout(db, "topic") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "a", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(value, "topic");
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "k0", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "k1999", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+
+    // The views come back on reopen and survive compaction
+    fossil_myshell_close(db);
+    db = fossil_myshell_open(file_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+    ASSUME_ITS_EQUAL_CSTR(db->branch, "topic");
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "a", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(value, "topic");
+    ASSUME_ITS_TRUE(fossil_myshell_compact(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_compact_wait(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_checkout(db, "main") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "a", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(value, "main");
+    fossil_myshell_close(db);
+    db = fossil_myshell_open(file_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+    ASSUME_ITS_TRUE(fossil_myshell_checkout(db, "topic") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "k0", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+
+    // A commit on one branch leaves the other's writes pending
+    ASSUME_ITS_TRUE(fossil_myshell_commit(db, "topic work") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_checkout(db, "main") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "a", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(value, "main");
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "k0", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+
+    // Writes on a detached head have no branch to wait on until one is made there
+    ASSUME_ITS_TRUE(fossil_myshell_checkout(db, base) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "d", "cstr", "loose") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_checkout(db, "main") == FOSSIL_MYSHELL_ERROR_CONCURRENCY);
+    ASSUME_ITS_TRUE(fossil_myshell_branch(db, "rescue") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_checkout(db, "main") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "d", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    ASSUME_ITS_TRUE(fossil_myshell_checkout(db, "rescue") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "d", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_check_integrity(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    fossil_myshell_close(db);
+    remove(file_name);
+}
+
+FOSSIL_TEST(c_test_myshell_zero_filled_tail) {
+    fossil_bluecrab_myshell_error_t err;
+    const char *file_name = "test_zero_tail.myshell";
+    fossil_bluecrab_myshell_t *db = fossil_myshell_create(file_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "a", "cstr", "one") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    fossil_myshell_close(db);
+    long size = c_myshell_file_size(file_name);
+
+    // A crash after the file grew but before the data reached it leaves zeros
+    static const unsigned char zeros[4096];
+    FILE *file = fopen(file_name, "ab");
+    ASSUME_ITS_TRUE(file != NULL);
+    fwrite(zeros, 1, sizeof(zeros), file);
+    fclose(file);
+
+    db = fossil_myshell_open(file_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+    char value[32];
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "a", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(value, "one");
+    fossil_myshell_close(db);
+    ASSUME_ITS_TRUE(c_myshell_file_size(file_name) == size);
+
+    // An intact record behind the damage means real corruption, not a torn tail
+    unsigned char last[64];
+    file = fopen(file_name, "rb");
+    ASSUME_ITS_TRUE(file != NULL);
+    fseek(file, 8, SEEK_SET);
+    size_t last_len = fread(last, 1, sizeof(last), file);
+    fclose(file);
+    ASSUME_ITS_TRUE(last_len == (size_t)size - 8);
+    file = fopen(file_name, "ab");
+    ASSUME_ITS_TRUE(file != NULL);
+    fwrite(zeros, 1, 64, file);
+    fwrite(last, 1, last_len, file);
+    fclose(file);
+    db = fossil_myshell_open(file_name, &err);
+    ASSUME_ITS_TRUE(db == NULL);
+    ASSUME_ITS_TRUE(err == FOSSIL_MYSHELL_ERROR_CORRUPTED);
+    remove(file_name);
+}
+
+FOSSIL_TEST(c_test_myshell_failed_commit) {
+    fossil_bluecrab_myshell_error_t err;
+    const char *file_name = "test_failed_commit.myshell";
+    remove(file_name);
+    fossil_bluecrab_myshell_t *db = fossil_myshell_create(file_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+    size_t start = db->file_size;
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "base", "cstr", "1") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_commit(db, "one") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    size_t end = db->file_size;
+
+    // Damage the first snapshot, so the next one fails after its batch went out
+    unsigned char saved[512], flipped[512];
+    ASSUME_ITS_TRUE(end - start <= sizeof(saved));
+    FILE *file = fopen(file_name, "r+b");
+    ASSUME_ITS_TRUE(file != NULL);
+    fseek(file, (long)start, SEEK_SET);
+    ASSUME_ITS_TRUE(fread(saved, 1, end - start, file) == end - start);
+    for (size_t i = 0; i < end - start; ++i) flipped[i] = (unsigned char)~saved[i];
+    fseek(file, (long)start, SEEK_SET);
+    fwrite(flipped, 1, end - start, file);
+    fclose(file);
+
+    ASSUME_ITS_TRUE(fossil_myshell_begin(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_put(db, "draft", "cstr", "2") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_commit(db, "two") != FOSSIL_MYSHELL_ERROR_SUCCESS);
+
+    // Nothing of the failed commit is left, and the transaction is still open
+    ASSUME_ITS_TRUE(db->file_size == end);
+    char value[32];
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "draft", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_begin(db) == FOSSIL_MYSHELL_ERROR_TRANSACTION_FAILED);
+
+    // Once the damage is repaired a retry writes the transaction once
+    file = fopen(file_name, "r+b");
+    ASSUME_ITS_TRUE(file != NULL);
+    fseek(file, (long)start, SEEK_SET);
+    fwrite(saved, 1, end - start, file);
+    fclose(file);
+    ASSUME_ITS_TRUE(fossil_myshell_commit(db, "two") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    fossil_myshell_close(db);
+
+    db = fossil_myshell_open(file_name, &err);
+    ASSUME_ITS_TRUE(db != NULL);
+    ASSUME_ITS_TRUE(fossil_myshell_check_integrity_full(db) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "draft", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_EQUAL_CSTR(value, "2");
+    ASSUME_ITS_TRUE(fossil_myshell_get(db, "base", value, sizeof(value)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    int commits = 0;
+    ASSUME_ITS_TRUE(fossil_myshell_log(db, c_myshell_count_commits, &commits) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(commits == 2);
+    fossil_myshell_close(db);
+    remove(file_name);
+}
+
 // * * * * * * * * * * * * * * * * * * * * * * * *
 // * Fossil Logic Test Pool
 // * * * * * * * * * * * * * * * * * * * * * * * *
@@ -386,6 +1507,24 @@ FOSSIL_TEST_GROUP(c_myshell_database_tests) {
     FOSSIL_TEST_ADD(c_myshell_fixture, c_test_myshell_backup_restore_null_args);
     FOSSIL_TEST_ADD(c_myshell_fixture, c_test_myshell_diff_null_args);
     FOSSIL_TEST_ADD(c_myshell_fixture, c_test_myshell_check_integrity_null);
+    FOSSIL_TEST_ADD(c_myshell_fixture, c_test_myshell_index_reopen);
+    FOSSIL_TEST_ADD(c_myshell_fixture, c_test_myshell_append_only_log);
+    FOSSIL_TEST_ADD(c_myshell_fixture, c_test_myshell_compaction);
+    FOSSIL_TEST_ADD(c_myshell_fixture, c_test_myshell_durability_and_recovery);
+    FOSSIL_TEST_ADD(c_myshell_fixture, c_test_myshell_binary_values);
+    FOSSIL_TEST_ADD(c_myshell_fixture, c_test_myshell_convert_text);
+    FOSSIL_TEST_ADD(c_myshell_fixture, c_test_myshell_mapped_views);
+    FOSSIL_TEST_ADD(c_myshell_fixture, c_test_myshell_batch_and_transaction);
+    FOSSIL_TEST_ADD(c_myshell_fixture, c_test_myshell_snapshot_checkout);
+    FOSSIL_TEST_ADD(c_myshell_fixture, c_test_myshell_commit_graph);
+    FOSSIL_TEST_ADD(c_myshell_fixture, c_test_myshell_integrity_checkpoint);
+    FOSSIL_TEST_ADD(c_myshell_fixture, c_test_myshell_integrity_parallel);
+    FOSSIL_TEST_ADD(c_myshell_fixture, c_test_myshell_diff_stream);
+    FOSSIL_TEST_ADD(c_myshell_fixture, c_test_myshell_three_way_merge);
+    FOSSIL_TEST_ADD(c_myshell_fixture, c_test_myshell_staging_area);
+    FOSSIL_TEST_ADD(c_myshell_fixture, c_test_myshell_branch_views);
+    FOSSIL_TEST_ADD(c_myshell_fixture, c_test_myshell_zero_filled_tail);
+    FOSSIL_TEST_ADD(c_myshell_fixture, c_test_myshell_failed_commit);
 
     FOSSIL_TEST_REGISTER(c_myshell_fixture);
 } // end of tests
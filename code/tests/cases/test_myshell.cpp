@@ -366,6 +366,458 @@ FOSSIL_TEST(cpp_test_myshell_check_integrity_null) {
     ASSUME_ITS_TRUE(err == FOSSIL_MYSHELL_ERROR_INVALID_FILE);
 }
 
+FOSSIL_TEST(cpp_test_myshell_index_reopen) {
+    fossil_bluecrab_myshell_error_t err;
+    const std::string file_name = "test_cpp_index_reopen.myshell";
+    {
+        auto db = fossil::bluecrab::MyShell::create(file_name, err);
+        ASSUME_ITS_TRUE(db.is_open());
+        for (int i = 0; i < 100; ++i) {
+            ASSUME_ITS_TRUE(db.put("key" + std::to_string(i), "i32", std::to_string(i)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+        }
+        ASSUME_ITS_TRUE(db.put("key3", "i32", "33") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+        ASSUME_ITS_TRUE(db.del("key4") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    }
+
+    fossil::bluecrab::MyShell db(file_name, err);
+    ASSUME_ITS_TRUE(db.is_open());
+    std::string value;
+    ASSUME_ITS_TRUE(db.get("key99", value) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(value == "99");
+    ASSUME_ITS_TRUE(db.get("key3", value) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(value == "33");
+    ASSUME_ITS_TRUE(db.get("key4", value) == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    db.close();
+    remove(file_name.c_str());
+}
+
+FOSSIL_TEST(cpp_test_myshell_append_only_log) {
+    fossil_bluecrab_myshell_error_t err;
+    const std::string file_name = "test_cpp_append_only_log.myshell";
+    {
+        auto db = fossil::bluecrab::MyShell::create(file_name, err);
+        ASSUME_ITS_TRUE(db.is_open());
+        ASSUME_ITS_TRUE(db.put("k", "cstr", "old") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+        ASSUME_ITS_TRUE(db.put("k", "cstr", "new") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+        ASSUME_ITS_TRUE(db.put("tmp", "cstr", "x") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+        ASSUME_ITS_TRUE(db.del("tmp") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+        ASSUME_ITS_TRUE(db.check_integrity() == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    }
+
+    fossil::bluecrab::MyShell db(file_name, err);
+    ASSUME_ITS_TRUE(db.is_open());
+    std::string value;
+    ASSUME_ITS_TRUE(db.get("k", value) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(value == "new");
+    ASSUME_ITS_TRUE(db.get("tmp", value) == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    db.close();
+    remove(file_name.c_str());
+}
+
+FOSSIL_TEST(cpp_test_myshell_compaction) {
+    fossil_bluecrab_myshell_error_t err;
+    const std::string file_name = "test_cpp_compaction.myshell";
+    auto db = fossil::bluecrab::MyShell::create(file_name, err);
+    ASSUME_ITS_TRUE(db.is_open());
+    for (int i = 0; i < 100; ++i) {
+        ASSUME_ITS_TRUE(db.put("k", "i32", std::to_string(i)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    }
+    ASSUME_ITS_TRUE(db.set_compaction(0.0, 1 << 20) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db.compact() == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db.put("during", "cstr", "yes") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db.compact_wait() == FOSSIL_MYSHELL_ERROR_SUCCESS);
+
+    std::string value;
+    ASSUME_ITS_TRUE(db.get("k", value) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(value == "99");
+    ASSUME_ITS_TRUE(db.get("during", value) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(value == "yes");
+    ASSUME_ITS_TRUE(db.check_integrity() == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    db.close();
+    remove(file_name.c_str());
+}
+
+FOSSIL_TEST(cpp_test_myshell_durability) {
+    fossil_bluecrab_myshell_error_t err;
+    const std::string file_name = "test_cpp_durability.myshell";
+    {
+        auto db = fossil::bluecrab::MyShell::create(file_name, err);
+        ASSUME_ITS_TRUE(db.is_open());
+        ASSUME_ITS_TRUE(db.set_durability(FOSSIL_MYSHELL_DURABILITY_INTERVAL, 0) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+        ASSUME_ITS_TRUE(db.put("k", "cstr", "v") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+        ASSUME_ITS_TRUE(db.commit("synced") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+        ASSUME_ITS_TRUE(db.set_durability(FOSSIL_MYSHELL_DURABILITY_NONE) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+        ASSUME_ITS_TRUE(db.put("later", "cstr", "w") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+        ASSUME_ITS_TRUE(db.sync() == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    }
+
+    fossil::bluecrab::MyShell db(file_name, err);
+    ASSUME_ITS_TRUE(db.is_open());
+    std::string value;
+    ASSUME_ITS_TRUE(db.get("later", value) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(value == "w");
+    db.close();
+    remove(file_name.c_str());
+}
+
+FOSSIL_TEST(cpp_test_myshell_binary_values_convert) {
+    fossil_bluecrab_myshell_error_t err;
+    const std::string text_name = "test_cpp_convert_v1.myshell";
+    const std::string file_name = "test_cpp_convert_v2.myshell";
+    {
+        FILE *file = fopen(text_name.c_str(), "wb");
+        ASSUME_ITS_TRUE(file != NULL);
+        fputs("alpha=1 #type=i32 #hash=14fb89debecff448\n", file);
+        fputs("#commit 4a2b6bca170157c8 First import 1712345678 #type=enum\n", file);
+        fclose(file);
+    }
+    ASSUME_ITS_TRUE(fossil::bluecrab::MyShell::convert(text_name, file_name) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+
+    fossil::bluecrab::MyShell db(file_name, err);
+    ASSUME_ITS_TRUE(db.is_open());
+    std::string value;
+    ASSUME_ITS_TRUE(db.get("alpha", value) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(value == "1");
+
+    // Newlines, '=' and long values survive the round trip
+    const std::string tricky = "a=b\n#hash=0 " + std::string(3000, 'z');
+    ASSUME_ITS_TRUE(db.put("key\nwith=newline", "cstr", tricky) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db.get("key\nwith=newline", value) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(value == tricky);
+    ASSUME_ITS_TRUE(db.check_integrity() == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    db.close();
+    remove(text_name.c_str());
+    remove(file_name.c_str());
+}
+
+FOSSIL_TEST(cpp_test_myshell_get_view) {
+    fossil_bluecrab_myshell_error_t err;
+    const std::string file_name = "test_cpp_get_view.myshell";
+    auto db = fossil::bluecrab::MyShell::create(file_name, err);
+    ASSUME_ITS_TRUE(db.is_open());
+    ASSUME_ITS_TRUE(db.put("k", "cstr", "viewed") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+
+    std::string_view view;
+    ASSUME_ITS_TRUE(db.get_view("k", view) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(view == "viewed");
+    uint64_t epoch = db.map_epoch();
+    std::string copy;
+    ASSUME_ITS_TRUE(db.get("k", copy) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db.map_epoch() == epoch);
+
+    // A newer version lives past the current mapping, so reading it remaps
+    ASSUME_ITS_TRUE(db.put("k", "cstr", "changed") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db.get_view("k", view) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(view == "changed");
+    ASSUME_ITS_TRUE(db.map_epoch() != epoch);
+    ASSUME_ITS_TRUE(db.get_view("none", view) == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    db.close();
+    remove(file_name.c_str());
+}
+
+FOSSIL_TEST(cpp_test_myshell_batch_transaction) {
+    fossil_bluecrab_myshell_error_t err;
+    const std::string file_name = "test_cpp_batch.myshell";
+    auto db = fossil::bluecrab::MyShell::create(file_name, err);
+    ASSUME_ITS_TRUE(db.is_open());
+
+    fossil::bluecrab::MyShell::Batch batch;
+    for (int i = 0; i < 100; ++i) {
+        ASSUME_ITS_TRUE(batch.put("k" + std::to_string(i), "i32", std::to_string(i)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    }
+    ASSUME_ITS_TRUE(batch.del("k0") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(batch.size() == 101);
+    ASSUME_ITS_TRUE(db.apply(batch) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    std::string value;
+    ASSUME_ITS_TRUE(db.get("k42", value) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(value == "42");
+    ASSUME_ITS_TRUE(db.get("k0", value) == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+
+    // Leaving the scope without commit rolls back
+    {
+        auto txn = db.begin();
+        ASSUME_ITS_TRUE(static_cast<bool>(txn));
+        ASSUME_ITS_TRUE(db.put("scratch", "cstr", "gone") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+        ASSUME_ITS_TRUE(db.get("scratch", value) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    }
+    ASSUME_ITS_TRUE(db.get("scratch", value) == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+
+    {
+        auto txn = db.begin();
+        ASSUME_ITS_TRUE(db.put("saved", "cstr", "kept") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+        ASSUME_ITS_TRUE(db.del("k1") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+        ASSUME_ITS_TRUE(txn.commit("saved it") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+        ASSUME_ITS_TRUE(!txn);
+    }
+    ASSUME_ITS_TRUE(db.get("saved", value) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(value == "kept");
+    ASSUME_ITS_TRUE(db.get("k1", value) == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    ASSUME_ITS_TRUE(db.check_integrity() == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    db.close();
+    remove(file_name.c_str());
+}
+
+FOSSIL_TEST(cpp_test_myshell_snapshot_checkout) {
+    fossil_bluecrab_myshell_error_t err;
+    const std::string file_name = "test_cpp_snapshot.myshell";
+    auto db = fossil::bluecrab::MyShell::create(file_name, err);
+    ASSUME_ITS_TRUE(db.is_open());
+    ASSUME_ITS_TRUE(db.put("color", "cstr", "red") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db.put("size", "i32", "3") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db.commit("first") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    std::string first;
+    ASSUME_ITS_TRUE(db.log([](const char *hash, const char *message, void *user) {
+        if (std::string(message) == "first") *static_cast<std::string *>(user) = hash;
+        return true;
+    }, &first) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(first.size() == 16);
+
+    ASSUME_ITS_TRUE(db.put("color", "cstr", "blue") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db.del("size") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db.commit("second") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+
+    std::string value;
+    ASSUME_ITS_TRUE(db.checkout(first) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db.get("color", value) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(value == "red");
+    ASSUME_ITS_TRUE(db.get("size", value) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(value == "3");
+    ASSUME_ITS_TRUE(db.put("color", "cstr", "green") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db.checkout(first) == FOSSIL_MYSHELL_ERROR_CONCURRENCY);
+    ASSUME_ITS_TRUE(db.check_integrity() == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    db.close();
+    remove(file_name.c_str());
+}
+
+FOSSIL_TEST(cpp_test_myshell_merge_base) {
+    fossil_bluecrab_myshell_error_t err;
+    const std::string file_name = "test_cpp_graph.myshell";
+    auto db = fossil::bluecrab::MyShell::create(file_name, err);
+    ASSUME_ITS_TRUE(db.is_open());
+    ASSUME_ITS_TRUE(db.put("a", "i32", "1") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db.commit("base") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db.branch("main") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db.branch("topic") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    std::string base;
+    ASSUME_ITS_TRUE(db.merge_base("main", "topic", base) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    for (int i = 0; i < 20; ++i) {
+        ASSUME_ITS_TRUE(db.put("t", "i32", std::to_string(i)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+        ASSUME_ITS_TRUE(db.commit("topic " + std::to_string(i)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    }
+    ASSUME_ITS_TRUE(db.checkout("main") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db.put("m", "i32", "1") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db.commit("main work") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+
+    std::string found;
+    ASSUME_ITS_TRUE(db.merge_base("topic", "main", found) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(found == base);
+    ASSUME_ITS_TRUE(db.tag(base, "release") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db.merge_base("release", "topic", found) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(found == base);
+    ASSUME_ITS_TRUE(db.revert(base) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db.merge_base("main", "missing", found) == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    db.close();
+    remove(file_name.c_str());
+}
+
+FOSSIL_TEST(cpp_test_myshell_integrity_checkpoint) {
+    fossil_bluecrab_myshell_error_t err;
+    const std::string file_name = "test_cpp_checkpoint.myshell";
+    auto db = fossil::bluecrab::MyShell::create(file_name, err);
+    ASSUME_ITS_TRUE(db.is_open());
+    for (int i = 0; i < 50; ++i) {
+        ASSUME_ITS_TRUE(db.put("k" + std::to_string(i), "i32", std::to_string(i)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+        ASSUME_ITS_TRUE(db.commit("c" + std::to_string(i)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+        if (i % 10 == 0) {
+            ASSUME_ITS_TRUE(db.check_integrity() == FOSSIL_MYSHELL_ERROR_SUCCESS);
+        }
+    }
+    ASSUME_ITS_TRUE(db.check_integrity() == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db.check_integrity_full() == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db.compact() == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db.compact_wait() == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db.check_integrity() == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    int commits = 0;
+    ASSUME_ITS_TRUE(db.log([](const char *, const char *, void *user) {
+        ++*static_cast<int *>(user);
+        return true;
+    }, &commits) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(commits == 50);
+    db.close();
+    remove(file_name.c_str());
+}
+
+FOSSIL_TEST(cpp_test_myshell_integrity_parallel) {
+    fossil_bluecrab_myshell_error_t err;
+    const std::string file_name = "test_cpp_parallel_check.myshell";
+    auto db = fossil::bluecrab::MyShell::create(file_name, err);
+    ASSUME_ITS_TRUE(db.is_open());
+    for (int i = 0; i < 200; ++i) {
+        ASSUME_ITS_TRUE(db.put("k" + std::to_string(i), "cstr", std::string(500, 'x')) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+        if (i % 20 == 0) {
+            ASSUME_ITS_TRUE(db.commit("c" + std::to_string(i)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+        }
+    }
+    std::vector<fossil_bluecrab_myshell_check_failure_t> failures;
+    size_t chunks = 0;
+    ASSUME_ITS_TRUE(db.check_integrity_parallel(failures, 4, 2, [](const fossil_bluecrab_myshell_check_progress_t *progress,
+                                                                   void *user) {
+        ++*static_cast<size_t *>(user);
+        (void)progress;
+    }, &chunks) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(failures.empty());
+    ASSUME_ITS_TRUE(chunks > 1);
+    // A successful parallel check leaves a checkpoint like the others
+    ASSUME_ITS_TRUE(db.check_integrity() == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    db.close();
+    remove(file_name.c_str());
+}
+
+FOSSIL_TEST(cpp_test_myshell_diff_stream) {
+    fossil_bluecrab_myshell_error_t err;
+    const std::string name1 = "test_cpp_diff_a.myshell";
+    const std::string name2 = "test_cpp_diff_b.myshell";
+    auto db1 = fossil::bluecrab::MyShell::create(name1, err);
+    auto db2 = fossil::bluecrab::MyShell::create(name2, err);
+    ASSUME_ITS_TRUE(db1.is_open() && db2.is_open());
+    for (int i = 0; i < 20; ++i) {
+        ASSUME_ITS_TRUE(db2.put("k" + std::to_string(i), "i32", "1") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+        ASSUME_ITS_TRUE(db2.commit("commit " + std::to_string(i)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    }
+    ASSUME_ITS_TRUE(db1.stage("shared", "cstr", std::string(2000, 'a')) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db2.stage("shared", "cstr", std::string(2000, 'b')) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    // Lines longer than the old 1 KB entries and output past the old 4 KB buffer
+    std::string diff;
+    ASSUME_ITS_TRUE(db1.diff(db2, diff) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(diff.size() > 4096);
+    ASSUME_ITS_TRUE(diff.find("~ #stage shared=") != std::string::npos);
+    ASSUME_ITS_TRUE(diff.find("+ #commit ") != std::string::npos);
+    int changes = 0;
+    ASSUME_ITS_TRUE(db1.diff(db2, [](char, const char *, const char *, void *user) {
+        ++*static_cast<int *>(user);
+        return true;
+    }, &changes) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(changes == 21);
+    db1.close();
+    db2.close();
+    remove(name1.c_str());
+    remove(name2.c_str());
+}
+
+FOSSIL_TEST(cpp_test_myshell_three_way_merge) {
+    fossil_bluecrab_myshell_error_t err;
+    const std::string file_name = "test_cpp_merge.myshell";
+    auto db = fossil::bluecrab::MyShell::create(file_name, err);
+    ASSUME_ITS_TRUE(db.is_open());
+    for (int i = 0; i < 100; ++i) {
+        ASSUME_ITS_TRUE(db.put("k" + std::to_string(i), "i32", "0") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    }
+    ASSUME_ITS_TRUE(db.commit("base") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db.branch("main") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db.branch("topic") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    for (int i = 0; i < 100; i += 2) {
+        ASSUME_ITS_TRUE(db.put("k" + std::to_string(i), "i32", "1") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    }
+    ASSUME_ITS_TRUE(db.commit("topic evens") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db.checkout("main") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    for (int i = 0; i < 100; i += 3) {
+        ASSUME_ITS_TRUE(db.put("k" + std::to_string(i), "i32", "2") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    }
+    ASSUME_ITS_TRUE(db.commit("main thirds") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+
+    // Keys changed on both sides (multiples of 6) go to the callback; ours wins
+    int conflicts = 0;
+    ASSUME_ITS_TRUE(db.merge("topic", "merge topic", [](const char *, const char *, const char *, const char *,
+                                                        void *user) {
+        ++*static_cast<int *>(user);
+        return FOSSIL_MYSHELL_MERGE_OURS;
+    }, &conflicts) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(conflicts == 17);
+    std::string value;
+    ASSUME_ITS_TRUE(db.get("k2", value) == FOSSIL_MYSHELL_ERROR_SUCCESS && value == "1");
+    ASSUME_ITS_TRUE(db.get("k3", value) == FOSSIL_MYSHELL_ERROR_SUCCESS && value == "2");
+    ASSUME_ITS_TRUE(db.get("k6", value) == FOSSIL_MYSHELL_ERROR_SUCCESS && value == "2");
+    ASSUME_ITS_TRUE(db.get("k7", value) == FOSSIL_MYSHELL_ERROR_SUCCESS && value == "0");
+    ASSUME_ITS_TRUE(db.check_integrity() == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    db.close();
+    remove(file_name.c_str());
+}
+
+FOSSIL_TEST(cpp_test_myshell_staging_area) {
+    fossil_bluecrab_myshell_error_t err;
+    const std::string file_name = "test_cpp_staging.myshell";
+    auto db = fossil::bluecrab::MyShell::create(file_name, err);
+    ASSUME_ITS_TRUE(db.is_open());
+    ASSUME_ITS_TRUE(db.set_stage_journal(true) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    for (int i = 0; i < 1000; ++i) {
+        ASSUME_ITS_TRUE(db.stage("k" + std::to_string(i), "i32", std::to_string(i)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    }
+    for (int i = 0; i < 1000; i += 2) {
+        ASSUME_ITS_TRUE(db.unstage("k" + std::to_string(i)) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    }
+    db.close();
+    fossil::bluecrab::MyShell reopened(file_name, err);
+    ASSUME_ITS_TRUE(reopened.is_open());
+    ASSUME_ITS_TRUE(reopened.commit("odd keys") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    std::string value;
+    ASSUME_ITS_TRUE(reopened.get("k0", value) == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    ASSUME_ITS_TRUE(reopened.get("k999", value) == FOSSIL_MYSHELL_ERROR_SUCCESS && value == "999");
+    ASSUME_ITS_TRUE(reopened.unstage("k1") == FOSSIL_MYSHELL_ERROR_NOT_FOUND);
+    reopened.close();
+    remove(file_name.c_str());
+}
+
+FOSSIL_TEST(cpp_test_myshell_branch_views) {
+    fossil_bluecrab_myshell_error_t err;
+    const std::string file_name = "test_cpp_branch_views.myshell";
+    auto db = fossil::bluecrab::MyShell::create(file_name, err);
+    ASSUME_ITS_TRUE(db.is_open());
+    for (int i = 0; i < 500; ++i) {
+        ASSUME_ITS_TRUE(db.put("k" + std::to_string(i), "i32", "1") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    }
+    ASSUME_ITS_TRUE(db.commit("base") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db.branch("main") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db.branch("topic") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db.put("k1", "i32", "2") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db.checkout("main") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(db.put("k1", "i32", "3") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    db.close();
+
+    fossil::bluecrab::MyShell reopened(file_name, err);
+    ASSUME_ITS_TRUE(reopened.is_open());
+    std::string value;
+    ASSUME_ITS_TRUE(reopened.get("k1", value) == FOSSIL_MYSHELL_ERROR_SUCCESS && value == "3");
+    ASSUME_ITS_TRUE(reopened.checkout("topic") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(reopened.get("k1", value) == FOSSIL_MYSHELL_ERROR_SUCCESS && value == "2");
+    ASSUME_ITS_TRUE(reopened.get("k499", value) == FOSSIL_MYSHELL_ERROR_SUCCESS && value == "1");
+    reopened.close();
+    remove(file_name.c_str());
+}
+
+FOSSIL_TEST(cpp_test_myshell_get_large_value) {
+    fossil_bluecrab_myshell_error_t err;
+    const std::string file_name = "test_cpp_large_value.myshell";
+    auto db = fossil::bluecrab::MyShell::create(file_name, err);
+    ASSUME_ITS_TRUE(db.is_open());
+    std::string large(20000, 'x');
+    large[4096] = 'y';
+    large.back() = 'z';
+    ASSUME_ITS_TRUE(db.put("large", "cstr", large) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    std::string value;
+    ASSUME_ITS_TRUE(db.get("large", value) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(value == large);
+    ASSUME_ITS_TRUE(db.commit("large") == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    db.close();
+
+    fossil::bluecrab::MyShell reopened(file_name, err);
+    ASSUME_ITS_TRUE(reopened.is_open());
+    value.clear();
+    ASSUME_ITS_TRUE(reopened.get("large", value) == FOSSIL_MYSHELL_ERROR_SUCCESS);
+    ASSUME_ITS_TRUE(value == large);
+    reopened.close();
+    remove(file_name.c_str());
+}
+
 // * * * * * * * * * * * * * * * * * * * * * * * *
 // * Fossil Logic Test Pool
 // * * * * * * * * * * * * * * * * * * * * * * * *
@@ -387,6 +839,22 @@ FOSSIL_TEST_GROUP(cpp_myshell_database_tests) {
     FOSSIL_TEST_ADD(cpp_myshell_fixture, cpp_test_myshell_backup_restore_null_args);
     FOSSIL_TEST_ADD(cpp_myshell_fixture, cpp_test_myshell_diff_null_args);
     FOSSIL_TEST_ADD(cpp_myshell_fixture, cpp_test_myshell_check_integrity_null);
+    FOSSIL_TEST_ADD(cpp_myshell_fixture, cpp_test_myshell_index_reopen);
+    FOSSIL_TEST_ADD(cpp_myshell_fixture, cpp_test_myshell_append_only_log);
+    FOSSIL_TEST_ADD(cpp_myshell_fixture, cpp_test_myshell_compaction);
+    FOSSIL_TEST_ADD(cpp_myshell_fixture, cpp_test_myshell_durability);
+    FOSSIL_TEST_ADD(cpp_myshell_fixture, cpp_test_myshell_binary_values_convert);
+    FOSSIL_TEST_ADD(cpp_myshell_fixture, cpp_test_myshell_get_view);
+    FOSSIL_TEST_ADD(cpp_myshell_fixture, cpp_test_myshell_batch_transaction);
+    FOSSIL_TEST_ADD(cpp_myshell_fixture, cpp_test_myshell_snapshot_checkout);
+    FOSSIL_TEST_ADD(cpp_myshell_fixture, cpp_test_myshell_merge_base);
+    FOSSIL_TEST_ADD(cpp_myshell_fixture, cpp_test_myshell_integrity_checkpoint);
+    FOSSIL_TEST_ADD(cpp_myshell_fixture, cpp_test_myshell_integrity_parallel);
+    FOSSIL_TEST_ADD(cpp_myshell_fixture, cpp_test_myshell_diff_stream);
+    FOSSIL_TEST_ADD(cpp_myshell_fixture, cpp_test_myshell_three_way_merge);
+    FOSSIL_TEST_ADD(cpp_myshell_fixture, cpp_test_myshell_staging_area);
+    FOSSIL_TEST_ADD(cpp_myshell_fixture, cpp_test_myshell_branch_views);
+    FOSSIL_TEST_ADD(cpp_myshell_fixture, cpp_test_myshell_get_large_value);
 
     FOSSIL_TEST_REGISTER(cpp_myshell_fixture);
 } // end of tests